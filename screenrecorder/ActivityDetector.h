@@ -0,0 +1,29 @@
+#pragma once
+
+// Whether someone is using the machine, and if not, why not.
+enum class ActivityState { Active, Idle, Locked, ScreenSaver };
+
+// The purpose of this interface is to tell the recorder when nobody is using the machine, so a recording of an
+// unattended screen can stop taking frames that are all the same. Detectors are polled from a thread of the recorder,
+// a few times a second, so a state must be cheap to find.
+class ActivityDetector {
+public:
+    virtual ~ActivityDetector() = default;
+
+    virtual ActivityState state() = 0;
+
+    static const char* state_name(ActivityState state)
+    {
+        switch (state)
+        {
+        case ActivityState::Idle:
+            return "idle";
+        case ActivityState::Locked:
+            return "locked";
+        case ActivityState::ScreenSaver:
+            return "screensaver";
+        default:
+            return "active";
+        }
+    }
+};
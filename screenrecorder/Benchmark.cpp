@@ -0,0 +1,2244 @@
+#include "pch.h"
+#include "Benchmark.h"
+#include "CircularFrameBuffer.h"
+#include "FrameEncoder.h"
+#include "FrameNameFormatter.h"
+#include "DirtyRegions.h"
+#include "MotionEstimator.h"
+#include "CursorCache.h"
+#include "ReadbackQueue.h"
+#include "RingArena.h"
+#include "ScreenCodec.h"
+#include "BlockCompressor.h"
+#include "FrameBus.h"
+#include "Server.h"
+#include "Client.h"
+#include "RecordingProcess.h"
+#include "ScreenRecorder.h"
+#include "SyntheticFrameSource.h"
+#include "TaskScheduler.h"
+#include "ToneMapper.h"
+#include "Redactor.h"
+#include "QualityTuner.h"
+#include "OutputWriter.h"
+#include "ChunkStore.h"
+#include "SystemActivityDetector.h"
+#include "FakeActivityDetector.h"
+
+namespace util
+{
+    using namespace robmikh::common::uwp;
+}
+
+static const uint32_t frameWidth = 1920;
+static const uint32_t frameHeight = 1080;
+static const double minimumMeasureSeconds = 0.25;
+
+// Heap allocations made through operator new on each thread. The replacements below count them in every build, not
+// only where the debug heap can report them, so the benchmarks can fail when a path meant to allocate nothing does.
+// They replace operator new for the whole program, and only add an increment of a thread local to it.
+static thread_local uint64_t threadAllocationCount = 0;
+
+void* operator new(size_t size)
+{
+    threadAllocationCount++;
+
+    if (void* memory = malloc(size > 0 ? size : 1))
+    {
+        return memory;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void Benchmark::run_all()
+{
+    m_d3dDevice = util::CreateD3DDevice();
+
+    run_buffer_benchmarks();
+    run_format_benchmarks();
+    run_dirty_region_benchmarks();
+    run_scroll_benchmarks();
+    run_cursor_benchmarks();
+    run_encode_benchmarks();
+    run_quality_benchmarks();
+    run_compress_benchmarks();
+    run_tone_map_benchmarks();
+    run_redact_benchmarks();
+    run_readback_benchmarks();
+    run_arena_benchmarks();
+    run_save_benchmarks();
+    run_write_benchmarks();
+    run_chunk_benchmarks();
+    run_capture_benchmarks();
+    run_idle_benchmarks();
+    run_export_benchmarks();
+    run_bus_benchmarks();
+    run_ipc_benchmarks();
+    run_startup_benchmarks();
+    run_scheduler_benchmarks();
+}
+
+bool Benchmark::matches(const std::string& name) const
+{
+    return m_filter.empty() || name.find(m_filter) != std::string::npos;
+}
+
+Benchmark::Result* Benchmark::measure(const std::string& name, size_t bytesPerOperation, const std::function<void()>& operation)
+{
+    if (!matches(name))
+    {
+        return nullptr;
+    }
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+
+    // Warm up caches and lazily created state before timing anything.
+    operation();
+
+    uint64_t iterations = 1;
+    double seconds = 0;
+
+    while (true)
+    {
+        QueryPerformanceCounter(&start);
+
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            operation();
+        }
+
+        QueryPerformanceCounter(&end);
+
+        seconds = static_cast<double>(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+
+        if (seconds >= minimumMeasureSeconds)
+        {
+            break;
+        }
+
+        // Aim past the minimum time on the next batch instead of creeping up on it.
+        double scale = seconds > 0 ? minimumMeasureSeconds * 1.5 / seconds : 10;
+        iterations = static_cast<uint64_t>(iterations * std::min(std::max(scale, 2.0), 100.0));
+    }
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nanosecondsPerOperation = seconds * 1e9 / iterations;
+    result.bytesPerSecond = bytesPerOperation * iterations / seconds;
+    m_results.push_back(result);
+
+    return &m_results.back();
+}
+
+Benchmark::Result* Benchmark::measure_without_allocations(const std::string& name, size_t bytesPerOperation, const std::function<void()>& operation)
+{
+    bool warmedUp = false;
+    uint64_t allocations = 0;
+    uint64_t operations = 0;
+
+    // Only the timed operations are counted, not the warm-up that may create state lazily, nor what measure() itself
+    // allocates around them.
+    Result* result = measure(name, bytesPerOperation, [&]()
+        {
+            if (!warmedUp)
+            {
+                operation();
+                warmedUp = true;
+
+                return;
+            }
+
+            uint64_t before = threadAllocationCount;
+            operation();
+            allocations += threadAllocationCount - before;
+            operations++;
+        });
+
+    if (result)
+    {
+        result->counters.push_back({ "allocationsPerOperation", static_cast<double>(allocations) / operations });
+
+        if (allocations > 0)
+        {
+            throw std::runtime_error(name + ": " + std::to_string(allocations) + " heap allocations in " + std::to_string(operations) + " operations, expected none.");
+        }
+    }
+
+    return result;
+}
+
+std::vector<uint8_t> Benchmark::create_synthetic_frame(uint32_t width, uint32_t height, uint32_t seed)
+{
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+    uint32_t random = seed * 2654435761u + 1;
+
+    auto next = [&random]()
+        {
+            random = random * 1664525u + 1013904223u;
+            return random >> 8;
+        };
+
+    auto fill = [&](uint32_t left, uint32_t top, uint32_t right, uint32_t bottom, uint32_t bgra)
+        {
+            for (uint32_t y = top; y < std::min(bottom, height); y++)
+            {
+                uint32_t* row = reinterpret_cast<uint32_t*>(pixels.data()) + static_cast<size_t>(y) * width;
+                std::fill(row + std::min(left, width), row + std::min(right, width), bgra);
+            }
+        };
+
+    // Desktop background and two windows with title bars.
+    fill(0, 0, width, height, 0xFF2D4A6B);
+    fill(width / 16, height / 12, width * 9 / 16, height * 11 / 12, 0xFFF3F3F3);
+    fill(width / 16, height / 12, width * 9 / 16, height / 12 + 32, 0xFFDADADA);
+    fill(width * 10 / 16, height / 6, width * 15 / 16, height * 5 / 6, 0xFFFFFFFF);
+
+    // Lines of text made of glyph-sized dark blocks with word gaps.
+    for (uint32_t line = height / 12 + 48; line + 14 < height * 11 / 12; line += 20)
+    {
+        uint32_t x = width / 16 + 12;
+        uint32_t lineEnd = width / 16 + 12 + next() % (width / 2 - 24);
+
+        while (x + 8 < lineEnd)
+        {
+            uint32_t wordEnd = std::min(x + 8 * (2 + next() % 8), lineEnd);
+
+            for (; x + 8 <= wordEnd; x += 8)
+            {
+                for (uint32_t stroke = 0; stroke < 3; stroke++)
+                {
+                    uint32_t left = x + next() % 5, top = line + next() % 10;
+                    fill(left, top, left + 1 + next() % 3, top + 2 + next() % 6, 0xFF1E1E1E);
+                }
+            }
+
+            x += 8;
+        }
+    }
+
+    // A photo-like gradient with noise in the second window.
+    for (uint32_t y = height / 6 + 16; y < height * 5 / 6 - 16; y++)
+    {
+        for (uint32_t x = width * 10 / 16 + 16; x < width * 15 / 16 - 16; x++)
+        {
+            uint8_t* pixel = &pixels[(static_cast<size_t>(y) * width + x) * 4];
+            uint8_t noise = static_cast<uint8_t>(next() & 0x0F);
+            pixel[0] = static_cast<uint8_t>(x * 255 / width) ^ noise;
+            pixel[1] = static_cast<uint8_t>(y * 255 / height) + noise;
+            pixel[2] = static_cast<uint8_t>((x + y) * 127 / (width + height)) + 64;
+            pixel[3] = 0xFF;
+        }
+    }
+
+    return pixels;
+}
+
+winrt::com_ptr<ID3D11Texture2D> Benchmark::create_synthetic_texture(uint32_t width, uint32_t height, uint32_t seed)
+{
+    std::vector<uint8_t> pixels = create_synthetic_frame(width, height, seed);
+
+    return create_texture(pixels.data(), width, height);
+}
+
+winrt::com_ptr<ID3D11Texture2D> Benchmark::create_texture(const uint8_t* pixels, uint32_t width, uint32_t height)
+{
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    D3D11_SUBRESOURCE_DATA data = {};
+    data.pSysMem = pixels;
+    data.SysMemPitch = width * 4;
+
+    winrt::com_ptr<ID3D11Texture2D> texture;
+    winrt::check_hresult(m_d3dDevice->CreateTexture2D(&desc, &data, texture.put()));
+
+    return texture;
+}
+
+std::vector<uint8_t> Benchmark::read_texture(winrt::com_ptr<ID3D11Texture2D> const& texture)
+{
+    std::vector<uint8_t> pixels;
+    ReadbackQueue readback(m_d3dDevice, 1);
+
+    readback.submit(texture);
+    readback.read_oldest([&](uint8_t* mapped, uint32_t rowPitch, const D3D11_TEXTURE2D_DESC& desc)
+        {
+            pixels.resize(static_cast<size_t>(desc.Width) * desc.Height * 4);
+
+            for (uint32_t y = 0; y < desc.Height; y++)
+            {
+                memcpy(pixels.data() + static_cast<size_t>(y) * desc.Width * 4, mapped + static_cast<size_t>(y) * rowPitch, desc.Width * 4);
+            }
+        });
+
+    return pixels;
+}
+
+void Benchmark::run_buffer_benchmarks()
+{
+    if (!matches("buffer/"))
+    {
+        return;
+    }
+
+    auto texture = create_synthetic_texture(frameWidth, frameHeight, 0);
+    FrameMetadata metadata = {};
+
+    // Both buffers are kept full, so every add evicts a frame. Their slots are reserved up front like those of a
+    // recording, so storing a frame must not allocate.
+    CircularFrameBuffer framesBuffer(16, false);
+    measure_without_allocations("buffer/add_frame/frames", 0, [&]()
+        {
+            framesBuffer.add_frame(texture, metadata);
+        });
+
+    CircularFrameBuffer megabytesBuffer(64, true);
+    megabytesBuffer.reserve(frameWidth, frameHeight);
+    measure_without_allocations("buffer/add_frame/megabytes", 0, [&]()
+        {
+            megabytesBuffer.add_frame(texture, metadata);
+        });
+
+    // Encoded frames are copied into the arena. A buffer sized in megabytes holds more of these than it reserves
+    // slots for, so it is filled first, as a recording fills its buffer, until adding a frame evicts one.
+    std::vector<uint8_t> encoded(frameWidth * frameHeight / 40, 0x5a);
+    FrameMetadata encodedMetadata = {};
+    encodedMetadata.Width = frameWidth;
+    encodedMetadata.Height = frameHeight;
+
+    CircularFrameBuffer encodedFramesBuffer(16, false, FrameEncoder(), FrameStorage::Encoded);
+    encodedFramesBuffer.reserve(frameWidth, frameHeight);
+    measure_without_allocations("buffer/add_encoded_frame/frames", encoded.size(), [&]()
+        {
+            encodedFramesBuffer.add_encoded_frame(encoded.data(), encoded.size(), encodedMetadata);
+        });
+
+    if (matches("buffer/add_encoded_frame/megabytes"))
+    {
+        CircularFrameBuffer encodedMegabytesBuffer(64, true, FrameEncoder(), FrameStorage::Encoded);
+        encodedMegabytesBuffer.reserve(frameWidth, frameHeight);
+
+        size_t frameCount = 0;
+
+        do
+        {
+            frameCount = encodedMegabytesBuffer.frame_count();
+            encodedMegabytesBuffer.add_encoded_frame(encoded.data(), encoded.size(), encodedMetadata);
+        } while (encodedMegabytesBuffer.frame_count() > frameCount);
+
+        measure_without_allocations("buffer/add_encoded_frame/megabytes", encoded.size(), [&]()
+            {
+                encodedMegabytesBuffer.add_encoded_frame(encoded.data(), encoded.size(), encodedMetadata);
+            });
+    }
+
+    // Every add evicts a frame into a tier that keeps it at half size, and that tier evicts one of its own.
+    CircularFrameBuffer tieredBuffer(16, false);
+    tieredBuffer.add_tier(16, false, 0, 2);
+    measure("buffer/add_frame/tiered", 0, [&]()
+        {
+            tieredBuffer.add_frame(texture, metadata);
+        });
+
+    size_t size = 0;
+    measure("buffer/calculate_frame_size", 0, [&]()
+        {
+            size += CircularFrameBuffer::calculate_frame_size(texture);
+        });
+}
+
+void Benchmark::run_format_benchmarks()
+{
+    char filename[FrameNameFormatter::maxLength];
+    int64_t timestamp = 133000000000000000;
+
+    measure_without_allocations("format/frame_name", 0, [&]()
+        {
+            FrameNameFormatter::Format(timestamp++, ".jpg", filename);
+        });
+}
+
+void Benchmark::run_dirty_region_benchmarks()
+{
+    if (!matches("dirty/"))
+    {
+        return;
+    }
+
+    struct DirtyCase
+    {
+        std::string name;
+        uint32_t left, top, right, bottom;  // Region that alternates between two frames, empty for an unchanged frame.
+    };
+
+    std::vector<DirtyCase> dirtyCases = {
+        { "dirty/detect/unchanged", 0, 0, 0, 0 },
+        { "dirty/detect/caret", 400, 300, 402, 318 },
+        { "dirty/detect/clock", frameWidth - 120, frameHeight - 40, frameWidth - 20, frameHeight - 8 },
+        { "dirty/detect/window", frameWidth / 16, frameHeight / 12, frameWidth * 9 / 16, frameHeight * 11 / 12 },
+    };
+
+    std::vector<uint8_t> original = create_synthetic_frame(frameWidth, frameHeight, 0);
+    std::vector<uint8_t> changedSource = create_synthetic_frame(frameWidth, frameHeight, 1);
+    uint64_t fullBytes = static_cast<uint64_t>(frameWidth) * frameHeight * 4;
+
+    for (const auto& dirtyCase : dirtyCases)
+    {
+        std::vector<uint8_t> changed = original;
+
+        for (uint32_t y = dirtyCase.top; y < dirtyCase.bottom; y++)
+        {
+            size_t offset = (static_cast<size_t>(y) * frameWidth + dirtyCase.left) * 4;
+            std::transform(changedSource.begin() + offset, changedSource.begin() + offset + (dirtyCase.right - dirtyCase.left) * 4, changed.begin() + offset, [](uint8_t value) { return static_cast<uint8_t>(~value); });
+        }
+
+        DirtyRegionDetector detector;
+        detector.detect(original.data(), frameWidth * 4, frameWidth, frameHeight);
+
+        bool showChanged = false;
+        uint64_t frames = 0, storedBytes = 0, regions = 0;
+
+        Result* result = measure(dirtyCase.name, static_cast<size_t>(fullBytes), [&]()
+            {
+                showChanged = !showChanged;
+                auto rects = detector.detect((showChanged ? changed : original).data(), frameWidth * 4, frameWidth, frameHeight);
+
+                frames++;
+                storedBytes += DirtyRegionDetector::total_area(rects) * 4;
+                regions += rects.size();
+            });
+
+        if (result)
+        {
+            result->counters.push_back({ "fullBytesPerFrame", static_cast<double>(fullBytes) });
+            result->counters.push_back({ "storedBytesPerFrame", static_cast<double>(storedBytes) / frames });
+            result->counters.push_back({ "dirtyRegionsPerFrame", static_cast<double>(regions) / frames });
+        }
+    }
+
+    if (!matches("dirty/rebuild"))
+    {
+        return;
+    }
+
+    // A window moves across the desktop and its content changes every frame. Each frame is stored the way the capture
+    // stores it, as the regions the detector found, in a buffer of a few frames, so that evictions keep promoting the
+    // oldest delta frame. After every frame, each frame of the buffer is rebuilt and compared with the frame it came
+    // from.
+    const uint32_t sequenceLength = 12;
+    const uint32_t bufferFrames = 4;
+    const uint32_t windowWidth = 480, windowHeight = 320;
+    std::vector<std::vector<uint8_t>> sources;
+
+    for (uint32_t i = 0; i < sequenceLength; i++)
+    {
+        std::vector<uint8_t> frame = original;
+        std::vector<uint8_t> window = create_synthetic_frame(windowWidth, windowHeight, i + 2);
+        uint32_t left = 100 + i * 37, top = 80 + i * 23;
+
+        for (uint32_t y = 0; y < windowHeight; y++)
+        {
+            memcpy(frame.data() + (static_cast<size_t>(top + y) * frameWidth + left) * 4, window.data() + static_cast<size_t>(y) * windowWidth * 4, windowWidth * 4);
+        }
+
+        sources.push_back(std::move(frame));
+    }
+
+    DirtyRegionDetector detector;
+    CircularFrameBuffer buffer(bufferFrames, false);
+    uint64_t deltaFrames = 0;
+
+    auto push = [&](uint32_t index)
+        {
+            const std::vector<uint8_t>& source = sources[index % sequenceLength];
+
+            FrameMetadata metadata = {};
+            metadata.Sequence = index;
+            metadata.Timestamp = index + 1;
+            metadata.Qpc = index + 1;
+            metadata.Width = frameWidth;
+            metadata.Height = frameHeight;
+
+            auto rects = detector.detect(source.data(), frameWidth * 4, frameWidth, frameHeight);
+
+            if (buffer.frame_count() == 0)
+            {
+                buffer.add_frame(create_texture(source.data(), frameWidth, frameHeight), metadata);
+                return;
+            }
+
+            // The regions are stacked in an atlas as the capture stacks them, each starting at column 0.
+            uint32_t atlasWidth = 0, atlasHeight = 0;
+
+            for (const auto& rect : rects)
+            {
+                atlasWidth = std::max(atlasWidth, rect.Width());
+                atlasHeight += rect.Height();
+            }
+
+            std::vector<uint8_t> atlasPixels(static_cast<size_t>(atlasWidth) * atlasHeight * 4);
+            std::vector<CircularFrameBuffer::Patch> patches;
+            uint32_t atlasY = 0;
+
+            for (const auto& rect : rects)
+            {
+                for (uint32_t y = 0; y < rect.Height(); y++)
+                {
+                    memcpy(atlasPixels.data() + static_cast<size_t>(atlasY + y) * atlasWidth * 4, source.data() + (static_cast<size_t>(rect.Top + y) * frameWidth + rect.Left) * 4, rect.Width() * 4);
+                }
+
+                patches.push_back({ rect, atlasY });
+                atlasY += rect.Height();
+            }
+
+            buffer.add_delta_frame(rects.empty() ? nullptr : create_texture(atlasPixels.data(), atlasWidth, atlasHeight), std::move(patches), metadata);
+            deltaFrames++;
+        };
+
+    for (uint32_t i = 0; i < sequenceLength; i++)
+    {
+        push(i);
+
+        auto copy = buffer.copy_range(INT64_MIN, INT64_MAX, 1);
+
+        for (size_t j = 0; j < copy->frame_count(); j++)
+        {
+            const auto& frame = copy->frame(j);
+
+            if (read_texture(frame.texture) != sources[frame.metadata.Sequence])
+            {
+                throw std::runtime_error("dirty/rebuild: frame " + std::to_string(frame.metadata.Sequence) + " rebuilt after frame " + std::to_string(i) + " differs from its source.");
+            }
+        }
+    }
+
+    uint32_t next = sequenceLength;
+
+    Result* result = measure("dirty/rebuild/push", static_cast<size_t>(fullBytes), [&]()
+        {
+            push(next++);
+        });
+
+    if (result)
+    {
+        result->counters.push_back({ "deltaShare", static_cast<double>(deltaFrames) / next });
+        result->counters.push_back({ "matchesSource", 1.0 });
+    }
+}
+
+// Moves the part of a BGRA8 frame a scroll covers, the way the frame buffer does on the GPU: through a copy, so
+// overlapping rows are read before they are written.
+static void apply_scroll(const ScrollMotion& motion, uint8_t* pixels, uint32_t rowPitch)
+{
+    DirtyRect source = motion.Source();
+    size_t length = static_cast<size_t>(source.Width()) * 4;
+    std::vector<uint8_t> moved(length * source.Height());
+
+    for (uint32_t y = source.Top; y < source.Bottom; y++)
+    {
+        memcpy(moved.data() + (y - source.Top) * length, pixels + static_cast<size_t>(y) * rowPitch + source.Left * 4, length);
+    }
+
+    for (uint32_t y = source.Top; y < source.Bottom; y++)
+    {
+        memcpy(pixels + static_cast<size_t>(y + motion.DeltaY) * rowPitch + (source.Left + motion.DeltaX) * 4, moved.data() + (y - source.Top) * length, length);
+    }
+}
+
+void Benchmark::run_scroll_benchmarks()
+{
+    if (!matches("scroll/"))
+    {
+        return;
+    }
+
+    struct ScrollCase
+    {
+        std::string name;
+        uint32_t stepX, stepY;  // Pixels the document moves by between frames.
+    };
+
+    const ScrollCase scrollCases[] = {
+        { "scroll/detect/unchanged", 0, 0 },
+        { "scroll/detect/vertical", 0, 40 },
+        { "scroll/detect/horizontal", 24, 0 },
+    };
+
+    // A window in the middle of the desktop shows part of a document three screens long, or three screens wide,
+    // moved by a step every frame. The sequence repeats, and the jump back to its start is a scroll as well.
+    const uint32_t left = 210, top = 150, right = 1410, bottom = 950;
+    const uint32_t sequenceLength = 8;
+    const uint32_t rowPitch = frameWidth * 4;
+    const uint64_t fullBytes = static_cast<uint64_t>(frameWidth) * frameHeight * 4;
+    std::vector<uint8_t> desktop = create_synthetic_frame(frameWidth, frameHeight, 0);
+
+    for (const auto& scrollCase : scrollCases)
+    {
+        if (!matches(scrollCase.name))
+        {
+            continue;
+        }
+
+        uint32_t documentWidth = scrollCase.stepX > 0 ? frameWidth * 3 : frameWidth;
+        uint32_t documentHeight = scrollCase.stepY > 0 ? frameHeight * 3 : frameHeight;
+        std::vector<uint8_t> document = create_synthetic_frame(documentWidth, documentHeight, 1);
+        std::vector<std::vector<uint8_t>> frames;
+
+        for (uint32_t i = 0; i < sequenceLength; i++)
+        {
+            std::vector<uint8_t> frame = desktop;
+
+            for (uint32_t y = top; y < bottom; y++)
+            {
+                size_t source = (static_cast<size_t>(y + i * scrollCase.stepY) * documentWidth + left + i * scrollCase.stepX) * 4;
+                memcpy(frame.data() + static_cast<size_t>(y) * rowPitch + left * 4, document.data() + source, (right - left) * 4);
+            }
+
+            frames.push_back(std::move(frame));
+        }
+
+        MotionEstimator estimator;
+        DirtyRegionDetector detector;
+        estimator.estimate(frames[0].data(), rowPitch, frameWidth, frameHeight);
+        detector.detect(frames[0].data(), rowPitch, frameWidth, frameHeight);
+
+        size_t next = 1;
+        uint64_t count = 0, storedBytes = 0, scrolls = 0;
+
+        Result* result = measure(scrollCase.name, static_cast<size_t>(fullBytes), [&]()
+            {
+                const std::vector<uint8_t>& frame = frames[next];
+                next = (next + 1) % sequenceLength;
+
+                ScrollMotion motion = estimator.estimate(frame.data(), rowPitch, frameWidth, frameHeight);
+
+                if (!motion.IsNone())
+                {
+                    detector.shift(motion);
+                    scrolls++;
+                }
+
+                storedBytes += DirtyRegionDetector::total_area(detector.detect(frame.data(), rowPitch, frameWidth, frameHeight)) * 4;
+                count++;
+            });
+
+        if (result)
+        {
+            // Dirty regions alone over one pass of the same sequence, for comparison.
+            DirtyRegionDetector dirtyOnly;
+            dirtyOnly.detect(frames[0].data(), rowPitch, frameWidth, frameHeight);
+
+            uint64_t dirtyOnlyBytes = 0;
+
+            for (uint32_t i = 1; i <= sequenceLength; i++)
+            {
+                dirtyOnlyBytes += DirtyRegionDetector::total_area(dirtyOnly.detect(frames[i % sequenceLength].data(), rowPitch, frameWidth, frameHeight)) * 4;
+            }
+
+            result->counters.push_back({ "fullBytesPerFrame", static_cast<double>(fullBytes) });
+            result->counters.push_back({ "storedBytesPerFrame", static_cast<double>(storedBytes) / count });
+            result->counters.push_back({ "dirtyOnlyBytesPerFrame", static_cast<double>(dirtyOnlyBytes) / sequenceLength });
+            result->counters.push_back({ "scrollsPerFrame", static_cast<double>(scrolls) / count });
+
+            // The detected scrolls and regions must rebuild every frame of the sequence from the one before it. A
+            // scroll guessed wrong only costs bytes, since the regions make up for it, so a mismatch is a bug.
+            MotionEstimator checkEstimator;
+            DirtyRegionDetector checkDetector;
+            checkEstimator.estimate(frames[0].data(), rowPitch, frameWidth, frameHeight);
+            checkDetector.detect(frames[0].data(), rowPitch, frameWidth, frameHeight);
+
+            std::vector<uint8_t> rebuilt = frames[0];
+
+            for (uint32_t i = 1; i <= sequenceLength; i++)
+            {
+                const std::vector<uint8_t>& frame = frames[i % sequenceLength];
+                ScrollMotion motion = checkEstimator.estimate(frame.data(), rowPitch, frameWidth, frameHeight);
+
+                if (!motion.IsNone())
+                {
+                    checkDetector.shift(motion);
+                    apply_scroll(motion, rebuilt.data(), rowPitch);
+                }
+
+                for (const auto& rect : checkDetector.detect(frame.data(), rowPitch, frameWidth, frameHeight))
+                {
+                    for (uint32_t y = rect.Top; y < rect.Bottom; y++)
+                    {
+                        size_t offset = static_cast<size_t>(y) * rowPitch + rect.Left * 4;
+                        memcpy(rebuilt.data() + offset, frame.data() + offset, static_cast<size_t>(rect.Width()) * 4);
+                    }
+                }
+
+                if (memcmp(rebuilt.data(), frame.data(), frame.size()) != 0)
+                {
+                    throw std::runtime_error(scrollCase.name + ": frame " + std::to_string(i % sequenceLength) + " rebuilt from its scroll and regions differs from its source.");
+                }
+            }
+        }
+    }
+}
+
+void Benchmark::run_cursor_benchmarks()
+{
+    if (!matches("cursor/"))
+    {
+        return;
+    }
+
+    // A 32x32 cursor with an antialiased right edge. Every row of the cursor is the same.
+    const uint32_t cursorSize = 32;
+    std::vector<uint8_t> cursor(cursorSize * 4);
+
+    for (uint32_t x = 0; x < cursorSize; x++)
+    {
+        uint8_t alpha = static_cast<uint8_t>(x < cursorSize / 2 ? 255 : 255 - (x - cursorSize / 2) * 16);
+        cursor[x * 4 + 0] = cursor[x * 4 + 1] = cursor[x * 4 + 2] = alpha / 2;
+        cursor[x * 4 + 3] = alpha;
+    }
+
+    std::vector<uint8_t> frame = create_synthetic_frame(frameWidth, frameHeight, 0);
+
+    measure("cursor/blend_row/scalar", cursorSize * cursorSize * 4, [&]()
+        {
+            for (uint32_t y = 0; y < cursorSize; y++)
+            {
+                CursorCache::blend_row(cursor.data(), frame.data() + (static_cast<size_t>(y) * frameWidth + 400) * 4, cursorSize, false);
+            }
+        });
+
+    Result* result = measure("cursor/blend_row/simd", cursorSize * cursorSize * 4, [&]()
+        {
+            for (uint32_t y = 0; y < cursorSize; y++)
+            {
+                CursorCache::blend_row(cursor.data(), frame.data() + (static_cast<size_t>(y) * frameWidth + 400) * 4, cursorSize);
+            }
+        });
+
+    if (result)
+    {
+        // Every source value of every channel over every alpha and destination value, premultiplied or not, since
+        // the SIMD path only differs from the scalar one in its arithmetic.
+        std::vector<uint8_t> source(256 * 256 * 4), destination(source.size()), scalarDestination(source.size());
+
+        for (uint32_t value = 0; value < 256; value++)
+        {
+            for (uint32_t i = 0; i < 256 * 256; i++)
+            {
+                uint8_t alpha = static_cast<uint8_t>(i >> 8);
+                uint8_t background = static_cast<uint8_t>(i & 0xFF);
+
+                source[i * 4 + 0] = source[i * 4 + 1] = source[i * 4 + 2] = static_cast<uint8_t>(value);
+                source[i * 4 + 3] = alpha;
+                destination[i * 4 + 0] = destination[i * 4 + 1] = destination[i * 4 + 2] = destination[i * 4 + 3] = background;
+            }
+
+            scalarDestination = destination;
+            CursorCache::blend_row(source.data(), scalarDestination.data(), 256 * 256, false);
+            CursorCache::blend_row(source.data(), destination.data(), 256 * 256);
+
+            if (destination != scalarDestination)
+            {
+                throw std::runtime_error("cursor/blend_row: SIMD blending of source value " + std::to_string(value) + " differs from scalar blending.");
+            }
+        }
+    }
+}
+
+void Benchmark::run_encode_benchmarks()
+{
+    if (!matches("encode/"))
+    {
+        return;
+    }
+
+    std::vector<uint8_t> pixels = create_synthetic_frame(frameWidth, frameHeight, 0);
+
+    struct EncodeCase
+    {
+        const char* name;
+        ImageFormat format;
+        float quality;
+    };
+
+    const EncodeCase cases[] =
+    {
+        { "encode/jpeg/default", ImageFormat::Jpeg, FrameEncoder::default_quality },
+        { "encode/jpeg/q50", ImageFormat::Jpeg, 0.5f },
+        { "encode/jpeg/q75", ImageFormat::Jpeg, 0.75f },
+        { "encode/jpeg/q95", ImageFormat::Jpeg, 0.95f },
+        { "encode/png", ImageFormat::Png, FrameEncoder::default_quality },
+        { "encode/bmp", ImageFormat::Bmp, FrameEncoder::default_quality },
+        { "encode/screen", ImageFormat::Screen, FrameEncoder::default_quality },
+    };
+
+    for (const auto& encodeCase : cases)
+    {
+        FrameEncoder encoder(encodeCase.format, encodeCase.quality);
+        uint64_t encodedSize = 0;
+
+        Result* result = measure(encodeCase.name, pixels.size(), [&]()
+            {
+                winrt::Windows::Storage::Streams::InMemoryRandomAccessStream stream;
+                encoder.encode(pixels.data(), frameWidth, frameHeight, frameWidth * 4, stream);
+                encodedSize = stream.Size();
+            });
+
+        if (result)
+        {
+            result->counters.push_back({ "encodedBytes", static_cast<double>(encodedSize) });
+            result->counters.push_back({ "compressionRatio", static_cast<double>(pixels.size()) / encodedSize });
+        }
+    }
+
+    // The screen codec is also timed without the stream around it, and checked to give back the exact pixels.
+    std::vector<uint8_t> encoded;
+    measure("encode/screen/codec_only", pixels.size(), [&]()
+        {
+            encoded = ScreenCodec::encode(pixels.data(), frameWidth, frameHeight, frameWidth * 4);
+        });
+
+    // Encoded and decoded again outside the timed cases, so the check runs even when they are filtered out.
+    encoded = ScreenCodec::encode(pixels.data(), frameWidth, frameHeight, frameWidth * 4);
+
+    uint32_t decodedWidth = 0, decodedHeight = 0;
+    std::vector<uint8_t> decoded = ScreenCodec::decode(encoded.data(), encoded.size(), decodedWidth, decodedHeight);
+
+    if (decodedWidth != frameWidth || decodedHeight != frameHeight)
+    {
+        throw std::runtime_error("encode/screen/decode: decoded frame is " + std::to_string(decodedWidth) + "x" + std::to_string(decodedHeight) +
+            " instead of " + std::to_string(frameWidth) + "x" + std::to_string(frameHeight) + ".");
+    }
+
+    if (decoded != pixels)
+    {
+        throw std::runtime_error("encode/screen/decode: decoded frame differs from the encoded one.");
+    }
+
+    measure("encode/screen/decode", pixels.size(), [&]()
+        {
+            decoded = ScreenCodec::decode(encoded.data(), encoded.size(), decodedWidth, decodedHeight);
+        });
+}
+
+void Benchmark::run_quality_benchmarks()
+{
+    if (!matches("quality/"))
+    {
+        return;
+    }
+
+    std::vector<uint8_t> pixels = create_synthetic_frame(frameWidth, frameHeight, 0);
+
+    // A decoded frame stand-in: the frame with a little noise on every channel, as lossy encoding leaves.
+    std::vector<uint8_t> noisy = pixels;
+    uint32_t state = 1;
+
+    for (auto& value : noisy)
+    {
+        state = state * 1664525 + 1013904223;
+        value = static_cast<uint8_t>(std::clamp(static_cast<int>(value) + static_cast<int>(state >> 29) - 4, 0, 255));
+    }
+
+    QualityScore scalarScore = QualityTuner::compare(pixels.data(), frameWidth * 4, noisy.data(), frameWidth * 4, frameWidth, frameHeight, false);
+    QualityScore score;
+
+    measure("quality/compare/scalar", pixels.size(), [&]()
+        {
+            score = QualityTuner::compare(pixels.data(), frameWidth * 4, noisy.data(), frameWidth * 4, frameWidth, frameHeight, false);
+        });
+
+    Result* result = measure("quality/compare/simd", pixels.size(), [&]()
+        {
+            score = QualityTuner::compare(pixels.data(), frameWidth * 4, noisy.data(), frameWidth * 4, frameWidth, frameHeight);
+        });
+
+    if (result)
+    {
+        if (score.Ssim != scalarScore.Ssim || score.Psnr != scalarScore.Psnr)
+        {
+            throw std::runtime_error("quality/compare: SIMD comparison differs from scalar comparison.");
+        }
+
+        result->counters.push_back({ "ssim", score.Ssim });
+        result->counters.push_back({ "psnr", score.Psnr });
+    }
+
+    // The search a recording pays once per content class, and the lookup every frame after it pays.
+    float quality = 0;
+
+    measure("quality/tune/search", pixels.size(), [&]()
+        {
+            QualityTuner tuner;
+            quality = tuner.quality_for(pixels.data(), frameWidth, frameHeight, frameWidth * 4);
+        });
+
+    QualityTuner tuner;
+    quality = tuner.quality_for(pixels.data(), frameWidth, frameHeight, frameWidth * 4);
+
+    measure("quality/tune/cached", pixels.size(), [&]()
+        {
+            quality = tuner.quality_for(pixels.data(), frameWidth, frameHeight, frameWidth * 4);
+        });
+
+    // One step of the search, encoding, decoding and comparing, at the tuned quality. The counters show what the tuned
+    // quality saves against the encoder's default, and what it costs in SSIM.
+    result = measure("quality/measure", pixels.size(), [&]()
+        {
+            QualityTuner::measure(pixels.data(), frameWidth, frameHeight, frameWidth * 4, quality);
+        });
+
+    if (result)
+    {
+        uint64_t tunedBytes = 0, defaultBytes = 0;
+        QualityScore tunedScore = QualityTuner::measure(pixels.data(), frameWidth, frameHeight, frameWidth * 4, quality, &tunedBytes);
+        QualityScore defaultScore = QualityTuner::measure(pixels.data(), frameWidth, frameHeight, frameWidth * 4, FrameEncoder::default_quality, &defaultBytes);
+
+        result->counters.push_back({ "tunedQuality", quality * 100.0 });
+        result->counters.push_back({ "textClass", QualityTuner::classify(pixels.data(), frameWidth, frameHeight, frameWidth * 4) == ContentClass::Text ? 1.0 : 0.0 });
+        result->counters.push_back({ "tunedBytes", static_cast<double>(tunedBytes) });
+        result->counters.push_back({ "defaultBytes", static_cast<double>(defaultBytes) });
+        result->counters.push_back({ "tunedSsim", tunedScore.Ssim });
+        result->counters.push_back({ "defaultSsim", defaultScore.Ssim });
+    }
+}
+
+void Benchmark::run_compress_benchmarks()
+{
+    if (!matches("compress/"))
+    {
+        return;
+    }
+
+    std::vector<uint8_t> pixels = create_synthetic_frame(frameWidth, frameHeight, 0);
+    std::vector<uint8_t> blocks(BlockCompressor::compressed_size(frameWidth, frameHeight));
+    std::vector<uint8_t> copy(pixels.size());
+
+    // Storing the frame as it is, for comparison.
+    measure("compress/raw_copy", pixels.size(), [&]()
+        {
+            memcpy(copy.data(), pixels.data(), pixels.size());
+        });
+
+    measure("compress/bc1/scalar", pixels.size(), [&]()
+        {
+            BlockCompressor::compress(pixels.data(), frameWidth, frameHeight, frameWidth * 4, blocks.data(), false);
+        });
+
+    std::vector<uint8_t> scalarBlocks = blocks;
+
+    Result* result = measure("compress/bc1/simd", pixels.size(), [&]()
+        {
+            BlockCompressor::compress(pixels.data(), frameWidth, frameHeight, frameWidth * 4, blocks.data());
+        });
+
+    if (result)
+    {
+        BlockCompressor::compress(pixels.data(), frameWidth, frameHeight, frameWidth * 4, scalarBlocks.data(), false);
+
+        if (blocks != scalarBlocks)
+        {
+            throw std::runtime_error("compress/bc1: SIMD compression differs from scalar compression.");
+        }
+
+        result->counters.push_back({ "compressionRatio", static_cast<double>(pixels.size()) / blocks.size() });
+    }
+
+    BlockCompressor::compress(pixels.data(), frameWidth, frameHeight, frameWidth * 4, blocks.data());
+
+    measure("compress/bc1/decompress/scalar", pixels.size(), [&]()
+        {
+            BlockCompressor::decompress(blocks.data(), frameWidth, frameHeight, copy.data(), frameWidth * 4, false);
+        });
+
+    std::vector<uint8_t> scalarCopy = copy;
+
+    result = measure("compress/bc1/decompress/simd", pixels.size(), [&]()
+        {
+            BlockCompressor::decompress(blocks.data(), frameWidth, frameHeight, copy.data(), frameWidth * 4);
+        });
+
+    if (result)
+    {
+        BlockCompressor::decompress(blocks.data(), frameWidth, frameHeight, scalarCopy.data(), frameWidth * 4, false);
+        BlockCompressor::decompress(blocks.data(), frameWidth, frameHeight, copy.data(), frameWidth * 4);
+
+        if (copy != scalarCopy)
+        {
+            throw std::runtime_error("compress/bc1: SIMD decompression differs from scalar decompression.");
+        }
+
+        // Peak signal to noise ratio of the color channels, in decibels. Higher is better, and above 35 is hard to tell
+        // apart from the original at a glance.
+        double squaredError = 0;
+
+        for (size_t i = 0; i < pixels.size(); i++)
+        {
+            if (i % 4 != 3)
+            {
+                double difference = static_cast<double>(pixels[i]) - copy[i];
+                squaredError += difference * difference;
+            }
+        }
+
+        double meanSquaredError = squaredError / (pixels.size() / 4 * 3);
+        result->counters.push_back({ "psnr", meanSquaredError == 0 ? 100.0 : 10 * log10(255.0 * 255.0 / meanSquaredError) });
+    }
+}
+
+// Converts to a 16-bit float, rounding toward zero. Values too small for a normal half become 0.
+static uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+
+    if (exponent <= 0)
+    {
+        return sign;
+    }
+
+    if (exponent >= 31)
+    {
+        return sign | 0x7C00;
+    }
+
+    return static_cast<uint16_t>(sign | exponent << 10 | ((bits >> 13) & 0x3FF));
+}
+
+void Benchmark::run_tone_map_benchmarks()
+{
+    if (!matches("tonemap/"))
+    {
+        return;
+    }
+
+    const uint32_t width = 3840;
+    const uint32_t height = 2160;
+    const float whiteLevel = 2.5f;
+
+    // An HDR desktop: SDR content drawn at a 200 nit white level, with a highlight five times brighter in the corner.
+    std::vector<uint8_t> sdr = create_synthetic_frame(width, height, 0);
+    std::vector<uint16_t> hdr(static_cast<size_t>(width) * height * 4);
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            size_t pixel = static_cast<size_t>(y) * width + x;
+            float boost = x < width / 8 && y < height / 8 ? 5.0f : 1.0f;
+
+            // scRGB is in RGB order, BGRA8 in BGR order.
+            for (int channel = 0; channel < 3; channel++)
+            {
+                double encoded = sdr[pixel * 4 + 2 - channel] / 255.0;
+                double linear = encoded <= 0.04045 ? encoded / 12.92 : std::pow((encoded + 0.055) / 1.055, 2.4);
+
+                hdr[pixel * 4 + channel] = float_to_half(static_cast<float>(linear) * whiteLevel * boost);
+            }
+
+            hdr[pixel * 4 + 3] = float_to_half(1.0f);
+        }
+    }
+
+    const uint8_t* hdrPixels = reinterpret_cast<const uint8_t*>(hdr.data());
+    std::vector<uint8_t> packed(ToneMapper::packed_size(width, height));
+    std::vector<uint8_t> scalarPacked(packed.size());
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+    std::vector<uint8_t> scalarPixels(pixels.size());
+
+    ToneMapper::pack(hdrPixels, width, height, width * 8, scalarPacked.data(), false);
+
+    measure("tonemap/pack/scalar", hdr.size() * 2, [&]()
+        {
+            ToneMapper::pack(hdrPixels, width, height, width * 8, packed.data(), false);
+        });
+
+    Result* result = measure("tonemap/pack/f16c", hdr.size() * 2, [&]()
+        {
+            ToneMapper::pack(hdrPixels, width, height, width * 8, packed.data());
+        });
+
+    if (result)
+    {
+        if (packed != scalarPacked)
+        {
+            throw std::runtime_error("tonemap/pack: F16C packing differs from scalar packing.");
+        }
+
+        result->counters.push_back({ "simdAvailable", ToneMapper::has_f16c() ? 1.0 : 0.0 });
+    }
+
+    ToneMapper::tone_map(scalarPacked.data(), width, height, whiteLevel, scalarPixels.data(), width * 4, false);
+
+    measure("tonemap/map/scalar", packed.size(), [&]()
+        {
+            ToneMapper::tone_map(scalarPacked.data(), width, height, whiteLevel, pixels.data(), width * 4, false);
+        });
+
+    result = measure("tonemap/map/avx2", packed.size(), [&]()
+        {
+            ToneMapper::tone_map(scalarPacked.data(), width, height, whiteLevel, pixels.data(), width * 4);
+        });
+
+    if (result)
+    {
+        if (pixels != scalarPixels)
+        {
+            throw std::runtime_error("tonemap/map: AVX2 tone mapping differs from scalar tone mapping.");
+        }
+
+        // How close SDR content comes out to what it was before capture, outside the highlight, in decibels.
+        double squaredError = 0;
+        size_t samples = 0;
+
+        for (uint32_t y = height / 8; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                for (int channel = 0; channel < 3; channel++)
+                {
+                    size_t i = (static_cast<size_t>(y) * width + x) * 4 + channel;
+                    double difference = static_cast<double>(sdr[i]) - pixels[i];
+                    squaredError += difference * difference;
+                    samples++;
+                }
+            }
+        }
+
+        double meanSquaredError = squaredError / samples;
+
+        result->counters.push_back({ "simdAvailable", ToneMapper::has_avx2() ? 1.0 : 0.0 });
+        result->counters.push_back({ "sdrPsnr", meanSquaredError == 0 ? 100.0 : 10 * log10(255.0 * 255.0 / meanSquaredError) });
+    }
+}
+
+void Benchmark::run_redact_benchmarks()
+{
+    if (!matches("redact/"))
+    {
+        return;
+    }
+
+    // A password manager window and a strip of notifications, about a quarter of the frame between them.
+    const RECT rects[] = { { 600, 200, 1400, 800 }, { 1500, 0, 1920, 120 } };
+    std::vector<DirtyRect> regions;
+
+    for (const auto& rect : rects)
+    {
+        regions.push_back({ static_cast<uint32_t>(rect.left), static_cast<uint32_t>(rect.top), static_cast<uint32_t>(rect.right), static_cast<uint32_t>(rect.bottom) });
+    }
+
+    const uint32_t rowPitch = frameWidth * 4;
+    const size_t regionBytes = DirtyRegionDetector::total_area(regions) * 4;
+    const std::vector<uint8_t> original = create_synthetic_frame(frameWidth, frameHeight, 0);
+    std::vector<uint8_t> pixels = original;
+    std::vector<uint8_t> scalarPixels = original;
+
+    for (const auto& region : regions)
+    {
+        Redactor::pixelate(scalarPixels.data(), rowPitch, region, Redactor::pixelateBlockSize, false);
+    }
+
+    measure("redact/fill/scalar", regionBytes, [&]()
+        {
+            for (const auto& region : regions)
+            {
+                Redactor::fill(pixels.data(), rowPitch, region, Redactor::fillColor, false);
+            }
+        });
+
+    Result* result = measure("redact/fill/simd", regionBytes, [&]()
+        {
+            for (const auto& region : regions)
+            {
+                Redactor::fill(pixels.data(), rowPitch, region, Redactor::fillColor);
+            }
+        });
+
+    if (result)
+    {
+        std::vector<uint8_t> scalarFilled = original;
+        pixels = original;
+
+        for (const auto& region : regions)
+        {
+            Redactor::fill(scalarFilled.data(), rowPitch, region, Redactor::fillColor, false);
+            Redactor::fill(pixels.data(), rowPitch, region, Redactor::fillColor);
+        }
+
+        if (pixels != scalarFilled)
+        {
+            throw std::runtime_error("redact/fill: SIMD filling differs from scalar filling.");
+        }
+    }
+
+    // Pixelating takes as long whatever the pixels are, so the regions are not restored between runs.
+    measure("redact/pixelate/scalar", regionBytes, [&]()
+        {
+            for (const auto& region : regions)
+            {
+                Redactor::pixelate(pixels.data(), rowPitch, region, Redactor::pixelateBlockSize, false);
+            }
+        });
+
+    result = measure("redact/pixelate/simd", regionBytes, [&]()
+        {
+            for (const auto& region : regions)
+            {
+                Redactor::pixelate(pixels.data(), rowPitch, region, Redactor::pixelateBlockSize);
+            }
+        });
+
+    if (result)
+    {
+        pixels = original;
+
+        for (const auto& region : regions)
+        {
+            Redactor::pixelate(pixels.data(), rowPitch, region, Redactor::pixelateBlockSize);
+        }
+
+        if (pixels != scalarPixels)
+        {
+            throw std::runtime_error("redact/pixelate: SIMD pixelation differs from scalar pixelation.");
+        }
+    }
+
+    // The whole store path, with the regions redacted on the GPU for texture storage and in memory for encoded
+    // storage, against the same path without redaction.
+    struct StorageCase
+    {
+        const char* name;
+        FrameStorage storage;
+    };
+
+    const StorageCase storageCases[] = { { "texture", FrameStorage::Texture }, { "encoded", FrameStorage::Encoded } };
+
+    auto device = CreateDirect3DDevice(m_d3dDevice.as<IDXGIDevice>().get());
+
+    for (const auto& storageCase : storageCases)
+    {
+        double baseline = 0;
+
+        for (const char* style : { "none", "fill", "pixelate" })
+        {
+            std::string name = std::string("redact/capture/") + storageCase.name + "/" + style;
+
+            if (!matches(name))
+            {
+                continue;
+            }
+
+            std::vector<winrt::com_ptr<ID3D11Texture2D>> frames = {
+                create_synthetic_texture(frameWidth, frameHeight, 0),
+                create_synthetic_texture(frameWidth, frameHeight, 1) };
+
+            auto source = std::make_unique<SyntheticFrameSource>(std::move(frames));
+            SyntheticFrameSource* sourcePointer = source.get();
+
+            RecordingOptions options;
+            options.Framerate = 1000000;
+            options.Storage = storageCase.storage;
+            options.Redaction = strcmp(style, "pixelate") == 0 ? RedactStyle::Pixelate : RedactStyle::Fill;
+
+            if (strcmp(style, "none") != 0)
+            {
+                options.RedactRects.assign(std::begin(rects), std::end(rects));
+            }
+
+            CircularFrameBuffer buffer(8, false, FrameEncoder(options.Format), options.Storage, false);
+            SimpleCapture capture(device, std::move(source), { 0, 0 }, options, std::move(buffer));
+            capture.StartCapture();
+
+            result = measure(name, static_cast<size_t>(frameWidth) * frameHeight * 4, [&]()
+                {
+                    sourcePointer->push_frame();
+                });
+
+            capture.Close();
+
+            if (!result)
+            {
+                continue;
+            }
+
+            if (strcmp(style, "none") == 0)
+            {
+                baseline = result->nanosecondsPerOperation;
+            }
+            else if (baseline > 0)
+            {
+                result->counters.push_back({ "addedMicroseconds", (result->nanosecondsPerOperation - baseline) / 1000 });
+            }
+        }
+    }
+}
+
+void Benchmark::run_readback_benchmarks()
+{
+    if (!matches("readback/"))
+    {
+        return;
+    }
+
+    const size_t frameCount = 8;
+    std::vector<winrt::com_ptr<ID3D11Texture2D>> textures;
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        textures.push_back(create_synthetic_texture(frameWidth, frameHeight, i));
+    }
+
+    // Every read copies the rows out, standing in for the encoder consuming them.
+    std::vector<uint8_t> consumed(static_cast<size_t>(frameWidth) * frameHeight * 4);
+
+    for (size_t depth : { 1, 2, 3, 4, 8 })
+    {
+        ReadbackQueue readback(m_d3dDevice, depth);
+        uint64_t frames = 0;
+
+        Result* result = measure("readback/depth_" + std::to_string(depth), frameCount * consumed.size(), [&]()
+            {
+                size_t submitted = 0;
+
+                for (size_t i = 0; i < frameCount; i++)
+                {
+                    while (submitted < frameCount && !readback.full())
+                    {
+                        readback.submit(textures[submitted++]);
+                    }
+
+                    readback.read_oldest([&](uint8_t* pixels, uint32_t rowPitch, const D3D11_TEXTURE2D_DESC& desc)
+                        {
+                            for (uint32_t y = 0; y < desc.Height; y++)
+                            {
+                                memcpy(consumed.data() + static_cast<size_t>(y) * desc.Width * 4, pixels + static_cast<size_t>(y) * rowPitch, desc.Width * 4);
+                            }
+                        });
+
+                    frames++;
+                }
+            });
+
+        if (result)
+        {
+            result->counters.push_back({ "stallsPerFrame", static_cast<double>(readback.stall_count()) / frames });
+        }
+    }
+}
+
+void Benchmark::run_arena_benchmarks()
+{
+    if (!matches("arena/"))
+    {
+        return;
+    }
+
+    // Encoded frames of a mostly static desktop vary a lot in size, from a few tens of kilobytes up to a few hundred.
+    const size_t budget = 64 * 1000000;
+    const size_t maxFrameSize = 400000;
+    std::vector<uint8_t> source(maxFrameSize, 0x5A);
+    std::vector<size_t> sizes(1024);
+    uint32_t random = 1;
+
+    for (auto& size : sizes)
+    {
+        random = random * 1664525u + 1013904223u;
+        size = 20000 + (random >> 8) % (maxFrameSize - 20000);
+    }
+
+    RingArena arena(budget);
+    size_t arenaIndex = 0;
+
+    Result* result = measure("arena/ring", maxFrameSize / 2, [&]()
+        {
+            size_t size = sizes[arenaIndex++ % sizes.size()];
+            uint8_t* record;
+
+            while ((record = arena.allocate(size)) == nullptr)
+            {
+                arena.release_oldest();
+            }
+
+            memcpy(record, source.data(), size);
+        });
+
+    if (result)
+    {
+        result->counters.push_back({ "framesHeld", static_cast<double>(arena.record_count()) });
+        result->counters.push_back({ "budgetUsed", static_cast<double>(arena.used()) / budget });
+    }
+
+    std::deque<std::vector<uint8_t>> frames;
+    size_t dequeUsage = 0;
+    size_t dequeIndex = 0;
+
+    result = measure("arena/deque_of_vectors", maxFrameSize / 2, [&]()
+        {
+            size_t size = sizes[dequeIndex++ % sizes.size()];
+
+            while (dequeUsage + size > budget)
+            {
+                dequeUsage -= frames.front().size();
+                frames.pop_front();
+            }
+
+            frames.emplace_back(source.begin(), source.begin() + size);
+            dequeUsage += size;
+        });
+
+    if (result)
+    {
+        // Only the payload is counted here: heap headers and fragmentation are not visible to the buffer.
+        result->counters.push_back({ "framesHeld", static_cast<double>(frames.size()) });
+        result->counters.push_back({ "budgetUsed", static_cast<double>(dequeUsage) / budget });
+    }
+}
+
+void Benchmark::run_save_benchmarks()
+{
+    if (!matches("save/"))
+    {
+        return;
+    }
+
+    const size_t frameCount = 20;
+
+    std::filesystem::path folder = std::filesystem::temp_directory_path() / ("screenrecorder_benchmark_" + std::to_string(GetCurrentProcessId()));
+    std::filesystem::create_directories(folder);
+    auto storageFolder = winrt::Windows::Storage::StorageFolder::GetFolderFromPathAsync(folder.wstring()).get();
+
+    CircularFrameBuffer buffer(frameCount, false);
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        FrameMetadata metadata = {};
+        metadata.Sequence = i;
+        metadata.Timestamp = 133000000000000000 + i * 10000;
+        metadata.Width = frameWidth;
+        metadata.Height = frameHeight;
+
+        buffer.add_frame(create_synthetic_texture(frameWidth, frameHeight, i), metadata);
+    }
+
+    Result* result = measure("save/jpeg", frameCount * frameWidth * frameHeight * 4, [&]()
+        {
+            buffer.save_frames(storageFolder);
+        });
+
+    if (result)
+    {
+        result->counters.push_back({ "framesPerSecond", frameCount * 1e9 / result->nanosecondsPerOperation });
+    }
+
+    std::error_code error;
+    std::filesystem::remove_all(folder, error);
+}
+
+void Benchmark::run_write_benchmarks()
+{
+    if (!matches("write/"))
+    {
+        return;
+    }
+
+    const uint32_t frameCount = 1000;
+
+    std::filesystem::path folder = std::filesystem::temp_directory_path() / ("screenrecorder_benchmark_" + std::to_string(GetCurrentProcessId()));
+    std::filesystem::create_directories(folder);
+    auto storageFolder = winrt::Windows::Storage::StorageFolder::GetFolderFromPathAsync(folder.wstring()).get();
+
+    // A dump of 1000 encoded screenshots, each with its own name like a saved recording.
+    std::vector<uint8_t> pixels = create_synthetic_frame(frameWidth, frameHeight, 0);
+    winrt::Windows::Storage::Streams::InMemoryRandomAccessStream encodedStream;
+    FrameEncoder().encode(pixels.data(), frameWidth, frameHeight, frameWidth * 4, encodedStream);
+
+    winrt::Windows::Storage::Streams::Buffer encoded(static_cast<uint32_t>(encodedStream.Size()));
+    encodedStream.Seek(0);
+    encodedStream.ReadAsync(encoded, encoded.Capacity(), winrt::Windows::Storage::Streams::InputStreamOptions::None).get();
+
+    std::vector<std::string> filenames(frameCount);
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        char filename[FrameNameFormatter::maxLength];
+        size_t length = FrameNameFormatter::Format(133000000000000000 + static_cast<int64_t>(i) * 10000, ".jpg", filename);
+        filenames[i] = std::string(filename, length);
+    }
+
+    size_t dumpBytes = static_cast<size_t>(frameCount) * encoded.Length();
+
+    // The path saves took before the output writer: a file created, opened, written and flushed at a time.
+    Result* result = measure("write/winrt_stream", dumpBytes, [&]()
+        {
+            for (const auto& filename : filenames)
+            {
+                auto file = storageFolder.CreateFileAsync(winrt::to_hstring(filename), winrt::Windows::Storage::CreationCollisionOption::ReplaceExisting).get();
+                auto stream = file.OpenAsync(winrt::Windows::Storage::FileAccessMode::ReadWrite).get();
+
+                stream.WriteAsync(encoded).get();
+                stream.FlushAsync().get();
+            }
+        });
+
+    if (result)
+    {
+        result->counters.push_back({ "filesPerSecond", frameCount * 1e9 / result->nanosecondsPerOperation });
+    }
+
+    const struct
+    {
+        const char* name;
+        bool directIo;
+        bool durable;
+    } writerCases[] =
+    {
+        { "write/writer/buffered", false, true },
+        { "write/writer/direct", true, true },
+        { "write/writer/not_durable", false, false },
+    };
+
+    for (const auto& writerCase : writerCases)
+    {
+        result = measure(writerCase.name, dumpBytes, [&]()
+            {
+                OutputWriter writer(folder.wstring(), writerCase.directIo, writerCase.durable);
+
+                for (const auto& filename : filenames)
+                {
+                    writer.write(filename, encoded.data(), encoded.Length());
+                }
+
+                writer.finish();
+            });
+
+        if (result)
+        {
+            result->counters.push_back({ "filesPerSecond", frameCount * 1e9 / result->nanosecondsPerOperation });
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::remove_all(folder, error);
+}
+
+void Benchmark::run_chunk_benchmarks()
+{
+    if (!matches("chunk/"))
+    {
+        return;
+    }
+
+    std::vector<uint8_t> pixels = create_synthetic_frame(frameWidth, frameHeight, 0);
+    std::vector<uint8_t> page(pixels.begin(), pixels.begin() + 4096);
+
+    // Chunks are only shared with other tools if the hash is the reference XXH64. Its values were computed with the
+    // reference implementation for bytes i * 131 + 17, at lengths covering every tail of the 32-byte steps, without
+    // and with a seed. The check runs even when the timed cases are filtered out.
+    struct HashCase
+    {
+        size_t size;
+        uint64_t hash;
+        uint64_t seededHash;
+    };
+
+    const uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    const HashCase hashCases[] =
+    {
+        { 0, 0xef46db3751d8e999ULL, 0xc4349fc93c010000ULL },
+        { 1, 0xad10cd9780ac4ff7ULL, 0xeee0b6d27c96399cULL },
+        { 3, 0x40626d96276e4594ULL, 0x93ba463a084767e9ULL },
+        { 4, 0x882207c122c76e23ULL, 0xd0c267b9ee1e5859ULL },
+        { 7, 0xcfc90033aa9dac4fULL, 0xd684eda4399035afULL },
+        { 8, 0x90fda2f089fa86deULL, 0x7dec350536051091ULL },
+        { 15, 0x59f95bad12d14c9dULL, 0x31d5801999d1c65eULL },
+        { 16, 0x3a5b1165d151aa50ULL, 0xe6c09e8a168a56c0ULL },
+        { 31, 0x44cc9efe5d2d0233ULL, 0x0fb3b15a174b3ff1ULL },
+        { 32, 0x0e1aab1d173cf196ULL, 0x860a935aa1fdd66bULL },
+        { 33, 0x5c820b4b4fe28fdcULL, 0x3b00a6ef0416e4a4ULL },
+        { 63, 0x1153d36cade87066ULL, 0x56b32cfa14b03d74ULL },
+        { 64, 0xd4c20ef54cbc9f67ULL, 0xf6fb8b57d2e5f8f6ULL },
+        { 65, 0xac086c9b87baea67ULL, 0xb3f69fad4838f9c3ULL },
+        { 100, 0x7f8375f3e09d8123ULL, 0x72a72996bc4434acULL },
+        { 1000, 0x9fb3251bef67c2b5ULL, 0xedcbda5346dc4c3cULL },
+        { 4096, 0xa78a1899df4ccfdcULL, 0xc5feaf4c2f2d3f1bULL },
+    };
+
+    std::vector<uint8_t> sequence(4096);
+
+    for (size_t i = 0; i < sequence.size(); i++)
+    {
+        sequence[i] = static_cast<uint8_t>(i * 131 + 17);
+    }
+
+    for (const auto& hashCase : hashCases)
+    {
+        if (ChunkStore::hash(sequence.data(), hashCase.size) != hashCase.hash || ChunkStore::hash(sequence.data(), hashCase.size, seed) != hashCase.seededHash)
+        {
+            throw std::runtime_error("chunk/hash: hash of " + std::to_string(hashCase.size) + " bytes differs from the reference XXH64.");
+        }
+    }
+
+    const char* reference = "abc";
+
+    if (ChunkStore::hash(reinterpret_cast<const uint8_t*>(reference), strlen(reference)) != 0x44bc2cf5ad770999ULL)
+    {
+        throw std::runtime_error("chunk/hash: hash of \"abc\" differs from the reference XXH64.");
+    }
+
+    measure("chunk/hash/frame", pixels.size(), [&]()
+        {
+            ChunkStore::hash(pixels.data(), pixels.size());
+        });
+
+    measure("chunk/hash/4k", page.size(), [&]()
+        {
+            ChunkStore::hash(page.data(), page.size());
+        });
+
+    if (!matches("chunk/save/first") && !matches("chunk/save/repeat"))
+    {
+        return;
+    }
+
+    // A dump of 100 screenshots of a mostly idle screen, where the picture changes every tenth screenshot.
+    const uint32_t frameCount = 100;
+    const uint32_t framesPerPicture = 10;
+
+    std::vector<std::vector<uint8_t>> pictures;
+
+    for (uint32_t i = 0; i < frameCount / framesPerPicture; i++)
+    {
+        std::vector<uint8_t> picture = create_synthetic_frame(frameWidth, frameHeight, i);
+        winrt::Windows::Storage::Streams::InMemoryRandomAccessStream stream;
+        FrameEncoder().encode(picture.data(), frameWidth, frameHeight, frameWidth * 4, stream);
+
+        winrt::Windows::Storage::Streams::Buffer encoded(static_cast<uint32_t>(stream.Size()));
+        stream.Seek(0);
+        stream.ReadAsync(encoded, encoded.Capacity(), winrt::Windows::Storage::Streams::InputStreamOptions::None).get();
+
+        pictures.emplace_back(encoded.data(), encoded.data() + encoded.Length());
+    }
+
+    std::vector<std::string> filenames(frameCount);
+    size_t dumpBytes = 0;
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        char filename[FrameNameFormatter::maxLength];
+        size_t length = FrameNameFormatter::Format(133000000000000000 + static_cast<int64_t>(i) * 10000, ".jpg", filename);
+        filenames[i] = std::string(filename, length);
+        dumpBytes += pictures[i / framesPerPicture].size();
+    }
+
+    std::filesystem::path folder = std::filesystem::temp_directory_path() / ("screenrecorder_benchmark_" + std::to_string(GetCurrentProcessId()));
+    std::filesystem::path store = folder / "store";
+    std::filesystem::path dump = folder / "dump";
+    std::filesystem::create_directories(dump);
+
+    auto save = [&](size_t& newChunks, uint64_t& newBytes)
+        {
+            ChunkStore chunks(store);
+
+            for (uint32_t i = 0; i < frameCount; i++)
+            {
+                const auto& picture = pictures[i / framesPerPicture];
+                chunks.add(filenames[i], picture.data(), picture.size());
+            }
+
+            chunks.commit(dump);
+
+            newChunks = chunks.new_chunks();
+            newBytes = chunks.new_bytes();
+        };
+
+    const struct
+    {
+        const char* name;
+        bool emptyStore;
+    } saveCases[] =
+    {
+        // An empty store each time, which pays for deleting the last one too.
+        { "chunk/save/first", true },
+        // The same dump again, which finds every screenshot in the store and writes only the manifest.
+        { "chunk/save/repeat", false },
+    };
+
+    for (const auto& saveCase : saveCases)
+    {
+        size_t newChunks = 0;
+        uint64_t newBytes = 0;
+
+        Result* result = measure(saveCase.name, dumpBytes, [&]()
+            {
+                if (saveCase.emptyStore)
+                {
+                    std::filesystem::remove_all(store);
+                }
+
+                save(newChunks, newBytes);
+            });
+
+        if (result)
+        {
+            result->counters.push_back({ "newChunks", static_cast<double>(newChunks) });
+            result->counters.push_back({ "bytesWritten", static_cast<double>(newBytes) });
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::remove_all(folder, error);
+}
+
+void Benchmark::run_capture_benchmarks()
+{
+    if (!matches("capture/"))
+    {
+        return;
+    }
+
+    struct Resolution
+    {
+        const char* name;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    struct StorageCase
+    {
+        const char* name;
+        FrameStorage storage;
+    };
+
+    const Resolution resolutions[] = { { "1080p", 1920, 1080 }, { "4k", 3840, 2160 } };
+    const StorageCase storageCases[] = { { "texture", FrameStorage::Texture }, { "compressed", FrameStorage::Compressed }, { "encoded", FrameStorage::Encoded } };
+
+    auto device = CreateDirect3DDevice(m_d3dDevice.as<IDXGIDevice>().get());
+
+    for (const auto& resolution : resolutions)
+    {
+        for (const auto& storageCase : storageCases)
+        {
+            std::string name = std::string("capture/") + resolution.name + "/" + storageCase.name;
+
+            if (!matches(name))
+            {
+                continue;
+            }
+
+            // Two alternating frames, so every frame differs from the one before it.
+            std::vector<winrt::com_ptr<ID3D11Texture2D>> frames = {
+                create_synthetic_texture(resolution.width, resolution.height, 0),
+                create_synthetic_texture(resolution.width, resolution.height, 1) };
+
+            auto source = std::make_unique<SyntheticFrameSource>(std::move(frames));
+            SyntheticFrameSource* sourcePointer = source.get();
+
+            // A framerate this high stores every frame pushed, as fast as the store path allows.
+            RecordingOptions options;
+            options.Framerate = 1000000;
+            options.Storage = storageCase.storage;
+
+            CircularFrameBuffer buffer(8, false, FrameEncoder(options.Format), options.Storage, false);
+            SimpleCapture capture(device, std::move(source), { 0, 0 }, options, std::move(buffer));
+            capture.StartCapture();
+
+            measure(name, static_cast<size_t>(resolution.width) * resolution.height * 4, [&]()
+                {
+                    sourcePointer->push_frame();
+                });
+
+            capture.Close();
+        }
+    }
+}
+
+void Benchmark::run_idle_benchmarks()
+{
+    if (!matches("idle/"))
+    {
+        return;
+    }
+
+    // The detector is asked ten times a second for as long as a recording runs.
+    SystemActivityDetector systemDetector(std::chrono::minutes(5));
+    ActivityState state = ActivityState::Active;
+
+    Result* result = measure("idle/poll/system", 0, [&]()
+        {
+            state = systemDetector.state();
+        });
+
+    if (result)
+    {
+        result->counters.push_back({ "active", state == ActivityState::Active ? 1.0 : 0.0 });
+    }
+
+    const struct
+    {
+        const char* name;
+        ActivityState state;
+        int idleIntervalSeconds;
+    } idleCases[] =
+    {
+        { "idle/push/active", ActivityState::Active, 0 },
+        { "idle/push/paused", ActivityState::Locked, 0 },
+        { "idle/push/low_rate", ActivityState::Idle, 3600 },
+    };
+
+    auto device = CreateDirect3DDevice(m_d3dDevice.as<IDXGIDevice>().get());
+
+    for (const auto& idleCase : idleCases)
+    {
+        if (!matches(idleCase.name))
+        {
+            continue;
+        }
+
+        std::vector<winrt::com_ptr<ID3D11Texture2D>> frames = {
+            create_synthetic_texture(frameWidth, frameHeight, 0),
+            create_synthetic_texture(frameWidth, frameHeight, 1) };
+
+        auto source = std::make_unique<SyntheticFrameSource>(std::move(frames));
+        SyntheticFrameSource* sourcePointer = source.get();
+
+        // The fake detector is set before the capture starts, which asks it once, so the state holds from the first
+        // frame pushed. Pushes a paused source refuses cost nothing more than a check.
+        auto detector = std::make_unique<FakeActivityDetector>(idleCase.state);
+
+        RecordingOptions options;
+        options.Framerate = 1000000;
+        options.IdleIntervalSeconds = idleCase.idleIntervalSeconds;
+
+        CircularFrameBuffer buffer(8, false, FrameEncoder(options.Format), options.Storage, false);
+        SimpleCapture capture(device, std::move(source), { 0, 0 }, options, std::move(buffer), std::move(detector));
+        capture.StartCapture();
+
+        uint64_t pushed = 0;
+        uint64_t refused = 0;
+
+        result = measure(idleCase.name, static_cast<size_t>(frameWidth) * frameHeight * 4, [&]()
+            {
+                pushed++;
+
+                if (!sourcePointer->push_frame())
+                {
+                    refused++;
+                }
+            });
+
+        if (result)
+        {
+            result->counters.push_back({ "refusedShare", pushed > 0 ? static_cast<double>(refused) / pushed : 0.0 });
+        }
+
+        capture.Close();
+    }
+}
+
+void Benchmark::run_export_benchmarks()
+{
+    if (!matches("export/"))
+    {
+        return;
+    }
+
+    // Small frames keep the copies cheap, so the time left is the cost of finding them. It should not grow with the
+    // size of the buffer.
+    const uint32_t exportSize = 64;
+    const size_t selectedCount = 16;
+    auto texture = create_synthetic_texture(exportSize, exportSize, 0);
+
+    for (size_t frameCount : { 64, 1024 })
+    {
+        CircularFrameBuffer buffer(frameCount, false);
+
+        for (size_t i = 0; i < frameCount; i++)
+        {
+            FrameMetadata metadata = {};
+            metadata.Sequence = i;
+            metadata.Qpc = static_cast<int64_t>(i) * 1000;
+            metadata.Width = exportSize;
+            metadata.Height = exportSize;
+
+            buffer.add_frame(texture, metadata);
+        }
+
+        int64_t from = static_cast<int64_t>(frameCount / 2) * 1000;
+        int64_t to = from + static_cast<int64_t>(selectedCount - 1) * 1000;
+        std::string suffix = "/of_" + std::to_string(frameCount);
+
+        measure("export/copy_range" + suffix, 0, [&]()
+            {
+                buffer.copy_range(from, to, 1);
+            });
+
+        measure("export/copy_nearest" + suffix, 0, [&]()
+            {
+                buffer.copy_nearest(from + 400);
+            });
+    }
+}
+
+void Benchmark::run_bus_benchmarks()
+{
+    if (!matches("bus/"))
+    {
+        return;
+    }
+
+    const uint32_t slotCount = 4;
+
+    std::vector<uint8_t> pixels = create_synthetic_frame(frameWidth, frameHeight, 0);
+    FrameBus bus(slotCount, frameWidth * frameHeight * 4);
+    FrameBusReader reader(bus.name());
+
+    FrameMetadata metadata = {};
+    metadata.Width = frameWidth;
+    metadata.Height = frameHeight;
+
+    measure("bus/publish", pixels.size(), [&]()
+        {
+            bus.publish(pixels.data(), frameWidth * 4, metadata);
+        });
+
+    reader.skip_to_latest();
+
+    // The consumer only looks at the frame in place, as a consumer in another process would.
+    uint64_t checksum = 0;
+
+    Result* result = measure("bus/publish_and_read", pixels.size(), [&]()
+        {
+            bus.publish(pixels.data(), frameWidth * 4, metadata);
+            reader.read([&](const FrameMetadata& frameMetadata, const uint8_t* framePixels, uint32_t rowPitch)
+                {
+                    checksum += framePixels[static_cast<size_t>(frameMetadata.Height - 1) * rowPitch];
+                });
+        });
+
+    if (result)
+    {
+        // A consumer lapped by the producer skips what was overwritten rather than reading a torn frame.
+        uint64_t missedBefore = reader.missed_frames();
+
+        for (uint32_t i = 0; i < slotCount + 2; i++)
+        {
+            bus.publish(pixels.data(), frameWidth * 4, metadata);
+        }
+
+        while (reader.read([](const FrameMetadata&, const uint8_t*, uint32_t) {}) != FrameBusReader::ReadResult::NoFrame)
+        {
+        }
+
+        result->counters.push_back({ "missedWhenLapped", static_cast<double>(reader.missed_frames() - missedBefore) });
+        result->counters.push_back({ "missedWhileReading", static_cast<double>(missedBefore) });
+    }
+}
+
+void Benchmark::run_ipc_benchmarks()
+{
+    if (!matches("ipc/"))
+    {
+        return;
+    }
+
+    std::wstring pipeName = L"screenrecorder_benchmark_" + std::to_wstring(GetCurrentProcessId());
+    Server server(pipeName);
+
+    if (!server.try_init())
+    {
+        throw std::runtime_error("\b\tFailed to create the benchmark server.\n");
+    }
+
+    std::thread serverThread([&server]() { server.run(); });
+
+    // try_init created the first pipe instance, so the server is ready for a client before run even starts, and a
+    // connection that finds it busy waits for the next instance in try_connect.
+    Client client(pipeName);
+
+    if (client.try_connect())
+    {
+        // Polling an unknown job goes through the whole request path without touching the recorder.
+        Request request = Request::BuildJobStatusRequest(0);
+
+        measure("ipc/round_trip", 0, [&]()
+            {
+                client.send(request);
+            });
+
+        Request killRequest = Request::BuildKillRequest();
+        client.send(killRequest);
+    }
+    else
+    {
+        Client killer(pipeName);
+        Request killRequest = Request::BuildKillRequest();
+
+        if (killer.try_connect())
+        {
+            killer.send(killRequest);
+        }
+    }
+
+    serverThread.join();
+}
+
+void Benchmark::run_startup_benchmarks()
+{
+    if (!matches("startup/"))
+    {
+        return;
+    }
+
+    LARGE_INTEGER frequency, start, ready;
+    QueryPerformanceFrequency(&frequency);
+
+    std::wstring pipeName = L"screenrecorder_startup_" + std::to_wstring(GetCurrentProcessId());
+    double readySeconds = 0;
+    uint64_t spawns = 0;
+
+    // Every iteration also shuts the process down again, so the time until it was ready is reported separately.
+    Result* result = measure("startup/spawn_to_ready", 0, [&]()
+        {
+            RecordingProcess process;
+
+            QueryPerformanceCounter(&start);
+
+            if (!process.try_create(pipeName) || !process.wait_until_ready(5000))
+            {
+                throw std::runtime_error("\b\tFailed to start the benchmark recording process.\n");
+            }
+
+            QueryPerformanceCounter(&ready);
+            readySeconds += static_cast<double>(ready.QuadPart - start.QuadPart) / frequency.QuadPart;
+            spawns++;
+
+            Client client(pipeName);
+            Request killRequest = Request::BuildKillRequest();
+
+            if (client.try_connect())
+            {
+                client.send(killRequest);
+            }
+
+            process.wait_for_exit(5000);
+        });
+
+    if (result)
+    {
+        result->counters.push_back({ "millisecondsToReady", readySeconds * 1000 / spawns });
+    }
+
+    if (!matches("startup/first_frame"))
+    {
+        return;
+    }
+
+    // The first frame is seen through the frame bus, as soon as the capture publishes it.
+    RecordingOptions options;
+    options.Framerate = 60;
+    options.BufferCapacity = 1;
+    options.AsMegabytes = false;
+    options.FrameBusSlots = 1;
+
+    ScreenRecorder recorder;
+    recorder.prepare();
+
+    measure("startup/first_frame", 0, [&]()
+        {
+            recorder.start(options);
+
+            std::string name;
+            uint32_t slotCount, slotCapacity;
+            recorder.frame_bus(options.Session, name, slotCount, slotCapacity);
+
+            FrameBusReader reader(winrt::to_hstring(name).c_str());
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+            while (reader.published_frames() == 0)
+            {
+                if (std::chrono::steady_clock::now() > deadline)
+                {
+                    recorder.cancel(options.Session);
+
+                    throw std::runtime_error("\b\tNo frame was captured.\n");
+                }
+
+                std::this_thread::yield();
+            }
+
+            recorder.cancel(options.Session);
+        });
+}
+
+void Benchmark::run_scheduler_benchmarks()
+{
+    if (!matches("sched/"))
+    {
+        return;
+    }
+
+    // Tasks spin instead of sleeping, so they hold their worker like encoding does.
+    auto spin = [](std::chrono::microseconds duration)
+        {
+            auto end = std::chrono::steady_clock::now() + duration;
+
+            while (std::chrono::steady_clock::now() < end)
+            {
+            }
+        };
+
+    struct LoadCase
+    {
+        const char* name;
+        bool liveEncodeLoad;
+        bool bulkSaveLoad;
+    };
+
+    const LoadCase loadCases[] = { { "idle", false, false }, { "save", false, true }, { "encode_and_save", true, true } };
+    const TaskLane measuredLanes[] = { TaskLane::Capture, TaskLane::LiveEncode };
+    const char* laneNames[] = { "capture", "live_encode", "bulk_save" };
+
+    for (const auto& loadCase : loadCases)
+    {
+        for (TaskLane measuredLane : measuredLanes)
+        {
+            std::string name = std::string("sched/") + laneNames[static_cast<size_t>(measuredLane)] + "/" + loadCase.name;
+
+            if (!matches(name))
+            {
+                continue;
+            }
+
+            TaskScheduler scheduler;
+            std::atomic<bool> loading = true;
+
+            // Saving offers 2 ms tasks, the size of encoding a frame, and live encoding 500 us tasks at a rate that
+            // keeps about half of the workers busy, for as long as the lanes take them.
+            std::thread loader([&]()
+                {
+                    auto nextLiveEncode = std::chrono::steady_clock::now();
+                    auto liveEncodeInterval = std::chrono::microseconds(1000 / std::max(1u, scheduler.worker_count() / 2));
+
+                    while (loading)
+                    {
+                        if (loadCase.bulkSaveLoad)
+                        {
+                            while (!scheduler.congested(TaskLane::BulkSave) && scheduler.try_submit(TaskLane::BulkSave, [&]() { spin(std::chrono::microseconds(2000)); }))
+                            {
+                            }
+                        }
+
+                        if (loadCase.liveEncodeLoad && std::chrono::steady_clock::now() >= nextLiveEncode)
+                        {
+                            scheduler.try_submit(TaskLane::LiveEncode, [&]() { spin(std::chrono::microseconds(500)); });
+                            nextLiveEncode += liveEncodeInterval;
+                        }
+
+                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    }
+                });
+
+            // Let the load reach its steady state before measuring.
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            scheduler.reset_stats();
+
+            Result* result = measure(name, 0, [&]()
+                {
+                    std::atomic<bool> ran = false;
+
+                    while (!scheduler.try_submit(measuredLane, [&ran]() { ran = true; }))
+                    {
+                        std::this_thread::yield();
+                    }
+
+                    while (!ran)
+                    {
+                        std::this_thread::yield();
+                    }
+                });
+
+            if (result)
+            {
+                TaskScheduler::LaneStats measured = scheduler.stats(measuredLane);
+                result->counters.push_back({ "averageWaitMicroseconds", measured.AverageWaitMicroseconds });
+                result->counters.push_back({ "maxWaitMicroseconds", measured.MaxWaitMicroseconds });
+
+                for (size_t lane = 0; lane < TaskScheduler::laneCount; lane++)
+                {
+                    TaskScheduler::LaneStats stats = scheduler.stats(static_cast<TaskLane>(lane));
+                    result->counters.push_back({ std::string(laneNames[lane]) + "Utilization", stats.Utilization });
+                }
+
+                result->counters.push_back({ "bulkSaveRejected", static_cast<double>(scheduler.stats(TaskLane::BulkSave).Rejected) });
+            }
+
+            loading = false;
+            loader.join();
+        }
+    }
+}
+
+void Benchmark::write_summary(std::ostream& stream) const
+{
+    for (const auto& result : m_results)
+    {
+        stream << std::left << std::setw(32) << result.name
+            << std::right << std::setw(14) << std::fixed << std::setprecision(1) << result.nanosecondsPerOperation << " ns/op";
+
+        if (result.bytesPerSecond > 0)
+        {
+            stream << std::setw(10) << std::setprecision(1) << result.bytesPerSecond / 1000000 << " MB/s";
+        }
+
+        for (const auto& [name, value] : result.counters)
+        {
+            stream << "  " << name << "=" << std::setprecision(2) << value;
+        }
+
+        stream << std::endl;
+    }
+}
+
+void Benchmark::write_json(std::ostream& stream) const
+{
+    stream << "{\n  \"benchmarks\": [";
+
+    for (size_t i = 0; i < m_results.size(); i++)
+    {
+        const auto& result = m_results[i];
+
+        stream << (i == 0 ? "\n" : ",\n")
+            << "    { \"name\": \"" << result.name << "\""
+            << ", \"iterations\": " << result.iterations
+            << ", \"nsPerOp\": " << std::setprecision(6) << result.nanosecondsPerOperation
+            << ", \"bytesPerSecond\": " << result.bytesPerSecond
+            << ", \"counters\": {";
+
+        for (size_t j = 0; j < result.counters.size(); j++)
+        {
+            stream << (j == 0 ? " " : ", ") << "\"" << result.counters[j].first << "\": " << result.counters[j].second;
+        }
+
+        stream << (result.counters.empty() ? "} }" : " } }");
+    }
+
+    stream << "\n  ]\n}\n";
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "pch.h"
+
+// The purpose of this class is to measure the throughput of the capture, buffer and save pipeline. Every case runs on
+// synthetic frames, so no display or capture session is needed, and the results are written as JSON so they can be
+// compared between builds.
+class Benchmark {
+public:
+    struct Result
+    {
+        std::string name;
+        uint64_t iterations;
+        double nanosecondsPerOperation;
+        double bytesPerSecond;
+        std::vector<std::pair<std::string, double>> counters;
+    };
+
+    Benchmark(const std::string& filter) : m_filter(filter) {}
+
+    void run_all();
+
+    void write_summary(std::ostream& stream) const;
+    void write_json(std::ostream& stream) const;
+
+    // Creates a BGRA8 frame that looks like a desktop: flat window backgrounds, lines of text and a photo-like gradient.
+    static std::vector<uint8_t> create_synthetic_frame(uint32_t width, uint32_t height, uint32_t seed);
+
+private:
+    bool matches(const std::string& name) const;
+
+    /**
+     * Runs the operation until it has taken long enough to measure and records the average time per operation.
+     * @returns nullptr if the case is excluded by the filter
+     */
+    Result* measure(const std::string& name, size_t bytesPerOperation, const std::function<void()>& operation);
+
+    /**
+     * Measures the operation like measure() and counts the heap allocations it makes on this thread, leaving out the
+     * first call that warms it up.
+     * @returns nullptr if the case is excluded by the filter
+     * @throws std::runtime_error if the operation allocated
+     */
+    Result* measure_without_allocations(const std::string& name, size_t bytesPerOperation, const std::function<void()>& operation);
+
+    winrt::com_ptr<ID3D11Texture2D> create_synthetic_texture(uint32_t width, uint32_t height, uint32_t seed);
+    winrt::com_ptr<ID3D11Texture2D> create_texture(const uint8_t* pixels, uint32_t width, uint32_t height);
+
+    // Reads a BGRA8 texture back with its rows packed tightly.
+    std::vector<uint8_t> read_texture(winrt::com_ptr<ID3D11Texture2D> const& texture);
+
+    void run_buffer_benchmarks();
+    void run_encode_benchmarks();
+    void run_quality_benchmarks();
+    void run_compress_benchmarks();
+    void run_tone_map_benchmarks();
+    void run_redact_benchmarks();
+    void run_save_benchmarks();
+    void run_write_benchmarks();
+    void run_chunk_benchmarks();
+    void run_capture_benchmarks();
+    void run_idle_benchmarks();
+    void run_export_benchmarks();
+    void run_bus_benchmarks();
+    void run_readback_benchmarks();
+    void run_arena_benchmarks();
+    void run_ipc_benchmarks();
+    void run_startup_benchmarks();
+    void run_scheduler_benchmarks();
+    void run_format_benchmarks();
+    void run_dirty_region_benchmarks();
+    void run_scroll_benchmarks();
+    void run_cursor_benchmarks();
+
+    std::string m_filter;
+    std::vector<Result> m_results;
+    winrt::com_ptr<ID3D11Device> m_d3dDevice;
+};
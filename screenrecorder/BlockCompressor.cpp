@@ -0,0 +1,285 @@
+#include "pch.h"
+#include "BlockCompressor.h"
+#include "Simd.h"
+
+size_t BlockCompressor::compressed_size(uint32_t width, uint32_t height)
+{
+    size_t blocksWide = (width + blockSize - 1) / blockSize;
+    size_t blocksHigh = (height + blockSize - 1) / blockSize;
+
+    return blocksWide * blocksHigh * bytesPerBlock;
+}
+
+void BlockCompressor::compress(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, uint8_t* blocks, bool allowSimd)
+{
+    uint32_t block[16];
+
+    for (uint32_t blockY = 0; blockY < height; blockY += blockSize)
+    {
+        for (uint32_t blockX = 0; blockX < width; blockX += blockSize)
+        {
+            bool inside = blockX + blockSize <= width && blockY + blockSize <= height;
+
+            for (uint32_t row = 0; row < blockSize; row++)
+            {
+                uint32_t y = std::min(blockY + row, height - 1);
+                const uint32_t* source = reinterpret_cast<const uint32_t*>(pixels + static_cast<size_t>(y) * rowPitch);
+
+                if (inside)
+                {
+                    memcpy(&block[row * blockSize], source + blockX, blockSize * sizeof(uint32_t));
+                    continue;
+                }
+
+                for (uint32_t column = 0; column < blockSize; column++)
+                {
+                    block[row * blockSize + column] = source[std::min(blockX + column, width - 1)];
+                }
+            }
+
+            uint64_t compressed = compress_block(block, allowSimd);
+            memcpy(blocks, &compressed, bytesPerBlock);
+            blocks += bytesPerBlock;
+        }
+    }
+}
+
+void BlockCompressor::decompress(const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* pixels, uint32_t rowPitch, bool allowSimd)
+{
+#ifdef SIMD_SSE2
+    // The bits of each pixel's index within a row's byte of indices, and those bits holding index 1 and 2.
+    const __m128i indexMask = _mm_setr_epi32(3, 3 << 2, 3 << 4, 3 << 6);
+    const __m128i indexOne = _mm_setr_epi32(1, 1 << 2, 1 << 4, 1 << 6);
+    const __m128i indexTwo = _mm_setr_epi32(2, 2 << 2, 2 << 4, 2 << 6);
+#endif
+
+    for (uint32_t blockY = 0; blockY < height; blockY += blockSize)
+    {
+        for (uint32_t blockX = 0; blockX < width; blockX += blockSize)
+        {
+            uint16_t color0, color1;
+            uint32_t indices;
+            memcpy(&color0, blocks, sizeof(color0));
+            memcpy(&color1, blocks + 2, sizeof(color1));
+            memcpy(&indices, blocks + 4, sizeof(indices));
+            blocks += bytesPerBlock;
+
+            int32_t b0, g0, r0, b1, g1, r1;
+            from_565(color0, b0, g0, r0);
+            from_565(color1, b1, g1, r1);
+
+            uint32_t palette[4];
+            palette[0] = 0xFF000000u | r0 << 16 | g0 << 8 | b0;
+            palette[1] = 0xFF000000u | r1 << 16 | g1 << 8 | b1;
+
+            if (color0 > color1)
+            {
+                palette[2] = 0xFF000000u | (2 * r0 + r1) / 3 << 16 | (2 * g0 + g1) / 3 << 8 | (2 * b0 + b1) / 3;
+                palette[3] = 0xFF000000u | (r0 + 2 * r1) / 3 << 16 | (g0 + 2 * g1) / 3 << 8 | (b0 + 2 * b1) / 3;
+            }
+            else
+            {
+                palette[2] = 0xFF000000u | (r0 + r1) / 2 << 16 | (g0 + g1) / 2 << 8 | (b0 + b1) / 2;
+                palette[3] = 0xFF000000u;
+            }
+
+            uint32_t rows = std::min(blockSize, height - blockY);
+            uint32_t columns = std::min(blockSize, width - blockX);
+
+#ifdef SIMD_SSE2
+            if (allowSimd && rows == blockSize && columns == blockSize)
+            {
+                const __m128i entry0 = _mm_set1_epi32(static_cast<int>(palette[0]));
+                const __m128i entry1 = _mm_set1_epi32(static_cast<int>(palette[1]));
+                const __m128i entry2 = _mm_set1_epi32(static_cast<int>(palette[2]));
+                const __m128i entry3 = _mm_set1_epi32(static_cast<int>(palette[3]));
+
+                // Each lane keeps its own pixel's index bits and picks the palette color they match.
+                for (uint32_t row = 0; row < blockSize; row++)
+                {
+                    __m128i index = _mm_and_si128(_mm_set1_epi32(static_cast<int>((indices >> (8 * row)) & 0xFF)), indexMask);
+
+                    __m128i color = _mm_or_si128(
+                        _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi32(index, _mm_setzero_si128()), entry0), _mm_and_si128(_mm_cmpeq_epi32(index, indexOne), entry1)),
+                        _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi32(index, indexTwo), entry2), _mm_and_si128(_mm_cmpeq_epi32(index, indexMask), entry3)));
+
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + static_cast<size_t>(blockY + row) * rowPitch + blockX * 4), color);
+                }
+
+                continue;
+            }
+#endif
+
+            for (uint32_t row = 0; row < rows; row++)
+            {
+                uint32_t* target = reinterpret_cast<uint32_t*>(pixels + static_cast<size_t>(blockY + row) * rowPitch) + blockX;
+
+                for (uint32_t column = 0; column < columns; column++)
+                {
+                    target[column] = palette[(indices >> (2 * (row * blockSize + column))) & 3];
+                }
+            }
+        }
+    }
+}
+
+uint64_t BlockCompressor::compress_block(const uint32_t (&block)[16], bool allowSimd)
+{
+    uint32_t minColor = 0xFFFFFFFF;
+    uint32_t maxColor = 0;
+    bool simd = false;
+
+#ifdef SIMD_SSE2
+    simd = allowSimd;
+
+    if (simd)
+    {
+        __m128i row0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&block[0]));
+        __m128i row1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&block[4]));
+        __m128i row2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&block[8]));
+        __m128i row3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&block[12]));
+
+        __m128i minimum = _mm_min_epu8(_mm_min_epu8(row0, row1), _mm_min_epu8(row2, row3));
+        __m128i maximum = _mm_max_epu8(_mm_max_epu8(row0, row1), _mm_max_epu8(row2, row3));
+
+        minimum = _mm_min_epu8(minimum, _mm_shuffle_epi32(minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+        minimum = _mm_min_epu8(minimum, _mm_shuffle_epi32(minimum, _MM_SHUFFLE(2, 3, 0, 1)));
+        maximum = _mm_max_epu8(maximum, _mm_shuffle_epi32(maximum, _MM_SHUFFLE(1, 0, 3, 2)));
+        maximum = _mm_max_epu8(maximum, _mm_shuffle_epi32(maximum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+        minColor = static_cast<uint32_t>(_mm_cvtsi128_si32(minimum));
+        maxColor = static_cast<uint32_t>(_mm_cvtsi128_si32(maximum));
+    }
+#endif
+
+    int32_t minimum[3];
+    int32_t maximum[3];
+
+    for (int channel = 0; channel < 3; channel++)
+    {
+        if (simd)
+        {
+            minimum[channel] = (minColor >> (8 * channel)) & 0xFF;
+            maximum[channel] = (maxColor >> (8 * channel)) & 0xFF;
+            continue;
+        }
+
+        minimum[channel] = 255;
+        maximum[channel] = 0;
+
+        for (uint32_t pixel : block)
+        {
+            int32_t value = (pixel >> (8 * channel)) & 0xFF;
+            minimum[channel] = std::min(minimum[channel], value);
+            maximum[channel] = std::max(maximum[channel], value);
+        }
+    }
+
+    // Pulling the endpoints in by a sixteenth of the range lowers the average error, since few pixels sit at the
+    // very corners of the bounding box.
+    for (int channel = 0; channel < 3; channel++)
+    {
+        int32_t inset = (maximum[channel] - minimum[channel]) >> 4;
+        minimum[channel] += inset;
+        maximum[channel] -= inset;
+    }
+
+    uint16_t color0 = to_565(maximum[0], maximum[1], maximum[2]);
+    uint16_t color1 = to_565(minimum[0], minimum[1], minimum[2]);
+
+    // The four color mode is only used when the first color is the larger one.
+    if (color0 < color1)
+    {
+        std::swap(color0, color1);
+    }
+
+    if (color0 == color1)
+    {
+        return color0 | static_cast<uint64_t>(color1) << 16;
+    }
+
+    int32_t b0, g0, r0, b1, g1, r1;
+    from_565(color0, b0, g0, r0);
+    from_565(color1, b1, g1, r1);
+
+    int32_t db = b0 - b1;
+    int32_t dg = g0 - g1;
+    int32_t dr = r0 - r1;
+
+    // Each pixel is projected onto the line between the endpoints, so 0 is color1 and 3 is color0.
+    float scale = 3.0f / static_cast<float>(db * db + dg * dg + dr * dr);
+    int32_t steps[16];
+
+#ifdef SIMD_SSE2
+    if (simd)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i direction = _mm_setr_epi16(static_cast<short>(db), static_cast<short>(dg), static_cast<short>(dr), 0, static_cast<short>(db), static_cast<short>(dg), static_cast<short>(dr), 0);
+        const __m128i origin = _mm_setr_epi16(static_cast<short>(b1), static_cast<short>(g1), static_cast<short>(r1), 0, static_cast<short>(b1), static_cast<short>(g1), static_cast<short>(r1), 0);
+        const __m128 scale4 = _mm_set1_ps(scale);
+        const __m128 half = _mm_set1_ps(0.5f);
+
+        for (int row = 0; row < 4; row++)
+        {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&block[row * 4]));
+
+            // Each product holds the blue and green terms of one pixel, then the red term, for two pixels.
+            __m128i low = _mm_madd_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(pixels, zero), origin), direction);
+            __m128i high = _mm_madd_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(pixels, zero), origin), direction);
+
+            __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(low), _mm_castsi128_ps(high), _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(low), _mm_castsi128_ps(high), _MM_SHUFFLE(3, 1, 3, 1)));
+            __m128 dot = _mm_cvtepi32_ps(_mm_add_epi32(even, odd));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&steps[row * 4]), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(dot, scale4), half)));
+        }
+
+        return pack_block(color0, color1, steps);
+    }
+#endif
+
+    for (int i = 0; i < 16; i++)
+    {
+        int32_t b = block[i] & 0xFF;
+        int32_t g = (block[i] >> 8) & 0xFF;
+        int32_t r = (block[i] >> 16) & 0xFF;
+        int32_t dot = (b - b1) * db + (g - g1) * dg + (r - r1) * dr;
+
+        steps[i] = static_cast<int32_t>(static_cast<float>(dot) * scale + 0.5f);
+    }
+
+    return pack_block(color0, color1, steps);
+}
+
+uint64_t BlockCompressor::pack_block(uint16_t color0, uint16_t color1, const int32_t (&steps)[16])
+{
+    uint32_t indices = 0;
+
+    for (int i = 0; i < 16; i++)
+    {
+        uint32_t step = static_cast<uint32_t>(std::clamp(steps[i], 0, 3));
+
+        // Steps 3, 2, 1 and 0 select color0, the color two thirds of the way to color0, the color one third of the way
+        // and color1, which BC1 numbers 0, 2, 3 and 1.
+        uint32_t index = (step < 2 ? 1u : 0u) | ((step ^ (step >> 1)) & 1u) << 1;
+        indices |= index << (2 * i);
+    }
+
+    return color0 | static_cast<uint64_t>(color1) << 16 | static_cast<uint64_t>(indices) << 32;
+}
+
+uint16_t BlockCompressor::to_565(int32_t b, int32_t g, int32_t r)
+{
+    return static_cast<uint16_t>((r * 31 + 127) / 255 << 11 | (g * 63 + 127) / 255 << 5 | (b * 31 + 127) / 255);
+}
+
+void BlockCompressor::from_565(uint16_t color, int32_t& b, int32_t& g, int32_t& r)
+{
+    int32_t r5 = color >> 11;
+    int32_t g6 = (color >> 5) & 0x3F;
+    int32_t b5 = color & 0x1F;
+
+    r = r5 << 3 | r5 >> 2;
+    g = g6 << 2 | g6 >> 4;
+    b = b5 << 3 | b5 >> 2;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The purpose of this class is to shrink frames kept in memory to a fixed size, with the BC1 block compression
+// layout used by GPUs. Every 4x4 block of pixels takes 8 bytes, two 5:6:5 colors and a 2-bit index per pixel choosing
+// between them and two colors in between, so a BGRA8 frame becomes 8 times smaller whatever it shows, and any block
+// can be read back without decoding the ones before it. Alpha is dropped, since captured frames are opaque.
+class BlockCompressor {
+public:
+    static constexpr uint32_t blockSize = 4;
+    static constexpr size_t bytesPerBlock = 8;
+
+    // Bytes a frame of the given size takes once compressed.
+    static size_t compressed_size(uint32_t width, uint32_t height);
+
+    /**
+     * Compresses a BGRA8 frame into compressed_size(width, height) bytes. Blocks are stored in rows, left to right.
+     * Blocks overhanging the right or bottom edge repeat the last column or row.
+     * @param rowPitch distance in bytes between the starts of consecutive rows
+     * @param allowSimd uses SSE2 where available. The result is the same either way.
+     */
+    static void compress(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, uint8_t* blocks, bool allowSimd = true);
+
+    /**
+     * Expands compressed blocks back into opaque BGRA8 pixels.
+     * @param allowSimd uses SSE2 for the blocks inside the frame where available. The result is the same either way.
+     */
+    static void decompress(const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* pixels, uint32_t rowPitch, bool allowSimd = true);
+
+private:
+    static uint64_t compress_block(const uint32_t (&block)[16], bool allowSimd);
+
+    static uint16_t to_565(int32_t b, int32_t g, int32_t r);
+    static void from_565(uint16_t color, int32_t& b, int32_t& g, int32_t& r);
+
+    // Packs the 2-bit indices into the block, given each pixel's position between the endpoints from 0 to 3.
+    static uint64_t pack_block(uint16_t color0, uint16_t color1, const int32_t (&steps)[16]);
+};
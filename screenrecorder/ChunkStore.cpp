@@ -0,0 +1,382 @@
+#include "pch.h"
+#include "ChunkStore.h"
+
+namespace
+{
+    constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+    inline uint64_t rotate_left(uint64_t value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    inline uint64_t read64(const uint8_t* data)
+    {
+        uint64_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t read32(const uint8_t* data)
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    inline uint64_t round(uint64_t accumulator, uint64_t input)
+    {
+        accumulator += input * prime2;
+        accumulator = rotate_left(accumulator, 31);
+        return accumulator * prime1;
+    }
+
+    inline uint64_t merge_round(uint64_t hash, uint64_t accumulator)
+    {
+        hash ^= round(0, accumulator);
+        return hash * prime1 + prime4;
+    }
+
+    std::string to_hex(uint64_t value)
+    {
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+
+        return text;
+    }
+}
+
+ChunkStore::ChunkStore(const std::filesystem::path& folder, bool directIo) :
+    m_folder(folder), m_writer(folder.wstring(), directIo)
+{
+    std::filesystem::create_directories(folder);
+}
+
+void ChunkStore::add(std::string_view filename, const uint8_t* data, size_t size)
+{
+    std::string_view extension = filename.substr(std::min(filename.rfind('.'), filename.size()));
+    std::string chunk = chunk_name(hash(data, size), size, extension);
+
+    bool isNew = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_entries.push_back({ std::string(filename), chunk });
+
+        if (m_written.count(chunk) > 0)
+        {
+            m_reusedChunks++;
+        }
+        else if (std::filesystem::exists(m_folder / chunk))
+        {
+            // A chunk taken from the store is touched, so garbage collection running before the manifest is written
+            // sees it as new and leaves it alone.
+            std::error_code error;
+            std::filesystem::last_write_time(m_folder / chunk, std::filesystem::file_time_type::clock::now(), error);
+
+            m_reusedChunks++;
+        }
+        else
+        {
+            std::filesystem::create_directories((m_folder / chunk).parent_path());
+            m_written.insert(chunk);
+            m_newChunks++;
+            m_newBytes += size;
+            isNew = true;
+        }
+    }
+
+    // New chunks are written under a name of their own to this process, so a chunk another recorder is writing at the
+    // same time does not collide with it, and whichever finishes last simply replaces the other's identical bytes.
+    if (isNew)
+    {
+        m_writer.write(chunk + "." + std::to_string(GetCurrentProcessId()) + ".tmp", data, size);
+    }
+}
+
+void ChunkStore::add(std::string_view filename, winrt::Windows::Storage::Streams::IRandomAccessStream const& stream)
+{
+    winrt::Windows::Storage::Streams::Buffer buffer(static_cast<uint32_t>(stream.Size()));
+    stream.Seek(0);
+    stream.ReadAsync(buffer, buffer.Capacity(), winrt::Windows::Storage::Streams::InputStreamOptions::None).get();
+
+    add(filename, buffer.data(), buffer.Length());
+}
+
+void ChunkStore::commit(const std::filesystem::path& saveFolder)
+{
+    m_writer.finish();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::string suffix = "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+
+    for (const auto& chunk : m_written)
+    {
+        std::wstring temporary = (m_folder / (chunk + suffix)).wstring();
+
+        if (!MoveFileExW(temporary.c_str(), (m_folder / chunk).c_str(), MOVEFILE_REPLACE_EXISTING))
+        {
+            winrt::throw_last_error();
+        }
+    }
+
+    m_written.clear();
+
+    // Frames are added by the workers in whatever order they finish, so the manifest is sorted to be the same every time.
+    std::sort(m_entries.begin(), m_entries.end(), [](const auto& a, const auto& b) { return a.filename < b.filename; });
+
+    std::ofstream manifest(saveFolder / manifestFilename, std::ios::out | std::ios::trunc);
+    manifest.exceptions(std::ios::failbit | std::ios::badbit);
+
+    manifest << manifestHeader << "\n";
+    manifest << "store " << m_folder.u8string() << "\n";
+
+    for (const auto& entry : m_entries)
+    {
+        manifest << entry.filename << " " << entry.chunk << "\n";
+    }
+
+    manifest.close();
+
+    // The save registers itself as a root of the store, named after its folder so saving the same folder again
+    // registers it only once.
+    std::filesystem::path absolute = std::filesystem::absolute(saveFolder);
+    std::string folder = absolute.u8string();
+
+    std::filesystem::create_directories(m_folder / "roots");
+
+    std::ofstream root(m_folder / "roots" / (to_hex(hash(reinterpret_cast<const uint8_t*>(folder.data()), folder.size())) + ".root"), std::ios::out | std::ios::trunc);
+    root.exceptions(std::ios::failbit | std::ios::badbit);
+    root << folder << "\n";
+}
+
+uint64_t ChunkStore::hash(const uint8_t* data, size_t size, uint64_t seed)
+{
+    const uint8_t* end = data + size;
+    uint64_t h;
+
+    // Four independent accumulators take 32 bytes per step, so their multiplies overlap in the pipeline.
+    if (size >= 32)
+    {
+        const uint8_t* limit = end - 32;
+        uint64_t v1 = seed + prime1 + prime2;
+        uint64_t v2 = seed + prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - prime1;
+
+        do
+        {
+            v1 = round(v1, read64(data));
+            v2 = round(v2, read64(data + 8));
+            v3 = round(v3, read64(data + 16));
+            v4 = round(v4, read64(data + 24));
+            data += 32;
+        } while (data <= limit);
+
+        h = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12) + rotate_left(v4, 18);
+        h = merge_round(h, v1);
+        h = merge_round(h, v2);
+        h = merge_round(h, v3);
+        h = merge_round(h, v4);
+    }
+    else
+    {
+        h = seed + prime5;
+    }
+
+    h += static_cast<uint64_t>(size);
+
+    for (; data + 8 <= end; data += 8)
+    {
+        h ^= round(0, read64(data));
+        h = rotate_left(h, 27) * prime1 + prime4;
+    }
+
+    if (data + 4 <= end)
+    {
+        h ^= static_cast<uint64_t>(read32(data)) * prime1;
+        h = rotate_left(h, 23) * prime2 + prime3;
+        data += 4;
+    }
+
+    for (; data < end; data++)
+    {
+        h ^= *data * prime5;
+        h = rotate_left(h, 11) * prime1;
+    }
+
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+ChunkStore::GarbageReport ChunkStore::collect_garbage(const std::filesystem::path& store, const std::vector<std::filesystem::path>& extraFolders)
+{
+    GarbageReport report;
+    std::unordered_set<std::string> referenced;
+
+    auto mark = [&referenced](const std::filesystem::path& manifest)
+        {
+            auto [store, entries] = read_manifest(manifest);
+
+            for (auto& entry : entries)
+            {
+                referenced.insert(std::move(entry.chunk));
+            }
+        };
+
+    // A manifest that cannot be read stops the collection, since the chunks it names would otherwise be deleted.
+    std::error_code error;
+
+    for (const auto& root : std::filesystem::directory_iterator(store / "roots", error))
+    {
+        if (root.path().extension() != ".root")
+        {
+            continue;
+        }
+
+        std::ifstream stream(root.path());
+        std::string folder;
+        std::getline(stream, folder);
+
+        std::filesystem::path manifest = std::filesystem::u8path(folder) / manifestFilename;
+
+        if (!folder.empty() && std::filesystem::exists(manifest))
+        {
+            mark(manifest);
+        }
+        else
+        {
+            std::filesystem::remove(root.path());
+            report.droppedRoots++;
+        }
+    }
+
+    for (const auto& folder : extraFolders)
+    {
+        for (const auto& file : std::filesystem::recursive_directory_iterator(folder))
+        {
+            if (file.is_regular_file() && file.path().filename() == manifestFilename)
+            {
+                mark(file.path());
+            }
+        }
+    }
+
+    auto oldest = std::filesystem::file_time_type::clock::now() - gracePeriod;
+
+    for (const auto& folder : std::filesystem::directory_iterator(store))
+    {
+        std::string name = folder.path().filename().u8string();
+
+        // Only the 256 chunk folders are collected, never roots or anything else kept next to them.
+        if (!folder.is_directory() || name.size() != 2 || !isxdigit(static_cast<unsigned char>(name[0])) || !isxdigit(static_cast<unsigned char>(name[1])))
+        {
+            continue;
+        }
+
+        for (const auto& file : std::filesystem::directory_iterator(folder.path()))
+        {
+            if (!file.is_regular_file())
+            {
+                continue;
+            }
+
+            std::string chunk = name + "\\" + file.path().filename().u8string();
+
+            if (file.path().extension() != ".tmp" && referenced.count(chunk) > 0)
+            {
+                report.keptChunks++;
+                continue;
+            }
+
+            if (file.last_write_time() > oldest)
+            {
+                continue;
+            }
+
+            uint64_t size = file.file_size();
+
+            if (std::filesystem::remove(file.path(), error))
+            {
+                report.deletedChunks++;
+                report.deletedBytes += size;
+            }
+        }
+    }
+
+    return report;
+}
+
+size_t ChunkStore::restore(const std::filesystem::path& saveFolder, const std::filesystem::path& outputFolder)
+{
+    auto [store, entries] = read_manifest(saveFolder / manifestFilename);
+
+    std::filesystem::create_directories(outputFolder);
+
+    for (const auto& entry : entries)
+    {
+        std::filesystem::path chunk = store / entry.chunk;
+
+        if (!std::filesystem::exists(chunk))
+        {
+            throw std::runtime_error("\b\tMissing chunk " + entry.chunk + " for " + entry.filename + ".\n");
+        }
+
+        std::filesystem::copy_file(chunk, outputFolder / entry.filename, std::filesystem::copy_options::overwrite_existing);
+    }
+
+    return entries.size();
+}
+
+std::string ChunkStore::chunk_name(uint64_t hash, size_t size, std::string_view extension)
+{
+    std::string hex = to_hex(hash);
+
+    return hex.substr(0, 2) + "\\" + hex + "-" + std::to_string(size) + std::string(extension);
+}
+
+std::pair<std::filesystem::path, std::vector<ChunkStore::ManifestEntry>> ChunkStore::read_manifest(const std::filesystem::path& path)
+{
+    std::ifstream stream(path);
+    std::string line;
+
+    if (!stream || !std::getline(stream, line) || line != manifestHeader)
+    {
+        throw std::runtime_error("\b\t" + path.u8string() + " is not a chunk manifest.\n");
+    }
+
+    const std::string storePrefix = "store ";
+
+    if (!std::getline(stream, line) || line.compare(0, storePrefix.size(), storePrefix) != 0)
+    {
+        throw std::runtime_error("\b\t" + path.u8string() + " names no chunk store.\n");
+    }
+
+    std::filesystem::path store = std::filesystem::u8path(line.substr(storePrefix.size()));
+    std::vector<ManifestEntry> entries;
+
+    while (std::getline(stream, line))
+    {
+        size_t separator = line.find(' ');
+
+        if (separator == std::string::npos)
+        {
+            continue;
+        }
+
+        entries.push_back({ line.substr(0, separator), line.substr(separator + 1) });
+    }
+
+    return { store, entries };
+}
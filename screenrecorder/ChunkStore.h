@@ -0,0 +1,98 @@
+#pragma once
+
+#include "pch.h"
+#include "OutputWriter.h"
+
+// The purpose of this class is to store the files of many saves once, by content. Every encoded frame is a chunk named
+// after the XXH64 hash and size of its bytes, kept in a store folder shared by the saves, and written only if no
+// identical chunk is there already. A save then holds only a manifest naming the chunk of each of its frames, next to
+// its frame index, so saving the same ring again, or a ring that barely changed, writes almost nothing. Each save also
+// registers its folder with the store, and garbage collection deletes the chunks no registered manifest names.
+class ChunkStore {
+public:
+    static constexpr const char* manifestFilename = "frames.manifest";
+    static constexpr const char* manifestHeader = "screenrecorder-chunks 1";
+
+    // Chunks younger than this are never collected, since the save writing them may not have written its manifest yet.
+    static constexpr std::chrono::hours gracePeriod{ 1 };
+
+    struct GarbageReport
+    {
+        size_t keptChunks = 0;
+        size_t deletedChunks = 0;
+        uint64_t deletedBytes = 0;
+        size_t droppedRoots = 0;  // Registered save folders that no longer hold a manifest.
+    };
+
+    /**
+     * @param folder store folder, created if missing
+     * @param directIo writes new chunks around the system file cache
+     * @throws std::filesystem::filesystem_error if the folder cannot be created
+     */
+    ChunkStore(const std::filesystem::path& folder, bool directIo = false);
+
+    /**
+     * Adds a file to the manifest, storing its bytes as a new chunk unless the store already holds them. The bytes
+     * are copied, so they may be reused as soon as this returns. Safe to call from several threads.
+     */
+    void add(std::string_view filename, const uint8_t* data, size_t size);
+
+    // Same, with the whole content of a stream, such as an encoder's in-memory output.
+    void add(std::string_view filename, winrt::Windows::Storage::Streams::IRandomAccessStream const& stream);
+
+    /**
+     * Waits for the new chunks to reach the disk and moves them into place, then writes the manifest into the save
+     * folder and registers the folder with the store. Chunks only appear under their names once complete, so a save
+     * that fails part way never leaves a chunk that a later save would trust.
+     * @throws winrt::hresult_error or std::ios_base::failure if a chunk or the manifest cannot be written
+     */
+    void commit(const std::filesystem::path& saveFolder);
+
+    size_t new_chunks() const { return m_newChunks; }
+    size_t reused_chunks() const { return m_reusedChunks; }
+    uint64_t new_bytes() const { return m_newBytes; }
+
+    // XXH64 of the data, the same value as the reference implementation gives.
+    static uint64_t hash(const uint8_t* data, size_t size, uint64_t seed = 0);
+
+    /**
+     * Deletes the chunks that no manifest of a registered save, or of a save found under the extra folders, names.
+     * Registered saves whose folder no longer holds a manifest are forgotten.
+     * @param extraFolders folders searched for manifests, for saves moved since they were registered
+     */
+    static GarbageReport collect_garbage(const std::filesystem::path& store, const std::vector<std::filesystem::path>& extraFolders);
+
+    /**
+     * Copies the frames of a save out of the store into ordinary files in the output folder, created if missing.
+     * @returns the number of files restored
+     * @throws std::runtime_error if the save holds no manifest or a chunk it names is missing
+     */
+    static size_t restore(const std::filesystem::path& saveFolder, const std::filesystem::path& outputFolder);
+
+private:
+    struct ManifestEntry
+    {
+        std::string filename;
+        std::string chunk;  // Path of the chunk relative to the store.
+    };
+
+    // Chunks are spread over 256 subfolders by the first byte of their hash, named like 3f\3fa2...-183244.jpg.
+    static std::string chunk_name(uint64_t hash, size_t size, std::string_view extension);
+
+    /**
+     * @returns the store folder and entries of a manifest
+     * @throws std::runtime_error if the file is not a manifest
+     */
+    static std::pair<std::filesystem::path, std::vector<ManifestEntry>> read_manifest(const std::filesystem::path& path);
+
+    std::filesystem::path m_folder;
+    OutputWriter m_writer;
+
+    std::mutex m_mutex;
+    std::vector<ManifestEntry> m_entries;
+    std::unordered_set<std::string> m_written;  // Chunks written by this save, still under their temporary names.
+
+    size_t m_newChunks = 0;
+    size_t m_reusedChunks = 0;
+    uint64_t m_newBytes = 0;
+};
@@ -1,34 +1,330 @@
 #include "pch.h"
 #include "CircularFrameBuffer.h"
+#include "FrameIndex.h"
+#include "FrameNameFormatter.h"
+#include "PixelFormat.h"
+#include "ReadbackQueue.h"
+#include "BlockCompressor.h"
+#include "TaskScheduler.h"
 
-CircularFrameBuffer::CircularFrameBuffer(size_t capacity, bool asMegabytes) : m_capacity(capacity), m_asMegabytes(asMegabytes), m_memoryUsage(0)
+CircularFrameBuffer::CircularFrameBuffer(size_t capacity, bool asMegabytes, const FrameEncoder& encoder, FrameStorage storage, bool largePages) : 
+    m_capacity(capacity), m_asMegabytes(asMegabytes), m_encoder(encoder), m_storage(storage), m_largePages(largePages), m_memoryUsage(0)
 {
     if (asMegabytes) 
     {
         m_capacity *= 1000000;
     }
+    else
+    {
+        m_frames.reserve(m_capacity);
+    }
+
+    // The budget is reserved up front, so running out of memory shows up when the recording starts.
+    if (storage != FrameStorage::Texture && asMegabytes)
+    {
+        m_arena = std::make_unique<RingArena>(m_capacity, largePages);
+    }
+}
+
+void CircularFrameBuffer::add_frame(winrt::com_ptr<ID3D11Texture2D> texture, const FrameMetadata& metadata) 
+{
+    Frame frame;
+    frame.texture = texture;
+    frame.size = calculate_frame_size(texture);
+    frame.metadata = metadata;
+
+    push_frame(std::move(frame));
+}
+
+void CircularFrameBuffer::add_delta_frame(winrt::com_ptr<ID3D11Texture2D> atlas, std::vector<Patch> patches, const FrameMetadata& metadata, const ScrollMotion& scroll)
+{
+    if (m_frames.empty())
+    {
+        throw std::logic_error("A delta frame needs a previous frame to apply to.");
+    }
+
+    Frame frame;
+    frame.texture = atlas;
+    frame.size = calculate_frame_size(atlas) + patches.size() * sizeof(Patch);
+    frame.metadata = metadata;
+    frame.isKeyFrame = false;
+    frame.patches = std::move(patches);
+    frame.scroll = scroll;
+
+    push_frame(std::move(frame));
+}
+
+bool CircularFrameBuffer::add_encoded_frame(const uint8_t* data, size_t size, const FrameMetadata& metadata)
+{
+    // Recordings reserve the arena when they start. A buffer filled directly is reserved for its first frame.
+    if (!m_arena)
+    {
+        reserve(metadata.Width, metadata.Height);
+    }
+
+    if (RingArena::record_size(size) > m_arena->capacity())
+    {
+        return false;
+    }
+
+    uint8_t* record = nullptr;
+
+    while ((!m_asMegabytes && m_frames.size() >= m_capacity) || (record = m_arena->allocate(size)) == nullptr)
+    {
+        if (m_frames.empty())
+        {
+            return false;
+        }
+
+        evict_front();
+    }
+
+    memcpy(record, data, size);
+
+    Frame frame;
+    frame.size = RingArena::record_size(size);
+    frame.metadata = metadata;
+    frame.data = record;
+    frame.dataSize = size;
+
+    m_memoryUsage += frame.size;
+    m_frames.push_back(std::move(frame));
+
+    return true;
+}
+
+void CircularFrameBuffer::reserve(uint32_t width, uint32_t height)
+{
+    size_t frameSize = reserved_frame_size(m_storage, width, height);
+
+    // Encoded frames often come out smaller than their share, in which case more of them fit and the slots grow while
+    // the buffer first fills up, but never once it has.
+    if (m_asMegabytes && frameSize > 0)
+    {
+        m_frames.reserve(m_capacity / frameSize + 1);
+    }
+
+    if (m_arena || m_storage == FrameStorage::Texture)
+    {
+        return;
+    }
+
+    // There is always room for one unencoded frame, so no frame is ever too large for a buffer of a few frames.
+    size_t unencodedSize = PixelFormat::SurfaceSize(DXGI_FORMAT_B8G8R8A8_UNORM, width, height);
+
+    m_arena = std::make_unique<RingArena>(std::max(m_capacity * RingArena::record_size(frameSize), RingArena::record_size(unencodedSize)), m_largePages);
+}
+
+size_t CircularFrameBuffer::reserved_frame_size(FrameStorage storage, uint32_t width, uint32_t height)
+{
+    size_t unencodedSize = PixelFormat::SurfaceSize(DXGI_FORMAT_B8G8R8A8_UNORM, width, height);
+
+    // Compressed and packed HDR frames all take the same size, and packed HDR frames as much as unencoded ones.
+    switch (storage)
+    {
+    case FrameStorage::Compressed:
+        return BlockCompressor::compressed_size(width, height);
+    case FrameStorage::Encoded:
+        return unencodedSize / encodedFrameShare;
+    default:
+        return unencodedSize;
+    }
+}
+
+void CircularFrameBuffer::push_frame(Frame&& frame)
+{
+    Frame evicted;
+
+    // Evicting a frame promotes the delta frame after it to a key frame, and the new frame is promoted once it is the
+    // oldest, so the budget is checked again after every eviction with the sizes the promotions left.
+    auto fits = [&]()
+        {
+            return m_asMegabytes ? m_memoryUsage + frame.size <= m_capacity : m_frames.size() < m_capacity;
+        };
+
+    while (!fits() && !m_frames.empty())
+    {
+        evicted = evict_front();
+
+        // The oldest frame must always hold a whole image.
+        if (!frame.isKeyFrame && m_frames.empty())
+        {
+            promote(frame, evicted);
+        }
+    }
+
+    m_memoryUsage += frame.size;
+    m_frames.push_back(std::move(frame));
+}
+
+CircularFrameBuffer::Frame CircularFrameBuffer::evict_front()
+{
+    Frame evicted = std::move(m_frames.front());
+    m_frames.pop_front();
+    m_memoryUsage -= evicted.size;
+
+    // The next tier copies the frame before a following delta is applied to its texture below.
+    if (m_nextTier)
+    {
+        m_nextTier->receive_evicted(evicted);
+    }
+
+    // Encoded frames are added in the same order as their arena records, so the oldest frame owns the oldest record.
+    if (evicted.data)
+    {
+        m_arena->release_oldest();
+    }
+
+    if (!m_frames.empty() && !m_frames.front().isKeyFrame)
+    {
+        Frame& next = m_frames.front();
+
+        m_memoryUsage -= next.size;
+        promote(next, evicted);
+        m_memoryUsage += next.size;
+    }
+
+    return evicted;
+}
+
+void CircularFrameBuffer::promote(Frame& delta, Frame& previous)
+{
+    apply_patches(previous.texture, delta);
+
+    delta.texture = previous.texture;
+    delta.size = previous.size;
+    delta.isKeyFrame = true;
+    delta.patches.clear();
+    delta.scroll = {};
+}
+
+void CircularFrameBuffer::add_tier(size_t capacity, bool asMegabytes, uint32_t intervalSeconds, uint32_t scale)
+{
+    if (m_nextTier)
+    {
+        m_nextTier->add_tier(capacity, asMegabytes, intervalSeconds, scale);
+        return;
+    }
+
+    if (m_storage != FrameStorage::Texture)
+    {
+        throw std::invalid_argument("\b\tRetention tiers need texture storage.\n");
+    }
+
+    if (!TextureScaler::is_valid_scale(scale) || scale < m_scale)
+    {
+        throw std::invalid_argument("\b\tTier scale must be a power of two no smaller than the scale of the tier before it.\n");
+    }
+
+    m_nextTier = std::make_unique<CircularFrameBuffer>(capacity, asMegabytes, m_encoder);
+    m_nextTier->m_tier = m_tier + 1;
+    m_nextTier->m_scale = scale;
+    m_nextTier->m_inputScale = m_scale;
+    m_nextTier->m_interval = static_cast<int64_t>(intervalSeconds) * 10000000;
+}
+
+void CircularFrameBuffer::receive_evicted(const Frame& frame)
+{
+    if (m_lastReceivedTimestamp && frame.metadata.Timestamp - *m_lastReceivedTimestamp < m_interval)
+    {
+        return;
+    }
+
+    m_lastReceivedTimestamp = frame.metadata.Timestamp;
+
+    // The evicted texture may still be reused by the tier before this one, so the tier always keeps its own copy.
+    uint32_t relativeScale = m_scale / m_inputScale;
+    auto texture = relativeScale > 1 ? m_scaler.downscale(frame.texture, relativeScale) : copy_texture(frame.texture, nullptr);
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    texture->GetDesc(&desc);
+
+    FrameMetadata metadata = frame.metadata;
+    metadata.Width = desc.Width;
+    metadata.Height = desc.Height;
+    metadata.CursorX /= static_cast<int32_t>(relativeScale);
+    metadata.CursorY /= static_cast<int32_t>(relativeScale);
+    metadata.StoredBytes = static_cast<uint32_t>(calculate_frame_size(texture));
+    metadata.Tier = m_tier;
+
+    add_frame(texture, metadata);
+}
+
+void CircularFrameBuffer::apply_patches(winrt::com_ptr<ID3D11Texture2D> target, const Frame& delta)
+{
+    DirtyRect source = delta.scroll.Source();
+    bool scrolled = !delta.scroll.IsNone() && source.Width() > 0 && source.Height() > 0;
+
+    if (delta.patches.empty() && !scrolled)
+    {
+        return;
+    }
+
+    winrt::com_ptr<ID3D11Device> device;
+    target->GetDevice(device.put());
+
+    winrt::com_ptr<ID3D11DeviceContext> context;
+    device->GetImmediateContext(context.put());
+
+    // A texture cannot be copied onto an overlapping part of itself, so the moved part goes through a scratch texture.
+    if (scrolled)
+    {
+        D3D11_TEXTURE2D_DESC desc = {};
+        target->GetDesc(&desc);
+
+        desc.Width = source.Width();
+        desc.Height = source.Height();
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+
+        winrt::com_ptr<ID3D11Texture2D> scratch;
+        winrt::check_hresult(device->CreateTexture2D(&desc, nullptr, scratch.put()));
+
+        D3D11_BOX box = { source.Left, source.Top, 0, source.Right, source.Bottom, 1 };
+        context->CopySubresourceRegion(scratch.get(), 0, 0, 0, 0, target.get(), 0, &box);
+        context->CopySubresourceRegion(target.get(), 0, source.Left + delta.scroll.DeltaX, source.Top + delta.scroll.DeltaY, 0, scratch.get(), 0, nullptr);
+    }
+
+    for (const auto& patch : delta.patches)
+    {
+        D3D11_BOX box = { 0, patch.atlasY, 0, patch.rect.Width(), patch.atlasY + patch.rect.Height(), 1 };
+        context->CopySubresourceRegion(target.get(), 0, patch.rect.Left, patch.rect.Top, 0, delta.texture.get(), 0, &box);
+    }
 }
 
-void CircularFrameBuffer::add_frame(winrt::com_ptr<ID3D11Texture2D> texture, const std::string& filename) 
+winrt::com_ptr<ID3D11Texture2D> CircularFrameBuffer::copy_texture(winrt::com_ptr<ID3D11Texture2D> source, winrt::com_ptr<ID3D11Texture2D> destination)
 {
-    size_t frame_size = calculate_frame_size(texture);
+    D3D11_TEXTURE2D_DESC sourceDesc = {};
+    source->GetDesc(&sourceDesc);
+
+    winrt::com_ptr<ID3D11Device> device;
+    source->GetDevice(device.put());
 
-    if (m_asMegabytes) 
+    if (destination)
     {
-        while (m_memoryUsage + frame_size > m_capacity && !m_frames.empty()) 
+        D3D11_TEXTURE2D_DESC destinationDesc = {};
+        destination->GetDesc(&destinationDesc);
+
+        if (destinationDesc.Width != sourceDesc.Width || destinationDesc.Height != sourceDesc.Height || destinationDesc.Format != sourceDesc.Format)
         {
-            m_memoryUsage -= m_frames.front().size;
-            m_frames.pop_front();
+            destination = nullptr;
         }
     }
-    else if (m_frames.size() == m_capacity)
+
+    if (!destination)
     {
-        m_memoryUsage -= m_frames.front().size;
-        m_frames.pop_front();
+        winrt::check_hresult(device->CreateTexture2D(&sourceDesc, nullptr, destination.put()));
     }
 
-    m_frames.push_back({ texture, filename, frame_size });
-    m_memoryUsage += frame_size;
+    winrt::com_ptr<ID3D11DeviceContext> context;
+    device->GetImmediateContext(context.put());
+    context->CopyResource(destination.get(), source.get());
+
+    return destination;
 }
 
 size_t CircularFrameBuffer::calculate_frame_size(winrt::com_ptr<ID3D11Texture2D> texture) 
@@ -39,79 +335,406 @@ size_t CircularFrameBuffer::calculate_frame_size(winrt::com_ptr<ID3D11Texture2D>
     D3D11_TEXTURE2D_DESC desc;
     texture->GetDesc(&desc);
 
-    UINT bpp = 0;
-    switch (desc.Format)
-    {
-    case DXGI_FORMAT_R32G32B32A32_FLOAT:
-    case DXGI_FORMAT_R32G32B32A32_UINT:
-    case DXGI_FORMAT_R32G32B32A32_SINT:
-        bpp = 128;
-        break;
-    case DXGI_FORMAT_R32G32B32_FLOAT:
-    case DXGI_FORMAT_R32G32B32_UINT:
-    case DXGI_FORMAT_R32G32B32_SINT:
-        bpp = 96;
-        break;
-    case DXGI_FORMAT_R16G16B16A16_FLOAT:
-    case DXGI_FORMAT_R16G16B16A16_UNORM:
-    case DXGI_FORMAT_R16G16B16A16_UINT:
-    case DXGI_FORMAT_R16G16B16A16_SNORM:
-    case DXGI_FORMAT_R16G16B16A16_SINT:
-    case DXGI_FORMAT_R32G32_FLOAT:
-    case DXGI_FORMAT_R32G32_UINT:
-    case DXGI_FORMAT_R32G32_SINT:
-        bpp = 64;
-        break;
-    case DXGI_FORMAT_R10G10B10A2_UNORM:
-    case DXGI_FORMAT_R10G10B10A2_UINT:
-    case DXGI_FORMAT_R11G11B10_FLOAT:
-    case DXGI_FORMAT_R8G8B8A8_UNORM:
-    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
-    case DXGI_FORMAT_R8G8B8A8_UINT:
-    case DXGI_FORMAT_R8G8B8A8_SNORM:
-    case DXGI_FORMAT_R8G8B8A8_SINT:
-    case DXGI_FORMAT_B8G8R8A8_UNORM:
-    case DXGI_FORMAT_B8G8R8X8_UNORM:
-    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
-    case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
-    case DXGI_FORMAT_R16G16_FLOAT:
-    case DXGI_FORMAT_R16G16_UNORM:
-    case DXGI_FORMAT_R16G16_UINT:
-    case DXGI_FORMAT_R16G16_SNORM:
-    case DXGI_FORMAT_R16G16_SINT:
-        bpp = 32;
-        break;
-    }
-
-    size_t size = desc.Width * desc.Height * bpp / 8;
-
-    return size;
+    // The capture format is checked when the recording starts, and every other texture is made in a listed format.
+    return PixelFormat::SurfaceSize(desc.Format, desc.Width, desc.Height) * desc.ArraySize;
+}
+
+void CircularFrameBuffer::write_frame_file(OutputWriter& writer, ChunkStore* chunks, const FrameMetadata& metadata, const uint8_t* data, size_t size) const
+{
+    char filename[FrameNameFormatter::maxLength];
+    size_t filenameLength = FrameNameFormatter::Format(metadata.Timestamp, m_encoder.file_extension(), filename);
+
+    if (chunks)
+    {
+        chunks->add(std::string_view(filename, filenameLength), data, size);
+    }
+    else
+    {
+        writer.write(std::string_view(filename, filenameLength), data, size);
+    }
+}
+
+void CircularFrameBuffer::write_frame_file(OutputWriter& writer, ChunkStore* chunks, const FrameMetadata& metadata, winrt::Windows::Storage::Streams::IRandomAccessStream const& stream) const
+{
+    char filename[FrameNameFormatter::maxLength];
+    size_t filenameLength = FrameNameFormatter::Format(metadata.Timestamp, m_encoder.file_extension(), filename);
+
+    if (chunks)
+    {
+        chunks->add(std::string_view(filename, filenameLength), stream);
+    }
+    else
+    {
+        writer.write(std::string_view(filename, filenameLength), stream);
+    }
+}
+
+std::vector<const CircularFrameBuffer*> CircularFrameBuffer::tiers_oldest_first() const
+{
+    std::vector<const CircularFrameBuffer*> tiers;
+
+    for (const CircularFrameBuffer* tier = this; tier; tier = tier->m_nextTier.get())
+    {
+        tiers.push_back(tier);
+    }
+
+    std::reverse(tiers.begin(), tiers.end());
+
+    return tiers;
+}
+
+std::unique_ptr<CircularFrameBuffer> CircularFrameBuffer::copy_range(int64_t from, int64_t to, size_t stride) const
+{
+    if (stride == 0)
+    {
+        throw std::invalid_argument("\b\tStride must be at least 1.\n");
+    }
+
+    auto arrivedBefore = [](const Frame& frame, int64_t qpc) { return frame.metadata.Qpc < qpc; };
+    auto arrivedAfter = [](int64_t qpc, const Frame& frame) { return qpc < frame.metadata.Qpc; };
+
+    std::vector<Selection> selection;
+
+    // Offset of the next kept frame from the start of the next tier's range, so the stride carries across tiers.
+    size_t skip = 0;
+
+    for (const CircularFrameBuffer* tier : tiers_oldest_first())
+    {
+        const auto& frames = tier->m_frames;
+        size_t first = std::lower_bound(frames.begin(), frames.end(), from, arrivedBefore) - frames.begin();
+        size_t last = std::upper_bound(frames.begin(), frames.end(), to, arrivedAfter) - frames.begin();
+
+        if (first >= last)
+        {
+            continue;
+        }
+
+        size_t index = first + skip;
+
+        for (; index < last; index += stride)
+        {
+            selection.push_back({ tier, index });
+        }
+
+        skip = index - last;
+    }
+
+    return copy_selection(selection);
+}
+
+std::unique_ptr<CircularFrameBuffer> CircularFrameBuffer::copy_nearest(int64_t qpc) const
+{
+    auto arrivedBefore = [](const Frame& frame, int64_t time) { return frame.metadata.Qpc < time; };
+
+    std::vector<Selection> selection;
+    std::optional<uint64_t> bestDistance;
+
+    auto consider = [&](const CircularFrameBuffer* tier, size_t index)
+    {
+        int64_t frameQpc = tier->m_frames[index].metadata.Qpc;
+        uint64_t distance = frameQpc < qpc ? static_cast<uint64_t>(qpc) - frameQpc : static_cast<uint64_t>(frameQpc) - qpc;
+
+        if (!bestDistance || distance < *bestDistance)
+        {
+            bestDistance = distance;
+            selection = { { tier, index } };
+        }
+    };
+
+    // The nearest frame of a tier is either the first one at or after the time, or the one before it.
+    for (const CircularFrameBuffer* tier : tiers_oldest_first())
+    {
+        const auto& frames = tier->m_frames;
+        size_t index = std::lower_bound(frames.begin(), frames.end(), qpc, arrivedBefore) - frames.begin();
+
+        if (index < frames.size())
+        {
+            consider(tier, index);
+        }
+
+        if (index > 0)
+        {
+            consider(tier, index - 1);
+        }
+    }
+
+    return copy_selection(selection);
+}
+
+std::unique_ptr<CircularFrameBuffer> CircularFrameBuffer::copy_selection(const std::vector<Selection>& selection) const
+{
+    auto copy = std::make_unique<CircularFrameBuffer>(selection.size(), false, m_encoder, m_storage);
+    copy->m_cursorCache = m_cursorCache;
+    copy->m_whiteLevel = m_whiteLevel;
+    copy->m_directIo = m_directIo;
+    copy->m_chunkStore = m_chunkStore;
+
+    if (m_storage != FrameStorage::Texture)
+    {
+        size_t size = 0;
+
+        for (const auto& selected : selection)
+        {
+            size += selected.tier->m_frames[selected.index].size;
+        }
+
+        // Sized to hold exactly the selected records, rather than a whole buffer's worth of unencoded frames.
+        copy->m_arena = std::make_unique<RingArena>(size);
+
+        for (const auto& selected : selection)
+        {
+            const Frame& frame = selected.tier->m_frames[selected.index];
+            copy->add_encoded_frame(frame.data, frame.dataSize, frame.metadata);
+        }
+
+        return copy;
+    }
+
+    // Stored textures are reused when frames are evicted, so the copy gets textures of its own.
+    winrt::com_ptr<ID3D11Texture2D> working;
+    std::optional<size_t> workingIndex;
+    const CircularFrameBuffer* workingTier = nullptr;
+
+    for (const auto& selected : selection)
+    {
+        const Frame& frame = selected.tier->m_frames[selected.index];
+
+        if (frame.isKeyFrame)
+        {
+            copy->add_frame(copy_texture(frame.texture, nullptr), frame.metadata);
+            continue;
+        }
+
+        if (selected.tier != workingTier)
+        {
+            workingIndex.reset();
+            workingTier = selected.tier;
+        }
+
+        selected.tier->rebuild_frame(selected.index, working, workingIndex);
+        copy->add_frame(copy_texture(working, nullptr), frame.metadata);
+    }
+
+    return copy;
+}
+
+void CircularFrameBuffer::rebuild_frame(size_t index, winrt::com_ptr<ID3D11Texture2D>& working, std::optional<size_t>& workingIndex) const
+{
+    // The oldest frame is always a key frame, and key frames are stored at least every so many frames, so this walk
+    // is short.
+    size_t keyIndex = index;
+
+    while (!m_frames[keyIndex].isKeyFrame)
+    {
+        keyIndex--;
+    }
+
+    size_t next = keyIndex + 1;
+
+    if (workingIndex && *workingIndex >= keyIndex && *workingIndex <= index)
+    {
+        next = *workingIndex + 1;
+    }
+    else
+    {
+        working = copy_texture(m_frames[keyIndex].texture, working);
+    }
+
+    for (; next <= index; next++)
+    {
+        apply_patches(working, m_frames[next]);
+    }
+
+    workingIndex = index;
 }
 
 void CircularFrameBuffer::save_frames(winrt::Windows::Storage::StorageFolder storageFolder) 
 {
+    std::vector<FrameMetadata> records;
+    records.reserve(m_frames.size());
+
+    // Saving yields the workers to capture and live encoding, even when a recording is exported while it runs.
+    TaskScheduler::LaneScope lane(TaskLane::BulkSave);
+
+    OutputWriter writer(storageFolder.Path().c_str(), m_directIo);
+    std::unique_ptr<ChunkStore> chunks;
+
+    if (!m_chunkStore.empty())
+    {
+        chunks = std::make_unique<ChunkStore>(std::filesystem::u8path(m_chunkStore), m_directIo);
+    }
+
+    save_tier(writer, chunks.get(), records);
+    writer.finish();
+
+    // The manifest is written once every new chunk is in place, so it never names a chunk that is not there yet.
+    if (chunks)
+    {
+        chunks->commit(storageFolder.Path().c_str());
+    }
+
+    FrameIndex::Write(winrt::to_string(storageFolder.Path()) + "\\" + FrameIndex::filename, records);
+}
+
+void CircularFrameBuffer::save_tier(OutputWriter& writer, ChunkStore* chunks, std::vector<FrameMetadata>& records)
+{
+    // Every frame of a tier is older than the frames of the tier before it, so the last tier is saved first.
+    if (m_nextTier)
+    {
+        m_nextTier->save_tier(writer, chunks, records);
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    // Compressed frames are expanded on the CPU, so they need no readback either, and every frame is expanded, encoded
+    // and written on its own.
+    if (m_storage == FrameStorage::Compressed)
+    {
+        std::vector<FrameMetadata> tierRecords(m_frames.size());
+
+        TaskScheduler::shared().parallel_for(static_cast<uint32_t>(m_frames.size()), [&](uint32_t i)
+            {
+                const Frame& frame = m_frames[i];
+
+                std::vector<uint8_t> pixels(static_cast<size_t>(frame.metadata.Width) * frame.metadata.Height * 4);
+                BlockCompressor::decompress(frame.data, frame.metadata.Width, frame.metadata.Height, pixels.data(), frame.metadata.Width * 4);
+
+                winrt::Windows::Storage::Streams::InMemoryRandomAccessStream stream;
+
+                LARGE_INTEGER encodeStart, encodeEnd;
+                QueryPerformanceCounter(&encodeStart);
+
+                m_encoder.encode(pixels.data(), frame.metadata.Width, frame.metadata.Height, frame.metadata.Width * 4, stream);
+
+                QueryPerformanceCounter(&encodeEnd);
+
+                write_frame_file(writer, chunks, frame.metadata, stream);
+
+                tierRecords[i] = frame.metadata;
+                tierRecords[i].EncodeTime = static_cast<uint32_t>((encodeEnd.QuadPart - encodeStart.QuadPart) * 1000000 / frequency.QuadPart);
+            });
+
+        records.insert(records.end(), tierRecords.begin(), tierRecords.end());
+
+        return;
+    }
+
+    // HDR frames are tone mapped on the CPU and get their cursor drawn afterwards, since it is drawn in 8-bit.
+    if (m_storage == FrameStorage::Hdr)
+    {
+        std::vector<FrameMetadata> tierRecords(m_frames.size());
+
+        TaskScheduler::shared().parallel_for(static_cast<uint32_t>(m_frames.size()), [&](uint32_t i)
+            {
+                const Frame& frame = m_frames[i];
+                uint32_t width = frame.metadata.Width;
+                uint32_t height = frame.metadata.Height;
+
+                std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+
+                winrt::Windows::Storage::Streams::InMemoryRandomAccessStream stream;
+
+                LARGE_INTEGER encodeStart, encodeEnd;
+                QueryPerformanceCounter(&encodeStart);
+
+                ToneMapper::tone_map(frame.data, width, height, m_whiteLevel, pixels.data(), width * 4);
+
+                if (frame.metadata.CursorShape != CursorCache::noCursor)
+                {
+                    m_cursorCache.composite(frame.metadata.CursorShape, frame.metadata.CursorX, frame.metadata.CursorY, pixels.data(), width, height, width * 4);
+                }
+
+                m_encoder.encode(pixels.data(), width, height, width * 4, stream);
+
+                QueryPerformanceCounter(&encodeEnd);
+
+                write_frame_file(writer, chunks, frame.metadata, stream);
+
+                tierRecords[i] = frame.metadata;
+                tierRecords[i].EncodeTime = static_cast<uint32_t>((encodeEnd.QuadPart - encodeStart.QuadPart) * 1000000 / frequency.QuadPart);
+            });
+
+        records.insert(records.end(), tierRecords.begin(), tierRecords.end());
+
+        return;
+    }
+
+    // Encoded frames were encoded when they were captured, so they only need writing out. The writer keeps several
+    // writes in flight by itself.
+    if (m_frames.empty() || m_storage == FrameStorage::Encoded)
+    {
+        for (const auto& frame : m_frames)
+        {
+            write_frame_file(writer, chunks, frame.metadata, frame.data, frame.dataSize);
+            records.push_back(frame.metadata);
+        }
+
+        return;
+    }
+
+    winrt::com_ptr<ID3D11Device> device;
+    m_frames.front().texture->GetDevice(device.put());
+
+    // Frames are copied to the CPU a few at a time ahead of the one being encoded, so the encoder rarely waits on the GPU.
+    ReadbackQueue readback(device, readbackDepth);
+
+    // Delta frames are rebuilt on a private copy of the latest key frame, so the stored textures are left untouched.
+    // A frame's copy is queued before the next delta changes the working frame, so the copy still sees this frame.
+    winrt::com_ptr<ID3D11Texture2D> keyFrame;
+    winrt::com_ptr<ID3D11Texture2D> workingFrame;
+    bool workingFrameCurrent = false;
+    size_t submitted = 0;
+
     for (const auto& frame : m_frames) 
     {
-        auto file = storageFolder.CreateFileAsync(winrt::to_hstring(frame.filename), winrt::Windows::Storage::CreationCollisionOption::ReplaceExisting).get();
+        while (submitted < m_frames.size() && !readback.full())
+        {
+            const Frame& next = m_frames[submitted++];
 
-        // Get the file stream
-        auto stream = file.OpenAsync(winrt::Windows::Storage::FileAccessMode::ReadWrite).get();
+            if (next.isKeyFrame)
+            {
+                keyFrame = next.texture;
+                workingFrameCurrent = false;
+                readback.submit(keyFrame);
+            }
+            else
+            {
+                if (!workingFrameCurrent)
+                {
+                    workingFrame = copy_texture(keyFrame, workingFrame);
+                    workingFrameCurrent = true;
+                }
 
-        // Initialize the encoder
-        auto encoder = winrt::Windows::Graphics::Imaging::BitmapEncoder::CreateAsync(winrt::Windows::Graphics::Imaging::BitmapEncoder::JpegEncoderId(), stream).get();
+                apply_patches(workingFrame, next);
+                readback.submit(workingFrame);
+            }
+        }
 
-        // Encode the image
-        D3D11_TEXTURE2D_DESC desc = {};
-        frame.texture->GetDesc(&desc);
-        auto bytes = util::CopyBytesFromTexture(frame.texture);
-        encoder.SetPixelData(
-            winrt::Windows::Graphics::Imaging::BitmapPixelFormat::Bgra8,
-            winrt::Windows::Graphics::Imaging::BitmapAlphaMode::Premultiplied,
-            desc.Width,
-            desc.Height,
-            1.0,
-            1.0,
-            bytes);
-        encoder.FlushAsync().get();
+        // Frames are encoded into memory and handed to the writer, which writes them while the next one is encoded.
+        winrt::Windows::Storage::Streams::InMemoryRandomAccessStream stream;
+
+        LARGE_INTEGER encodeStart, encodeEnd;
+
+        // Encode the image straight from the mapped staging texture
+        readback.read_oldest([&](uint8_t* pixels, uint32_t rowPitch, const D3D11_TEXTURE2D_DESC& desc)
+            {
+                QueryPerformanceCounter(&encodeStart);
+
+                if (frame.metadata.CursorShape != CursorCache::noCursor)
+                {
+                    m_cursorCache.composite(frame.metadata.CursorShape, frame.metadata.CursorX, frame.metadata.CursorY, pixels, desc.Width, desc.Height, rowPitch);
+                }
+
+                m_encoder.encode(pixels, desc.Width, desc.Height, rowPitch, stream);
+
+                QueryPerformanceCounter(&encodeEnd);
+            });
+
+        write_frame_file(writer, chunks, frame.metadata, stream);
+
+        FrameMetadata record = frame.metadata;
+        record.EncodeTime = static_cast<uint32_t>((encodeEnd.QuadPart - encodeStart.QuadPart) * 1000000 / frequency.QuadPart);
+        records.push_back(record);
     }
 }
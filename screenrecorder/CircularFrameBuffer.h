@@ -1,31 +1,186 @@
 #pragma once
 
 #include "pch.h"
+#include "FrameMetadata.h"
+#include "FrameEncoder.h"
+#include "DirtyRegions.h"
+#include "CursorCache.h"
+#include "RingArena.h"
+#include "RingQueue.h"
+#include "RecordingOptions.h"
+#include "TextureScaler.h"
+#include "ToneMapper.h"
+#include "OutputWriter.h"
+#include "ChunkStore.h"
 
 namespace util
 {
     using namespace robmikh::common::uwp;
 }
 
+// The purpose of this class is to hold the most recent frames of a recording, up to a number of frames or megabytes.
+// Frames are either key frames, which hold the whole image, or delta frames, which hold only the regions that changed
+// since the previous frame, packed on top of each other in an atlas texture. A delta frame may also move part of the
+// previous frame before its regions are applied, so a frame that scrolled only holds the band that scrolled into
+// view. Full images are rebuilt from the deltas when the frames are saved.
 class CircularFrameBuffer {
 public:
+    struct Patch {
+        DirtyRect rect;
+        uint32_t atlasY;  // Row of the atlas at which the region starts. Every region starts at column 0.
+    };
+
     struct Frame {
         winrt::com_ptr<ID3D11Texture2D> texture;
-        std::string filename;
         size_t size;
+        FrameMetadata metadata;
+        bool isKeyFrame = true;
+        std::vector<Patch> patches;
+        ScrollMotion scroll;            // Applied to the previous frame before the patches.
+        const uint8_t* data = nullptr;  // Encoded image or compressed blocks held in the arena, instead of a texture.
+        size_t dataSize = 0;
     };
 
-    CircularFrameBuffer(size_t capacity, bool asMegabytes);
+    // Number of frames read back from the GPU ahead of the frame being encoded when saving.
+    static const size_t readbackDepth = 3;
+
+    // Encoded frames of a buffer sized in frames are given this share of an unencoded frame each. Screen content
+    // encodes to far less, and a run of larger frames only evicts the oldest frames before the count is reached.
+    static const size_t encodedFrameShare = 4;
+
+    CircularFrameBuffer(size_t capacity, bool asMegabytes, const FrameEncoder& encoder = FrameEncoder(), FrameStorage storage = FrameStorage::Texture, bool largePages = false);
+
+    void add_frame(winrt::com_ptr<ID3D11Texture2D> texture, const FrameMetadata& metadata);
+
+    /**
+     * Adds a frame that differs from the previous one only in the given patches, once part of the previous one is
+     * moved by the scroll. The atlas may be null if there are no patches.
+     * @throws std::logic_error if the buffer holds no frame to apply the patches to
+     */
+    void add_delta_frame(winrt::com_ptr<ID3D11Texture2D> atlas, std::vector<Patch> patches, const FrameMetadata& metadata, const ScrollMotion& scroll = {});
+    /**
+     * Adds a frame that has already been encoded with encoder(), or block compressed, copying it into the arena. Used
+     * with encoded and compressed storage.
+     * @returns false if the frame is larger than the whole buffer and was dropped
+     */
+    bool add_encoded_frame(const uint8_t* data, size_t size, const FrameMetadata& metadata);
+
+    /**
+     * Reserves the arena of a buffer with encoded or compressed storage sized in frames, for frames of the given size,
+     * so running out of memory shows up when the recording starts instead of on its first frame. Buffers sized in
+     * megabytes reserve their arena when they are created, and texture storage needs none. Buffers sized in megabytes
+     * also reserve slots for as many frames of the given size as they hold.
+     * @throws std::bad_alloc if the memory cannot be reserved
+     */
+    void reserve(uint32_t width, uint32_t height);
 
-    void add_frame(winrt::com_ptr<ID3D11Texture2D> texture, const std::string& filename);
+    // Bytes reserved for each frame of a buffer sized in frames, with the given storage.
+    static size_t reserved_frame_size(FrameStorage storage, uint32_t width, uint32_t height);
+
+    /**
+     * Adds a retention tier after the last one. Frames evicted from the last tier are passed on to the new tier,
+     * which keeps one at most every intervalSeconds, shrunk to 1/scale of the captured size.
+     * @throws std::invalid_argument if the buffer uses encoded storage or scale is not a power of two at least as
+     * large as the scale of the tier before it
+     */
+    void add_tier(size_t capacity, bool asMegabytes, uint32_t intervalSeconds, uint32_t scale);
+
+    /**
+     * Copies the frames of every tier that arrived between the given QueryPerformanceCounter values, inclusive,
+     * keeping every stride-th of them. Frames are found by binary search and delta frames are rebuilt from the key
+     * frame before them, so the cost depends on the number of frames copied rather than on the size of the buffer.
+     * @returns a buffer without tiers, holding only whole frames, that can be saved without holding up this one
+     */
+    std::unique_ptr<CircularFrameBuffer> copy_range(int64_t from, int64_t to, size_t stride) const;
+
+    // Copies the frame of any tier that arrived closest to the given QueryPerformanceCounter value, if there is one.
+    std::unique_ptr<CircularFrameBuffer> copy_nearest(int64_t qpc) const;
+
+    // Saves the frames of every tier, oldest first, with a single frame index. Files are written by an OutputWriter,
+    // so writing overlaps encoding, and are flushed to disk together before the index is written. With a chunk store,
+    // the frames go into the store instead and the folder gets a manifest naming them.
     void save_frames(winrt::Windows::Storage::StorageFolder storageFolder);
 
+    const FrameEncoder& encoder() const { return m_encoder; }
+    FrameStorage storage() const { return m_storage; }
+    CursorCache& cursor_cache() { return m_cursorCache; }
+
+    // scRGB value HDR frames are tone mapped to white when they are saved, usually the SDR white level of the display.
+    float white_level() const { return m_whiteLevel; }
+    void set_white_level(float whiteLevel) { m_whiteLevel = whiteLevel; }
+
+    // Whether saved files are written around the system file cache.
+    bool direct_io() const { return m_directIo; }
+    void set_direct_io(bool directIo) { m_directIo = directIo; }
+
+    // Folder of the chunk store saved frames are kept in, or empty to write them into the save folder.
+    const std::string& chunk_store() const { return m_chunkStore; }
+    void set_chunk_store(const std::string& chunkStore) { m_chunkStore = chunkStore; }
+
+    size_t frame_count() const { return m_frames.size(); }
+
+    // Frame of this tier at the given position, oldest first.
+    const Frame& frame(size_t index) const { return m_frames[index]; }
+    size_t memory_usage() const { return m_memoryUsage; }
+
+    static size_t calculate_frame_size(winrt::com_ptr<ID3D11Texture2D> texture);
+
 private:
-    size_t calculate_frame_size(winrt::com_ptr<ID3D11Texture2D> texture);
+    void push_frame(Frame&& frame);
+    Frame evict_front();
+    void receive_evicted(const Frame& frame);
+    void save_tier(OutputWriter& writer, ChunkStore* chunks, std::vector<FrameMetadata>& records);
+
+    struct Selection {
+        const CircularFrameBuffer* tier;
+        size_t index;
+    };
+
+    // Lists the tiers, the last one first, so that their frames run from oldest to newest.
+    std::vector<const CircularFrameBuffer*> tiers_oldest_first() const;
+    std::unique_ptr<CircularFrameBuffer> copy_selection(const std::vector<Selection>& selection) const;
+
+    // Rebuilds the frame at the given index into the working texture, starting from the frame already rebuilt there
+    // when no key frame lies in between.
+    void rebuild_frame(size_t index, winrt::com_ptr<ID3D11Texture2D>& working, std::optional<size_t>& workingIndex) const;
+
+    // Turns a delta frame into a key frame by applying its patches to the texture of the key frame before it.
+    static void promote(Frame& delta, Frame& previous);
+
+    // Writes an encoded frame to a file named after its timestamp, or adds it to the chunk store under that name.
+    void write_frame_file(OutputWriter& writer, ChunkStore* chunks, const FrameMetadata& metadata, const uint8_t* data, size_t size) const;
+    void write_frame_file(OutputWriter& writer, ChunkStore* chunks, const FrameMetadata& metadata, winrt::Windows::Storage::Streams::IRandomAccessStream const& stream) const;
+
+    // Moves the scrolled part of the target and copies the patches of the delta over it.
+    static void apply_patches(winrt::com_ptr<ID3D11Texture2D> target, const Frame& delta);
+
+    // Copies the source into the destination, creating a new destination if it is null or of a different size.
+    static winrt::com_ptr<ID3D11Texture2D> copy_texture(winrt::com_ptr<ID3D11Texture2D> source, winrt::com_ptr<ID3D11Texture2D> destination);
 
     size_t m_capacity;
     bool m_asMegabytes;
+    FrameEncoder m_encoder;
+    CursorCache m_cursorCache;
+    FrameStorage m_storage;
+    bool m_largePages;
+    float m_whiteLevel = ToneMapper::referenceWhiteLevel;
+    bool m_directIo = false;
+    std::string m_chunkStore;
+    std::unique_ptr<RingArena> m_arena;
+
+    // Retention tiers form a chain, each tier owning the next one.
+    std::unique_ptr<CircularFrameBuffer> m_nextTier;
+    uint32_t m_tier = 0;
+    uint32_t m_scale = 1;
+    uint32_t m_inputScale = 1;  // Scale of the frames passed on from the tier before this one.
+    int64_t m_interval = 0;     // In 100ns ticks, like the frame timestamps.
+    std::optional<int64_t> m_lastReceivedTimestamp;
+    TextureScaler m_scaler;
 
     size_t m_memoryUsage;
-    std::deque<Frame> m_frames;
+
+    // The slots of a buffer sized in frames are allocated when it is created, and those of a buffer sized in megabytes
+    // by reserve() for as many frames as it holds at the recording's size, so once the buffer has filled up, storing a
+    // frame allocates nothing.
+    RingQueue<Frame> m_frames;
 };
@@ -7,11 +7,13 @@
 
 class Client {
 public:
+    Client(const std::wstring& pipeName = L"myPipe") : m_pipeName(pipeName) {}
+
     bool try_connect();
-    bool try_connect(int retries);
 
     Response send(Request& request) const;
 
 private:
+    std::wstring m_pipeName;
     Pipe m_pipe;
 };
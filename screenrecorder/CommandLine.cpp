@@ -5,8 +5,36 @@ std::map<std::string, CommandType> map = { {"-start", CommandType::Start},
 	{"-stop", CommandType::Stop}, 
 	{"-cancel", CommandType::Cancel}, 
 	{"-newserver", CommandType::NewServer},
+	{"-export", CommandType::Export},
+	{"-exportindex", CommandType::ExportIndex},
+	{"-framebus", CommandType::FrameBus},
+	{"-decode", CommandType::Decode},
+	{"-qualitycurve", CommandType::QualityCurve},
+	{"-chunkgc", CommandType::ChunkGc},
+	{"-chunkrestore", CommandType::ChunkRestore},
+	{"-benchmark", CommandType::Benchmark},
 	{"-help", CommandType::Help} };
 
+std::string CommandLine::ParseSessionName(const char* arg)
+{
+	std::string session = arg;
+
+	if (session.empty() || session.size() > 64)
+	{
+		throw std::invalid_argument("Syntax error parsing args.");
+	}
+
+	for (char c : session)
+	{
+		if (!isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_')
+		{
+			throw std::invalid_argument("Syntax error parsing args.");
+		}
+	}
+
+	return session;
+}
+
 CommandType CommandLine::GetCommandType() const
 {
 	if (m_argc < 2) 
@@ -27,13 +55,10 @@ CommandType CommandLine::GetCommandType() const
 	}
 }
 
-void CommandLine::GetStartArgs(int& framerate, int& monitor, int& bufferSize, bool& isMegabytes) const
+void CommandLine::GetStartArgs(RecordingOptions& options) const
 {
 	int i = 2;
-	framerate = 1;
-	monitor = 0;
-	bufferSize = 100;
-	isMegabytes = true;
+	options = RecordingOptions();
 
 	while (i < m_argc) 
 	{
@@ -46,7 +71,7 @@ void CommandLine::GetStartArgs(int& framerate, int& monitor, int& bufferSize, bo
 				throw std::invalid_argument("Syntax error parsing args.");
 			}
 			
-			framerate = std::stoi(m_argv[i]);
+			options.Framerate = std::stoi(m_argv[i]);
 			
 			i++;
 		}
@@ -59,7 +84,7 @@ void CommandLine::GetStartArgs(int& framerate, int& monitor, int& bufferSize, bo
 				throw std::invalid_argument("Syntax error parsing args.");
 			}
 
-			monitor = std::stoi(m_argv[i]);
+			options.Monitor = std::stoi(m_argv[i]);
 
 			i++;
 		}
@@ -72,14 +97,318 @@ void CommandLine::GetStartArgs(int& framerate, int& monitor, int& bufferSize, bo
 				throw std::invalid_argument("Syntax error parsing args.");
 			}
 
-			isMegabytes = strcmp(m_argv[i], "-mb") == 0;
+			options.AsMegabytes = strcmp(m_argv[i], "-mb") == 0;
+
+			if (options.AsMegabytes)
+			{
+				i++;
+			}
+
+			options.BufferCapacity = std::stoi(m_argv[i]);
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-dirtyregions") == 0)
+		{
+			options.DirtyRegions = true;
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-cursormetadata") == 0)
+		{
+			options.CursorAsMetadata = true;
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-storage") == 0)
+		{
+			i++;
+
+			if (i >= m_argc)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			if (strcmp(m_argv[i], "texture") == 0)
+			{
+				options.Storage = FrameStorage::Texture;
+			}
+			else if (strcmp(m_argv[i], "encoded") == 0)
+			{
+				options.Storage = FrameStorage::Encoded;
+			}
+			else if (strcmp(m_argv[i], "compressed") == 0)
+			{
+				options.Storage = FrameStorage::Compressed;
+			}
+			else if (strcmp(m_argv[i], "hdr") == 0)
+			{
+				options.Storage = FrameStorage::Hdr;
+			}
+			else
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-format") == 0)
+		{
+			i++;
+
+			if (i == m_argc)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			if (strcmp(m_argv[i], "jpeg") == 0)
+			{
+				options.Format = ImageFormat::Jpeg;
+			}
+			else if (strcmp(m_argv[i], "png") == 0)
+			{
+				options.Format = ImageFormat::Png;
+			}
+			else if (strcmp(m_argv[i], "bmp") == 0)
+			{
+				options.Format = ImageFormat::Bmp;
+			}
+			else if (strcmp(m_argv[i], "screen") == 0)
+			{
+				options.Format = ImageFormat::Screen;
+			}
+			else
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-quality") == 0)
+		{
+			i++;
+
+			if (i == m_argc)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			if (strcmp(m_argv[i], "auto") == 0)
+			{
+				options.AutoQuality = true;
+			}
+			else
+			{
+				options.Quality = std::stoi(m_argv[i]);
+				options.AutoQuality = false;
+
+				if (options.Quality < 0 || options.Quality > 100)
+				{
+					throw std::invalid_argument("Syntax error parsing args.");
+				}
+			}
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-largepages") == 0)
+		{
+			options.LargePages = true;
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-directio") == 0)
+		{
+			options.DirectIo = true;
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-chunkstore") == 0)
+		{
+			i++;
+
+			if (i == m_argc)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			// The recording process may run from another folder, so the store is passed on as an absolute path.
+			options.ChunkStore = std::filesystem::absolute(std::filesystem::u8path(m_argv[i])).u8string();
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-session") == 0)
+		{
+			i++;
+
+			if (i == m_argc)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			options.Session = ParseSessionName(m_argv[i]);
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-memorycap") == 0)
+		{
+			i++;
+
+			if (i == m_argc)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			options.MemoryCapMegabytes = std::stoi(m_argv[i]);
+
+			if (options.MemoryCapMegabytes < 1)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-idle") == 0)
+		{
+			i++;
+
+			if (i == m_argc)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			options.IdleSeconds = std::stoi(m_argv[i]);
+
+			if (options.IdleSeconds < 1)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-idleinterval") == 0)
+		{
+			i++;
+
+			if (i == m_argc)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			options.IdleIntervalSeconds = std::stoi(m_argv[i]);
+
+			if (options.IdleIntervalSeconds < 0)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-publish") == 0)
+		{
+			i++;
+
+			if (i == m_argc)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			options.FrameBusSlots = std::stoi(m_argv[i]);
+
+			if (options.FrameBusSlots < 1)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-tier") == 0)
+		{
+			TierOptions tier;
+
+			if (i + 3 >= m_argc)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			tier.IntervalSeconds = std::stoi(m_argv[i + 1]);
+			tier.Scale = std::stoi(m_argv[i + 2]);
+			i += 3;
+
+			tier.AsMegabytes = strcmp(m_argv[i], "-mb") == 0;
 
-			if (isMegabytes)
+			if (tier.AsMegabytes)
 			{
 				i++;
+
+				if (i == m_argc)
+				{
+					throw std::invalid_argument("Syntax error parsing args.");
+				}
+			}
+
+			tier.Capacity = std::stoi(m_argv[i]);
+
+			if (tier.IntervalSeconds < 0 || tier.Scale < 1 || (tier.Scale & (tier.Scale - 1)) != 0 || tier.Capacity < 0)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			options.Tiers.push_back(tier);
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-redact") == 0)
+		{
+			if (i + 4 >= m_argc)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			RECT rect = { std::stoi(m_argv[i + 1]), std::stoi(m_argv[i + 2]), std::stoi(m_argv[i + 3]), std::stoi(m_argv[i + 4]) };
+
+			if (rect.left >= rect.right || rect.top >= rect.bottom)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			options.RedactRects.push_back(rect);
+
+			i += 5;
+		}
+		else if (strcmp(m_argv[i], "-redactapp") == 0)
+		{
+			i++;
+
+			if (i == m_argc || strlen(m_argv[i]) == 0)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
 			}
 
-			bufferSize = std::stoi(m_argv[i]);
+			options.RedactApps.push_back(m_argv[i]);
+
+			i++;
+		}
+		else if (strcmp(m_argv[i], "-redactstyle") == 0)
+		{
+			i++;
+
+			if (i == m_argc)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			if (strcmp(m_argv[i], "fill") == 0)
+			{
+				options.Redaction = RedactStyle::Fill;
+			}
+			else if (strcmp(m_argv[i], "pixelate") == 0)
+			{
+				options.Redaction = RedactStyle::Pixelate;
+			}
+			else
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
 
 			i++;
 		}
@@ -90,14 +419,213 @@ void CommandLine::GetStartArgs(int& framerate, int& monitor, int& bufferSize, bo
 	}
 }
 
-void CommandLine::GetStopArgs(std::string& folder) const
+void CommandLine::GetStopArgs(std::string& folder, std::string& session) const
+{
+	if (m_argc != 3 && !(m_argc == 5 && strcmp(m_argv[3], "-session") == 0))
+	{
+		throw std::invalid_argument("Syntax error parsing args.");
+	}
+
+	folder = m_argv[2];
+	session = m_argc == 5 ? ParseSessionName(m_argv[4]) : "";
+}
+
+void CommandLine::GetSessionArgs(std::string& session) const
+{
+	if (m_argc != 2 && !(m_argc == 4 && strcmp(m_argv[2], "-session") == 0))
+	{
+		throw std::invalid_argument("Syntax error parsing args.");
+	}
+
+	session = m_argc == 4 ? ParseSessionName(m_argv[3]) : "";
+}
+
+void CommandLine::GetNewServerArgs(uint64_t& readyEvent, std::wstring& pipeName) const
+{
+	int i = 2;
+	readyEvent = 0;
+	pipeName = L"myPipe";
+
+	while (i < m_argc)
+	{
+		if (i + 1 == m_argc)
+		{
+			throw std::invalid_argument("Syntax error parsing args.");
+		}
+
+		if (strcmp(m_argv[i], "-ready") == 0)
+		{
+			readyEvent = std::stoull(m_argv[i + 1]);
+		}
+		else if (strcmp(m_argv[i], "-pipe") == 0)
+		{
+			std::string name = m_argv[i + 1];
+			pipeName = std::wstring(name.begin(), name.end());
+		}
+		else
+		{
+			throw std::invalid_argument("Syntax error parsing args.");
+		}
+
+		i += 2;
+	}
+}
+
+void CommandLine::GetExportArgs(ExportOptions& options) const
 {
 	if (m_argc < 3)
 	{
 		throw std::invalid_argument("Syntax error parsing args.");
 	}
 
+	options = ExportOptions();
+	options.Folder = m_argv[2];
+
+	bool isRange = false;
+	int i = 3;
+
+	while (i < m_argc)
+	{
+		if (i + 1 == m_argc)
+		{
+			throw std::invalid_argument("Syntax error parsing args.");
+		}
+
+		if (strcmp(m_argv[i], "-from") == 0)
+		{
+			options.From = std::stoll(m_argv[i + 1]);
+			isRange = true;
+		}
+		else if (strcmp(m_argv[i], "-to") == 0)
+		{
+			options.To = std::stoll(m_argv[i + 1]);
+			isRange = true;
+		}
+		else if (strcmp(m_argv[i], "-stride") == 0)
+		{
+			options.Stride = std::stoi(m_argv[i + 1]);
+			isRange = true;
+
+			if (options.Stride < 1)
+			{
+				throw std::invalid_argument("Stride must be at least 1.");
+			}
+		}
+		else if (strcmp(m_argv[i], "-at") == 0)
+		{
+			options.At = std::stoll(m_argv[i + 1]);
+			options.Nearest = true;
+		}
+		else if (strcmp(m_argv[i], "-session") == 0)
+		{
+			options.Session = ParseSessionName(m_argv[i + 1]);
+		}
+		else
+		{
+			throw std::invalid_argument("Syntax error parsing args.");
+		}
+
+		i += 2;
+	}
+
+	if (isRange && options.Nearest)
+	{
+		throw std::invalid_argument("-at cannot be combined with -from, -to or -stride.");
+	}
+
+	if (options.From > options.To)
+	{
+		throw std::invalid_argument("-from must not be later than -to.");
+	}
+}
+
+void CommandLine::GetExportIndexArgs(std::string& indexFile, std::string& outputFile) const
+{
+	if (m_argc < 4)
+	{
+		throw std::invalid_argument("Syntax error parsing args.");
+	}
+
+	indexFile = m_argv[2];
+	outputFile = m_argv[3];
+}
+
+void CommandLine::GetDecodeArgs(std::string& inputFile, std::string& outputFile) const
+{
+	if (m_argc < 4)
+	{
+		throw std::invalid_argument("Syntax error parsing args.");
+	}
+
+	inputFile = m_argv[2];
+	outputFile = m_argv[3];
+}
+
+void CommandLine::GetQualityCurveArgs(std::string& folder, std::string& outputFile) const
+{
+	if (m_argc != 3 && m_argc != 4)
+	{
+		throw std::invalid_argument("Syntax error parsing args.");
+	}
+
 	folder = m_argv[2];
+	outputFile = m_argc == 4 ? m_argv[3] : "";
+}
+
+void CommandLine::GetChunkGcArgs(std::string& store, std::vector<std::string>& folders) const
+{
+	if (m_argc < 3)
+	{
+		throw std::invalid_argument("Syntax error parsing args.");
+	}
+
+	store = m_argv[2];
+	folders.assign(m_argv + 3, m_argv + m_argc);
+}
+
+void CommandLine::GetChunkRestoreArgs(std::string& folder, std::string& outputFolder) const
+{
+	if (m_argc != 4)
+	{
+		throw std::invalid_argument("Syntax error parsing args.");
+	}
+
+	folder = m_argv[2];
+	outputFolder = m_argv[3];
+}
+
+void CommandLine::GetBenchmarkArgs(std::string& filter, std::string& outputFile) const
+{
+	int i = 2;
+	filter = "";
+	outputFile = "";
+
+	while (i < m_argc)
+	{
+		if (strcmp(m_argv[i], "-filter") == 0)
+		{
+			i++;
+
+			if (i == m_argc)
+			{
+				throw std::invalid_argument("Syntax error parsing args.");
+			}
+
+			filter = m_argv[i];
+
+			i++;
+		}
+		else if (outputFile.empty())
+		{
+			outputFile = m_argv[i];
+
+			i++;
+		}
+		else
+		{
+			throw std::invalid_argument("Syntax error parsing args.");
+		}
+	}
 }
 
 void CommandLine::GetHelpArgs(std::string& arg) const
@@ -1,19 +1,33 @@
 #pragma once
 
 #include "pch.h"
+#include "RecordingOptions.h"
+#include "ExportOptions.h"
 
-enum class CommandType { Start, Stop, Cancel, NewServer, Help, Unknown };
+enum class CommandType { Start, Stop, Cancel, NewServer, Export, ExportIndex, FrameBus, Decode, QualityCurve, ChunkGc, ChunkRestore, Benchmark, Help, Unknown };
 
 class CommandLine {
 public:
     CommandLine(int argc, char* argv[]) : m_argc(argc), m_argv(argv) {}
 
     CommandType GetCommandType() const;
-    void GetStartArgs(int& framerate, int& monitor, int& bufferSize, bool& isMegabytes) const;
-    void GetStopArgs(std::string& folder) const;
+    void GetStartArgs(RecordingOptions& options) const;
+    void GetStopArgs(std::string& folder, std::string& session) const;
+    void GetSessionArgs(std::string& session) const;
+    void GetNewServerArgs(uint64_t& readyEvent, std::wstring& pipeName) const;
+    void GetExportArgs(ExportOptions& options) const;
+    void GetExportIndexArgs(std::string& indexFile, std::string& outputFile) const;
+    void GetDecodeArgs(std::string& inputFile, std::string& outputFile) const;
+    void GetQualityCurveArgs(std::string& folder, std::string& outputFile) const;
+    void GetChunkGcArgs(std::string& store, std::vector<std::string>& folders) const;
+    void GetChunkRestoreArgs(std::string& folder, std::string& outputFolder) const;
+    void GetBenchmarkArgs(std::string& filter, std::string& outputFile) const;
     void GetHelpArgs(std::string& arg) const;
 
 private:
+    // Session names become part of pipe and shared memory names, so they are limited to letters, digits, - and _.
+    static std::string ParseSessionName(const char* arg);
+
     int m_argc;
     char** m_argv;
 };
@@ -0,0 +1,237 @@
+#include "pch.h"
+#include "CursorCache.h"
+#include "Simd.h"
+
+uint32_t CursorCache::capture_current(POINT& hotspotPosition)
+{
+    CURSORINFO cursorInfo = { sizeof(cursorInfo) };
+
+    if (!GetCursorInfo(&cursorInfo) || (cursorInfo.flags & CURSOR_SHOWING) == 0 || cursorInfo.hCursor == nullptr)
+    {
+        return noCursor;
+    }
+
+    hotspotPosition = cursorInfo.ptScreenPos;
+
+    auto it = m_handles.find(cursorInfo.hCursor);
+
+    if (it != m_handles.end())
+    {
+        return it->second;
+    }
+
+    uint32_t id = add_shape(cursorInfo.hCursor);
+    m_handles[cursorInfo.hCursor] = id;
+
+    return id;
+}
+
+uint32_t CursorCache::add_shape(HCURSOR cursor)
+{
+    Shape shape;
+
+    if (!try_read_shape(cursor, shape))
+    {
+        return noCursor;
+    }
+
+    // Different handles often share a shape, for example when applications load the same system cursor.
+    for (size_t i = 0; i < m_shapes.size(); i++)
+    {
+        const Shape& cached = m_shapes[i];
+
+        if (cached.width == shape.width && cached.height == shape.height && cached.hotspotX == shape.hotspotX && cached.hotspotY == shape.hotspotY && cached.pixels == shape.pixels)
+        {
+            return static_cast<uint32_t>(i + 1);
+        }
+    }
+
+    m_shapes.push_back(std::move(shape));
+
+    return static_cast<uint32_t>(m_shapes.size());
+}
+
+bool CursorCache::try_read_shape(HCURSOR cursor, Shape& shape)
+{
+    ICONINFO iconInfo = {};
+
+    if (!GetIconInfo(cursor, &iconInfo))
+    {
+        return false;
+    }
+
+    wil::unique_hbitmap mask(iconInfo.hbmMask);
+    wil::unique_hbitmap color(iconInfo.hbmColor);
+
+    BITMAP maskBitmap = {};
+
+    if (!mask || GetObject(mask.get(), sizeof(maskBitmap), &maskBitmap) == 0)
+    {
+        return false;
+    }
+
+    // Monochrome cursors have no color bitmap and stack the AND mask on top of the XOR mask.
+    uint32_t width = maskBitmap.bmWidth;
+    uint32_t height = color ? maskBitmap.bmHeight : maskBitmap.bmHeight / 2;
+
+    auto readBits = [&](HBITMAP bitmap, uint32_t rows, std::vector<uint32_t>& bits)
+        {
+            BITMAPINFO bitmapInfo = {};
+            bitmapInfo.bmiHeader.biSize = sizeof(bitmapInfo.bmiHeader);
+            bitmapInfo.bmiHeader.biWidth = width;
+            bitmapInfo.bmiHeader.biHeight = -static_cast<int32_t>(rows);
+            bitmapInfo.bmiHeader.biPlanes = 1;
+            bitmapInfo.bmiHeader.biBitCount = 32;
+            bitmapInfo.bmiHeader.biCompression = BI_RGB;
+
+            bits.resize(static_cast<size_t>(width) * rows);
+
+            wil::unique_hdc_window screen = wil::GetDC(nullptr);
+            return GetDIBits(screen.get(), bitmap, 0, rows, bits.data(), &bitmapInfo, DIB_RGB_COLORS) == static_cast<int>(rows);
+        };
+
+    std::vector<uint32_t> maskBits, colorBits;
+
+    if (width == 0 || height == 0 || !readBits(mask.get(), color ? height : height * 2, maskBits))
+    {
+        return false;
+    }
+
+    if (color && !readBits(color.get(), height, colorBits))
+    {
+        return false;
+    }
+
+    bool hasAlpha = std::any_of(colorBits.begin(), colorBits.end(), [](uint32_t pixel) { return (pixel >> 24) != 0; });
+    size_t pixelCount = static_cast<size_t>(width) * height;
+
+    shape.width = width;
+    shape.height = height;
+    shape.hotspotX = iconInfo.xHotspot;
+    shape.hotspotY = iconInfo.yHotspot;
+    shape.pixels.resize(pixelCount * 4);
+
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        uint8_t* out = &shape.pixels[i * 4];
+        bool transparent = (maskBits[i] & 0x00FFFFFF) != 0;
+        uint32_t bgra;
+
+        if (color && hasAlpha)
+        {
+            bgra = colorBits[i];
+        }
+        else if (color)
+        {
+            bgra = transparent ? 0 : colorBits[i] | 0xFF000000;
+        }
+        else
+        {
+            // Inverting pixels cannot be expressed as a blend, so they are drawn black like the opaque black pixels.
+            bool xorSet = (maskBits[pixelCount + i] & 0x00FFFFFF) != 0;
+            bgra = transparent && !xorSet ? 0 : (!transparent && xorSet ? 0xFFFFFFFF : 0xFF000000);
+        }
+
+        // Cursor bitmaps hold straight alpha, but blending expects it premultiplied.
+        uint32_t alpha = bgra >> 24;
+        out[0] = static_cast<uint8_t>(((bgra & 0xFF) * alpha + 127) / 255);
+        out[1] = static_cast<uint8_t>((((bgra >> 8) & 0xFF) * alpha + 127) / 255);
+        out[2] = static_cast<uint8_t>((((bgra >> 16) & 0xFF) * alpha + 127) / 255);
+        out[3] = static_cast<uint8_t>(alpha);
+    }
+
+    return true;
+}
+
+const CursorCache::Shape* CursorCache::find(uint32_t id) const
+{
+    if (id == noCursor || id > m_shapes.size())
+    {
+        return nullptr;
+    }
+
+    return &m_shapes[id - 1];
+}
+
+void CursorCache::composite(uint32_t id, int32_t x, int32_t y, uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch) const
+{
+    const Shape* shape = find(id);
+
+    if (!shape)
+    {
+        return;
+    }
+
+    int64_t left = static_cast<int64_t>(x) - shape->hotspotX;
+    int64_t top = static_cast<int64_t>(y) - shape->hotspotY;
+
+    int64_t firstColumn = std::max<int64_t>(0, -left);
+    int64_t lastColumn = std::min<int64_t>(shape->width, static_cast<int64_t>(width) - left);
+    int64_t firstRow = std::max<int64_t>(0, -top);
+    int64_t lastRow = std::min<int64_t>(shape->height, static_cast<int64_t>(height) - top);
+
+    if (firstColumn >= lastColumn || firstRow >= lastRow)
+    {
+        return;
+    }
+
+    for (int64_t row = firstRow; row < lastRow; row++)
+    {
+        const uint8_t* source = &shape->pixels[(static_cast<size_t>(row) * shape->width + firstColumn) * 4];
+        uint8_t* destination = pixels + static_cast<size_t>(top + row) * rowPitch + static_cast<size_t>(left + firstColumn) * 4;
+
+        blend_row(source, destination, static_cast<uint32_t>(lastColumn - firstColumn));
+    }
+}
+
+// Computes value / 255 rounded to nearest for value <= 255 * 255, without a division.
+static inline uint32_t DivideBy255(uint32_t value)
+{
+    value += 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+void CursorCache::blend_row(const uint8_t* source, uint8_t* destination, uint32_t pixelCount, bool allowSimd)
+{
+    uint32_t i = 0;
+
+#ifdef SIMD_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(255);
+    const __m128i half = _mm_set1_epi16(128);
+
+    auto blendHalf = [&](__m128i source16, __m128i destination16)
+        {
+            __m128i alpha = _mm_shufflelo_epi16(source16, _MM_SHUFFLE(3, 3, 3, 3));
+            alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+
+            __m128i product = _mm_add_epi16(_mm_mullo_epi16(destination16, _mm_sub_epi16(max, alpha)), half);
+            product = _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+
+            return _mm_add_epi16(source16, product);
+        };
+
+    for (; allowSimd && i + 4 <= pixelCount; i += 4)
+    {
+        __m128i sourcePixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i * 4));
+        __m128i destinationPixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(destination + i * 4));
+
+        __m128i low = blendHalf(_mm_unpacklo_epi8(sourcePixels, zero), _mm_unpacklo_epi8(destinationPixels, zero));
+        __m128i high = blendHalf(_mm_unpackhi_epi8(sourcePixels, zero), _mm_unpackhi_epi8(destinationPixels, zero));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i * 4), _mm_packus_epi16(low, high));
+    }
+#endif
+
+    for (; i < pixelCount; i++)
+    {
+        const uint8_t* in = source + i * 4;
+        uint8_t* out = destination + i * 4;
+        uint32_t inverseAlpha = 255 - in[3];
+
+        for (int channel = 0; channel < 4; channel++)
+        {
+            out[channel] = static_cast<uint8_t>(std::min<uint32_t>(255, in[channel] + DivideBy255(out[channel] * inverseAlpha)));
+        }
+    }
+}
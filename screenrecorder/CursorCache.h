@@ -0,0 +1,52 @@
+#pragma once
+
+#include "pch.h"
+
+// The purpose of this class is to keep one copy of every cursor shape seen during a recording, so that frames can be
+// captured without the cursor and record only its position and shape id. The cursor is drawn back over each frame
+// when the frames are saved.
+class CursorCache {
+public:
+    struct Shape
+    {
+        uint32_t width;
+        uint32_t height;
+        int32_t hotspotX;
+        int32_t hotspotY;
+        std::vector<uint8_t> pixels;  // Premultiplied BGRA8, tightly packed.
+    };
+
+    static const uint32_t noCursor = 0;
+
+    /**
+     * Looks up the cursor currently shown on screen, adding its shape to the cache the first time it is seen.
+     * @param hotspotPosition receives the desktop position of the hotspot in physical pixels, since the process is per
+     * monitor DPI aware, so it lines up with the capture origin and the frame's pixels on scaled displays too
+     * @returns the id of the shape, or noCursor if the cursor is hidden or its shape cannot be read
+     */
+    uint32_t capture_current(POINT& hotspotPosition);
+
+    const Shape* find(uint32_t id) const;
+
+    /**
+     * Alpha blends a cached shape over a BGRA8 image with its hotspot at the given position. Parts of the shape outside
+     * the image are clipped.
+     */
+    void composite(uint32_t id, int32_t x, int32_t y, uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch) const;
+
+    /**
+     * Blends premultiplied BGRA8 source pixels over destination pixels.
+     * @param allowSimd uses SSE2 where available. The result is the same either way.
+     */
+    static void blend_row(const uint8_t* source, uint8_t* destination, uint32_t pixelCount, bool allowSimd = true);
+
+    size_t shape_count() const { return m_shapes.size(); }
+
+private:
+    uint32_t add_shape(HCURSOR cursor);
+    static bool try_read_shape(HCURSOR cursor, Shape& shape);
+
+    // Ids are indices into m_shapes plus one, so that noCursor is never a valid id.
+    std::vector<Shape> m_shapes;
+    std::map<HCURSOR, uint32_t> m_handles;
+};
@@ -33,6 +33,19 @@ int DataStream::ReadInt()
     return value;
 }
 
+void DataStream::WriteInt64(int64_t value) 
+{
+    m_stream << value << ' ';
+}
+
+int64_t DataStream::ReadInt64()
+{
+    int64_t value;
+    if (!(m_stream >> value))
+        throw std::runtime_error("Error reading int64 from stream.");
+    return value;
+}
+
 void DataStream::WriteBool(bool value) 
 {
     m_stream << value << ' ';
@@ -11,6 +11,9 @@ public:
     void WriteInt(int value);
     int ReadInt();
 
+    void WriteInt64(int64_t value);
+    int64_t ReadInt64();
+
     void WriteBool(bool value);
     bool ReadBool();
 
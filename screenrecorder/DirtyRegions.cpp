@@ -0,0 +1,166 @@
+#include "pch.h"
+#include "DirtyRegions.h"
+
+static const uint32_t bytesPerPixel = 4;
+
+std::vector<DirtyRect> DirtyRegionDetector::detect(const uint8_t* pixels, uint32_t rowPitch, uint32_t width, uint32_t height)
+{
+    uint32_t previousPitch = width * bytesPerPixel;
+
+    if (m_previous.empty() || width != m_width || height != m_height)
+    {
+        m_width = width;
+        m_height = height;
+        m_previous.resize(static_cast<size_t>(previousPitch) * height);
+
+        for (uint32_t y = 0; y < height; y++)
+        {
+            memcpy(m_previous.data() + static_cast<size_t>(y) * previousPitch, pixels + static_cast<size_t>(y) * rowPitch, previousPitch);
+        }
+
+        return { { 0, 0, width, height } };
+    }
+
+    uint32_t tilesX = (width + tileSize - 1) / tileSize;
+    uint32_t tilesY = (height + tileSize - 1) / tileSize;
+    std::vector<bool> dirtyTiles(static_cast<size_t>(tilesX) * tilesY, false);
+    bool anyDirty = false;
+
+    for (uint32_t tileY = 0; tileY < tilesY; tileY++)
+    {
+        uint32_t top = tileY * tileSize;
+        uint32_t bottom = std::min(top + tileSize, height);
+
+        for (uint32_t tileX = 0; tileX < tilesX; tileX++)
+        {
+            size_t offset = static_cast<size_t>(tileX) * tileSize * bytesPerPixel;
+            size_t length = static_cast<size_t>(std::min(tileSize, width - tileX * tileSize)) * bytesPerPixel;
+
+            uint32_t y = top;
+
+            while (y < bottom && memcmp(pixels + static_cast<size_t>(y) * rowPitch + offset, m_previous.data() + static_cast<size_t>(y) * previousPitch + offset, length) == 0)
+            {
+                y++;
+            }
+
+            if (y == bottom)
+            {
+                continue;
+            }
+
+            // Rows above y are known to be equal, so only the rest of the tile needs refreshing.
+            for (; y < bottom; y++)
+            {
+                memcpy(m_previous.data() + static_cast<size_t>(y) * previousPitch + offset, pixels + static_cast<size_t>(y) * rowPitch + offset, length);
+            }
+
+            dirtyTiles[static_cast<size_t>(tileY) * tilesX + tileX] = true;
+            anyDirty = true;
+        }
+    }
+
+    if (!anyDirty)
+    {
+        return {};
+    }
+
+    return merge_tiles(dirtyTiles, tilesX, tilesY, width, height);
+}
+
+void DirtyRegionDetector::reset()
+{
+    m_previous.clear();
+    m_width = 0;
+    m_height = 0;
+}
+
+void DirtyRegionDetector::shift(const ScrollMotion& motion)
+{
+    DirtyRect source = motion.Source();
+
+    if (m_previous.empty() || motion.IsNone() || source.Width() == 0 || source.Height() == 0 || motion.Rect.Right > m_width || motion.Rect.Bottom > m_height)
+    {
+        return;
+    }
+
+    uint32_t previousPitch = m_width * bytesPerPixel;
+    size_t length = static_cast<size_t>(source.Width()) * bytesPerPixel;
+
+    // Rows are moved away from the direction of the scroll, so no row is overwritten before it has been moved.
+    for (uint32_t i = 0; i < source.Height(); i++)
+    {
+        uint32_t y = motion.DeltaY > 0 ? source.Bottom - 1 - i : source.Top + i;
+        uint8_t* from = m_previous.data() + static_cast<size_t>(y) * previousPitch + static_cast<size_t>(source.Left) * bytesPerPixel;
+        uint8_t* to = from + static_cast<ptrdiff_t>(motion.DeltaY) * previousPitch + static_cast<ptrdiff_t>(motion.DeltaX) * bytesPerPixel;
+
+        memmove(to, from, length);
+    }
+}
+
+std::vector<DirtyRect> DirtyRegionDetector::merge_tiles(const std::vector<bool>& dirtyTiles, uint32_t tilesX, uint32_t tilesY, uint32_t width, uint32_t height)
+{
+    std::vector<DirtyRect> rects;
+
+    // Indices into rects of the rectangles that reach the bottom of the previous tile row.
+    std::vector<size_t> open, nextOpen;
+
+    for (uint32_t tileY = 0; tileY < tilesY; tileY++)
+    {
+        uint32_t top = tileY * tileSize;
+        uint32_t bottom = std::min(top + tileSize, height);
+        uint32_t tileX = 0;
+
+        nextOpen.clear();
+
+        while (tileX < tilesX)
+        {
+            if (!dirtyTiles[static_cast<size_t>(tileY) * tilesX + tileX])
+            {
+                tileX++;
+                continue;
+            }
+
+            uint32_t runStart = tileX;
+
+            while (tileX < tilesX && dirtyTiles[static_cast<size_t>(tileY) * tilesX + tileX])
+            {
+                tileX++;
+            }
+
+            uint32_t left = runStart * tileSize;
+            uint32_t right = std::min(tileX * tileSize, width);
+
+            auto match = std::find_if(open.begin(), open.end(), [&](size_t index)
+                {
+                    return rects[index].Left == left && rects[index].Right == right;
+                });
+
+            if (match != open.end())
+            {
+                rects[*match].Bottom = bottom;
+                nextOpen.push_back(*match);
+            }
+            else
+            {
+                nextOpen.push_back(rects.size());
+                rects.push_back({ left, top, right, bottom });
+            }
+        }
+
+        std::swap(open, nextOpen);
+    }
+
+    return rects;
+}
+
+uint64_t DirtyRegionDetector::total_area(const std::vector<DirtyRect>& rects)
+{
+    uint64_t area = 0;
+
+    for (const auto& rect : rects)
+    {
+        area += rect.Area();
+    }
+
+    return area;
+}
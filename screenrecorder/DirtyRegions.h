@@ -0,0 +1,79 @@
+#pragma once
+
+#include "pch.h"
+
+struct DirtyRect
+{
+    uint32_t Left;
+    uint32_t Top;
+    uint32_t Right;
+    uint32_t Bottom;
+
+    uint32_t Width() const { return Right - Left; }
+    uint32_t Height() const { return Bottom - Top; }
+    uint64_t Area() const { return static_cast<uint64_t>(Width()) * Height(); }
+};
+
+// Content of Rect that moved by DeltaX and DeltaY since the previous frame, as when a window scrolls: what was at
+// (x, y) is now at (x + DeltaX, y + DeltaY). Content moved past the edges of Rect is dropped, and the band of Rect
+// nothing moved into keeps its previous pixels.
+struct ScrollMotion
+{
+    DirtyRect Rect = {};
+    int32_t DeltaX = 0;
+    int32_t DeltaY = 0;
+
+    bool IsNone() const { return DeltaX == 0 && DeltaY == 0; }
+
+    // Part of Rect in the previous frame that is still inside Rect once moved. Empty if it moved entirely out.
+    DirtyRect Source() const
+    {
+        uint32_t offsetX = static_cast<uint32_t>(std::abs(DeltaX));
+        uint32_t offsetY = static_cast<uint32_t>(std::abs(DeltaY));
+
+        if (offsetX >= Rect.Width() || offsetY >= Rect.Height())
+        {
+            return { Rect.Left, Rect.Top, Rect.Left, Rect.Top };
+        }
+
+        return { Rect.Left + (DeltaX < 0 ? offsetX : 0), Rect.Top + (DeltaY < 0 ? offsetY : 0),
+            Rect.Right - (DeltaX > 0 ? offsetX : 0), Rect.Bottom - (DeltaY > 0 ? offsetY : 0) };
+    }
+};
+
+// The purpose of this class is to find the parts of a BGRA8 frame that changed since the previous frame. The frame is
+// compared against a copy of the previous one in square tiles, and the changed tiles are merged into as few
+// rectangles as possible.
+class DirtyRegionDetector {
+public:
+    static constexpr uint32_t tileSize = 32;
+
+    /**
+     * Compares the frame against the previous one and remembers it for the next call. The first frame, and any frame
+     * whose size differs from the previous one, is reported as a single rectangle covering the whole frame.
+     * @returns an empty vector if nothing changed
+     */
+    std::vector<DirtyRect> detect(const uint8_t* pixels, uint32_t rowPitch, uint32_t width, uint32_t height);
+
+    // Forgets the previous frame, so the next frame is reported as entirely dirty.
+    void reset();
+
+    /**
+     * Moves part of the previous frame the way the frame buffer moves it when it rebuilds a frame that scrolled, so
+     * the next call only reports what the scroll did not account for, such as the band that scrolled into view.
+     */
+    void shift(const ScrollMotion& motion);
+
+    /**
+     * Merges a grid of dirty tiles into rectangles. Dirty tiles next to each other in a row become one rectangle, and
+     * rectangles in consecutive rows that span the same columns are joined. Rectangles are clipped to the frame.
+     */
+    static std::vector<DirtyRect> merge_tiles(const std::vector<bool>& dirtyTiles, uint32_t tilesX, uint32_t tilesY, uint32_t width, uint32_t height);
+
+    static uint64_t total_area(const std::vector<DirtyRect>& rects);
+
+private:
+    std::vector<uint8_t> m_previous;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+};
@@ -0,0 +1,28 @@
+#include "pch.h"
+#include "ExportOptions.h"
+
+void ExportOptions::Write(DataStream& stream) const
+{
+    stream.WriteString(Session);
+    stream.WriteString(Folder);
+    stream.WriteInt64(From);
+    stream.WriteInt64(To);
+    stream.WriteInt(Stride);
+    stream.WriteBool(Nearest);
+    stream.WriteInt64(At);
+}
+
+ExportOptions ExportOptions::Read(DataStream& stream)
+{
+    ExportOptions options;
+
+    options.Session = stream.ReadString();
+    options.Folder = stream.ReadString();
+    options.From = stream.ReadInt64();
+    options.To = stream.ReadInt64();
+    options.Stride = stream.ReadInt();
+    options.Nearest = stream.ReadBool();
+    options.At = stream.ReadInt64();
+
+    return options;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "pch.h"
+#include "DataStream.h"
+
+// The purpose of this struct is to carry the frames to export from a running recording, selected by the
+// QueryPerformanceCounter time at which they arrived, so they can be matched against ETW events.
+struct ExportOptions
+{
+    std::string Session;   // Name of the recording to export from, empty for the default one.
+    std::string Folder;
+    int64_t From = std::numeric_limits<int64_t>::min();
+    int64_t To = std::numeric_limits<int64_t>::max();
+    int Stride = 1;        // Keeps every Stride-th frame of the range.
+    bool Nearest = false;  // Exports only the frame closest to At, instead of a range.
+    int64_t At = 0;
+
+    void Write(DataStream& stream) const;
+
+    /**
+     * @throws std::runtime_error if the stream does not hold export options
+     */
+    static ExportOptions Read(DataStream& stream);
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include "ActivityDetector.h"
+
+// The purpose of this class is to stand in for the system detector where nobody is at the machine, such as in
+// benchmarks and tests. It reports whatever state it was last given and calls nothing in Windows, so a run that idles
+// and resumes a recording does the same thing every time.
+class FakeActivityDetector : public ActivityDetector {
+public:
+    FakeActivityDetector(ActivityState state = ActivityState::Active) : m_state(state) {}
+
+    ActivityState state() override
+    {
+        m_polls++;
+        return m_state.load();
+    }
+
+    void set_state(ActivityState state) { m_state = state; }
+
+    // Number of times the state was asked for.
+    size_t polls() const { return m_polls.load(); }
+
+private:
+    std::atomic<ActivityState> m_state;
+    std::atomic<size_t> m_polls = 0;
+};
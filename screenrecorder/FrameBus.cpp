@@ -0,0 +1,221 @@
+#include "pch.h"
+#include "FrameBus.h"
+
+static const char magic[4] = { 'S', 'R', 'F', 'B' };
+
+size_t FrameBus::calculate_segment_size(uint32_t slotCount, uint32_t slotCapacity)
+{
+    using namespace FrameBusLayout;
+
+    size_t firstSlotOffset = (sizeof(Header) + alignment - 1) / alignment * alignment;
+    size_t slotStride = (pixelOffset + slotCapacity + alignment - 1) / alignment * alignment;
+
+    return firstSlotOffset + slotStride * slotCount;
+}
+
+FrameBus::FrameBus(uint32_t slotCount, uint32_t slotCapacity, const std::string& session) : m_header(nullptr)
+{
+    using namespace FrameBusLayout;
+
+    if (slotCount == 0)
+    {
+        throw std::invalid_argument("\b\tThe frame bus needs at least one slot.\n");
+    }
+
+    m_name = L"Local\\screenrecorder_framebus_" + std::to_wstring(GetCurrentProcessId());
+
+    if (!session.empty())
+    {
+        m_name += L"_" + std::wstring(session.begin(), session.end());
+    }
+
+    m_size = calculate_segment_size(slotCount, slotCapacity);
+
+    m_mapping.reset(CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(static_cast<uint64_t>(m_size) >> 32), static_cast<DWORD>(m_size), m_name.c_str()));
+
+    if (!m_mapping)
+    {
+        winrt::throw_last_error();
+    }
+
+    void* view = MapViewOfFile(m_mapping.get(), FILE_MAP_WRITE, 0, 0, m_size);
+
+    if (!view)
+    {
+        winrt::throw_last_error();
+    }
+
+    // The pages of a new mapping are zeroed, so every slot starts at version 0 with no frame in it.
+    m_header = new (view) Header();
+    std::copy(std::begin(magic), std::end(magic), m_header->Magic);
+    m_header->Version = version;
+    m_header->SlotCount = slotCount;
+    m_header->SlotCapacity = slotCapacity;
+    m_header->SlotStride = (pixelOffset + slotCapacity + alignment - 1) / alignment * alignment;
+    m_header->FirstSlotOffset = (sizeof(Header) + alignment - 1) / alignment * alignment;
+    m_header->WriteSequence.store(0);
+    m_header->DroppedFrames.store(0);
+
+    for (uint32_t i = 0; i < slotCount; i++)
+    {
+        new (slot(i)) Slot();
+    }
+}
+
+FrameBus::~FrameBus()
+{
+    if (m_header)
+    {
+        UnmapViewOfFile(m_header);
+    }
+}
+
+FrameBusLayout::Slot* FrameBus::slot(uint64_t sequence) const
+{
+    uint8_t* base = reinterpret_cast<uint8_t*>(m_header);
+
+    return reinterpret_cast<FrameBusLayout::Slot*>(base + m_header->FirstSlotOffset + (sequence % m_header->SlotCount) * m_header->SlotStride);
+}
+
+bool FrameBus::publish(const uint8_t* pixels, uint32_t rowPitch, const FrameMetadata& metadata)
+{
+    uint32_t packedPitch = metadata.Width * 4;
+    size_t size = static_cast<size_t>(packedPitch) * metadata.Height;
+
+    if (size > m_header->SlotCapacity)
+    {
+        m_header->DroppedFrames.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    uint64_t sequence = m_header->WriteSequence.load(std::memory_order_relaxed);
+    FrameBusLayout::Slot* target = slot(sequence);
+    uint64_t version = target->Version.load(std::memory_order_relaxed);
+
+    // The odd version must be visible before any of the slot is overwritten.
+    target->Version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    target->Sequence = sequence;
+    target->RowPitch = packedPitch;
+    target->Size = static_cast<uint32_t>(size);
+    target->Metadata = metadata;
+
+    uint8_t* destination = reinterpret_cast<uint8_t*>(target) + FrameBusLayout::pixelOffset;
+
+    for (uint32_t y = 0; y < metadata.Height; y++)
+    {
+        memcpy(destination + static_cast<size_t>(y) * packedPitch, pixels + static_cast<size_t>(y) * rowPitch, packedPitch);
+    }
+
+    target->Version.store(version + 2, std::memory_order_release);
+    m_header->WriteSequence.store(sequence + 1, std::memory_order_release);
+
+    return true;
+}
+
+FrameBusReader::FrameBusReader(const std::wstring& name) : m_header(nullptr)
+{
+    m_mapping.reset(OpenFileMappingW(FILE_MAP_READ, FALSE, name.c_str()));
+
+    if (!m_mapping)
+    {
+        throw std::runtime_error("\b\tCould not open the frame bus.\n");
+    }
+
+    m_header = static_cast<const FrameBusLayout::Header*>(MapViewOfFile(m_mapping.get(), FILE_MAP_READ, 0, 0, 0));
+
+    if (!m_header)
+    {
+        throw std::runtime_error("\b\tCould not map the frame bus.\n");
+    }
+
+    if (!std::equal(std::begin(magic), std::end(magic), m_header->Magic) || m_header->Version != FrameBusLayout::version)
+    {
+        UnmapViewOfFile(m_header);
+        m_header = nullptr;
+
+        throw std::runtime_error("\b\tNot a frame bus.\n");
+    }
+
+    // Reading starts from the frames published after the reader was created.
+    skip_to_latest();
+}
+
+FrameBusReader::~FrameBusReader()
+{
+    if (m_header)
+    {
+        UnmapViewOfFile(m_header);
+    }
+}
+
+const FrameBusLayout::Slot* FrameBusReader::slot(uint64_t sequence) const
+{
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(m_header);
+
+    return reinterpret_cast<const FrameBusLayout::Slot*>(base + m_header->FirstSlotOffset + (sequence % m_header->SlotCount) * m_header->SlotStride);
+}
+
+void FrameBusReader::skip_to_latest()
+{
+    m_nextSequence = m_header->WriteSequence.load(std::memory_order_acquire);
+}
+
+FrameBusReader::ReadResult FrameBusReader::read(const std::function<void(const FrameMetadata& metadata, const uint8_t* pixels, uint32_t rowPitch)>& consumer)
+{
+    while (true)
+    {
+        uint64_t writeSequence = m_header->WriteSequence.load(std::memory_order_acquire);
+
+        if (m_nextSequence >= writeSequence)
+        {
+            return ReadResult::NoFrame;
+        }
+
+        // Frames more than a ring behind the producer are gone.
+        if (writeSequence - m_nextSequence > m_header->SlotCount)
+        {
+            m_missedFrames += writeSequence - m_header->SlotCount - m_nextSequence;
+            m_nextSequence = writeSequence - m_header->SlotCount;
+        }
+
+        const FrameBusLayout::Slot* source = slot(m_nextSequence);
+        uint64_t version = source->Version.load(std::memory_order_acquire);
+
+        // The slot is being overwritten, or already holds a newer frame, so this frame was missed.
+        if (version % 2 == 1 || source->Sequence != m_nextSequence)
+        {
+            m_missedFrames++;
+            m_nextSequence++;
+            continue;
+        }
+
+        FrameMetadata metadata = source->Metadata;
+        uint32_t rowPitch = source->RowPitch;
+
+        // A slot overwritten since its version was read may describe a frame larger than the slot.
+        if (static_cast<uint64_t>(rowPitch) * metadata.Height > m_header->SlotCapacity)
+        {
+            m_missedFrames++;
+            m_nextSequence++;
+            continue;
+        }
+
+        consumer(metadata, reinterpret_cast<const uint8_t*>(source) + FrameBusLayout::pixelOffset, rowPitch);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        bool overwritten = source->Version.load(std::memory_order_relaxed) != version;
+
+        m_nextSequence++;
+
+        if (overwritten)
+        {
+            m_missedFrames++;
+            return ReadResult::Overwritten;
+        }
+
+        return ReadResult::Frame;
+    }
+}
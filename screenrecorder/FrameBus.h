@@ -0,0 +1,121 @@
+#pragma once
+
+#include "pch.h"
+#include "FrameMetadata.h"
+
+// The layout of the shared memory segment a FrameBus publishes to. Consumers in other processes map the segment by
+// name and read it with FrameBusReader, or with their own code following this layout.
+namespace FrameBusLayout
+{
+    static const uint32_t version = 1;
+
+    // Slot headers and pixels start on this alignment, so consumers can read pixels with aligned SIMD loads.
+    static const size_t alignment = 64;
+
+    struct Header
+    {
+        char Magic[4];                        // "SRFB"
+        uint32_t Version;
+        uint32_t SlotCount;
+        uint32_t SlotCapacity;                // Largest frame in bytes a slot holds. Larger frames are not published.
+        uint64_t SlotStride;                  // Distance in bytes between the starts of consecutive slots.
+        uint64_t FirstSlotOffset;             // Offset in bytes of the first slot from the start of the segment.
+        std::atomic<uint64_t> WriteSequence;  // Number of frames published so far. Frame n is in slot n % SlotCount.
+        std::atomic<uint64_t> DroppedFrames;  // Frames too large for a slot.
+    };
+
+    // Slots follow a seqlock protocol: Version is odd while the producer writes the slot and even otherwise, so a
+    // consumer that reads the same even Version before and after reading the slot knows it read a whole frame.
+    struct Slot
+    {
+        std::atomic<uint64_t> Version;
+        uint64_t Sequence;      // Number of the frame in the slot, counting every published frame.
+        uint32_t RowPitch;      // Always the frame width times 4, since rows are packed tightly.
+        uint32_t Size;          // Bytes of pixel data, RowPitch times the frame height.
+        FrameMetadata Metadata;
+    };
+
+    static const size_t pixelOffset = (sizeof(Slot) + alignment - 1) / alignment * alignment;
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Atomics shared between processes must be lock free.");
+}
+
+// The purpose of this class is to publish captured frames to other local processes, such as OCR or anomaly detection
+// agents, through a ring of slots in named shared memory. There is one producer and any number of consumers, which
+// each keep their own read position and never hold up the producer: a consumer that falls more than a ring behind
+// finds its frames overwritten and is told how many it missed.
+class FrameBus {
+public:
+    /**
+     * Creates the shared memory segment, named after the current process and the recording session.
+     * @throws winrt::hresult_error if the segment cannot be created
+     */
+    FrameBus(uint32_t slotCount, uint32_t slotCapacity, const std::string& session = "");
+    ~FrameBus();
+
+    FrameBus(const FrameBus&) = delete;
+    FrameBus& operator=(const FrameBus&) = delete;
+
+    /**
+     * Copies a BGRA8 frame into the next slot, overwriting the oldest frame. Rows are packed tightly in the slot.
+     * @returns false if the frame is larger than a slot and was dropped
+     */
+    bool publish(const uint8_t* pixels, uint32_t rowPitch, const FrameMetadata& metadata);
+
+    const std::wstring& name() const { return m_name; }
+    uint32_t slot_count() const { return m_header->SlotCount; }
+    uint32_t slot_capacity() const { return m_header->SlotCapacity; }
+    uint64_t segment_size() const { return m_size; }
+
+    static size_t calculate_segment_size(uint32_t slotCount, uint32_t slotCapacity);
+
+private:
+    FrameBusLayout::Slot* slot(uint64_t sequence) const;
+
+    std::wstring m_name;
+    size_t m_size;
+    wil::unique_handle m_mapping;
+    FrameBusLayout::Header* m_header;
+};
+
+// The purpose of this class is to read the frames published by a FrameBus, usually from another process. Frames are
+// read in place, without copying them out of the shared memory.
+class FrameBusReader {
+public:
+    enum class ReadResult { Frame, NoFrame, Overwritten };
+
+    /**
+     * Maps the segment of a running FrameBus read-only.
+     * @throws std::runtime_error if the segment does not exist or is not a frame bus
+     */
+    FrameBusReader(const std::wstring& name);
+    ~FrameBusReader();
+
+    FrameBusReader(const FrameBusReader&) = delete;
+    FrameBusReader& operator=(const FrameBusReader&) = delete;
+
+    /**
+     * Passes the next unread frame to the consumer. Frames the producer has already overwritten are skipped and counted
+     * in missed_frames.
+     * @returns Frame if the consumer saw a whole frame, NoFrame if no new frame was published, and Overwritten if the
+     * producer overwrote the frame while the consumer was reading it, in which case whatever the consumer made of it
+     * must be thrown away
+     */
+    ReadResult read(const std::function<void(const FrameMetadata& metadata, const uint8_t* pixels, uint32_t rowPitch)>& consumer);
+
+    // Skips every frame published so far, so the next read returns the next new frame.
+    void skip_to_latest();
+
+    uint64_t missed_frames() const { return m_missedFrames; }
+
+    // Frames published since the bus was created, including those published before the reader was created.
+    uint64_t published_frames() const { return m_header->WriteSequence.load(std::memory_order_acquire); }
+
+private:
+    const FrameBusLayout::Slot* slot(uint64_t sequence) const;
+
+    wil::unique_handle m_mapping;
+    const FrameBusLayout::Header* m_header;
+    uint64_t m_nextSequence = 0;
+    uint64_t m_missedFrames = 0;
+};
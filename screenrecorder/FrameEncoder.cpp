@@ -0,0 +1,126 @@
+#include "pch.h"
+#include "FrameEncoder.h"
+#include "ScreenCodec.h"
+#include "QualityTuner.h"
+
+#include <shcore.h>
+
+const float FrameEncoder::default_quality = -1.0f;
+
+FrameEncoder::FrameEncoder(ImageFormat format, float quality, std::shared_ptr<QualityTuner> tuner) : m_format(format), m_quality(quality), m_tuner(std::move(tuner))
+{
+    if (quality > 1.0f)
+    {
+        throw std::out_of_range("\b\tEncoder quality out of range.\n");
+    }
+}
+
+const char* FrameEncoder::file_extension() const
+{
+    switch (m_format)
+    {
+    case ImageFormat::Png:
+        return ".png";
+    case ImageFormat::Bmp:
+        return ".bmp";
+    case ImageFormat::Screen:
+        return ScreenCodec::fileExtension;
+    case ImageFormat::Jpeg:
+    default:
+        return ".jpg";
+    }
+}
+
+ImageFormat FrameEncoder::format_from_filename(const std::string& filename)
+{
+    std::string extension = std::filesystem::path(filename).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+
+    if (extension == ".png")
+    {
+        return ImageFormat::Png;
+    }
+    else if (extension == ".bmp")
+    {
+        return ImageFormat::Bmp;
+    }
+    else if (extension == ScreenCodec::fileExtension)
+    {
+        return ImageFormat::Screen;
+    }
+
+    return ImageFormat::Jpeg;
+}
+
+void FrameEncoder::encode(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, winrt::Windows::Storage::Streams::IRandomAccessStream const& stream) const
+{
+    if (m_format == ImageFormat::Screen)
+    {
+        std::vector<uint8_t> encoded = ScreenCodec::encode(pixels, width, height, rowPitch);
+
+        winrt::Windows::Storage::Streams::Buffer buffer(static_cast<uint32_t>(encoded.size()));
+        memcpy(buffer.data(), encoded.data(), encoded.size());
+        buffer.Length(static_cast<uint32_t>(encoded.size()));
+
+        stream.WriteAsync(buffer).get();
+        stream.FlushAsync().get();
+
+        return;
+    }
+
+    GUID containerFormat;
+
+    switch (m_format)
+    {
+    case ImageFormat::Png:
+        containerFormat = GUID_ContainerFormatPng;
+        break;
+    case ImageFormat::Bmp:
+        containerFormat = GUID_ContainerFormatBmp;
+        break;
+    case ImageFormat::Jpeg:
+    default:
+        containerFormat = GUID_ContainerFormatJpeg;
+        break;
+    }
+
+    float quality = m_format == ImageFormat::Jpeg && m_tuner ? m_tuner->quality_for(pixels, width, height, rowPitch) : m_quality;
+
+    // WIC is given the rows with their pitch, so rows read back from the GPU with padding are encoded without being
+    // repacked first, and converted to what the format stores as they are written.
+    auto factory = winrt::create_instance<IWICImagingFactory>(CLSID_WICImagingFactory);
+
+    winrt::com_ptr<IWICBitmap> bitmap;
+    winrt::check_hresult(factory->CreateBitmapFromMemory(width, height, GUID_WICPixelFormat32bppPBGRA, rowPitch,
+        static_cast<UINT>(static_cast<size_t>(rowPitch) * (height - 1) + static_cast<size_t>(width) * 4), const_cast<BYTE*>(pixels), bitmap.put()));
+
+    winrt::com_ptr<IStream> output;
+    winrt::check_hresult(CreateStreamOverRandomAccessStream(winrt::get_unknown(stream), IID_PPV_ARGS(output.put())));
+
+    winrt::com_ptr<IWICBitmapEncoder> encoder;
+    winrt::check_hresult(factory->CreateEncoder(containerFormat, nullptr, encoder.put()));
+    winrt::check_hresult(encoder->Initialize(output.get(), WICBitmapEncoderNoCache));
+
+    winrt::com_ptr<IWICBitmapFrameEncode> frame;
+    winrt::com_ptr<IPropertyBag2> options;
+    winrt::check_hresult(encoder->CreateNewFrame(frame.put(), options.put()));
+
+    if (m_format == ImageFormat::Jpeg && quality >= 0.0f)
+    {
+        PROPBAG2 option = {};
+        option.pstrName = const_cast<LPOLESTR>(L"ImageQuality");
+
+        VARIANT value;
+        VariantInit(&value);
+        value.vt = VT_R4;
+        value.fltVal = quality;
+
+        winrt::check_hresult(options->Write(1, &option, &value));
+    }
+
+    winrt::check_hresult(frame->Initialize(options.get()));
+    winrt::check_hresult(frame->SetSize(width, height));
+    winrt::check_hresult(frame->WriteSource(bitmap.get(), nullptr));
+    winrt::check_hresult(frame->Commit());
+    winrt::check_hresult(encoder->Commit());
+}
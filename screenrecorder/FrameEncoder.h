@@ -0,0 +1,41 @@
+#pragma once
+
+#include "pch.h"
+
+// Screen is the lossless screen content codec of ScreenCodec, which only this tool can decode.
+enum class ImageFormat { Jpeg, Png, Bmp, Screen };
+
+class QualityTuner;
+
+// The purpose of this class is to encode BGRA8 frames into image files with a fixed format and quality.
+class FrameEncoder {
+public:
+    static const float default_quality;
+
+    /**
+     * @param quality JPEG quality between 0.0 and 1.0, ignored by the lossless formats. Negative values use the encoder's default.
+     * @param tuner picks the JPEG quality of every frame in place of quality when given. Copies of the encoder share it,
+     * so what it learns lasts as long as the recording.
+     */
+    FrameEncoder(ImageFormat format = ImageFormat::Jpeg, float quality = default_quality, std::shared_ptr<QualityTuner> tuner = nullptr);
+
+    ImageFormat format() const { return m_format; }
+    float quality() const { return m_quality; }
+    const std::shared_ptr<QualityTuner>& tuner() const { return m_tuner; }
+    const char* file_extension() const;
+
+    /**
+     * Picks the format from the extension of a filename, falling back to JPEG.
+     */
+    static ImageFormat format_from_filename(const std::string& filename);
+
+    /**
+     * @param rowPitch distance in bytes between the starts of consecutive rows, which need not be tightly packed
+     */
+    void encode(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, winrt::Windows::Storage::Streams::IRandomAccessStream const& stream) const;
+
+private:
+    ImageFormat m_format;
+    float m_quality;
+    std::shared_ptr<QualityTuner> m_tuner;
+};
@@ -0,0 +1,141 @@
+#include "pch.h"
+#include "FrameIndex.h"
+
+const char* const FrameIndex::filename = "frames.idx";
+
+static const char magic[4] = { 'S', 'R', 'F', 'I' };
+static const uint32_t version = 1;
+
+// Size of a record before the cursor fields were appended.
+static const uint32_t minimumRecordSize = 56;
+
+void FrameIndex::Write(const std::string& path, const std::vector<FrameMetadata>& records)
+{
+    Header header = {};
+    std::copy(std::begin(magic), std::end(magic), header.Magic);
+    header.Version = version;
+    header.RecordSize = sizeof(FrameMetadata);
+
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    header.QpcFrequency = frequency.QuadPart;
+#else
+    // Frames captured on Linux record steady_clock ticks where Windows records QueryPerformanceCounter values.
+    header.QpcFrequency = std::chrono::steady_clock::period::den / std::chrono::steady_clock::period::num;
+#endif
+    header.RecordCount = records.size();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    if (!file)
+    {
+        throw std::ios_base::failure("Failed to create frame index \"" + path + "\".");
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(FrameMetadata));
+
+    if (!file)
+    {
+        throw std::ios_base::failure("Failed to write frame index \"" + path + "\".");
+    }
+}
+
+std::vector<FrameMetadata> FrameIndex::Read(const std::string& path, int64_t& qpcFrequency)
+{
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file)
+    {
+        throw std::ios_base::failure("Failed to open frame index \"" + path + "\".");
+    }
+
+    Header header = {};
+
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    {
+        throw std::runtime_error("\"" + path + "\" is not a frame index.");
+    }
+
+    if (!std::equal(std::begin(magic), std::end(magic), header.Magic) || header.Version != version || header.RecordSize < minimumRecordSize)
+    {
+        throw std::runtime_error("\"" + path + "\" is not a frame index.");
+    }
+
+    qpcFrequency = header.QpcFrequency;
+
+    // Newer versions may append fields to each record, so only the known prefix of every record is read. Fields
+    // missing from records written by older versions are left zero.
+    std::vector<FrameMetadata> records(header.RecordCount, FrameMetadata{});
+    size_t knownSize = std::min<size_t>(header.RecordSize, sizeof(FrameMetadata));
+
+    for (auto& record : records)
+    {
+        file.read(reinterpret_cast<char*>(&record), knownSize);
+        file.ignore(header.RecordSize - knownSize);
+    }
+
+    if (!file)
+    {
+        throw std::ios_base::failure("Failed to read frame index \"" + path + "\".");
+    }
+
+    return records;
+}
+
+void FrameIndex::ExportCsv(std::ostream& stream, const std::vector<FrameMetadata>& records, int64_t qpcFrequency)
+{
+    stream << "Sequence,Timestamp,Qpc,QpcFrequency,SystemRelativeTime,Width,Height,DirtyRegionCount,DedupeCount,EncodeTime,StoredBytes,CursorX,CursorY,CursorShape,Tier,RedactTime,IdleTime\n";
+
+    for (const auto& record : records)
+    {
+        stream << record.Sequence << ','
+            << record.Timestamp << ','
+            << record.Qpc << ','
+            << qpcFrequency << ','
+            << record.SystemRelativeTime << ','
+            << record.Width << ','
+            << record.Height << ','
+            << record.DirtyRegionCount << ','
+            << record.DedupeCount << ','
+            << record.EncodeTime << ','
+            << record.StoredBytes << ','
+            << record.CursorX << ','
+            << record.CursorY << ','
+            << record.CursorShape << ','
+            << record.Tier << ','
+            << record.RedactTime << ','
+            << record.IdleTime << '\n';
+    }
+}
+
+void FrameIndex::ExportJson(std::ostream& stream, const std::vector<FrameMetadata>& records, int64_t qpcFrequency)
+{
+    stream << "{\n  \"qpcFrequency\": " << qpcFrequency << ",\n  \"frames\": [";
+
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const auto& record = records[i];
+
+        stream << (i == 0 ? "\n" : ",\n")
+            << "    { \"sequence\": " << record.Sequence
+            << ", \"timestamp\": " << record.Timestamp
+            << ", \"qpc\": " << record.Qpc
+            << ", \"systemRelativeTime\": " << record.SystemRelativeTime
+            << ", \"width\": " << record.Width
+            << ", \"height\": " << record.Height
+            << ", \"dirtyRegionCount\": " << record.DirtyRegionCount
+            << ", \"dedupeCount\": " << record.DedupeCount
+            << ", \"encodeTime\": " << record.EncodeTime
+            << ", \"storedBytes\": " << record.StoredBytes
+            << ", \"cursorX\": " << record.CursorX
+            << ", \"cursorY\": " << record.CursorY
+            << ", \"cursorShape\": " << record.CursorShape
+            << ", \"tier\": " << record.Tier
+            << ", \"redactTime\": " << record.RedactTime
+            << ", \"idleTime\": " << record.IdleTime << " }";
+    }
+
+    stream << "\n  ]\n}\n";
+}
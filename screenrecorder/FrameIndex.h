@@ -0,0 +1,38 @@
+#pragma once
+
+#include "pch.h"
+#include "FrameMetadata.h"
+
+// The purpose of this class is to read and write the frame index, a compact binary file saved next to the screenshots
+// that holds one fixed-size FrameMetadata record per frame. Records are laid out back to back after the header, so
+// record i lives at sizeof(Header) + i * Header::RecordSize and can be read without parsing the rest of the file.
+class FrameIndex {
+public:
+    static const char* const filename;
+
+#pragma pack(push, 1)
+    struct Header
+    {
+        char Magic[4];
+        uint32_t Version;
+        uint32_t RecordSize;
+        uint32_t Reserved;
+        int64_t QpcFrequency;
+        uint64_t RecordCount;
+    };
+#pragma pack(pop)
+
+    /**
+     * @throws std::ios_base::failure if the file cannot be written
+     */
+    static void Write(const std::string& path, const std::vector<FrameMetadata>& records);
+
+    /**
+     * @throws std::ios_base::failure if the file cannot be read
+     * @throws std::runtime_error if the file is not a frame index
+     */
+    static std::vector<FrameMetadata> Read(const std::string& path, int64_t& qpcFrequency);
+
+    static void ExportCsv(std::ostream& stream, const std::vector<FrameMetadata>& records, int64_t qpcFrequency);
+    static void ExportJson(std::ostream& stream, const std::vector<FrameMetadata>& records, int64_t qpcFrequency);
+};
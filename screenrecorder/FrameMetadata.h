@@ -0,0 +1,29 @@
+#pragma once
+
+#include "pch.h"
+
+// The purpose of this struct is to describe a single captured frame. It is stored alongside the frame in the
+// circular buffer and written as a fixed-size record to the frame index when the buffer is saved.
+#pragma pack(push, 1)
+struct FrameMetadata
+{
+    uint64_t Sequence;           // Number of the frame since the recording started, counting only stored frames.
+    int64_t Timestamp;           // Wall clock time at which the frame arrived, as a UTC FILETIME (100ns ticks).
+    int64_t Qpc;                 // QueryPerformanceCounter value at which the frame arrived.
+    int64_t SystemRelativeTime;  // Direct3D11CaptureFrame::SystemRelativeTime of the frame, in 100ns ticks.
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t DirtyRegionCount;   // Number of regions that changed since the previous stored frame, 0 if unknown.
+    uint32_t DedupeCount;        // Number of frames that arrived since the previous stored frame and were folded into this one.
+    uint32_t EncodeTime;         // Time spent encoding the frame when it was saved, in microseconds.
+    uint32_t StoredBytes;        // Bytes copied into the buffer for the frame: the whole frame, or only its dirty regions.
+    int32_t CursorX;             // Position of the cursor hotspot relative to the top left of the frame.
+    int32_t CursorY;
+    uint32_t CursorShape;        // CursorCache id of the cursor drawn over the frame at save time, 0 if none.
+    uint32_t Tier;               // Retention tier that held the frame, 0 for the buffer that frames are captured into.
+    uint32_t RedactTime;         // Time spent finding and hiding the redacted regions of the frame, in microseconds.
+    uint32_t IdleTime;           // Time nobody used the machine just before the frame, in milliseconds, 0 if it was in use.
+};
+#pragma pack(pop)
+
+static_assert(sizeof(FrameMetadata) == 80, "FrameMetadata is written to disk and must keep its layout.");
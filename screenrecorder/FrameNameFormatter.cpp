@@ -0,0 +1,75 @@
+#include "pch.h"
+#include "FrameNameFormatter.h"
+
+static const char prefix[] = "screenshot_";
+
+#ifndef _WIN32
+// Seconds from the FILETIME epoch, 1601, to the Unix epoch, 1970.
+static const int64_t unixEpochSeconds = 11644473600;
+#endif
+
+static char* WriteDigits(char* out, unsigned int value, int digits)
+{
+    for (int i = digits - 1; i >= 0; i--)
+    {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+
+    return out + digits;
+}
+
+size_t FrameNameFormatter::Format(int64_t timestamp, const char* extension, char (&buffer)[maxLength])
+{
+#ifdef _WIN32
+    FILETIME utcTime, localTime;
+    utcTime.dwLowDateTime = static_cast<DWORD>(timestamp);
+    utcTime.dwHighDateTime = static_cast<DWORD>(timestamp >> 32);
+
+    SYSTEMTIME time = {};
+    FileTimeToLocalFileTime(&utcTime, &localTime);
+    FileTimeToSystemTime(&localTime, &time);
+
+    int64_t localTimestamp = (static_cast<int64_t>(localTime.dwHighDateTime) << 32) | localTime.dwLowDateTime;
+    unsigned int microseconds = static_cast<unsigned int>(localTimestamp % 10000000 / 10);
+
+    unsigned int year = time.wYear, month = time.wMonth, day = time.wDay;
+    unsigned int hour = time.wHour, minute = time.wMinute, second = time.wSecond;
+#else
+    // localtime_r keeps its result in the caller's struct, so it is as safe to call from any thread.
+    time_t unixTime = static_cast<time_t>(timestamp / 10000000 - unixEpochSeconds);
+    struct tm time = {};
+    localtime_r(&unixTime, &time);
+
+    unsigned int microseconds = static_cast<unsigned int>(timestamp % 10000000 / 10);
+
+    unsigned int year = time.tm_year + 1900, month = time.tm_mon + 1, day = time.tm_mday;
+    unsigned int hour = time.tm_hour, minute = time.tm_min, second = time.tm_sec;
+#endif
+
+    char* out = std::copy(prefix, prefix + sizeof(prefix) - 1, buffer);
+    out = WriteDigits(out, year, 4);
+    *out++ = '-';
+    out = WriteDigits(out, month, 2);
+    *out++ = '-';
+    out = WriteDigits(out, day, 2);
+    *out++ = '_';
+    out = WriteDigits(out, hour, 2);
+    *out++ = '-';
+    out = WriteDigits(out, minute, 2);
+    *out++ = '-';
+    out = WriteDigits(out, second, 2);
+    *out++ = '-';
+    out = WriteDigits(out, microseconds, 6);
+
+    char* end = buffer + maxLength - 1;
+
+    while (*extension != '\0' && out < end)
+    {
+        *out++ = *extension++;
+    }
+
+    *out = '\0';
+
+    return out - buffer;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "pch.h"
+
+// The purpose of this class is to render the filename of a frame from its timestamp. Frames only store their 64-bit
+// timestamp, so names are rendered on demand into a caller-provided fixed-size buffer without touching the heap,
+// the locale or the CRT's shared std::localtime state.
+class FrameNameFormatter {
+public:
+    // Large enough for "screenshot_YYYY-MM-DD_HH-MM-SS-uuuuuu" plus an extension and the terminating null.
+    static const size_t maxLength = 64;
+
+    /**
+     * Renders "screenshot_YYYY-MM-DD_HH-MM-SS-uuuuuu<extension>" in local time for a UTC FILETIME timestamp.
+     * @returns the length of the rendered name, not counting the terminating null
+     */
+    static size_t Format(int64_t timestamp, const char* extension, char (&buffer)[maxLength]);
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "pch.h"
+
+// The purpose of this interface is to separate where frames come from from what the recorder does with them, so the
+// buffering and save path can be fed by the Windows capture API or, without a display, by prepared frames. Frames are
+// D3D11 textures, so every source runs on Windows. Sources without textures, such as XShmFrameSource on Linux, are a
+// PixelFrameSource instead.
+class FrameSource {
+public:
+    /**
+     * Receives every frame the source produces, on a thread of the source. The texture is only valid during the call.
+     * @param systemRelativeTime time the frame was produced, in 100 nanosecond units
+     */
+    using FrameHandler = std::function<void(winrt::com_ptr<ID3D11Texture2D> const& texture, int64_t systemRelativeTime)>;
+
+    virtual ~FrameSource() = default;
+
+    virtual void start(const FrameHandler& handler) = 0;
+
+    // Stops producing frames. A frame already being handled may still finish.
+    virtual void close() = 0;
+
+    // Stops producing frames, and the work of producing them, until resume. A frame already being handled may still
+    // finish. Pausing a paused source, or resuming one that is running, does nothing.
+    virtual void pause() = 0;
+    virtual void resume() = 0;
+
+    // Size of the frames the source produces.
+    virtual winrt::Windows::Graphics::SizeInt32 size() const = 0;
+};
@@ -0,0 +1,118 @@
+#include "pch.h"
+#include "GraphicsCaptureSource.h"
+
+namespace winrt
+{
+    using namespace Windows::Foundation;
+    using namespace Windows::Graphics::Capture;
+    using namespace Windows::Graphics::DirectX;
+    using namespace Windows::Graphics::DirectX::Direct3D11;
+}
+
+GraphicsCaptureSource::GraphicsCaptureSource(winrt::IDirect3DDevice const& device, winrt::GraphicsCaptureItem const& item, bool captureCursor, winrt::DirectXPixelFormat pixelFormat) :
+    m_device(device), m_pixelFormat(pixelFormat), m_captureCursor(captureCursor)
+{
+    m_item = item;
+    m_size = m_item.Size();
+
+    create_session();
+}
+
+void GraphicsCaptureSource::create_session()
+{
+    // A free threaded frame pool raises FrameArrived on a thread of its own, so the thread that creates the session,
+    // such as the activity thread resuming it, needs no DispatcherQueue.
+    m_framePool = winrt::Direct3D11CaptureFramePool::CreateFreeThreaded(m_device, m_pixelFormat, 2, m_size);
+    m_session = m_framePool.CreateCaptureSession(m_item);
+
+    if (!m_captureCursor)
+    {
+        m_session.IsCursorCaptureEnabled(false);
+    }
+
+    m_framePool.FrameArrived({ this, &GraphicsCaptureSource::on_frame_arrived });
+}
+
+void GraphicsCaptureSource::start(const FrameHandler& handler)
+{
+    if (m_closed.load())
+    {
+        throw winrt::hresult_error(RO_E_CLOSED);
+    }
+
+    std::lock_guard<std::mutex> lock(m_sessionMutex);
+
+    m_handler = handler;
+
+    // A source paused before it started starts when it is resumed.
+    if (!m_paused)
+    {
+        m_session.StartCapture();
+    }
+}
+
+void GraphicsCaptureSource::close()
+{
+    auto expected = false;
+    if (m_closed.compare_exchange_strong(expected, true))
+    {
+        std::lock_guard<std::mutex> lock(m_sessionMutex);
+
+        // A paused source has already closed its session.
+        if (m_session)
+        {
+            m_session.Close();
+            m_framePool.Close();
+        }
+
+        m_framePool = nullptr;
+        m_session = nullptr;
+        m_item = nullptr;
+    }
+}
+
+void GraphicsCaptureSource::pause()
+{
+    std::lock_guard<std::mutex> lock(m_sessionMutex);
+
+    if (m_closed.load() || m_paused)
+    {
+        return;
+    }
+
+    m_session.Close();
+    m_framePool.Close();
+
+    m_framePool = nullptr;
+    m_session = nullptr;
+    m_paused = true;
+}
+
+void GraphicsCaptureSource::resume()
+{
+    std::lock_guard<std::mutex> lock(m_sessionMutex);
+
+    if (m_closed.load() || !m_paused)
+    {
+        return;
+    }
+
+    create_session();
+    m_session.StartCapture();
+    m_paused = false;
+}
+
+void GraphicsCaptureSource::on_frame_arrived(winrt::Direct3D11CaptureFramePool const& sender, winrt::IInspectable const&)
+{
+    auto frame = sender.TryGetNextFrame();
+
+    if (!frame)
+    {
+        return;
+    }
+
+    // The frame goes back to the pool once it is released, so the handler runs while it is held.
+    auto surfaceTexture = GetDXGIInterfaceFromObject<ID3D11Texture2D>(frame.Surface());
+
+    m_handler(surfaceTexture, frame.SystemRelativeTime().count());
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "pch.h"
+#include "FrameSource.h"
+
+// The purpose of this class is to produce frames of a monitor, or of all monitors, with Windows.Graphics.Capture.
+class GraphicsCaptureSource : public FrameSource {
+public:
+    /**
+     * @param captureCursor draws the cursor into the frames
+     * @param pixelFormat B8G8R8A8UIntNormalized, or R16G16B16A16Float to keep the HDR range of the desktop
+     */
+    GraphicsCaptureSource(winrt::Windows::Graphics::DirectX::Direct3D11::IDirect3DDevice const& device,
+        winrt::Windows::Graphics::Capture::GraphicsCaptureItem const& item, bool captureCursor,
+        winrt::Windows::Graphics::DirectX::DirectXPixelFormat pixelFormat = winrt::Windows::Graphics::DirectX::DirectXPixelFormat::B8G8R8A8UIntNormalized);
+    ~GraphicsCaptureSource() { close(); }
+
+    void start(const FrameHandler& handler) override;
+    void close() override;
+
+    // The capture API cannot pause a session, so pausing closes it, and resuming starts a new one on the same item.
+    void pause() override;
+    void resume() override;
+    winrt::Windows::Graphics::SizeInt32 size() const override { return m_size; }
+
+private:
+    void create_session();
+
+    void on_frame_arrived(winrt::Windows::Graphics::Capture::Direct3D11CaptureFramePool const& sender,
+        winrt::Windows::Foundation::IInspectable const& args);
+
+    winrt::Windows::Graphics::Capture::GraphicsCaptureItem m_item{ nullptr };
+    winrt::Windows::Graphics::Capture::Direct3D11CaptureFramePool m_framePool{ nullptr };
+    winrt::Windows::Graphics::Capture::GraphicsCaptureSession m_session{ nullptr };
+    winrt::Windows::Graphics::DirectX::Direct3D11::IDirect3DDevice m_device{ nullptr };
+    winrt::Windows::Graphics::DirectX::DirectXPixelFormat m_pixelFormat;
+    bool m_captureCursor;
+    winrt::Windows::Graphics::SizeInt32 m_size;
+    FrameHandler m_handler;
+    std::atomic<bool> m_closed = false;
+
+    // Guards the frame pool and session, which pausing and resuming replace while close may run on another thread.
+    std::mutex m_sessionMutex;
+    bool m_paused = false;
+};
@@ -0,0 +1,141 @@
+#include "pch.h"
+#include "JobManager.h"
+
+JobManager::~JobManager()
+{
+    for (auto& [id, job] : m_jobs)
+    {
+        if (job.thread.joinable())
+        {
+            job.thread.join();
+        }
+    }
+}
+
+int JobManager::submit(std::function<void()> work)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    prune();
+
+    int id = m_nextId++;
+    Job& job = m_jobs[id];
+    job.state = JobState::Running;
+
+    job.thread = std::thread([this, id, work = std::move(work)]()
+        {
+            JobState state = JobState::Succeeded;
+            std::string message;
+
+            try
+            {
+                work();
+            }
+            catch (const std::exception& e)
+            {
+                state = JobState::Failed;
+                message = e.what();
+            }
+            catch (const winrt::hresult_error& e)
+            {
+                state = JobState::Failed;
+                message = winrt::to_string(e.message());
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            m_jobs[id].state = state;
+            m_jobs[id].message = message;
+            m_jobFinished.notify_all();
+        });
+
+    return id;
+}
+
+JobState JobManager::status(int id, std::string& message)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    prune();
+
+    auto it = m_jobs.find(id);
+
+    if (it == m_jobs.end())
+    {
+        return JobState::Unknown;
+    }
+
+    message = it->second.message;
+    it->second.reported = it->second.state != JobState::Running;
+
+    return it->second.state;
+}
+
+JobState JobManager::wait(int id, std::string& message)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    prune();
+
+    auto it = m_jobs.find(id);
+
+    if (it == m_jobs.end())
+    {
+        return JobState::Unknown;
+    }
+
+    // A job is never forgotten while someone waits on it, so the iterator stays valid.
+    it->second.waiters++;
+    m_jobFinished.wait(lock, [&it]() { return it->second.state != JobState::Running; });
+    it->second.waiters--;
+
+    message = it->second.message;
+    it->second.reported = true;
+
+    return it->second.state;
+}
+
+void JobManager::prune()
+{
+    size_t unreported = 0;
+
+    for (const auto& [id, job] : m_jobs)
+    {
+        if (job.state != JobState::Running && !job.reported)
+        {
+            unreported++;
+        }
+    }
+
+    // Jobs are kept in the order they were submitted, so the oldest unreported jobs are forgotten first.
+    for (auto it = m_jobs.begin(); it != m_jobs.end();)
+    {
+        Job& job = it->second;
+
+        if (job.state == JobState::Running || job.waiters > 0)
+        {
+            ++it;
+            continue;
+        }
+
+        // The state is set last, with the lock held, so the thread has nothing left to do but return.
+        if (job.thread.joinable())
+        {
+            job.thread.join();
+        }
+
+        if (job.reported)
+        {
+            it = m_jobs.erase(it);
+        }
+        else if (unreported > maxUnreportedJobs)
+        {
+            it = m_jobs.erase(it);
+            unreported--;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
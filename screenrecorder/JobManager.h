@@ -0,0 +1,47 @@
+#pragma once
+
+#include "pch.h"
+
+enum class JobState { Running, Succeeded, Failed, Unknown };
+
+// The purpose of this class is to run long operations, such as saving a recording, in the background. Every job gets
+// an id that clients can use to poll the job or wait for it to finish while other requests keep being served. A job is
+// forgotten once a client has been told how it ended, or once maxUnreportedJobs finished jobs after it were not asked
+// about either, so the id of a forgotten job is reported as unknown.
+class JobManager {
+public:
+    static const size_t maxUnreportedJobs = 64;
+
+    ~JobManager();
+
+    int submit(std::function<void()> work);
+
+    /**
+     * @param message receives the exception message of a failed job
+     */
+    JobState status(int id, std::string& message);
+
+    /**
+     * Blocks until the job has finished.
+     * @param message receives the exception message of a failed job
+     */
+    JobState wait(int id, std::string& message);
+
+private:
+    struct Job
+    {
+        JobState state;
+        std::string message;
+        std::thread thread;
+        bool reported = false;  // Whether a client was told how the job ended.
+        int waiters = 0;
+    };
+
+    // Joins the threads of finished jobs and forgets the jobs that can be. Called with the lock held.
+    void prune();
+
+    std::mutex m_mutex;
+    std::condition_variable m_jobFinished;
+    std::map<int, Job> m_jobs;
+    int m_nextId = 1;
+};
@@ -0,0 +1,317 @@
+#include "pch.h"
+#include "MotionEstimator.h"
+#include "TaskScheduler.h"
+
+static const uint64_t hashMultiplier = 0x9E3779B97F4A7C15ull;
+
+static uint64_t mix(uint64_t hash, uint64_t value)
+{
+    return (hash ^ value) * hashMultiplier;
+}
+
+void MotionEstimator::reset()
+{
+    m_width = 0;
+    m_height = 0;
+    m_rowHashes.clear();
+    m_columnHashes.clear();
+    m_previousRowHashes.clear();
+    m_previousColumnHashes.clear();
+}
+
+void MotionEstimator::hash_frame(const uint8_t* pixels, uint32_t rowPitch)
+{
+    m_rowHashes.resize(static_cast<size_t>(m_height) * m_stripCount);
+    m_columnHashes.resize(static_cast<size_t>(m_width) * m_bandCount);
+
+    // Bands hash independently, each writing the rows it holds and its own hash of every column.
+    TaskScheduler::shared().parallel_for(m_bandCount, [&](uint32_t band)
+        {
+            uint32_t top = band * laneSize;
+            uint32_t bottom = std::min(top + laneSize, m_height);
+            std::vector<uint64_t> columns(m_width, 0);
+
+            for (uint32_t y = top; y < bottom; y++)
+            {
+                const uint8_t* row = pixels + static_cast<size_t>(y) * rowPitch;
+                uint64_t* rowHashes = m_rowHashes.data() + static_cast<size_t>(y) * m_stripCount;
+
+                for (uint32_t strip = 0; strip < m_stripCount; strip++)
+                {
+                    uint32_t left = strip * laneSize;
+                    uint32_t right = std::min(left + laneSize, m_width);
+                    uint64_t hash = 0;
+                    uint32_t x = left;
+
+                    // Rows are hashed two pixels at a time, which halves the chain of multiplications each one waits on.
+                    for (; x + 2 <= right; x += 2)
+                    {
+                        uint64_t pair;
+                        memcpy(&pair, row + static_cast<size_t>(x) * 4, sizeof(pair));
+
+                        hash = mix(hash, pair);
+                        columns[x] = mix(columns[x], static_cast<uint32_t>(pair));
+                        columns[x + 1] = mix(columns[x + 1], pair >> 32);
+                    }
+
+                    if (x < right)
+                    {
+                        uint32_t pixel;
+                        memcpy(&pixel, row + static_cast<size_t>(x) * 4, sizeof(pixel));
+
+                        hash = mix(hash, pixel);
+                        columns[x] = mix(columns[x], pixel);
+                    }
+
+                    rowHashes[strip] = hash;
+                }
+            }
+
+            for (uint32_t x = 0; x < m_width; x++)
+            {
+                m_columnHashes[static_cast<size_t>(x) * m_bandCount + band] = columns[x];
+            }
+        });
+}
+
+ScrollMotion MotionEstimator::estimate(const uint8_t* pixels, uint32_t rowPitch, uint32_t width, uint32_t height)
+{
+    ScrollMotion motion;
+
+    if (width != m_width || height != m_height)
+    {
+        reset();
+
+        m_width = width;
+        m_height = height;
+        m_stripCount = (width + laneSize - 1) / laneSize;
+        m_bandCount = (height + laneSize - 1) / laneSize;
+    }
+
+    hash_frame(pixels, rowPitch);
+
+    if (m_previousRowHashes.size() != m_rowHashes.size())
+    {
+        std::swap(m_rowHashes, m_previousRowHashes);
+        std::swap(m_columnHashes, m_previousColumnHashes);
+
+        return motion;
+    }
+
+    // The scroll is looked for within the tiles that changed, found from the row hashes of the strips.
+    uint32_t tileLeft = m_stripCount, tileTop = m_bandCount, tileRight = 0, tileBottom = 0;
+    uint32_t changedTiles = 0;
+
+    for (uint32_t band = 0; band < m_bandCount; band++)
+    {
+        uint32_t top = band * laneSize;
+        uint32_t bottom = std::min(top + laneSize, m_height);
+
+        for (uint32_t strip = 0; strip < m_stripCount; strip++)
+        {
+            uint32_t y = top;
+
+            while (y < bottom && m_rowHashes[static_cast<size_t>(y) * m_stripCount + strip] == m_previousRowHashes[static_cast<size_t>(y) * m_stripCount + strip])
+            {
+                y++;
+            }
+
+            if (y < bottom)
+            {
+                tileLeft = std::min(tileLeft, strip);
+                tileRight = std::max(tileRight, strip + 1);
+                tileTop = std::min(tileTop, band);
+                tileBottom = std::max(tileBottom, band + 1);
+                changedTiles++;
+            }
+        }
+    }
+
+    if (changedTiles >= minChangedTiles)
+    {
+        uint32_t top = tileTop * laneSize;
+        uint32_t bottom = std::min(tileBottom * laneSize, m_height);
+        uint32_t left = tileLeft * laneSize;
+        uint32_t right = std::min(tileRight * laneSize, m_width);
+
+        // Vertical scrolling is far more common, so it is looked for first.
+        if (auto vertical = find_motion(m_rowHashes, m_previousRowHashes, m_stripCount, top, bottom, tileLeft, tileRight))
+        {
+            motion.Rect = { vertical->laneBegin * laneSize, vertical->lineBegin, std::min(vertical->laneEnd * laneSize, m_width), vertical->lineEnd };
+            motion.DeltaY = vertical->offset;
+        }
+        else if (auto horizontal = find_motion(m_columnHashes, m_previousColumnHashes, m_bandCount, left, right, tileTop, tileBottom))
+        {
+            motion.Rect = { horizontal->lineBegin, horizontal->laneBegin * laneSize, horizontal->lineEnd, std::min(horizontal->laneEnd * laneSize, m_height) };
+            motion.DeltaX = horizontal->offset;
+        }
+    }
+
+    std::swap(m_rowHashes, m_previousRowHashes);
+    std::swap(m_columnHashes, m_previousColumnHashes);
+
+    return motion;
+}
+
+std::optional<MotionEstimator::AxisMotion> MotionEstimator::find_motion(const std::vector<uint64_t>& hashes, const std::vector<uint64_t>& previous, uint32_t laneCount,
+    uint32_t lineBegin, uint32_t lineEnd, uint32_t laneBegin, uint32_t laneEnd)
+{
+    if (lineEnd - lineBegin < minMovedLines * 2)
+    {
+        return std::nullopt;
+    }
+
+    auto hash_at = [laneCount](const std::vector<uint64_t>& table, uint32_t line, uint32_t lane)
+        {
+            return table[static_cast<size_t>(line) * laneCount + lane];
+        };
+
+    // A few lanes spread over the changed area vote for offsets. A line only votes if its hash appears once among the
+    // previous lines, so blank lines and repeated text do not vote for every offset.
+    std::map<int32_t, uint32_t> votes;
+    std::vector<std::pair<uint64_t, uint32_t>> sorted;
+
+    for (uint32_t sample = 1; sample <= 3; sample++)
+    {
+        uint32_t lane = laneBegin + (laneEnd - laneBegin) * sample / 4;
+
+        sorted.clear();
+
+        for (uint32_t line = lineBegin; line < lineEnd; line++)
+        {
+            sorted.push_back({ hash_at(previous, line, lane), line });
+        }
+
+        std::sort(sorted.begin(), sorted.end());
+
+        for (uint32_t line = lineBegin; line < lineEnd; line++)
+        {
+            uint64_t hash = hash_at(hashes, line, lane);
+            auto first = std::lower_bound(sorted.begin(), sorted.end(), std::make_pair(hash, 0u));
+
+            if (first == sorted.end() || first->first != hash || (first + 1 != sorted.end() && (first + 1)->first == hash) || first->second == line)
+            {
+                continue;
+            }
+
+            votes[static_cast<int32_t>(line) - static_cast<int32_t>(first->second)]++;
+        }
+    }
+
+    auto best = std::max_element(votes.begin(), votes.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+
+    if (best == votes.end() || best->second < minMovedLines)
+    {
+        return std::nullopt;
+    }
+
+    int32_t offset = best->first;
+    uint32_t span = lineEnd - lineBegin - static_cast<uint32_t>(std::abs(offset));
+
+    // Every lane is then checked at that offset. A lane fits the offset if most of its lines match the previous frame
+    // at the offset, which leaves out lanes that only partly moved, such as a strip that straddles the edge of a
+    // scrolling window. It moved if more of its lines match at the offset than without moving. Lanes that fit either
+    // way, such as blank margins, may be moved or not.
+    enum class Fit { None, Either, Moved };
+    std::vector<Fit> fits(laneEnd - laneBegin);
+
+    for (uint32_t lane = laneBegin; lane < laneEnd; lane++)
+    {
+        uint32_t matched = 0, stayed = 0;
+
+        for (uint32_t line = lineBegin; line < lineEnd; line++)
+        {
+            int32_t from = static_cast<int32_t>(line) - offset;
+
+            if (from >= static_cast<int32_t>(lineBegin) && from < static_cast<int32_t>(lineEnd) && hash_at(hashes, line, lane) == hash_at(previous, from, lane))
+            {
+                matched++;
+            }
+
+            if (hash_at(hashes, line, lane) == hash_at(previous, line, lane))
+            {
+                stayed++;
+            }
+        }
+
+        fits[lane - laneBegin] = matched * 4 < span * 3 ? Fit::None : matched > stayed ? Fit::Moved : Fit::Either;
+    }
+
+    // The run of neighboring lanes that fit with the most lanes that moved is taken as the scrolling area, without the
+    // lanes at its ends that did not need to move.
+    uint32_t runBegin = 0, runEnd = 0, runMoved = 0;
+
+    for (uint32_t lane = laneBegin; lane < laneEnd;)
+    {
+        if (fits[lane - laneBegin] == Fit::None)
+        {
+            lane++;
+            continue;
+        }
+
+        uint32_t start = lane, end = lane, movedCount = 0;
+
+        for (; lane < laneEnd && fits[lane - laneBegin] != Fit::None; lane++)
+        {
+            if (fits[lane - laneBegin] == Fit::Moved)
+            {
+                start = movedCount == 0 ? lane : start;
+                end = lane + 1;
+                movedCount++;
+            }
+        }
+
+        if (movedCount > runMoved)
+        {
+            runBegin = start;
+            runEnd = end;
+            runMoved = movedCount;
+        }
+    }
+
+    if (runEnd == runBegin)
+    {
+        return std::nullopt;
+    }
+
+    // Within the run, the moved lines are those where every lane matches, and the area runs from where the first of
+    // them came from to where the last one went.
+    std::optional<uint32_t> first, last;
+
+    for (uint32_t line = lineBegin; line < lineEnd; line++)
+    {
+        int32_t from = static_cast<int32_t>(line) - offset;
+
+        if (from < static_cast<int32_t>(lineBegin) || from >= static_cast<int32_t>(lineEnd))
+        {
+            continue;
+        }
+
+        uint32_t lane = runBegin;
+
+        while (lane < runEnd && hash_at(hashes, line, lane) == hash_at(previous, from, lane))
+        {
+            lane++;
+        }
+
+        if (lane == runEnd)
+        {
+            first = first.value_or(line);
+            last = line;
+        }
+    }
+
+    if (!first || *last + 1 - *first < minMovedLines)
+    {
+        return std::nullopt;
+    }
+
+    AxisMotion motion;
+    motion.offset = offset;
+    motion.laneBegin = runBegin;
+    motion.laneEnd = runEnd;
+    motion.lineBegin = static_cast<uint32_t>(std::min<int32_t>(*first, static_cast<int32_t>(*first) - offset));
+    motion.lineEnd = static_cast<uint32_t>(std::max<int32_t>(*last + 1, static_cast<int32_t>(*last + 1) - offset));
+
+    return motion;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "pch.h"
+#include "DirtyRegions.h"
+
+// The purpose of this class is to notice when a BGRA8 frame is the previous frame scrolled, as when reading logs or a
+// document, so the frame buffer can store the offset and the band that scrolled into view instead of the nearly
+// every pixel that changed. Each row of every 32 pixel wide strip, and each column of every 32 pixel tall band, is
+// hashed once per frame. Strips whose row hashes match the previous frame's at the same offset are taken to have
+// scrolled vertically, and bands whose column hashes match at the same offset to have scrolled horizontally. The
+// hashes are only used to find the scroll: the dirty region detector compares the pixels themselves once the previous
+// frame is moved, so a mistaken match costs space but never changes a stored frame.
+class MotionEstimator {
+public:
+    // Strips and bands line up with the tiles of the dirty region detector.
+    static constexpr uint32_t laneSize = DirtyRegionDetector::tileSize;
+
+    // Fewest changed tiles worth looking for a scroll in, and fewest rows or columns a scroll must move.
+    static constexpr uint32_t minChangedTiles = 8;
+    static constexpr uint32_t minMovedLines = 16;
+
+    /**
+     * Hashes the frame, looks for a scroll since the previous frame, and remembers the hashes for the next call.
+     * @returns a motion with no offset if nothing scrolled, and for the first frame or a frame of a new size
+     */
+    ScrollMotion estimate(const uint8_t* pixels, uint32_t rowPitch, uint32_t width, uint32_t height);
+
+    // Forgets the previous frame.
+    void reset();
+
+private:
+    struct AxisMotion
+    {
+        int32_t offset;
+        uint32_t laneBegin, laneEnd;  // Lanes that moved.
+        uint32_t lineBegin, lineEnd;  // Lines moved from and to.
+    };
+
+    void hash_frame(const uint8_t* pixels, uint32_t rowPitch);
+
+    /**
+     * Looks for an offset most lines of neighboring lanes moved by. Hashes are laid out line by line, laneCount to a
+     * line, so rows of strips and columns of bands are searched the same way.
+     */
+    static std::optional<AxisMotion> find_motion(const std::vector<uint64_t>& hashes, const std::vector<uint64_t>& previous, uint32_t laneCount,
+        uint32_t lineBegin, uint32_t lineEnd, uint32_t laneBegin, uint32_t laneEnd);
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_stripCount = 0;
+    uint32_t m_bandCount = 0;
+    std::vector<uint64_t> m_rowHashes;       // Per row, one hash per strip.
+    std::vector<uint64_t> m_columnHashes;    // Per column, one hash per band.
+    std::vector<uint64_t> m_previousRowHashes;
+    std::vector<uint64_t> m_previousColumnHashes;
+};
@@ -0,0 +1,221 @@
+#include "pch.h"
+#include "OutputWriter.h"
+
+OutputWriter::Write::~Write()
+{
+    if (buffer)
+    {
+        VirtualFree(buffer, 0, MEM_RELEASE);
+    }
+}
+
+OutputWriter::OutputWriter(const std::wstring& folder, bool directIo, bool durable, size_t maxPendingBytes) :
+    m_folder(folder), m_directIo(directIo), m_durable(durable), m_maxPendingBytes(maxPendingBytes)
+{
+    m_port.reset(CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0));
+
+    if (!m_port)
+    {
+        winrt::throw_last_error();
+    }
+}
+
+OutputWriter::~OutputWriter()
+{
+    try
+    {
+        finish();
+    }
+    catch (...)
+    {
+    }
+}
+
+void OutputWriter::write(std::string_view filename, const uint8_t* data, size_t size)
+{
+    // Direct writes must cover whole sectors, so they are rounded up and the file is cut back to size once written.
+    size_t writeSize = m_directIo ? (size + directAlignment - 1) / directAlignment * directAlignment : size;
+    std::wstring path = m_folder + L"\\" + std::wstring(winrt::to_hstring(filename));
+
+    wil::unique_handle file(CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | (m_directIo ? FILE_FLAG_NO_BUFFERING : 0), nullptr));
+
+    if (!file)
+    {
+        winrt::throw_last_error();
+    }
+
+    // Sizing the file up front lets the file system place it in one piece. The preallocated space is not marked as
+    // valid data, so a read past what was written sees zeroes rather than whatever was on the disk before, even if
+    // the write fails. Each file is written in one piece from its start, so there is nothing before it to zero.
+    FILE_ALLOCATION_INFO allocation = {};
+    allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(writeSize);
+
+    FILE_END_OF_FILE_INFO endOfFile = {};
+    endOfFile.EndOfFile.QuadPart = static_cast<LONGLONG>(writeSize);
+
+    if (!SetFileInformationByHandle(file.get(), FileAllocationInfo, &allocation, sizeof(allocation)) ||
+        !SetFileInformationByHandle(file.get(), FileEndOfFileInfo, &endOfFile, sizeof(endOfFile)))
+    {
+        winrt::throw_last_error();
+    }
+
+    if (!CreateIoCompletionPort(file.get(), m_port.get(), 0, 0))
+    {
+        winrt::throw_last_error();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Past the budget, a write waits for earlier ones to finish and hand back their buffers.
+    while (m_pendingCount > 0 && m_pendingBytes + writeSize > m_maxPendingBytes)
+    {
+        complete_one(INFINITE);
+    }
+
+    std::unique_ptr<Write> write = acquire(writeSize);
+    memcpy(write->buffer, data, size);
+    memset(write->buffer + size, 0, writeSize - size);
+
+    write->overlapped = {};
+    write->file = file.get();
+    write->size = size;
+
+    if (!WriteFile(file.get(), write->buffer, static_cast<DWORD>(writeSize), nullptr, &write->overlapped) && GetLastError() != ERROR_IO_PENDING)
+    {
+        HRESULT error = HRESULT_FROM_WIN32(GetLastError());
+        m_freeWrites.push_back(std::move(write));
+
+        winrt::throw_hresult(error);
+    }
+
+    // A write that completed at once still queues its completion, so every write is handed back the same way.
+    m_pendingBytes += write->capacity;
+    m_pendingCount++;
+    write.release();
+
+    m_files.push_back(std::move(file));
+}
+
+void OutputWriter::write(std::string_view filename, winrt::Windows::Storage::Streams::IRandomAccessStream const& stream)
+{
+    winrt::Windows::Storage::Streams::Buffer buffer(static_cast<uint32_t>(stream.Size()));
+    stream.Seek(0);
+    stream.ReadAsync(buffer, buffer.Capacity(), winrt::Windows::Storage::Streams::InputStreamOptions::None).get();
+
+    write(filename, buffer.data(), buffer.Length());
+}
+
+void OutputWriter::finish()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    while (m_pendingCount > 0)
+    {
+        if (!complete_one(INFINITE))
+        {
+            record_error(HRESULT_FROM_WIN32(GetLastError()));
+            break;
+        }
+    }
+
+    // The files are flushed together once every write is done, rather than waiting for the disk after each file.
+    if (m_durable)
+    {
+        for (const auto& file : m_files)
+        {
+            if (!FlushFileBuffers(file.get()))
+            {
+                record_error(HRESULT_FROM_WIN32(GetLastError()));
+            }
+        }
+    }
+
+    m_files.clear();
+
+    HRESULT error = m_error;
+    m_error = S_OK;
+
+    winrt::check_hresult(error);
+}
+
+std::unique_ptr<OutputWriter::Write> OutputWriter::acquire(size_t size)
+{
+    auto fits = std::find_if(m_freeWrites.begin(), m_freeWrites.end(), [size](const auto& write) { return write->capacity >= size; });
+
+    if (fits != m_freeWrites.end())
+    {
+        std::unique_ptr<Write> write = std::move(*fits);
+        m_freeWrites.erase(fits);
+
+        return write;
+    }
+
+    // None is large enough, so one is dropped in its place, which keeps no more buffers than were ever in flight.
+    if (!m_freeWrites.empty())
+    {
+        m_freeWrites.pop_back();
+    }
+
+    auto write = std::make_unique<Write>();
+    write->capacity = (std::max<size_t>(size, 1) + bufferGranularity - 1) / bufferGranularity * bufferGranularity;
+    write->buffer = static_cast<uint8_t*>(VirtualAlloc(nullptr, write->capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+
+    if (!write->buffer)
+    {
+        throw std::bad_alloc();
+    }
+
+    return write;
+}
+
+bool OutputWriter::complete_one(DWORD timeout)
+{
+    DWORD bytes = 0;
+    ULONG_PTR key = 0;
+    OVERLAPPED* overlapped = nullptr;
+
+    BOOL succeeded = GetQueuedCompletionStatus(m_port.get(), &bytes, &key, &overlapped, timeout);
+
+    if (!overlapped)
+    {
+        return false;
+    }
+
+    std::unique_ptr<Write> write(reinterpret_cast<Write*>(overlapped));
+
+    if (!succeeded)
+    {
+        record_error(HRESULT_FROM_WIN32(GetLastError()));
+    }
+    else
+    {
+        if (m_directIo)
+        {
+            FILE_END_OF_FILE_INFO endOfFile = {};
+            endOfFile.EndOfFile.QuadPart = static_cast<LONGLONG>(write->size);
+
+            if (!SetFileInformationByHandle(write->file, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile)))
+            {
+                record_error(HRESULT_FROM_WIN32(GetLastError()));
+            }
+        }
+
+        m_filesWritten++;
+        m_bytesWritten += write->size;
+    }
+
+    m_pendingBytes -= write->capacity;
+    m_pendingCount--;
+    m_freeWrites.push_back(std::move(write));
+
+    return true;
+}
+
+void OutputWriter::record_error(HRESULT error)
+{
+    if (SUCCEEDED(m_error))
+    {
+        m_error = error;
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "pch.h"
+
+// The purpose of this class is to write the files of a save without waiting on the disk between them. Each file is
+// created at its final size, copied into a page-aligned buffer and written with a single overlapped write on an I/O
+// completion port, so the next frame is encoded while the last one is written. Files stay open until finish(), which
+// waits for the writes and flushes every file to disk at the end instead of after each one.
+class OutputWriter {
+public:
+    // Direct writes are rounded up to this size, and every buffer starts on a page, which satisfies any sector size.
+    static constexpr size_t directAlignment = 4096;
+
+    // Most bytes of buffers waiting to be written before write() waits for some of them to finish.
+    static constexpr size_t defaultMaxPendingBytes = 64 * 1024 * 1024;
+
+    // Buffers are allocated in multiples of this size, the granularity of VirtualAlloc, so they can be reused for
+    // files of slightly different sizes.
+    static constexpr size_t bufferGranularity = 64 * 1024;
+
+    /**
+     * @param folder existing folder to create the files in
+     * @param directIo writes around the system file cache, so a large save does not push everything else out of it
+     * @param durable flushes every file to disk in finish()
+     * @throws winrt::hresult_error if the completion port cannot be created
+     */
+    OutputWriter(const std::wstring& folder, bool directIo = false, bool durable = true, size_t maxPendingBytes = defaultMaxPendingBytes);
+
+    // Finishes the writes still in flight, without reporting errors.
+    ~OutputWriter();
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    /**
+     * Creates a file in the folder, replacing any file of the same name, and starts writing the data to it. The data is
+     * copied, so it may be reused as soon as this returns. Safe to call from several threads.
+     * @throws winrt::hresult_error if the file cannot be created or the write cannot be started
+     */
+    void write(std::string_view filename, const uint8_t* data, size_t size);
+
+    // Same, with the whole content of a stream, such as an encoder's in-memory output.
+    void write(std::string_view filename, winrt::Windows::Storage::Streams::IRandomAccessStream const& stream);
+
+    /**
+     * Waits for every write, flushes the files when durable and closes them. Writing may continue afterwards.
+     * @throws winrt::hresult_error with the first error a write or flush met
+     */
+    void finish();
+
+    size_t files_written() const { return m_filesWritten; }
+    uint64_t bytes_written() const { return m_bytesWritten; }
+
+private:
+    struct Write
+    {
+        OVERLAPPED overlapped;  // First, so a completed OVERLAPPED leads back to its write.
+        HANDLE file = nullptr;
+        uint8_t* buffer = nullptr;
+        size_t capacity = 0;
+        size_t size = 0;
+
+        ~Write();
+    };
+
+    // Takes a buffer of at least the given size from the free ones, or allocates one.
+    std::unique_ptr<Write> acquire(size_t size);
+
+    /**
+     * Handles one completed write, waiting up to the timeout for it.
+     * @returns false if none completed in time
+     */
+    bool complete_one(DWORD timeout);
+
+    // Keeps the first error, which is the one finish() reports.
+    void record_error(HRESULT error);
+
+    std::wstring m_folder;
+    bool m_directIo;
+    bool m_durable;
+    size_t m_maxPendingBytes;
+    wil::unique_handle m_port;
+
+    std::mutex m_mutex;
+    std::vector<wil::unique_handle> m_files;
+    std::vector<std::unique_ptr<Write>> m_freeWrites;
+    size_t m_pendingCount = 0;
+    size_t m_pendingBytes = 0;
+    HRESULT m_error = S_OK;
+
+    size_t m_filesWritten = 0;
+    uint64_t m_bytesWritten = 0;
+};
@@ -1,34 +1,37 @@
 #include "pch.h"
 #include "Pipe.h"
 
-Pipe::Pipe() : m_name(L"mypipe"), m_hpipe(INVALID_HANDLE_VALUE), m_mode(SERVER) 
+Pipe::Pipe() : m_name(L"mypipe"), m_hpipe(INVALID_HANDLE_VALUE), m_mode(CLIENT) 
 {
 }
 
-bool Pipe::try_init(const std::wstring& name, Mode mode) 
+Pipe::Pipe(const std::wstring& name, HANDLE hpipe) : m_name(name), m_hpipe(hpipe), m_mode(SERVER)
+{
+    m_ioEvent.create(wil::EventOptions::ManualReset);
+}
+
+bool Pipe::try_init(const std::wstring& name) 
 {
     m_name = name;
-    m_mode = mode;
-
-    if (m_mode == SERVER) {
-        m_hpipe = CreateNamedPipe(
-            (L"\\\\.\\pipe\\" + m_name).c_str(),
-            PIPE_ACCESS_DUPLEX,
-            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
-            1,
-            0,
-            0,
-            0,
-            NULL
-        );
+    m_mode = CLIENT;
 
-        if (m_hpipe == INVALID_HANDLE_VALUE) {
-            return false;
-        }
-    }
-    else {
+    std::wstring path = L"\\\\.\\pipe\\" + m_name;
+
+    m_hpipe = CreateFile(
+        path.c_str(),
+        GENERIC_READ | GENERIC_WRITE,
+        0,
+        NULL,
+        OPEN_EXISTING,
+        0,
+        NULL
+    );
+
+    // Every server instance may be busy with another client for a moment while the next instance is being created.
+    if (m_hpipe == INVALID_HANDLE_VALUE && GetLastError() == ERROR_PIPE_BUSY && WaitNamedPipe(path.c_str(), 2000))
+    {
         m_hpipe = CreateFile(
-            (L"\\\\.\\pipe\\" + m_name).c_str(),
+            path.c_str(),
             GENERIC_READ | GENERIC_WRITE,
             0,
             NULL,
@@ -36,11 +39,11 @@ bool Pipe::try_init(const std::wstring& name, Mode mode)
             0,
             NULL
         );
+    }
 
-        if (m_hpipe == INVALID_HANDLE_VALUE) 
-        {
-            return false;
-        }
+    if (m_hpipe == INVALID_HANDLE_VALUE) 
+    {
+        return false;
     }
 
     return true;
@@ -53,27 +56,94 @@ Pipe::~Pipe()
     }
 }
 
-void Pipe::send(const std::string& message) const
+BOOL Pipe::complete_io(BOOL result, OVERLAPPED& overlapped, DWORD& bytesTransferred) const
 {
-    DWORD bytesWritten;
+    if (!result && m_ioEvent && GetLastError() == ERROR_IO_PENDING)
+    {
+        return GetOverlappedResult(m_hpipe, &overlapped, &bytesTransferred, TRUE);
+    }
+
+    return result;
+}
 
-    if (!WriteFile(m_hpipe, message.c_str(), message.size(), &bytesWritten, NULL)) 
+void Pipe::send(const std::string& message) const
+{
+    if (message.size() > maxMessageSize)
     {
-        throw std::ios_base::failure("Failed to write to pipe\nWriteFile failed with error " + std::to_string(GetLastError()));
+        throw std::ios_base::failure("Failed to write to pipe\nMessage of " + std::to_string(message.size()) + " bytes is too long");
     }
+
+    // The length goes first, so the other end knows when it has read the whole message.
+    uint32_t length = static_cast<uint32_t>(message.size());
+
+    write_all(&length, sizeof(length));
+    write_all(message.data(), length);
 }
 
 std::string Pipe::receive() const
 {
-    char buffer[1024];
-    DWORD bytesRead;
+    uint32_t length = 0;
+    read_all(&length, sizeof(length));
+
+    if (length > maxMessageSize)
+    {
+        throw std::ios_base::failure("Failed to read from pipe\nMessage of " + std::to_string(length) + " bytes is too long");
+    }
+
+    std::string message(length, '\0');
+    read_all(message.data(), length);
+
+    return message;
+}
+
+void Pipe::write_all(const void* data, DWORD size) const
+{
+    const char* bytes = static_cast<const char*>(data);
 
-    if (!ReadFile(m_hpipe, buffer, sizeof(buffer), &bytesRead, NULL)) 
+    while (size > 0)
     {
-        throw std::ios_base::failure("Failed to read from pipe\nReadFile failed with error " + std::to_string(GetLastError()));
+        DWORD bytesWritten;
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = m_ioEvent.get();
+
+        BOOL result = WriteFile(m_hpipe, bytes, size, &bytesWritten, m_ioEvent ? &overlapped : NULL);
+
+        if (!complete_io(result, overlapped, bytesWritten))
+        {
+            throw std::ios_base::failure("Failed to write to pipe\nWriteFile failed with error " + std::to_string(GetLastError()));
+        }
+
+        bytes += bytesWritten;
+        size -= bytesWritten;
     }
+}
+
+void Pipe::read_all(void* data, DWORD size) const
+{
+    char* bytes = static_cast<char*>(data);
+
+    // A byte mode pipe returns whatever has arrived so far, which may be only part of a long message.
+    while (size > 0)
+    {
+        DWORD bytesRead;
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = m_ioEvent.get();
+
+        BOOL result = ReadFile(m_hpipe, bytes, size, &bytesRead, m_ioEvent ? &overlapped : NULL);
+
+        if (!complete_io(result, overlapped, bytesRead))
+        {
+            throw std::ios_base::failure("Failed to read from pipe\nReadFile failed with error " + std::to_string(GetLastError()));
+        }
+
+        if (bytesRead == 0)
+        {
+            throw std::ios_base::failure("Failed to read from pipe\nThe pipe was closed in the middle of a message");
+        }
 
-    return std::string(buffer, bytesRead);
+        bytes += bytesRead;
+        size -= bytesRead;
+    }
 }
 
 void Pipe::disconnect() const
@@ -83,21 +153,114 @@ void Pipe::disconnect() const
         throw std::invalid_argument("Cannot call disconnect on a client side pipe");
     }
 
+    // Unread data is discarded on disconnect, so wait for the client to read the last response first.
+    FlushFileBuffers(m_hpipe);
+
     if (!DisconnectNamedPipe(m_hpipe))
     {
         throw std::ios_base::failure("Failed to disconnect from pipe\nDisconnectNamedPipe failed with error " + std::to_string(GetLastError()));
     }
 }
 
-void Pipe::connect() const
+void Pipe::close() const
 {
-    if (m_mode != SERVER)
+    CancelIoEx(m_hpipe, NULL);
+
+    if (m_mode == SERVER)
     {
-        throw std::invalid_argument("Cannot call connect on a client side pipe");
+        DisconnectNamedPipe(m_hpipe);
     }
+}
+
+PipeListener::PipeListener() : m_name(L"mypipe"), m_hpipe(INVALID_HANDLE_VALUE)
+{
+}
+
+PipeListener::~PipeListener()
+{
+    if (m_hpipe != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_hpipe);
+    }
+}
+
+bool PipeListener::try_init(const std::wstring& name)
+{
+    m_name = name;
+    m_connectEvent.create(wil::EventOptions::ManualReset);
+    m_closeEvent.create(wil::EventOptions::ManualReset);
+
+    m_hpipe = create_instance(true);
+
+    return m_hpipe != INVALID_HANDLE_VALUE;
+}
+
+HANDLE PipeListener::create_instance(bool firstInstance) const
+{
+    return CreateNamedPipe(
+        (L"\\\\.\\pipe\\" + m_name).c_str(),
+        PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | (firstInstance ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+        PIPE_UNLIMITED_INSTANCES,
+        0,
+        0,
+        0,
+        NULL
+    );
+}
 
-    if (!ConnectNamedPipe(m_hpipe, NULL))
+std::unique_ptr<Connection> PipeListener::accept()
+{
+    if (m_closeEvent.is_signaled())
     {
-        throw std::ios_base::failure("Failed to disconnect from pipe\nDisconnectNamedPipe failed with error " + std::to_string(GetLastError()));
+        return nullptr;
+    }
+
+    OVERLAPPED overlapped = {};
+    overlapped.hEvent = m_connectEvent.get();
+    m_connectEvent.ResetEvent();
+
+    if (!ConnectNamedPipe(m_hpipe, &overlapped))
+    {
+        DWORD error = GetLastError();
+
+        if (error == ERROR_IO_PENDING)
+        {
+            HANDLE events[] = { m_connectEvent.get(), m_closeEvent.get() };
+            DWORD bytesTransferred;
+
+            if (WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, INFINITE) != WAIT_OBJECT_0)
+            {
+                CancelIoEx(m_hpipe, &overlapped);
+                GetOverlappedResult(m_hpipe, &overlapped, &bytesTransferred, TRUE);
+
+                return nullptr;
+            }
+
+            if (!GetOverlappedResult(m_hpipe, &overlapped, &bytesTransferred, FALSE))
+            {
+                throw std::ios_base::failure("Failed to connect to pipe\nConnectNamedPipe failed with error " + std::to_string(GetLastError()));
+            }
+        }
+        else if (error != ERROR_PIPE_CONNECTED)
+        {
+            throw std::ios_base::failure("Failed to connect to pipe\nConnectNamedPipe failed with error " + std::to_string(error));
+        }
+    }
+
+    std::unique_ptr<Connection> connection(new Pipe(m_name, m_hpipe));
+
+    // Create the instance the next client will connect to before this one is handed off.
+    m_hpipe = create_instance(false);
+
+    if (m_hpipe == INVALID_HANDLE_VALUE)
+    {
+        throw std::ios_base::failure("Failed to create pipe\nCreateNamedPipe failed with error " + std::to_string(GetLastError()));
     }
-}
\ No newline at end of file
+
+    return connection;
+}
+
+void PipeListener::close()
+{
+    m_closeEvent.SetEvent();
+}
@@ -1,39 +1,84 @@
 #pragma once
 
 #include "pch.h"
+#include "Transport.h"
 
 // The purpose of this class is to wrap communication via a named pipe. It allows a server and client to send messages to each other.
-class Pipe {
+class Pipe : public Connection {
 public:
     enum Mode { SERVER, CLIENT };
+
+    // Longest message that can be sent or received. Messages are requests and responses, so anything longer is garbage.
+    static const uint32_t maxMessageSize = 16 * 1024 * 1024;
+
     Pipe();
     ~Pipe();
-    bool try_init(const std::wstring& name, Mode mode);
 
     /**
-     * @throws std::ios_base::failure if function fails
+     * Connects to the server end of the named pipe.
      */
-    void send(const std::string& message) const;
+    bool try_init(const std::wstring& name);
 
     /**
-     * @throws std::ios_base::failure if function fails
+     * Sends the message with its length in front of it, so it is received whole however long it is.
+     * @throws std::ios_base::failure if function fails or the message is longer than maxMessageSize
      */
-    std::string receive() const;
+    void send(const std::string& message) const override;
 
     /**
-     * @throws std::invalid_argument if called on a SERVER pipe
-     * @throws std::ios_base::failure if attempt to disconnect fails
+     * Reads until a whole message sent by send has arrived.
+     * @throws std::ios_base::failure if function fails, the pipe closes before the message is whole, or the message is
+     * longer than maxMessageSize
      */
-    void disconnect() const;
+    std::string receive() const override;
 
     /**
-     * @throws std::invalid_argument if called on a SERVER pipe
-     * @throws std::ios_base::failure if attempt to connect fails
+     * @throws std::invalid_argument if called on a CLIENT pipe
+     * @throws std::ios_base::failure if attempt to disconnect fails
      */
-    void connect() const;
+    void disconnect() const override;
+
+    void close() const override;
 
 private:
+    friend class PipeListener;
+
+    // Wraps a connected server instance created for overlapped I/O by PipeListener.
+    Pipe(const std::wstring& name, HANDLE hpipe);
+
+    BOOL complete_io(BOOL result, OVERLAPPED& overlapped, DWORD& bytesTransferred) const;
+
+    // Write or read exactly the given number of bytes, taking as many calls as the pipe needs.
+    void write_all(const void* data, DWORD size) const;
+    void read_all(void* data, DWORD size) const;
+
     std::wstring m_name;
     HANDLE m_hpipe;
     Mode m_mode;
-};
\ No newline at end of file
+    wil::unique_event m_ioEvent;
+};
+
+// The purpose of this class is to accept clients on a named pipe. Every client gets its own pipe instance, so any
+// number of clients can be connected at the same time.
+class PipeListener : public Listener {
+public:
+    PipeListener();
+    ~PipeListener();
+    bool try_init(const std::wstring& name);
+
+    /**
+     * @returns nullptr once the listener has been closed
+     * @throws std::ios_base::failure if attempt to accept a client fails
+     */
+    std::unique_ptr<Connection> accept() override;
+
+    void close() override;
+
+private:
+    HANDLE create_instance(bool firstInstance) const;
+
+    std::wstring m_name;
+    HANDLE m_hpipe;
+    wil::unique_event m_connectEvent;
+    wil::unique_event m_closeEvent;
+};
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "pch.h"
+
+// Describes how one plane of a format is laid out in memory. Pixels are grouped into blocks of BlockWidth x BlockHeight
+// that take BytesPerBlock bytes, after the plane has been subsampled by SubsampleX x SubsampleY relative to the image.
+struct PlaneDescriptor
+{
+    uint8_t BytesPerBlock;
+    uint8_t BlockWidth;
+    uint8_t BlockHeight;
+    uint8_t SubsampleX;
+    uint8_t SubsampleY;
+
+    // Uncompressed single-plane formats: one pixel per block.
+    static constexpr PlaneDescriptor Pixel(uint8_t bytes) { return { bytes, 1, 1, 1, 1 }; }
+    // Block-compressed or packed formats: one block of width x height pixels.
+    static constexpr PlaneDescriptor Block(uint8_t bytes, uint8_t width, uint8_t height) { return { bytes, width, height, 1, 1 }; }
+    // Planes of planar formats, subsampled relative to the first plane.
+    static constexpr PlaneDescriptor Subsampled(uint8_t bytes, uint8_t subsampleX, uint8_t subsampleY) { return { bytes, 1, 1, subsampleX, subsampleY }; }
+};
+
+struct FormatDescriptor
+{
+    DXGI_FORMAT Format;
+    uint8_t PlaneCount;
+    PlaneDescriptor Planes[3];
+};
+
+// The purpose of this class is to compute exact memory sizes of DXGI surfaces at compile time or at runtime from a single
+// table that covers every non-opaque DXGI format, including block-compressed, packed and planar video formats.
+class PixelFormat {
+public:
+    static constexpr FormatDescriptor table[] =
+    {
+        { DXGI_FORMAT_R32G32B32A32_TYPELESS, 1, { PlaneDescriptor::Pixel(16) } },
+        { DXGI_FORMAT_R32G32B32A32_FLOAT, 1, { PlaneDescriptor::Pixel(16) } },
+        { DXGI_FORMAT_R32G32B32A32_UINT, 1, { PlaneDescriptor::Pixel(16) } },
+        { DXGI_FORMAT_R32G32B32A32_SINT, 1, { PlaneDescriptor::Pixel(16) } },
+        { DXGI_FORMAT_R32G32B32_TYPELESS, 1, { PlaneDescriptor::Pixel(12) } },
+        { DXGI_FORMAT_R32G32B32_FLOAT, 1, { PlaneDescriptor::Pixel(12) } },
+        { DXGI_FORMAT_R32G32B32_UINT, 1, { PlaneDescriptor::Pixel(12) } },
+        { DXGI_FORMAT_R32G32B32_SINT, 1, { PlaneDescriptor::Pixel(12) } },
+        { DXGI_FORMAT_R16G16B16A16_TYPELESS, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_R16G16B16A16_FLOAT, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_R16G16B16A16_UNORM, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_R16G16B16A16_UINT, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_R16G16B16A16_SNORM, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_R16G16B16A16_SINT, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_R32G32_TYPELESS, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_R32G32_FLOAT, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_R32G32_UINT, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_R32G32_SINT, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_R32G8X24_TYPELESS, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_D32_FLOAT_S8X24_UINT, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_X32_TYPELESS_G8X24_UINT, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_R10G10B10A2_TYPELESS, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R10G10B10A2_UNORM, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R10G10B10A2_UINT, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R11G11B10_FLOAT, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R8G8B8A8_TYPELESS, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R8G8B8A8_UNORM, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R8G8B8A8_UINT, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R8G8B8A8_SNORM, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R8G8B8A8_SINT, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R16G16_TYPELESS, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R16G16_FLOAT, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R16G16_UNORM, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R16G16_UINT, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R16G16_SNORM, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R16G16_SINT, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R32_TYPELESS, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_D32_FLOAT, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R32_FLOAT, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R32_UINT, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R32_SINT, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R24G8_TYPELESS, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_D24_UNORM_S8_UINT, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R24_UNORM_X8_TYPELESS, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_X24_TYPELESS_G8_UINT, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R8G8_TYPELESS, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_R8G8_UNORM, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_R8G8_UINT, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_R8G8_SNORM, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_R8G8_SINT, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_R16_TYPELESS, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_R16_FLOAT, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_D16_UNORM, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_R16_UNORM, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_R16_UINT, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_R16_SNORM, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_R16_SINT, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_R8_TYPELESS, 1, { PlaneDescriptor::Pixel(1) } },
+        { DXGI_FORMAT_R8_UNORM, 1, { PlaneDescriptor::Pixel(1) } },
+        { DXGI_FORMAT_R8_UINT, 1, { PlaneDescriptor::Pixel(1) } },
+        { DXGI_FORMAT_R8_SNORM, 1, { PlaneDescriptor::Pixel(1) } },
+        { DXGI_FORMAT_R8_SINT, 1, { PlaneDescriptor::Pixel(1) } },
+        { DXGI_FORMAT_A8_UNORM, 1, { PlaneDescriptor::Pixel(1) } },
+        { DXGI_FORMAT_R1_UNORM, 1, { PlaneDescriptor::Block(1, 8, 1) } },
+        { DXGI_FORMAT_R9G9B9E5_SHAREDEXP, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R8G8_B8G8_UNORM, 1, { PlaneDescriptor::Block(4, 2, 1) } },
+        { DXGI_FORMAT_G8R8_G8B8_UNORM, 1, { PlaneDescriptor::Block(4, 2, 1) } },
+        { DXGI_FORMAT_BC1_TYPELESS, 1, { PlaneDescriptor::Block(8, 4, 4) } },
+        { DXGI_FORMAT_BC1_UNORM, 1, { PlaneDescriptor::Block(8, 4, 4) } },
+        { DXGI_FORMAT_BC1_UNORM_SRGB, 1, { PlaneDescriptor::Block(8, 4, 4) } },
+        { DXGI_FORMAT_BC2_TYPELESS, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_BC2_UNORM, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_BC2_UNORM_SRGB, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_BC3_TYPELESS, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_BC3_UNORM, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_BC3_UNORM_SRGB, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_BC4_TYPELESS, 1, { PlaneDescriptor::Block(8, 4, 4) } },
+        { DXGI_FORMAT_BC4_UNORM, 1, { PlaneDescriptor::Block(8, 4, 4) } },
+        { DXGI_FORMAT_BC4_SNORM, 1, { PlaneDescriptor::Block(8, 4, 4) } },
+        { DXGI_FORMAT_BC5_TYPELESS, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_BC5_UNORM, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_BC5_SNORM, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_B5G6R5_UNORM, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_B5G5R5A1_UNORM, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_B8G8R8A8_UNORM, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_B8G8R8X8_UNORM, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_B8G8R8A8_TYPELESS, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_B8G8R8A8_UNORM_SRGB, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_B8G8R8X8_TYPELESS, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_B8G8R8X8_UNORM_SRGB, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_BC6H_TYPELESS, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_BC6H_UF16, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_BC6H_SF16, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_BC7_TYPELESS, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_BC7_UNORM, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_BC7_UNORM_SRGB, 1, { PlaneDescriptor::Block(16, 4, 4) } },
+        { DXGI_FORMAT_AYUV, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_Y410, 1, { PlaneDescriptor::Pixel(4) } },
+        { DXGI_FORMAT_Y416, 1, { PlaneDescriptor::Pixel(8) } },
+        { DXGI_FORMAT_NV12, 2, { PlaneDescriptor::Pixel(1), PlaneDescriptor::Subsampled(2, 2, 2) } },
+        { DXGI_FORMAT_P010, 2, { PlaneDescriptor::Pixel(2), PlaneDescriptor::Subsampled(4, 2, 2) } },
+        { DXGI_FORMAT_P016, 2, { PlaneDescriptor::Pixel(2), PlaneDescriptor::Subsampled(4, 2, 2) } },
+        { DXGI_FORMAT_YUY2, 1, { PlaneDescriptor::Block(4, 2, 1) } },
+        { DXGI_FORMAT_Y210, 1, { PlaneDescriptor::Block(8, 2, 1) } },
+        { DXGI_FORMAT_Y216, 1, { PlaneDescriptor::Block(8, 2, 1) } },
+        { DXGI_FORMAT_NV11, 2, { PlaneDescriptor::Pixel(1), PlaneDescriptor::Subsampled(2, 4, 1) } },
+        { DXGI_FORMAT_AI44, 1, { PlaneDescriptor::Pixel(1) } },
+        { DXGI_FORMAT_IA44, 1, { PlaneDescriptor::Pixel(1) } },
+        { DXGI_FORMAT_P8, 1, { PlaneDescriptor::Pixel(1) } },
+        { DXGI_FORMAT_A8P8, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_B4G4R4A4_UNORM, 1, { PlaneDescriptor::Pixel(2) } },
+        { DXGI_FORMAT_P208, 2, { PlaneDescriptor::Pixel(1), PlaneDescriptor::Subsampled(2, 2, 1) } },
+        { DXGI_FORMAT_V208, 3, { PlaneDescriptor::Pixel(1), PlaneDescriptor::Subsampled(1, 1, 2), PlaneDescriptor::Subsampled(1, 1, 2) } },
+        { DXGI_FORMAT_V408, 3, { PlaneDescriptor::Pixel(1), PlaneDescriptor::Pixel(1), PlaneDescriptor::Pixel(1) } },
+    };
+
+    static constexpr const FormatDescriptor* Find(DXGI_FORMAT format)
+    {
+        for (const auto& descriptor : table)
+        {
+            if (descriptor.Format == format)
+            {
+                return &descriptor;
+            }
+        }
+
+        return nullptr;
+    }
+
+    static constexpr uint32_t DivideRoundingUp(uint32_t value, uint32_t divisor)
+    {
+        return (value + divisor - 1) / divisor;
+    }
+
+    // Bytes between the starts of two rows of blocks in a plane, padded to a multiple of alignment.
+    static constexpr uint32_t RowPitch(const FormatDescriptor& descriptor, uint32_t plane, uint32_t width, uint32_t alignment = 1)
+    {
+        const PlaneDescriptor& layout = descriptor.Planes[plane];
+        uint32_t pitch = DivideRoundingUp(DivideRoundingUp(width, layout.SubsampleX), layout.BlockWidth) * layout.BytesPerBlock;
+
+        return DivideRoundingUp(pitch, alignment) * alignment;
+    }
+
+    // Number of rows of blocks in a plane.
+    static constexpr uint32_t RowCount(const FormatDescriptor& descriptor, uint32_t plane, uint32_t height)
+    {
+        const PlaneDescriptor& layout = descriptor.Planes[plane];
+
+        return DivideRoundingUp(DivideRoundingUp(height, layout.SubsampleY), layout.BlockHeight);
+    }
+
+    // Bytes taken by a width x height surface with all of its planes, 0 for unknown or opaque formats.
+    static constexpr size_t SurfaceSize(DXGI_FORMAT format, uint32_t width, uint32_t height, uint32_t rowAlignment = 1)
+    {
+        const FormatDescriptor* descriptor = Find(format);
+
+        if (descriptor == nullptr)
+        {
+            return 0;
+        }
+
+        size_t size = 0;
+
+        for (uint32_t plane = 0; plane < descriptor->PlaneCount; plane++)
+        {
+            size += static_cast<size_t>(RowPitch(*descriptor, plane, width, rowAlignment)) * RowCount(*descriptor, plane, height);
+        }
+
+        return size;
+    }
+
+    // Average number of bits each pixel takes over all planes, 0 for unknown or opaque formats.
+    static constexpr uint32_t BitsPerPixel(DXGI_FORMAT format)
+    {
+        const FormatDescriptor* descriptor = Find(format);
+
+        if (descriptor == nullptr)
+        {
+            return 0;
+        }
+
+        uint32_t bits = 0;
+
+        for (uint32_t plane = 0; plane < descriptor->PlaneCount; plane++)
+        {
+            const PlaneDescriptor& layout = descriptor->Planes[plane];
+            bits += layout.BytesPerBlock * 8 / (layout.BlockWidth * layout.BlockHeight * layout.SubsampleX * layout.SubsampleY);
+        }
+
+        return bits;
+    }
+};
+
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_B8G8R8A8_UNORM, 1920, 1080) == 1920 * 1080 * 4, "BGRA8 is 4 bytes per pixel.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_R16G16B16A16_FLOAT, 3840, 2160) == 3840 * 2160 * 8, "FP16 RGBA is 8 bytes per pixel.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_R16_FLOAT, 7, 3) == 7 * 3 * 2, "R16 is 2 bytes per pixel.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_NV12, 1920, 1080) == 1920 * 1080 * 3 / 2, "NV12 has a full Y plane and a 2x2 subsampled UV plane.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_NV12, 3, 3) == 3 * 3 + 2 * 2 * 2, "NV12 chroma rounds odd sizes up.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_P010, 1920, 1080) == 1920 * 1080 * 3, "P010 is NV12 with 16-bit samples.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_NV11, 1920, 1080) == 1920 * 1080 * 3 / 2, "NV11 has a 4x1 subsampled UV plane.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_YUY2, 1921, 1) == 961 * 4, "YUY2 packs two pixels into four bytes.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_BC1_UNORM, 1920, 1080) == 480 * 270 * 8, "BC1 is 8 bytes per 4x4 block.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_BC7_UNORM, 1918, 1078) == 480 * 270 * 16, "BC7 rounds partial blocks up.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_R1_UNORM, 9, 2) == 2 * 2, "R1 packs eight pixels per byte.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_V208, 4, 4) == 16 + 2 * 4 * 2, "V208 has two vertically subsampled chroma planes.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_B8G8R8A8_UNORM, 1366, 768, 256) == 5632 * 768, "Rows are padded to the alignment.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_UNKNOWN, 1920, 1080) == 0, "Unknown formats have no size.");
+static_assert(PixelFormat::SurfaceSize(DXGI_FORMAT_420_OPAQUE, 1920, 1080) == 0, "Opaque formats have no layout the CPU can rely on.");
+static_assert(PixelFormat::BitsPerPixel(DXGI_FORMAT_NV12) == 12 && PixelFormat::BitsPerPixel(DXGI_FORMAT_BC1_UNORM) == 4 && PixelFormat::BitsPerPixel(DXGI_FORMAT_P010) == 24, "Bits per pixel average over blocks and planes.");
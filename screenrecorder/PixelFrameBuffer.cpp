@@ -0,0 +1,121 @@
+#include "pch.h"
+#include "PixelFrameBuffer.h"
+#include "BlockCompressor.h"
+#include "FrameIndex.h"
+#include "FrameNameFormatter.h"
+#include "TaskScheduler.h"
+
+PixelFrameBuffer::PixelFrameBuffer(size_t capacity, bool asMegabytes, uint32_t width, uint32_t height, bool largePages) :
+    m_width(width), m_height(height), m_frameSize(BlockCompressor::compressed_size(width, height)),
+    m_capacity(asMegabytes ? capacity * 1000000 / RingArena::record_size(m_frameSize) : capacity),
+    m_arena(std::max<size_t>(m_capacity, 1) * RingArena::record_size(m_frameSize), largePages)
+{
+    if (m_capacity == 0 || width == 0 || height == 0)
+    {
+        throw std::invalid_argument("\b\tThe buffer must hold at least one frame.\n");
+    }
+
+    m_frames.reserve(m_capacity);
+}
+
+void PixelFrameBuffer::add_frame(const uint8_t* pixels, uint32_t rowPitch, const FrameMetadata& metadata)
+{
+    uint8_t* record = nullptr;
+
+    // Every frame takes the same record, so evicting the oldest always makes room for the next one.
+    while (m_frames.size() >= m_capacity || (record = m_arena.allocate(m_frameSize)) == nullptr)
+    {
+        m_frames.pop_front();
+        m_arena.release_oldest();
+    }
+
+    auto compressStart = std::chrono::steady_clock::now();
+
+    // Bands of block rows compress independently into their own part of the record.
+    uint32_t bandCount = (m_height + compressBandHeight - 1) / compressBandHeight;
+
+    TaskScheduler::shared().parallel_for(bandCount, [&](uint32_t band)
+        {
+            uint32_t top = band * compressBandHeight;
+            uint8_t* blocks = record + BlockCompressor::compressed_size(m_width, top);
+
+            BlockCompressor::compress(pixels + static_cast<size_t>(top) * rowPitch, m_width, std::min(compressBandHeight, m_height - top), rowPitch, blocks);
+        });
+
+    Frame frame;
+    frame.metadata = metadata;
+    frame.metadata.Width = m_width;
+    frame.metadata.Height = m_height;
+    frame.metadata.StoredBytes = static_cast<uint32_t>(m_frameSize);
+    frame.metadata.EncodeTime = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - compressStart).count());
+    frame.blocks = record;
+
+    m_frames.push_back(std::move(frame));
+}
+
+void PixelFrameBuffer::save_frames(const std::string& folderPath) const
+{
+    // Saving yields the workers to capture, as it does on Windows.
+    TaskScheduler::LaneScope lane(TaskLane::BulkSave);
+
+    std::filesystem::path folder = std::filesystem::u8path(folderPath);
+    std::vector<FrameMetadata> records(m_frames.size());
+
+    TaskScheduler::shared().parallel_for(static_cast<uint32_t>(m_frames.size()), [&](uint32_t i)
+        {
+            const Frame& frame = m_frames[i];
+
+            std::vector<uint8_t> pixels(static_cast<size_t>(m_width) * m_height * 4);
+            BlockCompressor::decompress(frame.blocks, m_width, m_height, pixels.data(), m_width * 4);
+
+            char filename[FrameNameFormatter::maxLength];
+            FrameNameFormatter::Format(frame.metadata.Timestamp, ".bmp", filename);
+
+            write_bmp((folder / filename).string(), pixels.data(), m_width, m_height);
+
+            records[i] = frame.metadata;
+        });
+
+    FrameIndex::Write((folder / FrameIndex::filename).string(), records);
+}
+
+void PixelFrameBuffer::write_bmp(const std::string& path, const uint8_t* pixels, uint32_t width, uint32_t height)
+{
+#pragma pack(push, 1)
+    struct BmpHeader
+    {
+        char Magic[2];
+        uint32_t FileSize;
+        uint32_t Reserved;
+        uint32_t PixelOffset;
+        uint32_t InfoSize;
+        int32_t Width;
+        int32_t Height;
+        uint16_t Planes;
+        uint16_t BitsPerPixel;
+        uint32_t Compression;
+        uint32_t ImageSize;
+        int32_t XPixelsPerMeter;
+        int32_t YPixelsPerMeter;
+        uint32_t ColorsUsed;
+        uint32_t ColorsImportant;
+    };
+#pragma pack(pop)
+
+    static_assert(sizeof(BmpHeader) == 54, "BMP headers are 54 bytes.");
+
+    uint32_t imageSize = width * height * 4;
+
+    // A negative height stores the rows top down, in the order the pixels already are.
+    BmpHeader header = { { 'B', 'M' }, static_cast<uint32_t>(sizeof(BmpHeader)) + imageSize, 0, static_cast<uint32_t>(sizeof(BmpHeader)), 40,
+        static_cast<int32_t>(width), -static_cast<int32_t>(height), 1, 32, 0, imageSize, 3780, 3780, 0, 0 };
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(pixels), imageSize);
+
+    if (!file)
+    {
+        throw std::ios_base::failure("Failed to write \"" + path + "\".");
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "pch.h"
+#include "FrameMetadata.h"
+#include "RingArena.h"
+#include "RingQueue.h"
+
+// The purpose of this class is to hold the most recent frames of a PixelFrameSource, up to a number of frames or
+// megabytes, the way CircularFrameBuffer holds frames with compressed storage: every frame is BC1 compressed straight
+// into a RingArena reserved up front, so a buffer holds an exact number of frames and storing one allocates nothing.
+// It is what the Linux build records into, since it needs neither Direct3D nor WIC. Frames are saved as BMP files,
+// named like the screenshots of the Windows build, with a frame index.
+class PixelFrameBuffer {
+public:
+    /**
+     * @param asMegabytes capacity is in megabytes rather than frames
+     * @throws std::invalid_argument if not even one frame fits
+     * @throws std::bad_alloc if the memory cannot be reserved
+     */
+    PixelFrameBuffer(size_t capacity, bool asMegabytes, uint32_t width, uint32_t height, bool largePages = false);
+
+    /**
+     * Compresses a BGRA8 frame of the buffer's size into the buffer, evicting the oldest frame if it is full. Bands of
+     * the frame are compressed on the workers of the shared task scheduler.
+     * @param rowPitch distance in bytes between the starts of consecutive rows
+     */
+    void add_frame(const uint8_t* pixels, uint32_t rowPitch, const FrameMetadata& metadata);
+
+    /**
+     * Saves the frames, oldest first, as BMP files into the folder, with a frame index. Frames are decompressed and
+     * written on the workers of the shared task scheduler.
+     * @throws std::ios_base::failure if a file cannot be written
+     */
+    void save_frames(const std::string& folderPath) const;
+
+    size_t frame_count() const { return m_frames.size(); }
+    size_t capacity() const { return m_capacity; }
+    size_t memory_usage() const { return m_arena.used(); }
+    uint32_t width() const { return m_width; }
+    uint32_t height() const { return m_height; }
+
+private:
+    struct Frame {
+        FrameMetadata metadata = {};
+        const uint8_t* blocks = nullptr;
+    };
+
+    // Rows of pixels compressed by one task. A multiple of the block size, so bands never share a block.
+    static constexpr uint32_t compressBandHeight = 64;
+
+    static void write_bmp(const std::string& path, const uint8_t* pixels, uint32_t width, uint32_t height);
+
+    uint32_t m_width;
+    uint32_t m_height;
+    size_t m_frameSize;
+    size_t m_capacity;  // In frames.
+    RingArena m_arena;
+    RingQueue<Frame> m_frames;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "pch.h"
+
+// The purpose of this interface is to feed the recorder frames that arrive as pixels in memory rather than as D3D11
+// textures, such as the frames XShmFrameSource grabs on Linux, where there are no textures to hand over the way
+// FrameSource does. Frames are BGRA8, the layout of FrameSource textures once read back, so they are compressed,
+// stored and saved the same way.
+class PixelFrameSource {
+public:
+    /**
+     * Receives every frame the source produces, on a thread of the source. The pixels are only valid during the call.
+     * @param rowPitch distance in bytes between the starts of consecutive rows
+     * @param qpc std::chrono::steady_clock ticks at which the frame was grabbed
+     */
+    using FrameHandler = std::function<void(const uint8_t* pixels, uint32_t rowPitch, int64_t qpc)>;
+
+    virtual ~PixelFrameSource() = default;
+
+    virtual void start(const FrameHandler& handler) = 0;
+
+    // Stops producing frames. A frame already being handled finishes first.
+    virtual void close() = 0;
+
+    // Size of the frames the source produces.
+    virtual uint32_t width() const = 0;
+    virtual uint32_t height() const = 0;
+};
@@ -0,0 +1,548 @@
+#include "pch.h"
+#include "QualityTuner.h"
+#include "ScreenCodec.h"
+#include "Simd.h"
+#include "TaskScheduler.h"
+
+// BT.601 luma weights out of 256, in BGRA order.
+static const int16_t lumaBlue = 29;
+static const int16_t lumaGreen = 150;
+static const int16_t lumaRed = 77;
+
+// SSIM constants for 8-bit values, (0.01 * 255)^2 and (0.03 * 255)^2.
+static const double ssimC1 = 6.5025;
+static const double ssimC2 = 58.5225;
+
+// Frames are classified from every eighth row, and are text if at least half of those pixels repeat the one before.
+static const uint32_t classifyRowStep = 8;
+static const double textRepeatShare = 0.5;
+
+static const char* imageExtensions[] = { ".png", ".bmp", ".jpg", ".jpeg" };
+
+std::optional<float> QualityTuner::tuned_quality(ContentClass contentClass) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_searches.find(contentClass);
+
+    if (it == m_searches.end() || it->second->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        return std::nullopt;
+    }
+
+    return it->second->result.get();
+}
+
+float QualityTuner::quality_for(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch)
+{
+    ContentClass contentClass = classify(pixels, width, height, rowPitch);
+    bool saving = TaskScheduler::current_lane() == TaskLane::BulkSave;
+    std::shared_ptr<Search> search;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_searches.find(contentClass);
+
+        // The search gets a copy of the frame, since the caller's pixels may be gone by the time it runs.
+        if (it == m_searches.end())
+        {
+            search = std::make_shared<Search>();
+            search->frame.resize(static_cast<size_t>(width) * height * 4);
+            search->width = width;
+            search->height = height;
+            search->target = target_ssim(contentClass);
+
+            for (uint32_t y = 0; y < height; y++)
+            {
+                memcpy(search->frame.data() + static_cast<size_t>(y) * width * 4, pixels + static_cast<size_t>(y) * rowPitch, static_cast<size_t>(width) * 4);
+            }
+
+            // A save runs the search itself when the lane is full. Frames encoded as they are captured leave it for
+            // a later frame of the class instead, so a busy save does not also have to make room for it.
+            if (!TaskScheduler::shared().try_submit(TaskLane::BulkSave, [search]() { run(*search); }) && !saving)
+            {
+                return FrameEncoder::default_quality;
+            }
+
+            m_searches.emplace(contentClass, search);
+        }
+        else
+        {
+            search = it->second;
+        }
+    }
+
+    // Frames encoded as they are captured take the default quality until the search is done, so the capture never
+    // waits on six encodes. Saves wait for it, so every frame of a class they save has the same quality.
+    if (search->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        if (!saving)
+        {
+            return FrameEncoder::default_quality;
+        }
+
+        // The task may still be queued behind this save, so the save takes it over rather than wait for it.
+        run(*search);
+    }
+
+    return search->result.get();
+}
+
+void QualityTuner::run(Search& search)
+{
+    if (search.claimed.exchange(true))
+    {
+        return;
+    }
+
+    try
+    {
+        search.promise.set_value(QualityTuner::search(search.frame.data(), search.width, search.height, search.width * 4, search.target));
+    }
+    catch (...)
+    {
+        search.promise.set_exception(std::current_exception());
+    }
+
+    search.frame = std::vector<uint8_t>();
+}
+
+float QualityTuner::search(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, double target)
+{
+    // Qualities at or below low missed the target and those at or above high met it. Quality 1 is taken to meet it
+    // without trying, since there is no better quality to fall back on.
+    float low = 0.0f;
+    float high = 1.0f;
+
+    for (uint32_t step = 0; step < searchSteps; step++)
+    {
+        float middle = (low + high) / 2;
+
+        if (measure(pixels, width, height, rowPitch, middle).Ssim >= target)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle;
+        }
+    }
+
+    return high;
+}
+
+ContentClass QualityTuner::classify(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch)
+{
+    uint64_t repeated = 0, sampled = 0;
+
+    for (uint32_t y = 0; y < height; y += classifyRowStep)
+    {
+        const uint32_t* row = reinterpret_cast<const uint32_t*>(pixels + static_cast<size_t>(y) * rowPitch);
+
+        for (uint32_t x = 1; x < width; x++)
+        {
+            repeated += row[x] == row[x - 1];
+        }
+
+        sampled += width > 0 ? width - 1 : 0;
+    }
+
+    return sampled > 0 && repeated >= sampled * textRepeatShare ? ContentClass::Text : ContentClass::Natural;
+}
+
+double QualityTuner::target_ssim(ContentClass contentClass)
+{
+    return contentClass == ContentClass::Text ? textTargetSsim : naturalTargetSsim;
+}
+
+const char* QualityTuner::class_name(ContentClass contentClass)
+{
+    return contentClass == ContentClass::Text ? "text" : "natural";
+}
+
+void QualityTuner::to_luma(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, uint8_t* luma, bool allowSimd)
+{
+    for (uint32_t y = 0; y < height; y++)
+    {
+        const uint8_t* row = pixels + static_cast<size_t>(y) * rowPitch;
+        uint8_t* target = luma + static_cast<size_t>(y) * width;
+        uint32_t x = 0;
+
+#ifdef SIMD_SSE2
+        if (allowSimd)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i weights = _mm_setr_epi16(lumaBlue, lumaGreen, lumaRed, 0, lumaBlue, lumaGreen, lumaRed, 0);
+            const __m128i rounding = _mm_set1_epi32(128);
+
+            // Four pixels at a time. Multiplying the channels by their weights leaves blue and green summed in one
+            // 32-bit lane and red in the next, so adding each lane to the one after it gives every pixel's luma in
+            // an even lane.
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4));
+                __m128i low = _mm_madd_epi16(_mm_unpacklo_epi8(source, zero), weights);
+                __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(source, zero), weights);
+
+                low = _mm_add_epi32(low, _mm_srli_epi64(low, 32));
+                high = _mm_add_epi32(high, _mm_srli_epi64(high, 32));
+
+                __m128i sums = _mm_unpacklo_epi64(_mm_shuffle_epi32(low, _MM_SHUFFLE(3, 1, 2, 0)), _mm_shuffle_epi32(high, _MM_SHUFFLE(3, 1, 2, 0)));
+                __m128i values = _mm_srli_epi32(_mm_add_epi32(sums, rounding), 8);
+                int packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(values, zero), zero));
+
+                memcpy(target + x, &packed, sizeof(packed));
+            }
+        }
+#endif
+
+        for (; x < width; x++)
+        {
+            target[x] = static_cast<uint8_t>((row[x * 4] * lumaBlue + row[x * 4 + 1] * lumaGreen + row[x * 4 + 2] * lumaRed + 128) >> 8);
+        }
+    }
+}
+
+#ifdef SIMD_SSE2
+static uint32_t sum_lanes(__m128i value)
+{
+    value = _mm_add_epi32(value, _mm_srli_si128(value, 8));
+    value = _mm_add_epi32(value, _mm_srli_si128(value, 4));
+
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(value));
+}
+#endif
+
+QualityScore QualityTuner::compare(const uint8_t* source, uint32_t sourcePitch, const uint8_t* decoded, uint32_t decodedPitch, uint32_t width, uint32_t height, bool allowSimd)
+{
+    QualityScore score;
+
+    if (width == 0 || height == 0)
+    {
+        return score;
+    }
+
+    std::vector<uint8_t> sourceLuma(static_cast<size_t>(width) * height);
+    std::vector<uint8_t> decodedLuma(sourceLuma.size());
+
+    to_luma(source, width, height, sourcePitch, sourceLuma.data(), allowSimd);
+    to_luma(decoded, width, height, decodedPitch, decodedLuma.data(), allowSimd);
+
+    double ssimSum = 0;
+    uint64_t blockCount = 0;
+    uint64_t squaredError = 0;
+
+    for (uint32_t top = 0; top < height; top += ssimBlockSize)
+    {
+        uint32_t blockHeight = std::min(ssimBlockSize, height - top);
+
+        for (uint32_t left = 0; left < width; left += ssimBlockSize)
+        {
+            uint32_t blockWidth = std::min(ssimBlockSize, width - left);
+
+            // Sums of the source values, the decoded values, their squares and their products over the block. The
+            // largest, 64 squares of 255, fits easily in 32 bits.
+            uint32_t sumX = 0, sumY = 0, sumXX = 0, sumYY = 0, sumXY = 0;
+            bool summed = false;
+
+#ifdef SIMD_SSE2
+            if (allowSimd && blockWidth == ssimBlockSize)
+            {
+                const __m128i zero = _mm_setzero_si128();
+                __m128i x = _mm_setzero_si128(), y = _mm_setzero_si128();
+                __m128i xx = _mm_setzero_si128(), yy = _mm_setzero_si128(), xy = _mm_setzero_si128();
+
+                // A row of the block at a time, its eight values widened to 16 bits to multiply them in pairs.
+                for (uint32_t row = top; row < top + blockHeight; row++)
+                {
+                    size_t offset = static_cast<size_t>(row) * width + left;
+                    __m128i a = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(sourceLuma.data() + offset));
+                    __m128i b = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(decodedLuma.data() + offset));
+                    __m128i a16 = _mm_unpacklo_epi8(a, zero);
+                    __m128i b16 = _mm_unpacklo_epi8(b, zero);
+
+                    x = _mm_add_epi32(x, _mm_sad_epu8(a, zero));
+                    y = _mm_add_epi32(y, _mm_sad_epu8(b, zero));
+                    xx = _mm_add_epi32(xx, _mm_madd_epi16(a16, a16));
+                    yy = _mm_add_epi32(yy, _mm_madd_epi16(b16, b16));
+                    xy = _mm_add_epi32(xy, _mm_madd_epi16(a16, b16));
+                }
+
+                sumX = sum_lanes(x);
+                sumY = sum_lanes(y);
+                sumXX = sum_lanes(xx);
+                sumYY = sum_lanes(yy);
+                sumXY = sum_lanes(xy);
+                summed = true;
+            }
+#endif
+
+            if (!summed)
+            {
+                for (uint32_t row = top; row < top + blockHeight; row++)
+                {
+                    size_t offset = static_cast<size_t>(row) * width + left;
+
+                    for (uint32_t column = 0; column < blockWidth; column++)
+                    {
+                        uint32_t a = sourceLuma[offset + column];
+                        uint32_t b = decodedLuma[offset + column];
+
+                        sumX += a;
+                        sumY += b;
+                        sumXX += a * a;
+                        sumYY += b * b;
+                        sumXY += a * b;
+                    }
+                }
+            }
+
+            // The squared error of the block falls out of the same sums, so PSNR needs no pass of its own.
+            squaredError += static_cast<uint64_t>(sumXX) + sumYY - 2 * static_cast<uint64_t>(sumXY);
+
+            double count = static_cast<double>(blockWidth) * blockHeight;
+            double meanX = sumX / count;
+            double meanY = sumY / count;
+            double varianceX = sumXX / count - meanX * meanX;
+            double varianceY = sumYY / count - meanY * meanY;
+            double covariance = sumXY / count - meanX * meanY;
+
+            ssimSum += (2 * meanX * meanY + ssimC1) * (2 * covariance + ssimC2) / ((meanX * meanX + meanY * meanY + ssimC1) * (varianceX + varianceY + ssimC2));
+            blockCount++;
+        }
+    }
+
+    double meanSquaredError = static_cast<double>(squaredError) / (static_cast<double>(width) * height);
+
+    score.Ssim = ssimSum / blockCount;
+    score.Psnr = meanSquaredError == 0 ? 100.0 : 10 * log10(255.0 * 255.0 / meanSquaredError);
+
+    return score;
+}
+
+QualityScore QualityTuner::measure(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, float quality, uint64_t* encodedSize)
+{
+    using namespace winrt::Windows::Graphics::Imaging;
+
+    winrt::Windows::Storage::Streams::InMemoryRandomAccessStream stream;
+    FrameEncoder(ImageFormat::Jpeg, quality).encode(pixels, width, height, rowPitch, stream);
+
+    if (encodedSize)
+    {
+        *encodedSize = stream.Size();
+    }
+
+    stream.Seek(0);
+
+    auto decoder = BitmapDecoder::CreateAsync(stream).get();
+    auto pixelData = decoder.GetPixelDataAsync(BitmapPixelFormat::Bgra8, BitmapAlphaMode::Premultiplied, BitmapTransform(),
+        ExifOrientationMode::IgnoreExifOrientation, ColorManagementMode::DoNotColorManage).get();
+    auto decoded = pixelData.DetachPixelData();
+
+    return compare(pixels, rowPitch, decoded.data(), width * 4, width, height);
+}
+
+std::vector<uint8_t> QualityTuner::load_image(const std::string& path, uint32_t& width, uint32_t& height)
+{
+    using namespace winrt::Windows::Graphics::Imaging;
+
+    std::ifstream input(path, std::ios::binary);
+
+    if (!input)
+    {
+        throw std::runtime_error("Failed to open \"" + path + "\".");
+    }
+
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+    if (FrameEncoder::format_from_filename(path) == ImageFormat::Screen)
+    {
+        return ScreenCodec::decode(data.data(), data.size(), width, height);
+    }
+
+    try
+    {
+        winrt::Windows::Storage::Streams::InMemoryRandomAccessStream stream;
+        winrt::Windows::Storage::Streams::Buffer buffer(static_cast<uint32_t>(data.size()));
+        memcpy(buffer.data(), data.data(), data.size());
+        buffer.Length(static_cast<uint32_t>(data.size()));
+
+        stream.WriteAsync(buffer).get();
+        stream.Seek(0);
+
+        auto decoder = BitmapDecoder::CreateAsync(stream).get();
+        auto pixelData = decoder.GetPixelDataAsync(BitmapPixelFormat::Bgra8, BitmapAlphaMode::Premultiplied, BitmapTransform(),
+            ExifOrientationMode::IgnoreExifOrientation, ColorManagementMode::DoNotColorManage).get();
+        auto pixels = pixelData.DetachPixelData();
+
+        width = decoder.PixelWidth();
+        height = decoder.PixelHeight();
+
+        return std::vector<uint8_t>(pixels.begin(), pixels.end());
+    }
+    catch (const winrt::hresult_error&)
+    {
+        throw std::runtime_error("Failed to decode \"" + path + "\".");
+    }
+}
+
+std::vector<QualityCurvePoint> QualityTuner::measure_curve(const std::string& folder)
+{
+    std::vector<std::string> paths;
+
+    for (const auto& entry : std::filesystem::directory_iterator(folder))
+    {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+
+        bool isImage = extension == ScreenCodec::fileExtension;
+
+        for (const char* imageExtension : imageExtensions)
+        {
+            isImage = isImage || extension == imageExtension;
+        }
+
+        if (entry.is_regular_file() && isImage)
+        {
+            paths.push_back(entry.path().string());
+        }
+    }
+
+    if (paths.empty())
+    {
+        throw std::runtime_error("No images found in \"" + folder + "\".");
+    }
+
+    std::sort(paths.begin(), paths.end());
+
+    std::map<ContentClass, std::vector<QualityCurvePoint>> points;
+
+    // Frames are loaded one at a time, so a folder of any size fits in memory, and each is encoded at every quality in
+    // parallel.
+    for (const auto& path : paths)
+    {
+        uint32_t width, height;
+        std::vector<uint8_t> pixels = load_image(path, width, height);
+        ContentClass contentClass = classify(pixels.data(), width, height, width * 4);
+
+        auto& classPoints = points[contentClass];
+
+        if (classPoints.empty())
+        {
+            for (uint32_t step = 1; step <= curveSteps; step++)
+            {
+                QualityCurvePoint point;
+                point.Class = contentClass;
+                point.Quality = static_cast<float>(step) / curveSteps;
+                classPoints.push_back(point);
+            }
+        }
+
+        std::vector<QualityScore> scores(curveSteps);
+        std::vector<uint64_t> sizes(curveSteps);
+
+        TaskScheduler::shared().parallel_for(curveSteps, [&](uint32_t step)
+            {
+                scores[step] = measure(pixels.data(), width, height, width * 4, classPoints[step].Quality, &sizes[step]);
+            });
+
+        for (uint32_t step = 0; step < curveSteps; step++)
+        {
+            auto& point = classPoints[step];
+
+            point.Frames++;
+            point.MeanBytes += sizes[step];
+            point.MeanSsim += scores[step].Ssim;
+            point.MinSsim = std::min(point.MinSsim, scores[step].Ssim);
+            point.MeanPsnr += scores[step].Psnr;
+        }
+    }
+
+    std::vector<QualityCurvePoint> curve;
+
+    for (auto& [contentClass, classPoints] : points)
+    {
+        for (auto& point : classPoints)
+        {
+            point.MeanBytes /= point.Frames;
+            point.MeanSsim /= point.Frames;
+            point.MeanPsnr /= point.Frames;
+            curve.push_back(point);
+        }
+    }
+
+    return curve;
+}
+
+void QualityTuner::write_curve(std::ostream& stream, const std::vector<QualityCurvePoint>& curve)
+{
+    stream << std::left << std::setw(10) << "class" << std::right << std::setw(8) << "quality" << std::setw(8) << "frames"
+        << std::setw(14) << "bytes" << std::setw(10) << "ssim" << std::setw(10) << "minSsim" << std::setw(10) << "psnr" << std::endl;
+
+    for (const auto& point : curve)
+    {
+        stream << std::left << std::setw(10) << class_name(point.Class)
+            << std::right << std::setw(8) << std::fixed << std::setprecision(0) << point.Quality * 100
+            << std::setw(8) << point.Frames
+            << std::setw(14) << point.MeanBytes
+            << std::setw(10) << std::setprecision(4) << point.MeanSsim
+            << std::setw(10) << point.MinSsim
+            << std::setw(10) << std::setprecision(2) << point.MeanPsnr << std::endl;
+    }
+
+    stream << std::endl;
+
+    // The lowest quality at which every frame of the class met its target, which is what the tuner finds for the frame
+    // it samples, to within the spacing of the curve.
+    for (ContentClass contentClass : { ContentClass::Text, ContentClass::Natural })
+    {
+        const QualityCurvePoint* lowest = nullptr;
+        bool present = false;
+
+        for (const auto& point : curve)
+        {
+            if (point.Class == contentClass)
+            {
+                present = true;
+
+                if (!lowest && point.MinSsim >= target_ssim(contentClass))
+                {
+                    lowest = &point;
+                }
+            }
+        }
+
+        if (!present)
+        {
+            continue;
+        }
+
+        stream << "Lowest quality keeping every " << class_name(contentClass) << " frame at SSIM " << std::setprecision(2) << target_ssim(contentClass) << " or more: ";
+
+        if (lowest)
+        {
+            stream << std::setprecision(0) << lowest->Quality * 100 << ", " << lowest->MeanBytes << " bytes per frame" << std::endl;
+        }
+        else
+        {
+            stream << "none" << std::endl;
+        }
+    }
+}
+
+void QualityTuner::write_curve_csv(std::ostream& stream, const std::vector<QualityCurvePoint>& curve)
+{
+    stream << "Class,Quality,Frames,MeanBytes,MeanSsim,MinSsim,MeanPsnr\n";
+
+    for (const auto& point : curve)
+    {
+        stream << class_name(point.Class) << ','
+            << point.Quality * 100 << ','
+            << point.Frames << ','
+            << point.MeanBytes << ','
+            << point.MeanSsim << ','
+            << point.MinSsim << ','
+            << point.MeanPsnr << '\n';
+    }
+}
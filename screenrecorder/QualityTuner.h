@@ -0,0 +1,122 @@
+#pragma once
+
+#include "pch.h"
+#include "FrameEncoder.h"
+
+// Text is text and flat user interface, where JPEG ringing around sharp edges soon makes text hard to read. Natural is
+// photos, video and gradients, which hide it.
+enum class ContentClass { Text, Natural };
+
+// How close a decoded image is to its source, compared on luma. SSIM is 1 and PSNR is 100 dB for identical images.
+struct QualityScore
+{
+    double Ssim = 1.0;
+    double Psnr = 100.0;
+};
+
+// Averages over the frames of one class encoded at one quality, as reported by measure_curve.
+struct QualityCurvePoint
+{
+    ContentClass Class;
+    float Quality;    // Between 0.0 and 1.0, like FrameEncoder. Printed from 0 to 100, like -quality.
+    uint32_t Frames = 0;
+    double MeanBytes = 0;
+    double MeanSsim = 0;
+    double MinSsim = 1.0;
+    double MeanPsnr = 0;
+};
+
+// The purpose of this class is to pick the lowest JPEG quality that still looks like the captured frame. A copy of the
+// first frame of each content class an encoder sees is encoded, decoded and compared with SSIM over and over as a
+// bulk save task, while the quality is binary searched for the lowest one that meets the target of the class. The
+// result is kept for the rest of the recording, which shares one tuner between every copy of its encoder, so the
+// search runs once per class.
+class QualityTuner {
+public:
+    // Lowest SSIM each class is encoded at. Text needs more, since a little blur makes small text illegible.
+    static constexpr double textTargetSsim = 0.98;
+    static constexpr double naturalTargetSsim = 0.95;
+
+    // Halvings of the quality range in a search, which finds the quality to within 1/64.
+    static constexpr uint32_t searchSteps = 6;
+
+    // Side in pixels of the blocks SSIM is computed over.
+    static constexpr uint32_t ssimBlockSize = 8;
+
+    // Qualities measure_curve encodes every frame at.
+    static constexpr uint32_t curveSteps = 20;
+
+    /**
+     * Returns the quality tuned for the class of the frame, starting the search for it if this is the first frame of
+     * the class. Safe to call from several threads. Until the search is done, frames encoded in the Capture and
+     * LiveEncode lanes get FrameEncoder::default_quality, and frames saved in the BulkSave lane wait for it, running
+     * it themselves if it has not started. When the BulkSave lane is full, the search is left for a later frame.
+     * @throws whatever the search threw, if it failed
+     */
+    float quality_for(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch);
+
+    // The quality tuned for a class so far, if the search for it is done.
+    std::optional<float> tuned_quality(ContentClass contentClass) const;
+
+    // Sorts a BGRA8 frame by how much of it is made of runs of identical pixels, which text and user interfaces are.
+    static ContentClass classify(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch);
+
+    static double target_ssim(ContentClass contentClass);
+    static const char* class_name(ContentClass contentClass);
+
+    /**
+     * Compares two BGRA8 images of the same size on luma, with SSIM averaged over 8x8 blocks and PSNR.
+     * @param allowSimd uses SSE2 where available. The result is the same either way.
+     */
+    static QualityScore compare(const uint8_t* source, uint32_t sourcePitch, const uint8_t* decoded, uint32_t decodedPitch, uint32_t width, uint32_t height, bool allowSimd = true);
+
+    /**
+     * Encodes a BGRA8 frame as JPEG at the given quality, decodes it and compares it with the frame.
+     * @param encodedSize if not null, receives the size of the encoded image in bytes
+     */
+    static QualityScore measure(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, float quality, uint64_t* encodedSize = nullptr);
+
+    /**
+     * Decodes an image file, either a standard format or the screen codec, to BGRA8 with rows packed tightly.
+     * @throws std::runtime_error if the file cannot be read or decoded
+     */
+    static std::vector<uint8_t> load_image(const std::string& path, uint32_t& width, uint32_t& height);
+
+    /**
+     * Encodes every image in a folder at qualities from 1/curveSteps to 1, and averages size and scores per class.
+     * @returns the points of each class present, in order of quality
+     * @throws std::runtime_error if the folder holds no images
+     */
+    static std::vector<QualityCurvePoint> measure_curve(const std::string& folder);
+
+    // Prints the curve as a table, followed by the quality the tuner would pick for each class.
+    static void write_curve(std::ostream& stream, const std::vector<QualityCurvePoint>& curve);
+    static void write_curve_csv(std::ostream& stream, const std::vector<QualityCurvePoint>& curve);
+
+private:
+    // The search of one class. A bulk save task and any saves waiting for it all hold it, and whichever claims it first
+    // runs it, so a save never waits on a task still queued behind it.
+    struct Search
+    {
+        std::vector<uint8_t> frame;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        double target = 0;
+        std::atomic<bool> claimed = false;
+        std::promise<float> promise;
+        std::shared_future<float> result = promise.get_future().share();
+    };
+
+    // Runs the search unless another thread already claimed it. Never throws: a failure is kept in the result.
+    static void run(Search& search);
+
+    static float search(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, double target);
+
+    // Converts BGRA8 to 8-bit luma with BT.601 weights.
+    static void to_luma(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, uint8_t* luma, bool allowSimd);
+
+    // The search of each class seen so far, queued, running or done. Searches own their copy of the frame, so the
+    // tuner can be destroyed while one is still queued or running.
+    mutable std::mutex m_mutex;
+    std::map<ContentClass, std::shared_ptr<Search>> m_searches;
+};
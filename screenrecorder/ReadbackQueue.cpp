@@ -0,0 +1,86 @@
+#include "pch.h"
+#include "ReadbackQueue.h"
+
+ReadbackQueue::ReadbackQueue(winrt::com_ptr<ID3D11Device> device, size_t depth) : m_device(device), m_slots(depth)
+{
+    if (depth == 0)
+    {
+        throw std::invalid_argument("Readback depth must be at least one.");
+    }
+
+    m_device->GetImmediateContext(m_context.put());
+}
+
+void ReadbackQueue::submit(winrt::com_ptr<ID3D11Texture2D> texture)
+{
+    if (full())
+    {
+        throw std::logic_error("Readback queue is full.");
+    }
+
+    Slot& slot = m_slots[(m_oldest + m_count) % m_slots.size()];
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    texture->GetDesc(&desc);
+
+    // Staging textures are kept between submissions and only recreated when the frame size or format changes.
+    if (!slot.staging || slot.desc.Width != desc.Width || slot.desc.Height != desc.Height || slot.desc.Format != desc.Format)
+    {
+        D3D11_TEXTURE2D_DESC stagingDesc = desc;
+        stagingDesc.MipLevels = 1;
+        stagingDesc.ArraySize = 1;
+        stagingDesc.SampleDesc.Count = 1;
+        stagingDesc.SampleDesc.Quality = 0;
+        stagingDesc.Usage = D3D11_USAGE_STAGING;
+        stagingDesc.BindFlags = 0;
+        stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ | D3D11_CPU_ACCESS_WRITE;
+        stagingDesc.MiscFlags = 0;
+
+        slot.staging = nullptr;
+        winrt::check_hresult(m_device->CreateTexture2D(&stagingDesc, nullptr, slot.staging.put()));
+        slot.desc = stagingDesc;
+    }
+
+    m_context->CopySubresourceRegion(slot.staging.get(), 0, 0, 0, 0, texture.get(), 0, nullptr);
+
+    m_count++;
+    m_needsFlush = true;
+}
+
+void ReadbackQueue::read_oldest(const std::function<void(uint8_t* pixels, uint32_t rowPitch, const D3D11_TEXTURE2D_DESC& desc)>& read)
+{
+    if (empty())
+    {
+        throw std::logic_error("Readback queue is empty.");
+    }
+
+    // Copies only start once the queued commands are sent to the GPU, so they are sent before checking on them.
+    if (m_needsFlush)
+    {
+        m_context->Flush();
+        m_needsFlush = false;
+    }
+
+    Slot& slot = m_slots[m_oldest];
+    D3D11_MAPPED_SUBRESOURCE mapped = {};
+
+    HRESULT hr = m_context->Map(slot.staging.get(), 0, D3D11_MAP_READ_WRITE, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped);
+
+    if (hr == DXGI_ERROR_WAS_STILL_DRAWING)
+    {
+        m_stallCount++;
+        hr = m_context->Map(slot.staging.get(), 0, D3D11_MAP_READ_WRITE, 0, &mapped);
+    }
+
+    winrt::check_hresult(hr);
+
+    // The slot is released even if the callback throws, so the queue stays usable.
+    auto release = wil::scope_exit([&]()
+        {
+            m_context->Unmap(slot.staging.get(), 0);
+            m_oldest = (m_oldest + 1) % m_slots.size();
+            m_count--;
+        });
+
+    read(static_cast<uint8_t*>(mapped.pData), mapped.RowPitch, slot.desc);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "pch.h"
+
+// The purpose of this class is to read textures back to the CPU without waiting on the GPU for every one of them. Each
+// submitted texture is copied into one of a ring of staging textures, and up to depth copies are kept in flight, so
+// by the time the oldest copy is mapped the GPU has usually finished it.
+class ReadbackQueue {
+public:
+    /**
+     * @throws std::invalid_argument if depth is zero
+     */
+    ReadbackQueue(winrt::com_ptr<ID3D11Device> device, size_t depth);
+
+    size_t depth() const { return m_slots.size(); }
+    size_t in_flight() const { return m_count; }
+    bool full() const { return m_count == m_slots.size(); }
+    bool empty() const { return m_count == 0; }
+
+    // Number of reads that had to wait for the GPU to finish the copy.
+    uint64_t stall_count() const { return m_stallCount; }
+
+    /**
+     * Queues a copy of the texture. Later changes to the texture do not affect the copy.
+     * @throws std::logic_error if the queue is full
+     */
+    void submit(winrt::com_ptr<ID3D11Texture2D> texture);
+
+    /**
+     * Maps the oldest queued copy and passes its rows to the callback, which may modify them in place. The rows are
+     * only valid until the callback returns.
+     * @throws std::logic_error if the queue is empty
+     */
+    void read_oldest(const std::function<void(uint8_t* pixels, uint32_t rowPitch, const D3D11_TEXTURE2D_DESC& desc)>& read);
+
+private:
+    struct Slot
+    {
+        winrt::com_ptr<ID3D11Texture2D> staging;
+        D3D11_TEXTURE2D_DESC desc;
+    };
+
+    winrt::com_ptr<ID3D11Device> m_device;
+    winrt::com_ptr<ID3D11DeviceContext> m_context;
+
+    std::vector<Slot> m_slots;
+    size_t m_oldest = 0;
+    size_t m_count = 0;
+    bool m_needsFlush = false;
+    uint64_t m_stallCount = 0;
+};
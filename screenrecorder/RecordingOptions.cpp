@@ -0,0 +1,106 @@
+#include "pch.h"
+#include "RecordingOptions.h"
+
+void RecordingOptions::Write(DataStream& stream) const
+{
+    stream.WriteString(Session);
+    stream.WriteInt(Framerate);
+    stream.WriteInt(Monitor);
+    stream.WriteInt(BufferCapacity);
+    stream.WriteBool(AsMegabytes);
+    stream.WriteBool(DirtyRegions);
+    stream.WriteBool(CursorAsMetadata);
+    stream.WriteEnum(Storage);
+    stream.WriteBool(LargePages);
+    stream.WriteEnum(Format);
+    stream.WriteInt(FrameBusSlots);
+    stream.WriteInt(MemoryCapMegabytes);
+    stream.WriteInt(static_cast<int>(Tiers.size()));
+
+    for (const auto& tier : Tiers)
+    {
+        stream.WriteInt(tier.IntervalSeconds);
+        stream.WriteInt(tier.Scale);
+        stream.WriteInt(tier.Capacity);
+        stream.WriteBool(tier.AsMegabytes);
+    }
+
+    stream.WriteInt(static_cast<int>(RedactRects.size()));
+
+    for (const auto& rect : RedactRects)
+    {
+        stream.WriteInt(rect.left);
+        stream.WriteInt(rect.top);
+        stream.WriteInt(rect.right);
+        stream.WriteInt(rect.bottom);
+    }
+
+    stream.WriteInt(static_cast<int>(RedactApps.size()));
+
+    for (const auto& app : RedactApps)
+    {
+        stream.WriteString(app);
+    }
+
+    stream.WriteEnum(Redaction);
+    stream.WriteInt(Quality);
+    stream.WriteBool(AutoQuality);
+    stream.WriteBool(DirectIo);
+    stream.WriteString(ChunkStore);
+    stream.WriteInt(IdleSeconds);
+    stream.WriteInt(IdleIntervalSeconds);
+}
+
+RecordingOptions RecordingOptions::Read(DataStream& stream)
+{
+    RecordingOptions options;
+
+    options.Session = stream.ReadString();
+    options.Framerate = stream.ReadInt();
+    options.Monitor = stream.ReadInt();
+    options.BufferCapacity = stream.ReadInt();
+    options.AsMegabytes = stream.ReadBool();
+    options.DirtyRegions = stream.ReadBool();
+    options.CursorAsMetadata = stream.ReadBool();
+    options.Storage = stream.ReadEnum<FrameStorage>();
+    options.LargePages = stream.ReadBool();
+    options.Format = stream.ReadEnum<ImageFormat>();
+    options.FrameBusSlots = stream.ReadInt();
+    options.MemoryCapMegabytes = stream.ReadInt();
+    options.Tiers.resize(std::max(0, stream.ReadInt()));
+
+    for (auto& tier : options.Tiers)
+    {
+        tier.IntervalSeconds = stream.ReadInt();
+        tier.Scale = stream.ReadInt();
+        tier.Capacity = stream.ReadInt();
+        tier.AsMegabytes = stream.ReadBool();
+    }
+
+    options.RedactRects.resize(std::max(0, stream.ReadInt()));
+
+    for (auto& rect : options.RedactRects)
+    {
+        rect.left = stream.ReadInt();
+        rect.top = stream.ReadInt();
+        rect.right = stream.ReadInt();
+        rect.bottom = stream.ReadInt();
+    }
+
+    options.RedactApps.resize(std::max(0, stream.ReadInt()));
+
+    for (auto& app : options.RedactApps)
+    {
+        app = stream.ReadString();
+    }
+
+    options.Redaction = stream.ReadEnum<RedactStyle>();
+    options.Quality = stream.ReadInt();
+    options.AutoQuality = stream.ReadBool();
+    options.DirectIo = stream.ReadBool();
+    options.ChunkStore = stream.ReadString();
+    options.IdleSeconds = stream.ReadInt();
+    options.IdleIntervalSeconds = stream.ReadInt();
+
+    return options;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "pch.h"
+#include "DataStream.h"
+#include "FrameEncoder.h"
+
+// Texture keeps frames on the GPU as captured. Encoded encodes every frame into an image file as soon as it is
+// captured and keeps the files in one contiguous block of memory. Compressed keeps BC1 compressed frames, of a fixed
+// size, in the same kind of block, and encodes them when they are saved. Hdr captures 16-bit float frames, keeps them
+// packed to 4 bytes per pixel in the same kind of block, and tone maps them to 8-bit when they are saved.
+enum class FrameStorage { Texture, Encoded, Compressed, Hdr };
+
+// Fill paints redacted regions a solid color. Pixelate replaces them with large blocks of their average color.
+enum class RedactStyle { Fill, Pixelate };
+
+// A retention tier keeps frames that have aged out of the tier before it, at a lower rate and resolution.
+struct TierOptions
+{
+    int IntervalSeconds = 1;  // Minimum time between frames kept by the tier.
+    int Scale = 1;            // Power of two the original frame width and height are divided by.
+    int Capacity = 100;
+    bool AsMegabytes = true;
+};
+
+// The purpose of this struct is to carry the settings of a recording from the command line to the recording process.
+struct RecordingOptions
+{
+    std::string Session;      // Name of the recording, empty for the default one.
+    int Framerate = 1;
+    int Monitor = 0;
+    int BufferCapacity = 100;
+    bool AsMegabytes = true;
+    bool DirtyRegions = false;
+    bool CursorAsMetadata = false;
+    FrameStorage Storage = FrameStorage::Texture;
+    bool LargePages = false;
+    ImageFormat Format = ImageFormat::Jpeg;
+    int Quality = -1;         // JPEG quality from 0 to 100. -1 uses the encoder's default.
+    bool AutoQuality = false; // Picks the lowest JPEG quality that keeps each kind of content looking as captured.
+    bool DirectIo = false;    // Saves files around the system file cache.
+    std::string ChunkStore;   // Absolute path of the chunk store saved frames are kept in, empty to save them as files.
+    int IdleSeconds = 0;      // Seconds without input after which the recording idles. 0 never idles.
+    int IdleIntervalSeconds = 0;  // Seconds between frames stored while idle. 0 pauses the capture.
+    int FrameBusSlots = 0;    // Live frames are published to a frame bus with this many slots. 0 disables it.
+    int MemoryCapMegabytes = 0;  // Most memory all recordings may reserve together. 0 is half of physical memory.
+    std::vector<TierOptions> Tiers;
+    std::vector<RECT> RedactRects;       // Rectangles hidden in every frame, relative to the top left of the frame.
+    std::vector<std::string> RedactApps;  // Executable names, such as keepass.exe, of applications whose windows are hidden.
+    RedactStyle Redaction = RedactStyle::Fill;
+
+    void Write(DataStream& stream) const;
+
+    /**
+     * @throws std::runtime_error if the stream does not hold recording options
+     */
+    static RecordingOptions Read(DataStream& stream);
+};
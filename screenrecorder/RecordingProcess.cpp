@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "RecordingProcess.h"
+
+bool RecordingProcess::try_create(const std::wstring& pipeName)
+{
+    TCHAR szPath[MAX_PATH];
+
+    if (!GetModuleFileName(NULL, szPath, MAX_PATH))
+    {
+        return false;
+    }
+
+    SECURITY_ATTRIBUTES attributes = { sizeof(attributes), nullptr, TRUE };
+    m_readyEvent.reset(CreateEvent(&attributes, TRUE, FALSE, nullptr));
+
+    if (!m_readyEvent)
+    {
+        return false;
+    }
+
+    HANDLE readyEvent = m_readyEvent.get();
+    std::wstring cmdLine = std::wstring(szPath) + L" -newserver -ready " + std::to_wstring(reinterpret_cast<uintptr_t>(readyEvent)) + L" -pipe " + pipeName;
+
+    // Only the event is inherited, so the recording process cannot keep any other handle of the client open.
+    SIZE_T attributeListSize = 0;
+    InitializeProcThreadAttributeList(nullptr, 1, 0, &attributeListSize);
+    std::vector<uint8_t> attributeList(attributeListSize);
+
+    STARTUPINFOEX info = {};
+    info.StartupInfo.cb = sizeof(info);
+    info.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+    info.StartupInfo.hStdOutput = NULL;
+    info.StartupInfo.hStdError = NULL;
+    info.lpAttributeList = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributeList.data());
+
+    if (!InitializeProcThreadAttributeList(info.lpAttributeList, 1, 0, &attributeListSize))
+    {
+        return false;
+    }
+
+    auto deleteAttributeList = wil::scope_exit([&]() { DeleteProcThreadAttributeList(info.lpAttributeList); });
+
+    if (!UpdateProcThreadAttribute(info.lpAttributeList, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, &readyEvent, sizeof(readyEvent), nullptr, nullptr))
+    {
+        return false;
+    }
+
+    PROCESS_INFORMATION processInfo = {};
+
+    if (!CreateProcess(szPath, &cmdLine[0], NULL, NULL, TRUE, EXTENDED_STARTUPINFO_PRESENT, NULL, NULL, &info.StartupInfo, &processInfo))
+    {
+        return false;
+    }
+
+    CloseHandle(processInfo.hThread);
+    m_process.reset(processInfo.hProcess);
+
+    return true;
+}
+
+bool RecordingProcess::wait_until_ready(DWORD timeoutMilliseconds) const
+{
+    // A server that fails to start exits without signaling, which ends the wait early.
+    HANDLE handles[] = { m_readyEvent.get(), m_process.get() };
+
+    return WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, timeoutMilliseconds) == WAIT_OBJECT_0;
+}
+
+bool RecordingProcess::wait_for_exit(DWORD timeoutMilliseconds) const
+{
+    return WaitForSingleObject(m_process.get(), timeoutMilliseconds) == WAIT_OBJECT_0;
+}
+
+void RecordingProcess::signal_ready(uint64_t readyEvent)
+{
+    HANDLE handle = reinterpret_cast<HANDLE>(static_cast<uintptr_t>(readyEvent));
+
+    SetEvent(handle);
+    CloseHandle(handle);
+}
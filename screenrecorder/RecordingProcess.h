@@ -0,0 +1,31 @@
+#pragma once
+
+#include "pch.h"
+
+// The purpose of this class is to start the recording process and learn when it is ready for clients. The process
+// inherits an event that the server signals once its pipe is listening, so the client connects as soon as it can
+// instead of polling for the pipe.
+class RecordingProcess {
+public:
+    /**
+     * Starts this executable with -newserver, listening on the given pipe.
+     * @returns false if the process could not be created
+     */
+    bool try_create(const std::wstring& pipeName = L"myPipe");
+
+    /**
+     * Waits for the server to signal that it is listening.
+     * @returns false if the process exited or did not become ready in time
+     */
+    bool wait_until_ready(DWORD timeoutMilliseconds) const;
+
+    // Waits for the process to exit, such as after it was sent a kill request.
+    bool wait_for_exit(DWORD timeoutMilliseconds) const;
+
+    // Signals the event passed to the recording process on its command line, and closes it.
+    static void signal_ready(uint64_t readyEvent);
+
+private:
+    wil::unique_event m_readyEvent;
+    wil::unique_handle m_process;
+};
@@ -0,0 +1,326 @@
+#include "pch.h"
+#include "Redactor.h"
+#include "Simd.h"
+
+Redactor::Redactor(const winrt::com_ptr<ID3D11Device>& device, const RecordingOptions& options) :
+    m_d3dDevice(device), m_rects(options.RedactRects), m_appNames(options.RedactApps), m_style(options.Redaction)
+{
+    m_d3dDevice.as<ID3D11Device1>()->GetImmediateContext1(m_d3dContext.put());
+}
+
+std::vector<DirtyRect> Redactor::find_regions(POINT itemOrigin, uint32_t width, uint32_t height)
+{
+    std::vector<RECT> rects = m_rects;
+
+    if (!m_appNames.empty())
+    {
+        std::vector<RECT> windows;
+
+        // When the windows cannot be listed, there is no telling where the applications are, so the whole frame is
+        // hidden rather than stored with them in it.
+        if (!find_app_windows(windows))
+        {
+            return { { 0, 0, width, height } };
+        }
+
+        for (auto& window : windows)
+        {
+            OffsetRect(&window, -itemOrigin.x, -itemOrigin.y);
+            rects.push_back(window);
+        }
+    }
+
+    std::vector<DirtyRect> regions;
+
+    for (const auto& rect : rects)
+    {
+        LONG left = std::max<LONG>(rect.left, 0);
+        LONG top = std::max<LONG>(rect.top, 0);
+        LONG right = std::min<LONG>(rect.right, static_cast<LONG>(width));
+        LONG bottom = std::min<LONG>(rect.bottom, static_cast<LONG>(height));
+
+        if (left < right && top < bottom)
+        {
+            regions.push_back({ static_cast<uint32_t>(left), static_cast<uint32_t>(top), static_cast<uint32_t>(right), static_cast<uint32_t>(bottom) });
+        }
+    }
+
+    return regions;
+}
+
+bool Redactor::find_app_windows(std::vector<RECT>& windows)
+{
+    struct Search
+    {
+        Redactor* redactor;
+        std::vector<RECT>* windows;
+    };
+
+    Search search = { this, &windows };
+
+    // The whole window is hidden even where other windows cover it, since what covers it can move before the next frame.
+    return EnumWindows([](HWND window, LPARAM context) -> BOOL
+        {
+            auto& search = *reinterpret_cast<Search*>(context);
+
+            if (!IsWindowVisible(window) || IsIconic(window))
+            {
+                return TRUE;
+            }
+
+            DWORD processId = 0;
+            GetWindowThreadProcessId(window, &processId);
+
+            RECT rect;
+
+            if (search.redactor->is_redacted_process(processId) && GetWindowRect(window, &rect))
+            {
+                search.windows->push_back(rect);
+            }
+
+            return TRUE;
+        }, reinterpret_cast<LPARAM>(&search)) != FALSE;
+}
+
+bool Redactor::is_redacted_process(DWORD processId)
+{
+    auto now = std::chrono::steady_clock::now();
+
+    if (now - m_processesTime >= processRefreshInterval)
+    {
+        m_processes.clear();
+        m_processesTime = now;
+    }
+
+    auto it = m_processes.find(processId);
+
+    if (it != m_processes.end())
+    {
+        return it->second;
+    }
+
+    bool redacted = false;
+
+    // Limited query access is granted for elevated processes too, so their names can be read without elevation.
+    wil::unique_handle process(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId));
+    char path[1024];
+    DWORD size = static_cast<DWORD>(sizeof(path));
+
+    if (process && QueryFullProcessImageNameA(process.get(), 0, path, &size))
+    {
+        const char* separator = strrchr(path, '\\');
+        const char* name = separator ? separator + 1 : path;
+
+        for (const auto& appName : m_appNames)
+        {
+            redacted = redacted || _stricmp(name, appName.c_str()) == 0;
+        }
+    }
+
+    m_processes[processId] = redacted;
+
+    return redacted;
+}
+
+winrt::com_ptr<ID3D11Texture2D> Redactor::redact_texture(const winrt::com_ptr<ID3D11Texture2D>& surfaceTexture, const std::vector<DirtyRect>& regions)
+{
+    D3D11_TEXTURE2D_DESC desc{};
+    surfaceTexture->GetDesc(&desc);
+
+    if (m_redactedTexture)
+    {
+        D3D11_TEXTURE2D_DESC redactedDesc{};
+        m_redactedTexture->GetDesc(&redactedDesc);
+
+        if (redactedDesc.Width != desc.Width || redactedDesc.Height != desc.Height || redactedDesc.Format != desc.Format)
+        {
+            m_redactedTexture = nullptr;
+            m_renderTarget = nullptr;
+            m_stagingTexture = nullptr;
+        }
+    }
+
+    if (!m_redactedTexture)
+    {
+        D3D11_TEXTURE2D_DESC redactedDesc = desc;
+        redactedDesc.MipLevels = 1;
+        redactedDesc.ArraySize = 1;
+        redactedDesc.Usage = D3D11_USAGE_DEFAULT;
+        redactedDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+        redactedDesc.CPUAccessFlags = 0;
+        redactedDesc.MiscFlags = 0;
+
+        winrt::check_hresult(m_d3dDevice->CreateTexture2D(&redactedDesc, nullptr, m_redactedTexture.put()));
+        winrt::check_hresult(m_d3dDevice->CreateRenderTargetView(m_redactedTexture.get(), nullptr, m_renderTarget.put()));
+    }
+
+    m_d3dContext->CopyResource(m_redactedTexture.get(), surfaceTexture.get());
+
+    if (m_style == RedactStyle::Fill || desc.Format != DXGI_FORMAT_B8G8R8A8_UNORM)
+    {
+        std::vector<D3D11_RECT> rects;
+        rects.reserve(regions.size());
+
+        for (const auto& region : regions)
+        {
+            rects.push_back({ static_cast<LONG>(region.Left), static_cast<LONG>(region.Top), static_cast<LONG>(region.Right), static_cast<LONG>(region.Bottom) });
+        }
+
+        // Opaque black in every format, matching fillColor.
+        const float color[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        m_d3dContext->ClearView(m_renderTarget.get(), color, rects.data(), static_cast<UINT>(rects.size()));
+
+        return m_redactedTexture;
+    }
+
+    if (!m_stagingTexture)
+    {
+        D3D11_TEXTURE2D_DESC stagingDesc = desc;
+        stagingDesc.MipLevels = 1;
+        stagingDesc.ArraySize = 1;
+        stagingDesc.Usage = D3D11_USAGE_STAGING;
+        stagingDesc.BindFlags = 0;
+        stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ | D3D11_CPU_ACCESS_WRITE;
+        stagingDesc.MiscFlags = 0;
+
+        winrt::check_hresult(m_d3dDevice->CreateTexture2D(&stagingDesc, nullptr, m_stagingTexture.put()));
+    }
+
+    // Only the regions are read back, pixelated in place, and written over the copy.
+    for (const auto& region : regions)
+    {
+        D3D11_BOX box = { region.Left, region.Top, 0, region.Right, region.Bottom, 1 };
+        m_d3dContext->CopySubresourceRegion(m_stagingTexture.get(), 0, region.Left, region.Top, 0, surfaceTexture.get(), 0, &box);
+    }
+
+    D3D11_MAPPED_SUBRESOURCE mapped{};
+    winrt::check_hresult(m_d3dContext->Map(m_stagingTexture.get(), 0, D3D11_MAP_READ_WRITE, 0, &mapped));
+
+    uint8_t* pixels = static_cast<uint8_t*>(mapped.pData);
+
+    for (const auto& region : regions)
+    {
+        pixelate(pixels, mapped.RowPitch, region, pixelateBlockSize);
+
+        D3D11_BOX box = { region.Left, region.Top, 0, region.Right, region.Bottom, 1 };
+        m_d3dContext->UpdateSubresource(m_redactedTexture.get(), 0, &box, pixels + static_cast<size_t>(region.Top) * mapped.RowPitch + region.Left * 4, mapped.RowPitch, 0);
+    }
+
+    m_d3dContext->Unmap(m_stagingTexture.get(), 0);
+
+    return m_redactedTexture;
+}
+
+void Redactor::redact_pixels(uint8_t* pixels, uint32_t rowPitch, const std::vector<DirtyRect>& regions) const
+{
+    for (const auto& region : regions)
+    {
+        if (m_style == RedactStyle::Pixelate)
+        {
+            pixelate(pixels, rowPitch, region, pixelateBlockSize);
+        }
+        else
+        {
+            fill(pixels, rowPitch, region, fillColor);
+        }
+    }
+}
+
+static void fill_row(uint32_t* row, uint32_t count, uint32_t bgra, bool simd)
+{
+    uint32_t x = 0;
+
+#ifdef SIMD_SSE2
+    if (simd)
+    {
+        __m128i color = _mm_set1_epi32(static_cast<int>(bgra));
+
+        for (; x + 4 <= count; x += 4)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x), color);
+        }
+    }
+#endif
+
+    for (; x < count; x++)
+    {
+        row[x] = bgra;
+    }
+}
+
+void Redactor::fill(uint8_t* pixels, uint32_t rowPitch, const DirtyRect& rect, uint32_t bgra, bool allowSimd)
+{
+    for (uint32_t y = rect.Top; y < rect.Bottom; y++)
+    {
+        fill_row(reinterpret_cast<uint32_t*>(pixels + static_cast<size_t>(y) * rowPitch) + rect.Left, rect.Width(), bgra, allowSimd);
+    }
+}
+
+void Redactor::pixelate(uint8_t* pixels, uint32_t rowPitch, const DirtyRect& rect, uint32_t blockSize, bool allowSimd)
+{
+    blockSize = std::max(1u, blockSize);
+
+    for (uint32_t top = rect.Top; top < rect.Bottom; top += blockSize)
+    {
+        uint32_t bottom = std::min(top + blockSize, rect.Bottom);
+
+        for (uint32_t left = rect.Left; left < rect.Right; left += blockSize)
+        {
+            uint32_t width = std::min(left + blockSize, rect.Right) - left;
+
+            // Sums of the blue, green, red and alpha channels of the block.
+            uint32_t sums[4] = {};
+
+            for (uint32_t y = top; y < bottom; y++)
+            {
+                const uint8_t* row = pixels + static_cast<size_t>(y) * rowPitch + static_cast<size_t>(left) * 4;
+                uint32_t x = 0;
+
+#ifdef SIMD_SSE2
+                if (allowSimd)
+                {
+                    const __m128i zero = _mm_setzero_si128();
+                    __m128i rowSums = _mm_setzero_si128();
+
+                    // Four pixels at a time. Channels are widened to 16 bits to add the four pixels together, and to
+                    // 32 bits to add them to the row, so no sum overflows however large the block.
+                    for (; x + 4 <= width; x += 4)
+                    {
+                        __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4));
+                        __m128i pairs = _mm_add_epi16(_mm_unpacklo_epi8(source, zero), _mm_unpackhi_epi8(source, zero));
+                        __m128i quads = _mm_add_epi16(pairs, _mm_srli_si128(pairs, 8));
+
+                        rowSums = _mm_add_epi32(rowSums, _mm_unpacklo_epi16(quads, zero));
+                    }
+
+                    alignas(16) uint32_t lanes[4];
+                    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), rowSums);
+
+                    for (int channel = 0; channel < 4; channel++)
+                    {
+                        sums[channel] += lanes[channel];
+                    }
+                }
+#endif
+
+                for (; x < width; x++)
+                {
+                    for (int channel = 0; channel < 4; channel++)
+                    {
+                        sums[channel] += row[x * 4 + channel];
+                    }
+                }
+            }
+
+            uint32_t count = width * (bottom - top);
+            uint32_t average = 0;
+
+            for (int channel = 0; channel < 4; channel++)
+            {
+                average |= ((sums[channel] + count / 2) / count) << (8 * channel);
+            }
+
+            fill(pixels, rowPitch, { left, top, left + width, bottom }, average, allowSimd);
+        }
+    }
+}
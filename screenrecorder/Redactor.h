@@ -0,0 +1,77 @@
+#pragma once
+
+#include "pch.h"
+#include "DirtyRegions.h"
+#include "RecordingOptions.h"
+
+// The purpose of this class is to hide private parts of the screen before a frame reaches the buffer. Regions are
+// configured rectangles of the captured frame and the windows of configured applications, and are either filled with
+// a solid color or pixelated into large blocks. Frames kept on the GPU are redacted on the GPU, in a copy of the
+// captured surface that is stored in its place, and frames read back to be encoded are redacted in memory, so the
+// unredacted pixels never get further than the capture callback.
+class Redactor {
+public:
+    // Side in pixels of the blocks pixelated regions are averaged over.
+    static constexpr uint32_t pixelateBlockSize = 16;
+
+    // Opaque black, the color filled regions are painted with.
+    static constexpr uint32_t fillColor = 0xFF000000;
+
+    Redactor(const winrt::com_ptr<ID3D11Device>& device, const RecordingOptions& options);
+
+    /**
+     * Finds the regions to hide in a frame, clipped to it and in frame coordinates.
+     * @param itemOrigin desktop coordinates of the top left of the frame, in physical pixels like the window positions, to
+     * place application windows in it
+     * @returns an empty vector if nothing in the frame needs hiding
+     */
+    std::vector<DirtyRect> find_regions(POINT itemOrigin, uint32_t width, uint32_t height);
+
+    /**
+     * Copies the surface into a texture of the redactor and hides the regions in the copy. Fill runs on the GPU, and
+     * pixelation reads back only the regions to pixelate them. Frames that are not BGRA8 are filled instead.
+     * @returns the redacted copy, which is overwritten by the next call
+     */
+    winrt::com_ptr<ID3D11Texture2D> redact_texture(const winrt::com_ptr<ID3D11Texture2D>& surfaceTexture, const std::vector<DirtyRect>& regions);
+
+    // Hides the regions in BGRA8 pixels in memory, in the configured style.
+    void redact_pixels(uint8_t* pixels, uint32_t rowPitch, const std::vector<DirtyRect>& regions) const;
+
+    /**
+     * Fills a rectangle of BGRA8 pixels with a color.
+     * @param allowSimd uses SSE2 where available. The result is the same either way.
+     */
+    static void fill(uint8_t* pixels, uint32_t rowPitch, const DirtyRect& rect, uint32_t bgra, bool allowSimd = true);
+
+    /**
+     * Replaces every block of a rectangle of BGRA8 pixels with its average color. Blocks start at the top left of the
+     * rectangle, and those on its right and bottom edges are cut short.
+     * @param allowSimd uses SSE2 where available. The result is the same either way.
+     */
+    static void pixelate(uint8_t* pixels, uint32_t rowPitch, const DirtyRect& rect, uint32_t blockSize, bool allowSimd = true);
+
+private:
+    /**
+     * Adds the desktop rectangles of the visible windows of the configured applications.
+     * @returns false if the windows could not be listed
+     */
+    bool find_app_windows(std::vector<RECT>& windows);
+
+    // Whether the process is one of the configured applications, remembered per process id.
+    bool is_redacted_process(DWORD processId);
+
+    winrt::com_ptr<ID3D11Device> m_d3dDevice;
+    winrt::com_ptr<ID3D11DeviceContext1> m_d3dContext;
+    std::vector<RECT> m_rects;
+    std::vector<std::string> m_appNames;
+    RedactStyle m_style;
+
+    // Process ids are reused once a process exits, so what is known about them is forgotten every refresh interval.
+    static constexpr std::chrono::seconds processRefreshInterval{ 1 };
+    std::map<DWORD, bool> m_processes;
+    std::chrono::steady_clock::time_point m_processesTime;
+
+    winrt::com_ptr<ID3D11Texture2D> m_redactedTexture;
+    winrt::com_ptr<ID3D11RenderTargetView> m_renderTarget;
+    winrt::com_ptr<ID3D11Texture2D> m_stagingTexture;
+};
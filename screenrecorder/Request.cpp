@@ -10,34 +10,33 @@ Request Request::FromString(const std::string& str)
 	return Request(DataStream::FromString(str));
 }
 
-Request Request::BuildStartRequest(int framerate, int monitor, int bufferSize, bool isMegabytes)
+Request Request::BuildStartRequest(const RecordingOptions& options)
 {
 	DataStream stream;
 
 	stream.WriteEnum(RequestType::Start);
-	stream.WriteInt(framerate);
-	stream.WriteInt(monitor);
-	stream.WriteInt(bufferSize);
-	stream.WriteBool(isMegabytes);
+	options.Write(stream);
 
 	return Request(stream);
 }
 
-Request Request::BuildStopRequest(const std::string& folder)
+Request Request::BuildStopRequest(const std::string& folder, const std::string& session)
 {
 	DataStream stream;
 
 	stream.WriteEnum(RequestType::Stop);
 	stream.WriteString(folder);
+	stream.WriteString(session);
 
 	return Request(stream);
 }
 
-Request Request::BuildCancelRequest()
+Request Request::BuildCancelRequest(const std::string& session)
 {
 	DataStream stream;
 
 	stream.WriteEnum(RequestType::Cancel);
+	stream.WriteString(session);
 
 	return Request(stream);
 }
@@ -60,17 +59,70 @@ Request Request::BuildKillRequest()
 	return Request(stream);
 }
 
-void Request::ParseStartArgs(int& framerate, int& monitor, int& bufferSize, bool& isMegabytes) 
+Request Request::BuildJobStatusRequest(int jobId)
 {
-	framerate = m_dataStream.ReadInt();
-	monitor = m_dataStream.ReadInt();
-	bufferSize = m_dataStream.ReadInt();
-	isMegabytes = m_dataStream.ReadBool();
+	DataStream stream;
+
+	stream.WriteEnum(RequestType::JobStatus);
+	stream.WriteInt(jobId);
+
+	return Request(stream);
 }
 
-void Request::ParseStopArgs(std::string& folder)
+Request Request::BuildJobWaitRequest(int jobId)
+{
+	DataStream stream;
+
+	stream.WriteEnum(RequestType::JobWait);
+	stream.WriteInt(jobId);
+
+	return Request(stream);
+}
+
+Request Request::BuildExportRequest(const ExportOptions& options)
+{
+	DataStream stream;
+
+	stream.WriteEnum(RequestType::Export);
+	options.Write(stream);
+
+	return Request(stream);
+}
+
+Request Request::BuildFrameBusRequest(const std::string& session)
+{
+	DataStream stream;
+
+	stream.WriteEnum(RequestType::FrameBus);
+	stream.WriteString(session);
+
+	return Request(stream);
+}
+
+void Request::ParseStartArgs(RecordingOptions& options) 
+{
+	options = RecordingOptions::Read(m_dataStream);
+}
+
+void Request::ParseStopArgs(std::string& folder, std::string& session)
 {
 	folder = m_dataStream.ReadString();
+	session = m_dataStream.ReadString();
+}
+
+void Request::ParseSessionArgs(std::string& session)
+{
+	session = m_dataStream.ReadString();
+}
+
+void Request::ParseExportArgs(ExportOptions& options)
+{
+	options = ExportOptions::Read(m_dataStream);
+}
+
+void Request::ParseJobArgs(int& jobId)
+{
+	jobId = m_dataStream.ReadInt();
 }
 
 RequestType Request::ParseRequestType()
@@ -2,8 +2,10 @@
 
 #include "pch.h"
 #include "DataStream.h"
+#include "RecordingOptions.h"
+#include "ExportOptions.h"
 
-enum class RequestType { Start, Stop, Cancel, Disconnect, Kill, Unknown };
+enum class RequestType { Start, Stop, Cancel, Disconnect, Kill, JobStatus, JobWait, Export, FrameBus, Unknown };
 
 class Request {
 public:
@@ -11,14 +13,21 @@ public:
 
     static Request FromString(const std::string& str);
 
-    static Request BuildStartRequest(int arg1, int arg2, int arg3, bool arg4);
-    static Request BuildStopRequest(const std::string& arg1);
-    static Request BuildCancelRequest();
+    static Request BuildStartRequest(const RecordingOptions& arg1);
+    static Request BuildStopRequest(const std::string& arg1, const std::string& arg2);
+    static Request BuildCancelRequest(const std::string& arg1);
     static Request BuildDisconnectRequest();
     static Request BuildKillRequest();
-
-    void ParseStartArgs(int& arg1, int& arg2, int& arg3, bool& arg4);
-    void ParseStopArgs(std::string& arg1);
+    static Request BuildJobStatusRequest(int arg1);
+    static Request BuildJobWaitRequest(int arg1);
+    static Request BuildExportRequest(const ExportOptions& arg1);
+    static Request BuildFrameBusRequest(const std::string& arg1);
+
+    void ParseStartArgs(RecordingOptions& arg1);
+    void ParseStopArgs(std::string& arg1, std::string& arg2);
+    void ParseSessionArgs(std::string& arg1);
+    void ParseJobArgs(int& arg1);
+    void ParseExportArgs(ExportOptions& arg1);
 
     RequestType ParseRequestType();
 
@@ -29,11 +29,62 @@ Response Response::BuildExceptionResponse(const std::exception& e)
 	return Response(stream);
 }
 
+Response Response::BuildJobResponse(int jobId)
+{
+	DataStream stream;
+
+	stream.WriteEnum(ResponseType::Job);
+	stream.WriteInt(jobId);
+
+	return Response(stream);
+}
+
+Response Response::BuildJobStatusResponse(JobState state, const std::string& message)
+{
+	DataStream stream;
+
+	stream.WriteEnum(ResponseType::JobStatus);
+	stream.WriteEnum(state);
+	stream.WriteString(message);
+
+	return Response(stream);
+}
+
+Response Response::BuildFrameBusResponse(const std::string& name, uint32_t slotCount, uint32_t slotCapacity)
+{
+	DataStream stream;
+
+	stream.WriteEnum(ResponseType::FrameBus);
+	stream.WriteString(name);
+	stream.WriteInt(static_cast<int>(slotCount));
+	stream.WriteInt(static_cast<int>(slotCapacity));
+
+	return Response(stream);
+}
+
 void Response::ParseExceptionArgs(std::exception& e)
 {
 	e = m_dataStream.ReadException();
 }
 
+void Response::ParseJobArgs(int& jobId)
+{
+	jobId = m_dataStream.ReadInt();
+}
+
+void Response::ParseJobStatusArgs(JobState& state, std::string& message)
+{
+	state = m_dataStream.ReadEnum<JobState>();
+	message = m_dataStream.ReadString();
+}
+
+void Response::ParseFrameBusArgs(std::string& name, uint32_t& slotCount, uint32_t& slotCapacity)
+{
+	name = m_dataStream.ReadString();
+	slotCount = static_cast<uint32_t>(m_dataStream.ReadInt());
+	slotCapacity = static_cast<uint32_t>(m_dataStream.ReadInt());
+}
+
 ResponseType Response::ParseResponseType()
 {
 	try
@@ -2,8 +2,9 @@
 
 #include "pch.h"
 #include "DataStream.h"
+#include "JobManager.h"
 
-enum class ResponseType { Success, Exception, Unknown };
+enum class ResponseType { Success, Exception, Job, JobStatus, FrameBus, Unknown };
 
 class Response {
 public:
@@ -13,8 +14,14 @@ public:
 
     static Response BuildSuccessResponse();
     static Response BuildExceptionResponse(const std::exception& e);
+    static Response BuildJobResponse(int jobId);
+    static Response BuildJobStatusResponse(JobState state, const std::string& message);
+    static Response BuildFrameBusResponse(const std::string& name, uint32_t slotCount, uint32_t slotCapacity);
 
     void ParseExceptionArgs(std::exception& e);
+    void ParseJobArgs(int& jobId);
+    void ParseJobStatusArgs(JobState& state, std::string& message);
+    void ParseFrameBusArgs(std::string& name, uint32_t& slotCount, uint32_t& slotCapacity);
 
     ResponseType ParseResponseType();
 
@@ -0,0 +1,168 @@
+#include "pch.h"
+#include "RingArena.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+RingArena::RingArena(size_t capacity, bool largePages)
+{
+    m_capacity = record_size(capacity);
+
+#ifdef _WIN32
+    if (largePages && try_enable_lock_memory_privilege())
+    {
+        size_t largePageSize = GetLargePageMinimum();
+
+        if (largePageSize != 0)
+        {
+            size_t roundedCapacity = (m_capacity + largePageSize - 1) / largePageSize * largePageSize;
+            m_memory = static_cast<uint8_t*>(VirtualAlloc(nullptr, roundedCapacity, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+
+            if (m_memory)
+            {
+                m_capacity = roundedCapacity;
+                m_largePages = true;
+            }
+        }
+    }
+
+    if (!m_memory)
+    {
+        m_memory = static_cast<uint8_t*>(VirtualAlloc(nullptr, m_capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    }
+#else
+    // Huge pages come from the pool the administrator reserved, so there may be none to take.
+    if (largePages)
+    {
+        size_t roundedCapacity = (m_capacity + hugePageSize - 1) / hugePageSize * hugePageSize;
+        void* memory = mmap(nullptr, roundedCapacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+
+        if (memory != MAP_FAILED)
+        {
+            m_memory = static_cast<uint8_t*>(memory);
+            m_capacity = roundedCapacity;
+            m_largePages = true;
+        }
+    }
+
+    // The pages are touched up front, so running out of memory does not wait for the first frames to show up.
+    if (!m_memory)
+    {
+        void* memory = mmap(nullptr, m_capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        m_memory = memory != MAP_FAILED ? static_cast<uint8_t*>(memory) : nullptr;
+    }
+#endif
+
+    if (!m_memory)
+    {
+        throw std::bad_alloc();
+    }
+
+    m_watermark = m_capacity;
+}
+
+RingArena::~RingArena()
+{
+    if (m_memory)
+    {
+#ifdef _WIN32
+        VirtualFree(m_memory, 0, MEM_RELEASE);
+#else
+        munmap(m_memory, m_capacity);
+#endif
+    }
+}
+
+size_t RingArena::record_size(size_t size)
+{
+    return sizeof(RecordHeader) + (size + alignment - 1) / alignment * alignment;
+}
+
+uint8_t* RingArena::allocate(size_t size)
+{
+    size_t recordSize = record_size(size);
+    size_t offset;
+
+    if (!m_wrapped && m_head + recordSize <= m_capacity)
+    {
+        offset = m_head;
+    }
+    else if (!m_wrapped && recordSize <= m_tail)
+    {
+        m_watermark = m_head;
+        m_wrapped = true;
+        offset = 0;
+    }
+    else if (m_wrapped && m_head + recordSize <= m_tail)
+    {
+        offset = m_head;
+    }
+    else
+    {
+        return nullptr;
+    }
+
+    RecordHeader* header = reinterpret_cast<RecordHeader*>(m_memory + offset);
+    header->recordSize = recordSize;
+    header->payloadSize = size;
+
+    m_head = offset + recordSize;
+    m_used += recordSize;
+    m_recordCount++;
+
+    return m_memory + offset + sizeof(RecordHeader);
+}
+
+void RingArena::release_oldest()
+{
+    if (m_recordCount == 0)
+    {
+        throw std::logic_error("Ring arena is empty.");
+    }
+
+    const RecordHeader* header = reinterpret_cast<const RecordHeader*>(m_memory + m_tail);
+
+    m_tail += header->recordSize;
+    m_used -= header->recordSize;
+    m_recordCount--;
+
+    if (m_recordCount == 0)
+    {
+        // Starting over from the beginning leaves the whole block free in one piece.
+        m_head = 0;
+        m_tail = 0;
+        m_watermark = m_capacity;
+        m_wrapped = false;
+    }
+    else if (m_wrapped && m_tail == m_watermark)
+    {
+        m_tail = 0;
+        m_watermark = m_capacity;
+        m_wrapped = false;
+    }
+}
+
+#ifdef _WIN32
+bool RingArena::try_enable_lock_memory_privilege()
+{
+    wil::unique_handle token;
+
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, token.put()))
+    {
+        return false;
+    }
+
+    TOKEN_PRIVILEGES privileges = {};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+    if (!LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid))
+    {
+        return false;
+    }
+
+    // AdjustTokenPrivileges succeeds without enabling anything when the account does not hold the privilege.
+    return AdjustTokenPrivileges(token.get(), FALSE, &privileges, 0, nullptr, nullptr) && GetLastError() == ERROR_SUCCESS;
+}
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "pch.h"
+
+// The purpose of this class is to store variable-size records, oldest first out, in one contiguous block of memory
+// reserved up front. Records are placed back to back like a bip-buffer: when a record does not fit before the end of
+// the block it is placed at the start, and the unused end is given back once the oldest records wrap around too. No
+// memory is allocated or freed per record, and the space taken by every record is known exactly.
+class RingArena {
+public:
+    // Records start on this alignment, and every record takes a header of the same size in front of it.
+    static const size_t alignment = 16;
+
+    /**
+     * @param largePages backs the arena with large pages when the process is allowed to lock pages in memory, or on
+     * Linux when huge pages are reserved, and falls back to normal pages otherwise
+     * @throws std::bad_alloc if the memory cannot be reserved
+     */
+    RingArena(size_t capacity, bool largePages = false);
+    ~RingArena();
+
+    RingArena(const RingArena&) = delete;
+    RingArena& operator=(const RingArena&) = delete;
+
+    /**
+     * Places a record of the given size after the newest one.
+     * @returns nullptr if it does not fit without releasing older records first
+     */
+    uint8_t* allocate(size_t size);
+
+    /**
+     * @throws std::logic_error if the arena is empty
+     */
+    void release_oldest();
+
+    // Bytes an allocation of the given size takes, including its header and alignment.
+    static size_t record_size(size_t size);
+
+    size_t capacity() const { return m_capacity; }
+    size_t used() const { return m_used; }
+
+    // Bytes at the end of the block skipped over by a record that wrapped to the start, free again once the oldest
+    // records wrap as well. used() + wasted() + free bytes always equal capacity().
+    size_t wasted() const { return m_wrapped ? m_capacity - m_watermark : 0; }
+
+    size_t record_count() const { return m_recordCount; }
+    bool uses_large_pages() const { return m_largePages; }
+
+private:
+    struct RecordHeader
+    {
+        uint64_t recordSize;
+        uint64_t payloadSize;
+    };
+
+    static_assert(sizeof(RecordHeader) == alignment, "Record payloads must stay aligned.");
+
+#ifdef _WIN32
+    static bool try_enable_lock_memory_privilege();
+#else
+    // Size of the huge pages large page arenas are backed with on Linux, the default on x64.
+    static const size_t hugePageSize = 2 * 1024 * 1024;
+#endif
+
+    uint8_t* m_memory = nullptr;
+    size_t m_capacity = 0;
+    bool m_largePages = false;
+
+    // Live records run from m_tail to m_head, or from m_tail to m_watermark and then from the start to m_head once
+    // the newest records have wrapped.
+    size_t m_head = 0;
+    size_t m_tail = 0;
+    size_t m_watermark = 0;
+    bool m_wrapped = false;
+
+    size_t m_used = 0;
+    size_t m_recordCount = 0;
+};
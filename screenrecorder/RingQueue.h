@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// The purpose of this class is to hold a queue of values, oldest first, in slots allocated up front, so pushing and
+// popping values allocates nothing. A push that finds every slot taken doubles the slots, so a queue reserved for
+// fewer values than it ends up holding only allocates until it first reaches its largest size. Values can be read by
+// position and searched with the standard algorithms, like those of a deque.
+template <typename T>
+class RingQueue {
+public:
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        const_iterator() = default;
+        const_iterator(const RingQueue* queue, size_t index) : m_queue(queue), m_index(index) {}
+
+        reference operator*() const { return (*m_queue)[m_index]; }
+        pointer operator->() const { return &(*m_queue)[m_index]; }
+        reference operator[](difference_type offset) const { return (*m_queue)[m_index + offset]; }
+
+        const_iterator& operator++() { m_index++; return *this; }
+        const_iterator operator++(int) { const_iterator previous = *this; m_index++; return previous; }
+        const_iterator& operator--() { m_index--; return *this; }
+        const_iterator operator--(int) { const_iterator previous = *this; m_index--; return previous; }
+        const_iterator& operator+=(difference_type offset) { m_index += offset; return *this; }
+        const_iterator& operator-=(difference_type offset) { m_index -= offset; return *this; }
+
+        const_iterator operator+(difference_type offset) const { return { m_queue, m_index + offset }; }
+        const_iterator operator-(difference_type offset) const { return { m_queue, m_index - offset }; }
+        friend const_iterator operator+(difference_type offset, const const_iterator& it) { return it + offset; }
+        difference_type operator-(const const_iterator& other) const { return static_cast<difference_type>(m_index) - static_cast<difference_type>(other.m_index); }
+
+        bool operator==(const const_iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const const_iterator& other) const { return m_index != other.m_index; }
+        bool operator<(const const_iterator& other) const { return m_index < other.m_index; }
+        bool operator>(const const_iterator& other) const { return m_index > other.m_index; }
+        bool operator<=(const const_iterator& other) const { return m_index <= other.m_index; }
+        bool operator>=(const const_iterator& other) const { return m_index >= other.m_index; }
+
+    private:
+        const RingQueue* m_queue = nullptr;
+        size_t m_index = 0;
+    };
+
+    // Makes room for at least the given number of values. Never gives slots back.
+    void reserve(size_t capacity)
+    {
+        if (capacity <= m_slots.size())
+        {
+            return;
+        }
+
+        std::vector<T> slots(capacity);
+
+        for (size_t i = 0; i < m_count; i++)
+        {
+            slots[i] = std::move((*this)[i]);
+        }
+
+        m_slots = std::move(slots);
+        m_first = 0;
+    }
+
+    void push_back(T&& value)
+    {
+        if (m_count == m_slots.size())
+        {
+            reserve(m_slots.empty() ? 1 : m_slots.size() * 2);
+        }
+
+        m_slots[(m_first + m_count) % m_slots.size()] = std::move(value);
+        m_count++;
+    }
+
+    // The slot is reset, so it lets go of what the value held instead of keeping it until it is reused.
+    void pop_front()
+    {
+        m_slots[m_first] = T();
+        m_first = (m_first + 1) % m_slots.size();
+        m_count--;
+    }
+
+    T& front() { return m_slots[m_first]; }
+    const T& front() const { return m_slots[m_first]; }
+
+    // Value at the given position, oldest first.
+    T& operator[](size_t index) { return m_slots[(m_first + index) % m_slots.size()]; }
+    const T& operator[](size_t index) const { return m_slots[(m_first + index) % m_slots.size()]; }
+
+    const_iterator begin() const { return { this, 0 }; }
+    const_iterator end() const { return { this, m_count }; }
+
+    size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+    size_t capacity() const { return m_slots.size(); }
+
+private:
+    std::vector<T> m_slots;
+    size_t m_first = 0;  // Slot of the oldest value.
+    size_t m_count = 0;
+};
@@ -0,0 +1,479 @@
+#include "pch.h"
+#include "ScreenCodec.h"
+#include "TaskScheduler.h"
+
+const char* const ScreenCodec::fileExtension = ".srsc";
+
+static const char magic[4] = { 'S', 'R', 'S', 'C' };
+static const uint32_t version = 1;
+
+using unique_compressor = wil::unique_any<COMPRESSOR_HANDLE, decltype(&CloseCompressor), CloseCompressor>;
+using unique_decompressor = wil::unique_any<DECOMPRESSOR_HANDLE, decltype(&CloseDecompressor), CloseDecompressor>;
+
+// Reads a band front to back, failing on anything that would read past its end.
+class BandReader {
+public:
+    BandReader(const uint8_t* data, size_t size) : m_data(data), m_size(size), m_position(0) {}
+
+    const uint8_t* take(size_t size)
+    {
+        if (size > m_size - m_position)
+        {
+            throw std::runtime_error("Corrupt screen codec image.");
+        }
+
+        const uint8_t* data = m_data + m_position;
+        m_position += size;
+
+        return data;
+    }
+
+    uint8_t take_byte() { return *take(1); }
+
+    uint32_t take_color()
+    {
+        uint32_t color;
+        memcpy(&color, take(sizeof(color)), sizeof(color));
+
+        return color;
+    }
+
+    bool at_end() const { return m_position == m_size; }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_position;
+};
+
+static void append(std::vector<uint8_t>& output, const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    output.insert(output.end(), bytes, bytes + size);
+}
+
+static const uint32_t* pixel_row(const uint8_t* pixels, uint32_t rowPitch, uint32_t y)
+{
+    return reinterpret_cast<const uint32_t*>(pixels + static_cast<size_t>(y) * rowPitch);
+}
+
+std::vector<uint8_t> ScreenCodec::encode(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch)
+{
+    uint32_t bandCount = (height + tileSize - 1) / tileSize;
+    std::vector<std::vector<uint8_t>> rawBands(bandCount);
+    std::vector<std::vector<uint8_t>> storedBands(bandCount);
+
+    for_each_band(bandCount, [&](uint32_t band)
+        {
+            std::vector<uint8_t>& raw = rawBands[band];
+            std::vector<uint8_t>& stored = storedBands[band];
+
+            encode_band(pixels, width, height, rowPitch, band, raw);
+
+            unique_compressor compressor;
+            winrt::check_bool(CreateCompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, nullptr, compressor.put()));
+
+            // The output buffer is no larger than the input, so bands that do not shrink fail to compress and are
+            // stored as they are.
+            stored.resize(raw.size());
+            SIZE_T storedSize = 0;
+
+            bool compressed = !raw.empty() && Compress(compressor.get(), raw.data(), raw.size(), stored.data(), stored.size(), &storedSize);
+
+            if (compressed && storedSize < raw.size())
+            {
+                stored.resize(storedSize);
+            }
+            else if (compressed || raw.empty() || GetLastError() == ERROR_INSUFFICIENT_BUFFER)
+            {
+                stored = raw;
+            }
+            else
+            {
+                winrt::throw_last_error();
+            }
+        });
+
+    Header header = {};
+    std::copy(std::begin(magic), std::end(magic), header.Magic);
+    header.Version = version;
+    header.Width = width;
+    header.Height = height;
+    header.TileSize = tileSize;
+    header.BandCount = bandCount;
+
+    size_t size = sizeof(Header) + bandCount * sizeof(BandHeader);
+
+    for (const auto& stored : storedBands)
+    {
+        size += stored.size();
+    }
+
+    std::vector<uint8_t> output;
+    output.reserve(size);
+    append(output, &header, sizeof(header));
+
+    for (uint32_t band = 0; band < bandCount; band++)
+    {
+        BandHeader bandHeader = { static_cast<uint32_t>(rawBands[band].size()), static_cast<uint32_t>(storedBands[band].size()) };
+        append(output, &bandHeader, sizeof(bandHeader));
+    }
+
+    for (const auto& stored : storedBands)
+    {
+        append(output, stored.data(), stored.size());
+    }
+
+    return output;
+}
+
+void ScreenCodec::encode_band(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, uint32_t band, std::vector<uint8_t>& output)
+{
+    uint32_t y0 = band * tileSize;
+    uint32_t tileHeight = std::min(tileSize, height - y0);
+    std::vector<uint32_t> palette;
+
+    for (uint32_t x0 = 0; x0 < width; x0 += tileSize)
+    {
+        uint32_t tileWidth = std::min(tileSize, width - x0);
+        bool hasPalette = find_palette(pixels, rowPitch, x0, y0, tileWidth, tileHeight, palette);
+
+        if (hasPalette && palette.size() == 1)
+        {
+            output.push_back(static_cast<uint8_t>(TileMode::Solid));
+            append(output, &palette[0], sizeof(uint32_t));
+
+            continue;
+        }
+
+        size_t tileStart = output.size();
+        output.push_back(static_cast<uint8_t>(TileMode::Predicted));
+        encode_predicted(pixels, rowPitch, x0, y0, tileWidth, tileHeight, output);
+
+        if (!hasPalette)
+        {
+            continue;
+        }
+
+        // Text and controls drawn with a few colors are usually smaller as palette indices than as runs.
+        size_t bits = palette_index_bits(palette.size());
+        size_t rowBytes = (tileWidth * bits + 7) / 8;
+        size_t paletteTileSize = 2 + palette.size() * sizeof(uint32_t) + rowBytes * tileHeight;
+
+        if (paletteTileSize >= output.size() - tileStart)
+        {
+            continue;
+        }
+
+        output.resize(tileStart);
+        output.push_back(static_cast<uint8_t>(TileMode::Palette));
+        output.push_back(static_cast<uint8_t>(palette.size()));
+        append(output, palette.data(), palette.size() * sizeof(uint32_t));
+
+        for (uint32_t y = y0; y < y0 + tileHeight; y++)
+        {
+            const uint32_t* row = pixel_row(pixels, rowPitch, y);
+            size_t rowStart = output.size();
+            output.resize(rowStart + rowBytes, 0);
+
+            uint8_t index = 0;
+
+            for (uint32_t x = 0; x < tileWidth; x++)
+            {
+                if (palette[index] != row[x0 + x])
+                {
+                    index = static_cast<uint8_t>(std::find(palette.begin(), palette.end(), row[x0 + x]) - palette.begin());
+                }
+
+                size_t bit = x * bits;
+                output[rowStart + bit / 8] |= static_cast<uint8_t>(index << (8 - bits - bit % 8));
+            }
+        }
+    }
+}
+
+void ScreenCodec::encode_predicted(const uint8_t* pixels, uint32_t rowPitch, uint32_t x0, uint32_t y0, uint32_t tileWidth, uint32_t tileHeight, std::vector<uint8_t>& output)
+{
+    const uint32_t maxRun = 64;
+    uint32_t end = x0 + tileWidth;
+
+    for (uint32_t y = y0; y < y0 + tileHeight; y++)
+    {
+        const uint32_t* row = pixel_row(pixels, rowPitch, y);
+
+        // Only rows of the same tile are predicted from, so bands can be decoded independently.
+        const uint32_t* above = y > y0 ? pixel_row(pixels, rowPitch, y - 1) : nullptr;
+
+        uint32_t literalStart = x0;
+        uint32_t x = x0;
+
+        auto flushLiteral = [&](uint32_t until)
+        {
+            while (literalStart < until)
+            {
+                uint32_t length = std::min(until - literalStart, maxRun);
+
+                output.push_back(static_cast<uint8_t>(static_cast<uint8_t>(RunOp::Literal) << 6 | (length - 1)));
+                append(output, row + literalStart, length * sizeof(uint32_t));
+                literalStart += length;
+            }
+        };
+
+        while (x < end)
+        {
+            uint32_t maxLength = std::min(end - x, maxRun);
+            uint32_t aboveLength = 0;
+            uint32_t leftLength = 0;
+
+            if (above)
+            {
+                while (aboveLength < maxLength && row[x + aboveLength] == above[x + aboveLength])
+                {
+                    aboveLength++;
+                }
+            }
+
+            if (x > 0)
+            {
+                uint32_t left = row[x - 1];
+
+                while (leftLength < maxLength && row[x + leftLength] == left)
+                {
+                    leftLength++;
+                }
+            }
+
+            // A single predicted pixel costs about as much as leaving it in a literal run.
+            if (std::max(aboveLength, leftLength) < 2)
+            {
+                x++;
+                continue;
+            }
+
+            flushLiteral(x);
+
+            RunOp op = aboveLength >= leftLength ? RunOp::Above : RunOp::Left;
+            uint32_t length = std::max(aboveLength, leftLength);
+
+            output.push_back(static_cast<uint8_t>(static_cast<uint8_t>(op) << 6 | (length - 1)));
+            x += length;
+            literalStart = x;
+        }
+
+        flushLiteral(end);
+    }
+}
+
+bool ScreenCodec::find_palette(const uint8_t* pixels, uint32_t rowPitch, uint32_t x0, uint32_t y0, uint32_t tileWidth, uint32_t tileHeight, std::vector<uint32_t>& palette)
+{
+    palette.clear();
+
+    uint32_t last = pixel_row(pixels, rowPitch, y0)[x0];
+    palette.push_back(last);
+
+    for (uint32_t y = y0; y < y0 + tileHeight; y++)
+    {
+        const uint32_t* row = pixel_row(pixels, rowPitch, y);
+
+        for (uint32_t x = x0; x < x0 + tileWidth; x++)
+        {
+            if (row[x] == last)
+            {
+                continue;
+            }
+
+            last = row[x];
+
+            if (std::find(palette.begin(), palette.end(), last) == palette.end())
+            {
+                if (palette.size() == maxPaletteSize)
+                {
+                    return false;
+                }
+
+                palette.push_back(last);
+            }
+        }
+    }
+
+    return true;
+}
+
+size_t ScreenCodec::palette_index_bits(size_t paletteSize)
+{
+    return paletteSize <= 2 ? 1 : paletteSize <= 4 ? 2 : 4;
+}
+
+std::vector<uint8_t> ScreenCodec::decode(const uint8_t* data, size_t size, uint32_t& width, uint32_t& height)
+{
+    BandReader reader(data, size);
+
+    Header header;
+    memcpy(&header, reader.take(sizeof(header)), sizeof(header));
+
+    if (!std::equal(std::begin(magic), std::end(magic), header.Magic) || header.Version != version || header.TileSize != tileSize)
+    {
+        throw std::runtime_error("Not a screen codec image.");
+    }
+
+    // Screenshots are never larger than the largest texture Direct3D 11 allows.
+    const uint32_t maxDimension = 16384;
+
+    if (header.Width == 0 || header.Height == 0 || header.Width > maxDimension || header.Height > maxDimension ||
+        header.BandCount != (header.Height + tileSize - 1) / tileSize)
+    {
+        throw std::runtime_error("Corrupt screen codec image.");
+    }
+
+    std::vector<BandHeader> bandHeaders(header.BandCount);
+    memcpy(bandHeaders.data(), reader.take(header.BandCount * sizeof(BandHeader)), header.BandCount * sizeof(BandHeader));
+
+    std::vector<const uint8_t*> bandData(header.BandCount);
+
+    for (uint32_t band = 0; band < header.BandCount; band++)
+    {
+        bandData[band] = reader.take(bandHeaders[band].StoredSize);
+    }
+
+    width = header.Width;
+    height = header.Height;
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * sizeof(uint32_t));
+
+    for_each_band(header.BandCount, [&](uint32_t band)
+        {
+            const BandHeader& bandHeader = bandHeaders[band];
+
+            if (bandHeader.StoredSize == bandHeader.RawSize)
+            {
+                decode_band(bandData[band], bandHeader.RawSize, width, height, band, pixels.data());
+                return;
+            }
+
+            unique_decompressor decompressor;
+            winrt::check_bool(CreateDecompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, nullptr, decompressor.put()));
+
+            std::vector<uint8_t> raw(bandHeader.RawSize);
+            SIZE_T rawSize = 0;
+
+            if (!Decompress(decompressor.get(), bandData[band], bandHeader.StoredSize, raw.data(), raw.size(), &rawSize) || rawSize != raw.size())
+            {
+                throw std::runtime_error("Corrupt screen codec image.");
+            }
+
+            decode_band(raw.data(), raw.size(), width, height, band, pixels.data());
+        });
+
+    return pixels;
+}
+
+void ScreenCodec::decode_band(const uint8_t* data, size_t size, uint32_t width, uint32_t height, uint32_t band, uint8_t* pixels)
+{
+    BandReader reader(data, size);
+    uint32_t rowPitch = width * sizeof(uint32_t);
+    uint32_t y0 = band * tileSize;
+    uint32_t tileHeight = std::min(tileSize, height - y0);
+
+    auto row = [&](uint32_t y) { return reinterpret_cast<uint32_t*>(pixels + static_cast<size_t>(y) * rowPitch); };
+
+    for (uint32_t x0 = 0; x0 < width; x0 += tileSize)
+    {
+        uint32_t tileWidth = std::min(tileSize, width - x0);
+        uint32_t end = x0 + tileWidth;
+        TileMode mode = static_cast<TileMode>(reader.take_byte());
+
+        if (mode == TileMode::Solid)
+        {
+            uint32_t color = reader.take_color();
+
+            for (uint32_t y = y0; y < y0 + tileHeight; y++)
+            {
+                std::fill(row(y) + x0, row(y) + end, color);
+            }
+        }
+        else if (mode == TileMode::Palette)
+        {
+            size_t paletteSize = reader.take_byte();
+
+            if (paletteSize < 2 || paletteSize > maxPaletteSize)
+            {
+                throw std::runtime_error("Corrupt screen codec image.");
+            }
+
+            uint32_t palette[maxPaletteSize] = {};
+
+            for (size_t i = 0; i < paletteSize; i++)
+            {
+                palette[i] = reader.take_color();
+            }
+
+            size_t bits = palette_index_bits(paletteSize);
+            uint8_t mask = static_cast<uint8_t>((1 << bits) - 1);
+
+            for (uint32_t y = y0; y < y0 + tileHeight; y++)
+            {
+                const uint8_t* indices = reader.take((tileWidth * bits + 7) / 8);
+                uint32_t* target = row(y);
+
+                for (uint32_t x = 0; x < tileWidth; x++)
+                {
+                    size_t bit = x * bits;
+                    target[x0 + x] = palette[(indices[bit / 8] >> (8 - bits - bit % 8)) & mask];
+                }
+            }
+        }
+        else if (mode == TileMode::Predicted)
+        {
+            for (uint32_t y = y0; y < y0 + tileHeight; y++)
+            {
+                uint32_t* target = row(y);
+                uint32_t x = x0;
+
+                while (x < end)
+                {
+                    uint8_t run = reader.take_byte();
+                    RunOp op = static_cast<RunOp>(run >> 6);
+                    uint32_t length = (run & 0x3F) + 1u;
+
+                    if (length > end - x)
+                    {
+                        throw std::runtime_error("Corrupt screen codec image.");
+                    }
+
+                    if (op == RunOp::Literal)
+                    {
+                        memcpy(target + x, reader.take(length * sizeof(uint32_t)), length * sizeof(uint32_t));
+                    }
+                    else if (op == RunOp::Left && x > 0)
+                    {
+                        std::fill(target + x, target + x + length, target[x - 1]);
+                    }
+                    else if (op == RunOp::Above && y > y0)
+                    {
+                        memcpy(target + x, row(y - 1) + x, length * sizeof(uint32_t));
+                    }
+                    else
+                    {
+                        throw std::runtime_error("Corrupt screen codec image.");
+                    }
+
+                    x += length;
+                }
+            }
+        }
+        else
+        {
+            throw std::runtime_error("Corrupt screen codec image.");
+        }
+    }
+
+    if (!reader.at_end())
+    {
+        throw std::runtime_error("Corrupt screen codec image.");
+    }
+}
+
+void ScreenCodec::for_each_band(uint32_t bandCount, const std::function<void(uint32_t band)>& function)
+{
+    // Bands run in the lane of the caller, so encoding a live frame is not held up behind a save.
+    TaskScheduler::shared().parallel_for(bandCount, function);
+}
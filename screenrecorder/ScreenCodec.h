@@ -0,0 +1,69 @@
+#pragma once
+
+#include "pch.h"
+
+// The purpose of this class is to compress screenshots losslessly and quickly, by taking advantage of what screen
+// content looks like: large flat areas, text and controls drawn with a handful of colors, and rows that repeat the row
+// above. The frame is cut into square tiles, each stored as a single color, as indices into a small palette, or as
+// runs of pixels predicted from their left or upper neighbour. Each row of tiles is then entropy coded on its own
+// with the Windows compression API, so rows are compressed and decompressed in parallel on the persistent workers of
+// the shared TaskScheduler.
+class ScreenCodec {
+public:
+    static const char* const fileExtension;
+    static constexpr uint32_t tileSize = 64;
+    static constexpr uint32_t maxPaletteSize = 16;
+
+    /**
+     * Compresses a BGRA8 frame into a self-contained image file.
+     * @param rowPitch distance in bytes between the starts of consecutive rows
+     */
+    static std::vector<uint8_t> encode(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch);
+
+    /**
+     * Decompresses an image file written by encode into tightly packed BGRA8 pixels.
+     * @throws std::runtime_error if the data is not a valid image
+     */
+    static std::vector<uint8_t> decode(const uint8_t* data, size_t size, uint32_t& width, uint32_t& height);
+
+private:
+    enum class TileMode : uint8_t { Solid, Palette, Predicted };
+
+    // Predicted tiles are a sequence of runs within each row of the tile. Every run starts with a byte holding the
+    // operation in its top two bits and the run length minus one in the others, so a run covers at most a tile row.
+    enum class RunOp : uint8_t { Literal, Left, Above };
+
+#pragma pack(push, 1)
+    struct Header
+    {
+        char Magic[4];
+        uint32_t Version;
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t TileSize;
+        uint32_t BandCount;
+    };
+
+    struct BandHeader
+    {
+        uint32_t RawSize;
+        uint32_t StoredSize;  // Equal to RawSize when entropy coding did not make the band smaller.
+    };
+#pragma pack(pop)
+
+    static void encode_band(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, uint32_t band, std::vector<uint8_t>& output);
+    static void encode_predicted(const uint8_t* pixels, uint32_t rowPitch, uint32_t x0, uint32_t y0, uint32_t tileWidth, uint32_t tileHeight, std::vector<uint8_t>& output);
+
+    // Finds the distinct colors of a tile. @returns false if there are more than maxPaletteSize
+    static bool find_palette(const uint8_t* pixels, uint32_t rowPitch, uint32_t x0, uint32_t y0, uint32_t tileWidth, uint32_t tileHeight, std::vector<uint32_t>& palette);
+
+    static size_t palette_index_bits(size_t paletteSize);
+
+    /**
+     * @throws std::runtime_error if the band is malformed
+     */
+    static void decode_band(const uint8_t* data, size_t size, uint32_t width, uint32_t height, uint32_t band, uint8_t* pixels);
+
+    // Runs the function for every band, spread over the workers of the shared TaskScheduler.
+    static void for_each_band(uint32_t bandCount, const std::function<void(uint32_t band)>& function);
+};
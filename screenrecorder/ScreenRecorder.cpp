@@ -3,58 +3,295 @@
 #include "MonitorInfo.h"
 #include "SimpleCapture.h"
 #include "ScreenRecorderProvider.h"
+#include "GraphicsCaptureSource.h"
+#include "PixelFormat.h"
+#include "ToneMapper.h"
+#include "QualityTuner.h"
+#include "SystemActivityDetector.h"
 
-ScreenRecorder::ScreenRecorder() : isCapturing(false)
+// Finds the SDR white level of the display showing the monitor, as an scRGB value, so HDR frames can be tone mapped
+// to look the way SDR content does on it. Falls back to the reference white when the display does not say.
+static float sdr_white_level(HMONITOR monitor)
+{
+    MONITORINFOEXW monitorInfo = {};
+    monitorInfo.cbSize = sizeof(monitorInfo);
+
+    if (!GetMonitorInfoW(monitor, &monitorInfo))
+    {
+        return ToneMapper::referenceWhiteLevel;
+    }
+
+    UINT32 pathCount = 0;
+    UINT32 modeCount = 0;
+
+    if (GetDisplayConfigBufferSizes(QDC_ONLY_ACTIVE_PATHS, &pathCount, &modeCount) != ERROR_SUCCESS)
+    {
+        return ToneMapper::referenceWhiteLevel;
+    }
+
+    std::vector<DISPLAYCONFIG_PATH_INFO> paths(pathCount);
+    std::vector<DISPLAYCONFIG_MODE_INFO> modes(modeCount);
+
+    if (QueryDisplayConfig(QDC_ONLY_ACTIVE_PATHS, &pathCount, paths.data(), &modeCount, modes.data(), nullptr) != ERROR_SUCCESS)
+    {
+        return ToneMapper::referenceWhiteLevel;
+    }
+
+    for (UINT32 i = 0; i < pathCount; i++)
+    {
+        DISPLAYCONFIG_SOURCE_DEVICE_NAME source = {};
+        source.header.type = DISPLAYCONFIG_DEVICE_INFO_GET_SOURCE_NAME;
+        source.header.size = sizeof(source);
+        source.header.adapterId = paths[i].sourceInfo.adapterId;
+        source.header.id = paths[i].sourceInfo.id;
+
+        if (DisplayConfigGetDeviceInfo(&source.header) != ERROR_SUCCESS || wcscmp(source.viewGdiDeviceName, monitorInfo.szDevice) != 0)
+        {
+            continue;
+        }
+
+        DISPLAYCONFIG_SDR_WHITE_LEVEL whiteLevel = {};
+        whiteLevel.header.type = DISPLAYCONFIG_DEVICE_INFO_GET_SDR_WHITE_LEVEL;
+        whiteLevel.header.size = sizeof(whiteLevel);
+        whiteLevel.header.adapterId = paths[i].targetInfo.adapterId;
+        whiteLevel.header.id = paths[i].targetInfo.id;
+
+        // The level is given in thousandths of the reference white.
+        if (DisplayConfigGetDeviceInfo(&whiteLevel.header) == ERROR_SUCCESS)
+        {
+            return whiteLevel.SDRWhiteLevel / 1000.0f;
+        }
+    }
+
+    return ToneMapper::referenceWhiteLevel;
+}
+
+ScreenRecorder::ScreenRecorder()
 {
     TraceLoggingRegister(g_hMyComponentProvider);
 }
 
 ScreenRecorder::~ScreenRecorder()
 {
+    m_sessions.clear();
+
     TraceLoggingUnregister(g_hMyComponentProvider);
 }
 
-void ScreenRecorder::start(int framerate, int monitor, int bufferCapacity, bool asMegabytes)
+void ScreenRecorder::prepare()
+{
+    m_preparedDevice = std::async(std::launch::async, []() { return util::CreateD3DDevice(); });
+}
+
+void ScreenRecorder::start(const RecordingOptions& options)
 {
-    if (isCapturing)
+    if (m_sessions.count(options.Session))
     {
-        throw std::logic_error("\b\tRecording already started.\n");
+        throw std::logic_error(options.Session.empty() ? "\b\tRecording already started.\n" : "\b\tRecording \"" + options.Session + "\" already started.\n");
     }
 
     std::vector<MonitorInfo> monitors = MonitorInfo::EnumerateAllMonitors(true);
 
-    if (monitor < 0 || monitors.size() <= monitor)
+    if (options.Monitor < 0 || monitors.size() <= options.Monitor)
     {
         throw std::out_of_range("\b\tMonitor out of range.\n");
     }
 
-    CircularFrameBuffer buffer(bufferCapacity, asMegabytes);
+    // A tuner is made per recording, so its qualities are searched for once and kept until the recording stops.
+    float quality = options.Quality < 0 ? FrameEncoder::default_quality : options.Quality / 100.0f;
+    FrameEncoder encoder(options.Format, quality, options.AutoQuality ? std::make_shared<QualityTuner>() : nullptr);
+
+    CircularFrameBuffer buffer(options.BufferCapacity, options.AsMegabytes, encoder, options.Storage, options.LargePages);
+
+    buffer.set_direct_io(options.DirectIo);
+    buffer.set_chunk_store(options.ChunkStore);
 
-    auto d3dDevice = util::CreateD3DDevice();
-    auto dxgiDevice = d3dDevice.as<IDXGIDevice>();
-    auto device = CreateDirect3DDevice(dxgiDevice.get());
+    for (const auto& tier : options.Tiers)
+    {
+        buffer.add_tier(tier.Capacity, tier.AsMegabytes, tier.IntervalSeconds, tier.Scale);
+    }
 
-    MonitorInfo monitorInfo = monitors[monitor];
+    MonitorInfo monitorInfo = monitors[options.Monitor];
     auto item = util::CreateCaptureItemForMonitor(monitorInfo.MonitorHandle);
 
-    m_simpleCapture = std::make_unique<SimpleCapture>(device, item, framerate, buffer);
+    // A recording of all monitors is tone mapped for the primary monitor.
+    if (options.Storage == FrameStorage::Hdr)
+    {
+        buffer.set_white_level(sdr_white_level(monitorInfo.MonitorHandle ? monitorInfo.MonitorHandle : MonitorFromPoint({ 0, 0 }, MONITOR_DEFAULTTOPRIMARY)));
+    }
+
+    // Every recording must fit next to the ones already running, whichever of them fills its buffer first.
+    uint64_t memoryBudget = calculate_memory_budget(options, item.Size());
+    uint64_t memoryCap = static_cast<uint64_t>(options.MemoryCapMegabytes) * 1000000;
+
+    if (options.MemoryCapMegabytes <= 0)
+    {
+        MEMORYSTATUSEX status = { sizeof(status) };
+        winrt::check_bool(GlobalMemoryStatusEx(&status));
+        memoryCap = status.ullTotalPhys / 2;
+    }
+
+    uint64_t memoryInUse = 0;
+
+    for (const auto& session : m_sessions)
+    {
+        memoryInUse += session.second.memoryBudget;
+    }
+
+    if (memoryInUse + memoryBudget > memoryCap)
+    {
+        throw std::invalid_argument("\b\tThe recording needs " + std::to_string(memoryBudget / 1000000) + " MB, but only " +
+            std::to_string(memoryCap > memoryInUse ? (memoryCap - memoryInUse) / 1000000 : 0) + " MB are left under the memory cap.\n");
+    }
+
+    // All recordings share one device, created in the background by prepare if it was called.
+    if (!m_device)
+    {
+        auto d3dDevice = m_preparedDevice.valid() ? m_preparedDevice.get() : util::CreateD3DDevice();
+        auto dxgiDevice = d3dDevice.as<IDXGIDevice>();
+        m_device = CreateDirect3DDevice(dxgiDevice.get());
+    }
+
+    // Capture items cover the monitor, or the whole virtual screen when recording all monitors.
+    POINT itemOrigin = { GetSystemMetrics(SM_XVIRTUALSCREEN), GetSystemMetrics(SM_YVIRTUALSCREEN) };
+
+    if (monitorInfo.MonitorHandle)
+    {
+        MONITORINFO bounds = { sizeof(bounds) };
+        winrt::check_bool(GetMonitorInfo(monitorInfo.MonitorHandle, &bounds));
+        itemOrigin = { bounds.rcMonitor.left, bounds.rcMonitor.top };
+    }
+
+    auto pixelFormat = options.Storage == FrameStorage::Hdr ?
+        winrt::Windows::Graphics::DirectX::DirectXPixelFormat::R16G16B16A16Float :
+        winrt::Windows::Graphics::DirectX::DirectXPixelFormat::B8G8R8A8UIntNormalized;
+
+    // Frames are sized from their format as they are stored, and one counted as zero bytes would never trigger
+    // eviction in megabyte mode, so the format is checked once here. DirectXPixelFormat values are DXGI formats.
+    if (PixelFormat::SurfaceSize(static_cast<DXGI_FORMAT>(pixelFormat), 1, 1) == 0)
+    {
+        throw std::invalid_argument("\b\tUnsupported frame format " + std::to_string(static_cast<int32_t>(pixelFormat)) + ".\n");
+    }
+
+    // The cursor is recorded next to each frame and drawn back when the frames are saved.
+    auto source = std::make_unique<GraphicsCaptureSource>(m_device, item, !options.CursorAsMetadata, pixelFormat);
 
-    m_simpleCapture->StartCapture();
-    isCapturing = true;
+    // Locking the session, the screensaver or no input for -idle seconds idles the recording.
+    std::unique_ptr<ActivityDetector> activityDetector;
+
+    if (options.IdleSeconds > 0)
+    {
+        activityDetector = std::make_unique<SystemActivityDetector>(std::chrono::seconds(options.IdleSeconds));
+    }
+
+    Session session;
+    session.capture = std::make_shared<SimpleCapture>(m_device, std::move(source), itemOrigin, options, std::move(buffer), std::move(activityDetector));
+    session.memoryBudget = memoryBudget;
+
+    session.capture->StartCapture();
+    m_sessions.emplace(options.Session, std::move(session));
+}
+
+std::shared_ptr<SimpleCapture> ScreenRecorder::capture(const std::string& session)
+{
+    return find_session(session).capture;
+}
+
+std::shared_ptr<SimpleCapture> ScreenRecorder::begin_stop(const std::string& session)
+{
+    Session& found = find_session(session);
+    found.stopping = true;
+
+    return found.capture;
+}
+
+void ScreenRecorder::end_stop(const std::string& session, const std::shared_ptr<SimpleCapture>& capture)
+{
+    auto it = m_sessions.find(session);
+
+    if (it == m_sessions.end() || it->second.capture != capture)
+    {
+        return;
+    }
+
+    if (capture->IsClosed())
+    {
+        m_sessions.erase(it);
+    }
+    else
+    {
+        it->second.stopping = false;
+    }
+}
+
+void ScreenRecorder::stop(SimpleCapture& capture, const std::string& folderPath)
+{
+    StorageFolder storageFolder = open_folder(folderPath);
+
+    capture.CloseAndSave(storageFolder);
 }
 
-void ScreenRecorder::stop(const std::string& folderPath)
+void ScreenRecorder::export_frames(SimpleCapture& capture, const ExportOptions& options)
 {
-    if (!isCapturing)
+    StorageFolder storageFolder = open_folder(options.Folder);
+
+    capture.Export(storageFolder, options);
+}
+
+void ScreenRecorder::frame_bus(const std::string& session, std::string& name, uint32_t& slotCount, uint32_t& slotCapacity)
+{
+    const FrameBus* frameBus = find_session(session).capture->GetFrameBus();
+
+    if (!frameBus)
     {
-        throw std::logic_error("\b\tRecording is not started.\n");
+        throw std::invalid_argument("\b\tThe recording does not publish frames. Start it with -publish.\n");
     }
 
-    StorageFolder storageFolder = NULL;
+    name = winrt::to_string(frameBus->name());
+    slotCount = frameBus->slot_count();
+    slotCapacity = frameBus->slot_capacity();
+}
+
+uint64_t ScreenRecorder::calculate_memory_budget(const RecordingOptions& options, winrt::Windows::Graphics::SizeInt32 frameSize)
+{
+    auto budget = [](int capacity, bool asMegabytes, uint64_t frameBytes)
+        {
+            return static_cast<uint64_t>(std::max(0, capacity)) * (asMegabytes ? 1000000 : frameBytes);
+        };
+
+    uint32_t width = static_cast<uint32_t>(frameSize.Width);
+    uint32_t height = static_cast<uint32_t>(frameSize.Height);
 
+    // Storage sized in frames reserves what the buffer reserves for each of them.
+    uint64_t frameBytes = CircularFrameBuffer::reserved_frame_size(options.Storage, width, height);
+    uint64_t total = budget(options.BufferCapacity, options.AsMegabytes, frameBytes);
+
+    for (const auto& tier : options.Tiers)
+    {
+        uint64_t tierFrameBytes = static_cast<uint64_t>(width / tier.Scale) * (height / tier.Scale) * 4;
+        total += budget(tier.Capacity, tier.AsMegabytes, tierFrameBytes);
+    }
+
+    return total;
+}
+
+ScreenRecorder::Session& ScreenRecorder::find_session(const std::string& session)
+{
+    auto it = m_sessions.find(session);
+
+    if (it == m_sessions.end() || it->second.stopping)
+    {
+        throw std::logic_error(session.empty() ? "\b\tRecording is not started.\n" : "\b\tRecording \"" + session + "\" is not started.\n");
+    }
+
+    return it->second;
+}
+
+StorageFolder ScreenRecorder::open_folder(const std::string& folderPath)
+{
     try
     {
-        storageFolder = StorageFolder::GetFolderFromPathAsync(winrt::to_hstring(folderPath)).get();
+        return StorageFolder::GetFolderFromPathAsync(winrt::to_hstring(folderPath)).get();
     }
     catch (const winrt::hresult_invalid_argument& e)
     {
@@ -64,18 +301,10 @@ void ScreenRecorder::stop(const std::string& folderPath)
     {
         throw std::invalid_argument("\b\tCould not open folder \"" + folderPath + "\".\n");
     }
-
-    m_simpleCapture->CloseAndSave(storageFolder);
-    isCapturing = false;
 }
 
-void ScreenRecorder::cancel()
+void ScreenRecorder::cancel(const std::string& session)
 {
-    if (!isCapturing)
-    {
-        throw std::logic_error("\b\tRecording is not started.\n");
-    }
-
-    m_simpleCapture->Close();
-    isCapturing = false;
+    find_session(session).capture->Close();
+    m_sessions.erase(session);
 }
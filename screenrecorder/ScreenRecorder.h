@@ -2,7 +2,11 @@
 
 #include "pch.h"
 #include "SimpleCapture.h"
+#include "RecordingOptions.h"
+#include "ExportOptions.h"
 
+// The purpose of this class is to run any number of named recordings side by side. Each session has its own capture,
+// buffer and settings, while the D3D device is shared, and the memory the sessions reserve together is capped.
 class ScreenRecorder {
 public:
     ScreenRecorder();
@@ -13,11 +17,66 @@ public:
     static const int default_bufferCapacity = 10;
     static const bool default_asMegabytes = false;
 
-    void start(int framerate, int monitor, int bufferCapacity, bool asMegabytes);
-    void stop(const std::string& folderPath);
-    void cancel();
+    // Starts creating the D3D device in the background, so a recording started soon after does not wait for it.
+    void prepare();
+
+    /**
+     * @throws std::logic_error if a recording with the same session name is running
+     * @throws std::invalid_argument if the recording would take the memory of all recordings over the cap
+     */
+    void start(const RecordingOptions& options);
+    void cancel(const std::string& session);
+
+    /**
+     * Looks up the capture of a recording. The capture outlives its recording being removed, so the caller can save
+     * it without holding the lock it guards the recorder with.
+     * @throws std::logic_error if no recording with the session name is running
+     */
+    std::shared_ptr<SimpleCapture> capture(const std::string& session);
+
+    /**
+     * Marks a recording as stopping and looks up its capture, for the caller to save without holding the lock. Every
+     * other call treats a stopping recording as not started, so a second stop cannot save the same capture again.
+     * The caller calls end_stop once the save has finished, whether it succeeded or not.
+     * @throws std::logic_error if no recording with the session name is running
+     */
+    std::shared_ptr<SimpleCapture> begin_stop(const std::string& session);
+
+    // Removes a stopping recording once its capture is closed. A capture still open, because the save failed before
+    // closing it, keeps recording and can be stopped again.
+    void end_stop(const std::string& session, const std::shared_ptr<SimpleCapture>& capture);
+
+    // Stops the capture and saves its frames. Only the capture is locked, so other recordings are not held up.
+    static void stop(SimpleCapture& capture, const std::string& folderPath);
+    static void export_frames(SimpleCapture& capture, const ExportOptions& options);
+
+    /**
+     * Describes the frame bus of the recording, for consumers to map.
+     * @throws std::invalid_argument if the recording does not publish frames
+     */
+    void frame_bus(const std::string& session, std::string& name, uint32_t& slotCount, uint32_t& slotCapacity);
+
+    size_t session_count() const { return m_sessions.size(); }
+
+    // Most memory the buffers and tiers of a recording can take, for frames of the given size.
+    static uint64_t calculate_memory_budget(const RecordingOptions& options, winrt::Windows::Graphics::SizeInt32 frameSize);
 
 private:
-    std::unique_ptr<SimpleCapture> m_simpleCapture;
-    bool isCapturing;
-};
\ No newline at end of file
+    struct Session
+    {
+        std::shared_ptr<SimpleCapture> capture;
+        uint64_t memoryBudget;
+        bool stopping = false;  // The capture is being saved by a stop and the recording only waits to be removed.
+    };
+
+    static StorageFolder open_folder(const std::string& folderPath);
+
+    /**
+     * @throws std::logic_error if no recording with the session name is running, or if it is stopping
+     */
+    Session& find_session(const std::string& session);
+
+    std::map<std::string, Session> m_sessions;
+    std::future<winrt::com_ptr<ID3D11Device>> m_preparedDevice;
+    winrt::Windows::Graphics::DirectX::Direct3D11::IDirect3DDevice m_device{ nullptr };
+};
@@ -5,9 +5,17 @@
 // Forward-declare the g_hMyComponentProvider variable that will be used in any class that wants to log events for the screen recorder.
 TRACELOGGING_DECLARE_PROVIDER(g_hMyComponentProvider);
 
-#define ReceivedFrameEvent(filename) \
+#define ReceivedFrameEvent(filename, sequence, qpc) \
     TraceLoggingWrite(g_hMyComponentProvider, \
         "ReceivedFrame", \
-        TraceLoggingString(filename.c_str(), "Filename"))
+        TraceLoggingString(filename, "Filename"), \
+        TraceLoggingUInt64(sequence, "Sequence"), \
+        TraceLoggingInt64(qpc, "Qpc"))
+
+#define ActivityChangedEvent(state, idleTime) \
+    TraceLoggingWrite(g_hMyComponentProvider, \
+        "ActivityChanged", \
+        TraceLoggingString(state, "State"), \
+        TraceLoggingUInt32(idleTime, "IdleTime"))
 
 
@@ -3,10 +3,27 @@
 
 const std::string unknownEnumCaseMessage = "\b\tReceived an unknown request from the main process.\n";
 const std::string defaultEnumCaseMessage = "\b\tReceived an unhandled request from the main process.\n";
+const std::string unknownJobMessage = "\b\tReceived a request for an unknown job.\n";
+
+Server::~Server()
+{
+    // Connections are dropped when run returns, so the threads left have finished serving or are about to.
+    for (auto& [id, thread] : m_connectionThreads)
+    {
+        thread.join();
+    }
+}
 
 bool Server::try_init() 
 {
-    return m_pipe.try_init(L"myPipe", Pipe::SERVER);
+    if (!m_listener.try_init(m_pipeName))
+    {
+        return false;
+    }
+
+    m_screenRecorder.prepare();
+
+    return true;
 }
 
 void Server::run()
@@ -15,105 +32,264 @@ void Server::run()
 
     while (m_isRunning)
     {
+        std::shared_ptr<Connection> connection;
+
         try
         {
-            m_pipe.connect();
+            connection = m_listener.accept();
         }
         catch (const std::ios_base::failure& e)
         {
-            return;
+            break;
         }
-        
-        m_isConnectedToClient = true;
 
-        while (m_isConnectedToClient)
+        if (!connection)
         {
-            Request request;
-            Response response;
+            break;
+        }
 
-            try
-            {
-                request = Request::FromString(m_pipe.receive());
-            }
-            catch (const std::ios_base::failure& e)
-            {
-                m_isConnectedToClient = false;
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
 
-                break;
-            }
+        join_finished_threads();
 
-            RequestType requestType = request.ParseRequestType();
+        m_connections.push_back(connection);
 
-            if (requestType == RequestType::Disconnect)
+        // The thread is only added to the finished ones under the lock, so it is always tracked by then.
+        std::thread thread([this, connection]()
             {
-                m_isConnectedToClient = false;
+                serve_connection(connection);
 
-                break;
-            }
+                std::lock_guard<std::mutex> lock(m_connectionsMutex);
+
+                m_connections.erase(std::find(m_connections.begin(), m_connections.end(), connection));
+                m_finishedThreads.push_back(std::this_thread::get_id());
+                m_connectionClosed.notify_all();
+            });
+
+        m_connectionThreads.emplace(thread.get_id(), std::move(thread));
+    }
+
+    // Drop the clients that are still connected and wait for their threads to finish before shutting down.
+    std::unique_lock<std::mutex> lock(m_connectionsMutex);
+
+    for (const auto& connection : m_connections)
+    {
+        connection->close();
+    }
+
+    m_connectionClosed.wait(lock, [this]() { return m_connections.empty(); });
+
+    join_finished_threads();
+}
+
+void Server::join_finished_threads()
+{
+    // A finished thread only has to release the lock and return, so joining it does not wait for long.
+    for (const auto& id : m_finishedThreads)
+    {
+        auto it = m_connectionThreads.find(id);
+        it->second.join();
+        m_connectionThreads.erase(it);
+    }
+
+    m_finishedThreads.clear();
+}
+
+void Server::serve_connection(const std::shared_ptr<Connection>& connection)
+{
+    while (true)
+    {
+        Request request;
+        Response response;
+
+        try
+        {
+            request = Request::FromString(connection->receive());
+        }
+        catch (const std::ios_base::failure& e)
+        {
+            return;
+        }
+
+        RequestType requestType = request.ParseRequestType();
+
+        if (requestType == RequestType::Disconnect)
+        {
+            break;
+        }
+
+        if (requestType == RequestType::Kill)
+        {
+            bool isIdle;
 
-            if (requestType == RequestType::Kill)
             {
-                m_isConnectedToClient = false;
-                m_isRunning = false;
+                std::lock_guard<std::mutex> lock(m_screenRecorderMutex);
 
-                break;
+                isIdle = m_screenRecorder.session_count() == 0;
             }
 
+            // Clients ask to shut down after stopping their recording, but the server keeps serving the others.
+            // Answer before shutting down, since the remaining connections are dropped once the listener is closed.
             try
             {
-                response = serve_request(request, requestType);
+                connection->send(Response::BuildSuccessResponse().ToString());
+                connection->disconnect();
             }
-            catch (const std::exception& e)
+            catch (std::ios_base::failure)
             {
-                response = Response::BuildExceptionResponse(e);
             }
 
-            try
+            if (isIdle)
             {
-                m_pipe.send(response.ToString());
+                m_isRunning = false;
+                m_listener.close();
             }
-            catch (const std::ios_base::failure& e)
-            {
-                m_isConnectedToClient = false;
 
-                break;
-            }
+            return;
+        }
+
+        try
+        {
+            response = serve_request(request, requestType);
+        }
+        catch (const std::exception& e)
+        {
+            response = Response::BuildExceptionResponse(e);
         }
 
         try
         {
-            m_pipe.send(Response::BuildSuccessResponse().ToString());
-            m_pipe.disconnect();
+            connection->send(response.ToString());
         }
-        catch (std::ios_base::failure)
+        catch (const std::ios_base::failure& e)
         {
             return;
-        }  
+        }
+    }
+
+    try
+    {
+        connection->send(Response::BuildSuccessResponse().ToString());
+        connection->disconnect();
+    }
+    catch (std::ios_base::failure)
+    {
     }
 }
 
 Response Server::serve_request(Request& request, RequestType requestType)
 {
-    int framerate, monitor, bufferSize;
-    bool isMegabytes;
-    std::string folder;
+    RecordingOptions options;
+    ExportOptions exportOptions;
+    int jobId;
+    std::string folder, session, message, frameBusName;
+    uint32_t slotCount, slotCapacity;
+    JobState jobState;
 
     switch (requestType)
     {
     case RequestType::Start:
-        request.ParseStartArgs(framerate, monitor, bufferSize, isMegabytes);
+    {
+        request.ParseStartArgs(options);
 
-        m_screenRecorder.start(framerate, monitor, bufferSize, isMegabytes);
+        std::lock_guard<std::mutex> lock(m_screenRecorderMutex);
+
+        m_screenRecorder.start(options);
 
         return Response::BuildSuccessResponse();
+    }
     case RequestType::Stop:
-        request.ParseStopArgs(folder);
+        request.ParseStopArgs(folder, session);
 
-        m_screenRecorder.stop(folder);
+        // Saving the buffer can take a long time, so it runs as a job the client waits on. The recorder is only locked
+        // to mark the recording as stopping and to remove it afterwards, so other clients are served while the frames
+        // are saved, and a second stop finds the recording already gone. The recording keeps its memory until it is
+        // removed. A failed save still ends the stop, so the recording is removed, or keeps running if the save failed
+        // before closing the capture, as when the folder cannot be opened.
+        jobId = m_jobs.submit([this, folder, session]()
+            {
+                std::shared_ptr<SimpleCapture> capture;
 
-        return Response::BuildSuccessResponse();
+                {
+                    std::lock_guard<std::mutex> lock(m_screenRecorderMutex);
+
+                    capture = m_screenRecorder.begin_stop(session);
+                }
+
+                auto endStop = wil::scope_exit([&]()
+                    {
+                        std::lock_guard<std::mutex> lock(m_screenRecorderMutex);
+
+                        m_screenRecorder.end_stop(session, capture);
+                    });
+
+                ScreenRecorder::stop(*capture, folder);
+            });
+
+        return Response::BuildJobResponse(jobId);
+    case RequestType::Export:
+        request.ParseExportArgs(exportOptions);
+
+        // Saving the frames can take a long time, so it runs as a job like stop. The recording keeps running.
+        jobId = m_jobs.submit([this, exportOptions]()
+            {
+                std::shared_ptr<SimpleCapture> capture;
+
+                {
+                    std::lock_guard<std::mutex> lock(m_screenRecorderMutex);
+
+                    capture = m_screenRecorder.capture(exportOptions.Session);
+                }
+
+                ScreenRecorder::export_frames(*capture, exportOptions);
+            });
+
+        return Response::BuildJobResponse(jobId);
+    case RequestType::FrameBus:
+    {
+        request.ParseSessionArgs(session);
+
+        std::lock_guard<std::mutex> lock(m_screenRecorderMutex);
+
+        m_screenRecorder.frame_bus(session, frameBusName, slotCount, slotCapacity);
+
+        return Response::BuildFrameBusResponse(frameBusName, slotCount, slotCapacity);
+    }
     case RequestType::Cancel:
-        m_screenRecorder.cancel();
+    {
+        request.ParseSessionArgs(session);
+
+        std::lock_guard<std::mutex> lock(m_screenRecorderMutex);
+
+        m_screenRecorder.cancel(session);
+
+        return Response::BuildSuccessResponse();
+    }
+    case RequestType::JobStatus:
+        request.ParseJobArgs(jobId);
+
+        jobState = m_jobs.status(jobId, message);
+
+        if (jobState == JobState::Unknown)
+        {
+            throw std::invalid_argument(unknownJobMessage);
+        }
+
+        return Response::BuildJobStatusResponse(jobState, message);
+    case RequestType::JobWait:
+        request.ParseJobArgs(jobId);
+
+        jobState = m_jobs.wait(jobId, message);
+
+        if (jobState == JobState::Unknown)
+        {
+            throw std::invalid_argument(unknownJobMessage);
+        }
+
+        if (jobState == JobState::Failed)
+        {
+            throw std::runtime_error(message);
+        }
 
         return Response::BuildSuccessResponse();
     case RequestType::Unknown:
@@ -121,4 +297,4 @@ Response Server::serve_request(Request& request, RequestType requestType)
     default:
         throw std::invalid_argument(defaultEnumCaseMessage);
     }
-}
\ No newline at end of file
+}
@@ -4,19 +4,36 @@
 #include "Pipe.h"
 #include "Request.h"
 #include "Response.h"
+#include "JobManager.h"
 #include "ScreenRecorder.h"
 
-// The purpose of this class is to receive screen recording requests from clients and proces them.
+// The purpose of this class is to receive screen recording requests from clients and proces them. Every client is
+// served on its own thread, and long operations run as jobs, so a slow request never blocks the other clients.
 class Server {
 public:
+    Server(const std::wstring& pipeName = L"myPipe") : m_pipeName(pipeName) {}
+    ~Server();
+
     bool try_init();
     void run();
 
 private:
+    void serve_connection(const std::shared_ptr<Connection>& connection);
     Response serve_request(Request& request, RequestType requestType);
 
-    Pipe m_pipe;
+    // Joins the threads that finished serving their client. Called with the connections lock held.
+    void join_finished_threads();
+
+    std::wstring m_pipeName;
+    PipeListener m_listener;
     ScreenRecorder m_screenRecorder;
-    bool m_isRunning;
-    bool m_isConnectedToClient;
-};
\ No newline at end of file
+    std::mutex m_screenRecorderMutex;
+    JobManager m_jobs;
+    std::atomic<bool> m_isRunning;
+
+    std::mutex m_connectionsMutex;
+    std::condition_variable m_connectionClosed;
+    std::vector<std::shared_ptr<Connection>> m_connections;
+    std::map<std::thread::id, std::thread> m_connectionThreads;
+    std::vector<std::thread::id> m_finishedThreads;
+};
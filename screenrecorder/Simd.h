@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+// Which SIMD code paths are built. SIMD_X86 is set for x86 and x64 with MSVC, GCC or Clang. SIMD_SSE2 is set where
+// SSE2 can be used without checking for it: always with MSVC, which targets SSE2 on both, and with GCC and Clang when
+// the build enables it, as it does by default on x64. Wider instruction sets are checked for at run time, and the
+// functions using them are marked with SIMD_TARGET_AVX2 so GCC and Clang compile them for AVX2 and F16C whatever the
+// rest of the build targets. MSVC accepts their intrinsics anywhere.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIMD_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#endif
+
+// Fills info with EAX, EBX, ECX and EDX as CPUID returns them for the leaf and subleaf.
+inline void read_cpuid(int (&info)[4], int leaf, int subleaf = 0)
+{
+#ifdef _MSC_VER
+    __cpuidex(info, leaf, subleaf);
+#else
+    __cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+#endif
+}
+
+// The register states the operating system saves on a context switch. Only valid when CPUID reports OSXSAVE.
+inline uint64_t read_xcr0()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t low, high;
+    __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+
+    return static_cast<uint64_t>(high) << 32 | low;
+#endif
+}
+#endif
@@ -1,6 +1,10 @@
 #include "pch.h"
 #include "SimpleCapture.h"
 #include "ScreenRecorderProvider.h"
+#include "FrameNameFormatter.h"
+#include "BlockCompressor.h"
+#include "TaskScheduler.h"
+#include "ToneMapper.h"
 
 namespace winrt
 {
@@ -21,34 +25,154 @@ namespace util
 }
 
 SimpleCapture::SimpleCapture(winrt::Windows::Graphics::DirectX::Direct3D11::IDirect3DDevice const& device, 
-    winrt::Windows::Graphics::Capture::GraphicsCaptureItem const& item, 
-    int framerate, CircularFrameBuffer frameBuffer) : m_frameInterval(1000 / framerate), m_frameBuffer(frameBuffer)
+    std::unique_ptr<FrameSource> source, 
+    POINT itemOrigin, const RecordingOptions& options, CircularFrameBuffer frameBuffer,
+    std::unique_ptr<ActivityDetector> activityDetector) : m_source(std::move(source)), m_frameInterval(1000 / options.Framerate), m_frameBuffer(std::move(frameBuffer)), 
+    m_storeDirtyRegions(options.DirtyRegions), m_storeCursor(options.CursorAsMetadata), m_itemOrigin(itemOrigin),
+    m_activityDetector(std::move(activityDetector)), m_idleFrameInterval(options.IdleIntervalSeconds * 1000)
 {
-    m_item = item;
     m_device = device;
     m_fileFormatGuid = winrt::BitmapEncoder::JpegEncoderId();
     m_bitmapPixelFormat = winrt::BitmapPixelFormat::Bgra8;
-    auto pixelFormat = winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized;
 
     m_d3dDevice = GetDXGIInterfaceFromObject<ID3D11Device>(m_device);
     m_d3dDevice->GetImmediateContext(m_d3dContext.put());
 
-    // Creating our frame pool with 'Create' instead of 'CreateFreeThreaded'
-    // means that the frame pool's FrameArrived event is called on the thread
-    // the frame pool was created on. This also means that the creating thread
-    // must have a DispatcherQueue. If you use this method, it's best not to do
-    // it on the UI thread. 
-    m_framePool = winrt::Direct3D11CaptureFramePool::CreateFreeThreaded(m_device, pixelFormat, 2, m_item.Size());
-    m_session = m_framePool.CreateCaptureSession(m_item);
-    m_lastSize = m_item.Size();
-    m_framePool.FrameArrived({ this, &SimpleCapture::OnFrameArrived });
+    // Exports save their frames on another thread while the capture keeps using the immediate context.
+    m_d3dContext.as<ID3D11Multithread>()->SetMultithreadProtected(TRUE);
+
+    if (m_frameBuffer.storage() != FrameStorage::Texture || options.DirtyRegions || options.FrameBusSlots > 0)
+    {
+        m_readback = std::make_unique<ReadbackQueue>(m_d3dDevice, readbackDepth);
+    }
+
+    // Sources keep the size they started with, so encoded storage sized in frames is reserved for it up front.
+    m_frameBuffer.reserve(static_cast<uint32_t>(m_source->size().Width), static_cast<uint32_t>(m_source->size().Height));
+
+    // Sources keep the size they started with, so every slot is sized for a whole frame.
+    if (options.FrameBusSlots > 0)
+    {
+        auto size = m_source->size();
+        m_frameBus = std::make_unique<FrameBus>(options.FrameBusSlots, static_cast<uint32_t>(size.Width) * size.Height * 4, options.Session);
+    }
+
+    if (!options.RedactRects.empty() || !options.RedactApps.empty())
+    {
+        m_redactor = std::make_unique<Redactor>(m_d3dDevice, options);
+    }
 }
 
 void SimpleCapture::StartCapture()
 {
     CheckClosed();
-    m_lastFrameTime = std::chrono::steady_clock::now();
-    m_session.StartCapture();
+
+    // The first frame is stored as soon as it arrives, instead of a whole frame interval after starting.
+    m_lastFrameTime = std::chrono::steady_clock::now() - std::chrono::milliseconds(m_frameInterval);
+    m_source->start([this](winrt::com_ptr<ID3D11Texture2D> const& surfaceTexture, int64_t systemRelativeTime)
+        {
+            OnFrameArrived(surfaceTexture, systemRelativeTime);
+        });
+
+    if (!m_activityDetector)
+    {
+        return;
+    }
+
+    // A recording started on an unattended machine is paused straight away.
+    CheckActivity();
+
+    m_activityThread = std::thread([this]()
+        {
+            std::unique_lock<std::mutex> lock(m_activityMutex);
+
+            while (!m_activityWake.wait_for(lock, activityPollInterval, [this]() { return m_closed.load(); }))
+            {
+                lock.unlock();
+
+                // A source that fails to resume, such as one whose monitor went away, is tried again on the next poll.
+                try
+                {
+                    CheckActivity();
+                }
+                catch (const winrt::hresult_error&)
+                {
+                }
+                catch (const std::exception&)
+                {
+                }
+
+                lock.lock();
+            }
+        });
+}
+
+void SimpleCapture::CheckActivity()
+{
+    std::lock_guard<std::mutex> lock(m_activityMutex);
+
+    if (!m_activityDetector || m_closed.load())
+    {
+        return;
+    }
+
+    ActivityState state = m_activityDetector->state();
+    bool idle = state != ActivityState::Active;
+
+    if (idle == m_idle.load())
+    {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    uint32_t idleTime = 0;
+
+    if (idle)
+    {
+        // The source is paused first, so if it throws the capture keeps running and pausing is tried on the next poll.
+        if (m_idleFrameInterval == 0)
+        {
+            m_source->pause();
+        }
+
+        m_idleSince = now;
+        m_idle = true;
+
+        if (m_idleFrameInterval == 0)
+        {
+            // The last frames before the pause are stored now rather than whenever capture resumes.
+            std::lock_guard<std::mutex> frameBufferLock(m_frameBufferMutex);
+            FlushReadbacks();
+        }
+    }
+    else
+    {
+        // Likewise, the source is resumed first, so if it throws the capture stays idle until the next poll.
+        m_source->resume();
+
+        // Spans too short to be followed by a stored frame add up, so none of the time goes missing.
+        idleTime = static_cast<uint32_t>(std::min<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now - m_idleSince).count(), UINT32_MAX));
+        m_idleTime += idleTime;
+
+        m_idle = false;
+        m_resumed = true;
+    }
+
+    ActivityChangedEvent(ActivityDetector::state_name(state), idleTime);
+}
+
+void SimpleCapture::StopActivityThread()
+{
+    // Taking the lock orders the wake after the wait checked m_closed, so the thread cannot miss it.
+    {
+        std::lock_guard<std::mutex> lock(m_activityMutex);
+    }
+
+    m_activityWake.notify_all();
+
+    if (m_activityThread.joinable())
+    {
+        m_activityThread.join();
+    }
 }
 
 void SimpleCapture::Close()
@@ -56,12 +180,11 @@ void SimpleCapture::Close()
     auto expected = false;
     if (m_closed.compare_exchange_strong(expected, true))
     {
-        m_session.Close();
-        m_framePool.Close();
+        StopActivityThread();
+        m_source->close();
 
-        m_framePool = nullptr;
-        m_session = nullptr;
-        m_item = nullptr;
+        // Waits for a frame that was already being stored, since the capture may be destroyed right after.
+        std::lock_guard<std::mutex> lock(m_frameBufferMutex);
     }
 }
 
@@ -70,51 +193,501 @@ void SimpleCapture::CloseAndSave(StorageFolder storageFolder)
     auto expected = false;
     if (m_closed.compare_exchange_strong(expected, true))
     {
+        StopActivityThread();
+        m_source->close();
 
-        m_session.Close();
-        m_framePool.Close();
-
+        std::lock_guard<std::mutex> lock(m_frameBufferMutex);
+        FlushReadbacks();
         m_frameBuffer.save_frames(storageFolder);
+    }
+}
+
+void SimpleCapture::Export(StorageFolder storageFolder, const ExportOptions& options)
+{
+    CheckClosed();
+
+    std::unique_ptr<CircularFrameBuffer> frames;
+
+    // Only copying the frames holds up the capture, saving them does not.
+    {
+        std::lock_guard<std::mutex> lock(m_frameBufferMutex);
 
-        m_framePool = nullptr;
-        m_session = nullptr;
-        m_item = nullptr;
+        FlushReadbacks();
+        frames = options.Nearest ? m_frameBuffer.copy_nearest(options.At) : m_frameBuffer.copy_range(options.From, options.To, options.Stride);
     }
+
+    if (frames->frame_count() == 0)
+    {
+        throw std::invalid_argument("\b\tNo screenshots in the buffer match the requested times.\n");
+    }
+
+    frames->save_frames(storageFolder);
 }
 
-void SimpleCapture::OnFrameArrived(winrt::Direct3D11CaptureFramePool const& sender, winrt::IInspectable const&)
+void SimpleCapture::OnFrameArrived(winrt::com_ptr<ID3D11Texture2D> const& surfaceTexture, int64_t systemRelativeTime)
 {
-    auto frame = sender.TryGetNextFrame();
+    LARGE_INTEGER qpc;
+    QueryPerformanceCounter(&qpc);
+
+    // Work the capture waits on is scheduled ahead of live encoding and saving.
+    TaskScheduler::LaneScope lane(TaskLane::Capture);
+
+    // A source being paused may still hand over a frame that was on its way, which is dropped like the ones after it.
+    bool idle = m_idle.load();
+
+    if (idle && m_idleFrameInterval == 0)
+    {
+        return;
+    }
 
     auto now = std::chrono::steady_clock::now();
     auto timeSinceLastFrame = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastFrameTime).count();
     
-    if (timeSinceLastFrame >= m_frameInterval) 
+    // The first frame after the machine is used again is stored at once, however recently the last one was.
+    if (m_resumed.exchange(false) || timeSinceLastFrame >= (idle ? m_idleFrameInterval : m_frameInterval)) 
     {
-        auto now_sysclock = std::chrono::system_clock::now();
-        auto now_time_t = std::chrono::system_clock::to_time_t(now_sysclock);
-        auto now_us = std::chrono::duration_cast<std::chrono::microseconds>(now_sysclock.time_since_epoch()) % 1000000;
-        std::stringstream ss;
-        ss << std::put_time(std::localtime(&now_time_t), "%Y-%m-%d_%H-%M-%S-") << std::setw(6) << std::setfill('0') << now_us.count();
-        std::string timestamp = ss.str();
-        std::string filename = "screenshot_" + timestamp + ".jpg";
+        FILETIME fileTime;
+        GetSystemTimePreciseAsFileTime(&fileTime);
+        int64_t timestamp = (static_cast<int64_t>(fileTime.dwHighDateTime) << 32) | fileTime.dwLowDateTime;
 
-        ReceivedFrameEvent(filename);
+        if (TraceLoggingProviderEnabled(g_hMyComponentProvider, 0, 0))
+        {
+            char filename[FrameNameFormatter::maxLength];
+            FrameNameFormatter::Format(timestamp, m_frameBuffer.encoder().file_extension(), filename);
 
-        // Store frame
+            ReceivedFrameEvent(filename, m_frameSequence, qpc.QuadPart);
+        }
 
-        auto surfaceTexture = GetDXGIInterfaceFromObject<ID3D11Texture2D>(frame.Surface());
+        // Store frame
 
         D3D11_TEXTURE2D_DESC desc{};
         surfaceTexture->GetDesc(&desc);
 
-        winrt::com_ptr<ID3D11Texture2D> frameTexture;
-        winrt::check_hresult(m_d3dDevice->CreateTexture2D(&desc, nullptr, frameTexture.put()));
+        FrameMetadata metadata = {};
+        metadata.Sequence = m_frameSequence++;
+        metadata.Timestamp = timestamp;
+        metadata.Qpc = qpc.QuadPart;
+        metadata.SystemRelativeTime = systemRelativeTime;
+        metadata.Width = desc.Width;
+        metadata.Height = desc.Height;
+        metadata.DedupeCount = m_dedupeCount;
+        metadata.IdleTime = m_idleTime.exchange(0);
+
+        std::lock_guard<std::mutex> lock(m_frameBufferMutex);
+
+        if (m_storeCursor)
+        {
+            POINT cursorPosition = {};
+            metadata.CursorShape = m_frameBuffer.cursor_cache().capture_current(cursorPosition);
+
+            if (metadata.CursorShape != CursorCache::noCursor)
+            {
+                metadata.CursorX = cursorPosition.x - m_itemOrigin.x;
+                metadata.CursorY = cursorPosition.y - m_itemOrigin.y;
+            }
+        }
+
+        winrt::com_ptr<ID3D11Texture2D> frameTexture = surfaceTexture;
+        std::vector<DirtyRect> redactRegions;
+
+        if (m_redactor)
+        {
+            LARGE_INTEGER frequency, redactStart, redactEnd;
+            QueryPerformanceFrequency(&frequency);
+            QueryPerformanceCounter(&redactStart);
+
+            redactRegions = m_redactor->find_regions(m_itemOrigin, desc.Width, desc.Height);
+
+            // Frames kept on the GPU are redacted there, and the redacted copy takes the place of the captured surface
+            // from here on. Encoded and compressed frames are redacted in memory as soon as they are read back.
+            if (!redactRegions.empty() && (m_frameBuffer.storage() == FrameStorage::Texture || m_frameBuffer.storage() == FrameStorage::Hdr))
+            {
+                frameTexture = m_redactor->redact_texture(surfaceTexture, redactRegions);
+                redactRegions.clear();
+            }
+
+            QueryPerformanceCounter(&redactEnd);
+            metadata.RedactTime = static_cast<uint32_t>((redactEnd.QuadPart - redactStart.QuadPart) * 1000000 / frequency.QuadPart);
+        }
 
-        m_d3dContext->CopyResource(frameTexture.get(), surfaceTexture.get());
+        // Frames stored in memory are read back to the CPU and stored once their copy is read, and are published to
+        // the frame bus at the same time. So are frames stored as dirty regions, which are compared with the previous
+        // frame on the CPU, while a copy of the frame waits on the GPU. Other frames kept on the GPU are stored at
+        // once, and read back only to be published.
+        if (m_frameBuffer.storage() != FrameStorage::Texture)
+        {
+            QueueReadback(frameTexture, metadata, std::move(redactRegions));
+        }
+        else if (m_storeDirtyRegions)
+        {
+            QueueReadback(frameTexture, metadata, {}, CopyFrame(frameTexture));
+        }
+        else
+        {
+            StoreKeyFrame(CopyFrame(frameTexture), metadata);
 
-        m_frameBuffer.add_frame(frameTexture, filename);
+            if (m_frameBus)
+            {
+                QueueReadback(frameTexture, metadata, {});
+            }
+        }
 
+        m_dedupeCount = 0;
         m_lastFrameTime = now;
     }
+    else
+    {
+        m_dedupeCount++;
+    }
+}
+
+void SimpleCapture::QueueReadback(winrt::com_ptr<ID3D11Texture2D> const& frameTexture, const FrameMetadata& metadata, std::vector<DirtyRect> redactRegions, winrt::com_ptr<ID3D11Texture2D> frameCopy)
+{
+    m_readback->submit(frameTexture);
+    m_pendingFrames.push_back({ metadata, std::move(redactRegions), std::move(frameCopy) });
+
+    if (m_readback->full())
+    {
+        CompleteReadback();
+    }
+}
+
+void SimpleCapture::CompleteReadback()
+{
+    PendingFrame frame = std::move(m_pendingFrames.front());
+    m_pendingFrames.pop_front();
+
+    switch (m_frameBuffer.storage())
+    {
+    case FrameStorage::Encoded:
+        StoreEncodedFrame(frame);
+        break;
+    case FrameStorage::Compressed:
+        StoreCompressedFrame(frame);
+        break;
+    case FrameStorage::Hdr:
+        StoreHdrFrame(frame);
+        break;
+    default:
+        if (frame.texture)
+        {
+            StoreDirtyRegions(frame);
+        }
+        else
+        {
+            PublishFrame(frame);
+        }
+        break;
+    }
+}
+
+void SimpleCapture::FlushReadbacks()
+{
+    while (!m_pendingFrames.empty())
+    {
+        CompleteReadback();
+    }
+}
+
+winrt::com_ptr<ID3D11Texture2D> SimpleCapture::CopyFrame(winrt::com_ptr<ID3D11Texture2D> const& surfaceTexture)
+{
+    D3D11_TEXTURE2D_DESC desc{};
+    surfaceTexture->GetDesc(&desc);
+
+    winrt::com_ptr<ID3D11Texture2D> frameCopy = std::move(m_spareFrameCopy);
+
+    if (frameCopy)
+    {
+        D3D11_TEXTURE2D_DESC copyDesc{};
+        frameCopy->GetDesc(&copyDesc);
+
+        if (copyDesc.Width != desc.Width || copyDesc.Height != desc.Height || copyDesc.Format != desc.Format)
+        {
+            frameCopy = nullptr;
+        }
+    }
+
+    if (!frameCopy)
+    {
+        winrt::check_hresult(m_d3dDevice->CreateTexture2D(&desc, nullptr, frameCopy.put()));
+    }
+
+    m_d3dContext->CopyResource(frameCopy.get(), surfaceTexture.get());
+
+    return frameCopy;
+}
+
+void SimpleCapture::StoreKeyFrame(winrt::com_ptr<ID3D11Texture2D> const& frameCopy, FrameMetadata& metadata)
+{
+    metadata.StoredBytes = static_cast<uint32_t>(CircularFrameBuffer::calculate_frame_size(frameCopy));
+
+    m_frameBuffer.add_frame(frameCopy, metadata);
+    m_framesSinceKeyFrame = 0;
+}
+
+void SimpleCapture::StoreEncodedFrame(PendingFrame& frame)
+{
+    winrt::Windows::Storage::Streams::InMemoryRandomAccessStream stream;
+    TaskScheduler::LaneScope lane(TaskLane::LiveEncode);
+
+    FrameMetadata& metadata = frame.metadata;
+    LARGE_INTEGER frequency, encodeStart, encodeEnd;
+    QueryPerformanceFrequency(&frequency);
+
+    // The cursor is drawn now, since encoded frames are not touched again before they are saved.
+    m_readback->read_oldest([&](uint8_t* pixels, uint32_t rowPitch, const D3D11_TEXTURE2D_DESC& desc)
+        {
+            RedactPixels(pixels, rowPitch, frame);
+
+            QueryPerformanceCounter(&encodeStart);
+
+            if (metadata.CursorShape != CursorCache::noCursor)
+            {
+                m_frameBuffer.cursor_cache().composite(metadata.CursorShape, metadata.CursorX, metadata.CursorY, pixels, desc.Width, desc.Height, rowPitch);
+            }
+
+            m_frameBuffer.encoder().encode(pixels, desc.Width, desc.Height, rowPitch, stream);
+
+            QueryPerformanceCounter(&encodeEnd);
+
+            if (m_frameBus)
+            {
+                m_frameBus->publish(pixels, rowPitch, metadata);
+            }
+        });
+
+    metadata.EncodeTime = static_cast<uint32_t>((encodeEnd.QuadPart - encodeStart.QuadPart) * 1000000 / frequency.QuadPart);
+
+    winrt::Windows::Storage::Streams::Buffer buffer(static_cast<uint32_t>(stream.Size()));
+    stream.Seek(0);
+    stream.ReadAsync(buffer, buffer.Capacity(), winrt::Windows::Storage::Streams::InputStreamOptions::None).get();
+
+    metadata.StoredBytes = buffer.Length();
+
+    m_frameBuffer.add_encoded_frame(buffer.data(), buffer.Length(), metadata);
+}
+
+void SimpleCapture::StoreCompressedFrame(PendingFrame& frame)
+{
+    FrameMetadata& metadata = frame.metadata;
+    LARGE_INTEGER frequency, compressStart, compressEnd;
+    QueryPerformanceFrequency(&frequency);
+
+    m_compressedFrame.resize(BlockCompressor::compressed_size(metadata.Width, metadata.Height));
+
+    // As with encoded frames, the cursor is drawn before the pixels are compressed.
+    m_readback->read_oldest([&](uint8_t* pixels, uint32_t rowPitch, const D3D11_TEXTURE2D_DESC& desc)
+        {
+            RedactPixels(pixels, rowPitch, frame);
+
+            QueryPerformanceCounter(&compressStart);
+
+            if (metadata.CursorShape != CursorCache::noCursor)
+            {
+                m_frameBuffer.cursor_cache().composite(metadata.CursorShape, metadata.CursorX, metadata.CursorY, pixels, desc.Width, desc.Height, rowPitch);
+            }
+
+            // Bands of block rows compress independently into their own part of the frame.
+            uint32_t bandCount = (desc.Height + compressBandHeight - 1) / compressBandHeight;
+
+            TaskScheduler::shared().parallel_for(bandCount, [&](uint32_t band)
+                {
+                    uint32_t top = band * compressBandHeight;
+                    uint8_t* blocks = m_compressedFrame.data() + BlockCompressor::compressed_size(desc.Width, top);
+
+                    BlockCompressor::compress(pixels + static_cast<size_t>(top) * rowPitch, desc.Width, std::min(compressBandHeight, desc.Height - top), rowPitch, blocks);
+                });
+
+            QueryPerformanceCounter(&compressEnd);
+
+            if (m_frameBus)
+            {
+                m_frameBus->publish(pixels, rowPitch, metadata);
+            }
+        });
+
+    metadata.EncodeTime = static_cast<uint32_t>((compressEnd.QuadPart - compressStart.QuadPart) * 1000000 / frequency.QuadPart);
+    metadata.StoredBytes = static_cast<uint32_t>(m_compressedFrame.size());
+
+    m_frameBuffer.add_encoded_frame(m_compressedFrame.data(), m_compressedFrame.size(), metadata);
+}
+
+void SimpleCapture::StoreHdrFrame(PendingFrame& frame)
+{
+    FrameMetadata& metadata = frame.metadata;
+    LARGE_INTEGER frequency, packStart, packEnd;
+    QueryPerformanceFrequency(&frequency);
+
+    m_compressedFrame.resize(ToneMapper::packed_size(metadata.Width, metadata.Height));
+
+    // The cursor is drawn in 8-bit, so it is only drawn once the frame has been tone mapped.
+    m_readback->read_oldest([&](uint8_t* pixels, uint32_t rowPitch, const D3D11_TEXTURE2D_DESC& desc)
+        {
+            QueryPerformanceCounter(&packStart);
+
+            uint32_t bandCount = (desc.Height + compressBandHeight - 1) / compressBandHeight;
+
+            TaskScheduler::shared().parallel_for(bandCount, [&](uint32_t band)
+                {
+                    uint32_t top = band * compressBandHeight;
+                    uint8_t* packed = m_compressedFrame.data() + ToneMapper::packed_size(desc.Width, top);
+
+                    ToneMapper::pack(pixels + static_cast<size_t>(top) * rowPitch, desc.Width, std::min(compressBandHeight, desc.Height - top), rowPitch, packed);
+                });
+
+            QueryPerformanceCounter(&packEnd);
+        });
+
+    metadata.EncodeTime = static_cast<uint32_t>((packEnd.QuadPart - packStart.QuadPart) * 1000000 / frequency.QuadPart);
+    metadata.StoredBytes = static_cast<uint32_t>(m_compressedFrame.size());
+
+    if (m_frameBus)
+    {
+        uint32_t rowPitch = metadata.Width * 4;
+        m_publishedFrame.resize(static_cast<size_t>(rowPitch) * metadata.Height);
+
+        ToneMapper::tone_map(m_compressedFrame.data(), metadata.Width, metadata.Height, m_frameBuffer.white_level(), m_publishedFrame.data(), rowPitch);
+
+        if (metadata.CursorShape != CursorCache::noCursor)
+        {
+            m_frameBuffer.cursor_cache().composite(metadata.CursorShape, metadata.CursorX, metadata.CursorY, m_publishedFrame.data(), metadata.Width, metadata.Height, rowPitch);
+        }
+
+        m_frameBus->publish(m_publishedFrame.data(), rowPitch, metadata);
+    }
+
+    m_frameBuffer.add_encoded_frame(m_compressedFrame.data(), m_compressedFrame.size(), metadata);
+}
+
+void SimpleCapture::StoreDirtyRegions(PendingFrame& frame)
+{
+    FrameMetadata& metadata = frame.metadata;
+    ScrollMotion scroll;
+    std::vector<DirtyRect> rects;
+
+    // The frame is compared before the cursor is drawn on it for the frame bus, since the buffer stores it without.
+    m_readback->read_oldest([&](uint8_t* pixels, uint32_t rowPitch, const D3D11_TEXTURE2D_DESC& desc)
+        {
+            rects = DetectDirtyRegions(pixels, rowPitch, desc.Width, desc.Height, scroll);
+
+            if (m_frameBus)
+            {
+                if (metadata.CursorShape != CursorCache::noCursor)
+                {
+                    m_frameBuffer.cursor_cache().composite(metadata.CursorShape, metadata.CursorX, metadata.CursorY, pixels, desc.Width, desc.Height, rowPitch);
+                }
+
+                m_frameBus->publish(pixels, rowPitch, metadata);
+            }
+        });
+
+    metadata.DirtyRegionCount = static_cast<uint32_t>(rects.size());
+
+    uint32_t atlasWidth = 0;
+    uint32_t atlasHeight = 0;
+
+    for (const auto& rect : rects)
+    {
+        atlasWidth = std::max(atlasWidth, rect.Width());
+        atlasHeight += rect.Height();
+    }
+
+    uint64_t frameArea = static_cast<uint64_t>(metadata.Width) * metadata.Height;
+
+    // The first frame and frames of a new size are reported as entirely dirty, so they always become key frames.
+    if (m_frameBuffer.frame_count() == 0 ||
+        m_framesSinceKeyFrame >= keyFrameInterval ||
+        DirtyRegionDetector::total_area(rects) >= frameArea * maxDirtyShare ||
+        atlasHeight > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION)
+    {
+        StoreKeyFrame(frame.texture, metadata);
+        return;
+    }
+
+    winrt::com_ptr<ID3D11Texture2D> atlas;
+    std::vector<CircularFrameBuffer::Patch> patches;
+    patches.reserve(rects.size());
+
+    if (!rects.empty())
+    {
+        D3D11_TEXTURE2D_DESC desc{};
+        frame.texture->GetDesc(&desc);
+
+        D3D11_TEXTURE2D_DESC atlasDesc{};
+        atlasDesc.Width = atlasWidth;
+        atlasDesc.Height = atlasHeight;
+        atlasDesc.MipLevels = 1;
+        atlasDesc.ArraySize = 1;
+        atlasDesc.Format = desc.Format;
+        atlasDesc.SampleDesc.Count = 1;
+        atlasDesc.Usage = D3D11_USAGE_DEFAULT;
+
+        winrt::check_hresult(m_d3dDevice->CreateTexture2D(&atlasDesc, nullptr, atlas.put()));
+
+        uint32_t atlasY = 0;
+
+        for (const auto& rect : rects)
+        {
+            D3D11_BOX box = { rect.Left, rect.Top, 0, rect.Right, rect.Bottom, 1 };
+            m_d3dContext->CopySubresourceRegion(atlas.get(), 0, 0, atlasY, 0, frame.texture.get(), 0, &box);
+
+            patches.push_back({ rect, atlasY });
+            atlasY += rect.Height();
+        }
+    }
+
+    metadata.StoredBytes = static_cast<uint32_t>(CircularFrameBuffer::calculate_frame_size(atlas));
+
+    m_frameBuffer.add_delta_frame(atlas, std::move(patches), metadata, scroll);
+    m_framesSinceKeyFrame++;
+
+    // Only the patches are kept, so the copy of the whole frame takes the next frame.
+    m_spareFrameCopy = std::move(frame.texture);
+}
+
+void SimpleCapture::PublishFrame(const PendingFrame& frame)
+{
+    const FrameMetadata& metadata = frame.metadata;
+
+    // Consumers get the frame as it will be saved, so the cursor is drawn like it is for encoded frames.
+    m_readback->read_oldest([&](uint8_t* pixels, uint32_t rowPitch, const D3D11_TEXTURE2D_DESC& desc)
+        {
+            if (metadata.CursorShape != CursorCache::noCursor)
+            {
+                m_frameBuffer.cursor_cache().composite(metadata.CursorShape, metadata.CursorX, metadata.CursorY, pixels, desc.Width, desc.Height, rowPitch);
+            }
+
+            m_frameBus->publish(pixels, rowPitch, metadata);
+        });
+}
+
+void SimpleCapture::RedactPixels(uint8_t* pixels, uint32_t rowPitch, PendingFrame& frame)
+{
+    if (frame.redactRegions.empty())
+    {
+        return;
+    }
+
+    LARGE_INTEGER frequency, redactStart, redactEnd;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&redactStart);
+
+    m_redactor->redact_pixels(pixels, rowPitch, frame.redactRegions);
+
+    QueryPerformanceCounter(&redactEnd);
+    frame.metadata.RedactTime += static_cast<uint32_t>((redactEnd.QuadPart - redactStart.QuadPart) * 1000000 / frequency.QuadPart);
+}
+
+std::vector<DirtyRect> SimpleCapture::DetectDirtyRegions(const uint8_t* pixels, uint32_t rowPitch, uint32_t width, uint32_t height, ScrollMotion& scroll)
+{
+    // When the frame scrolled, the detector's copy of the previous frame is moved the way the buffer will move it, so
+    // only the band that scrolled into view and whatever else changed are reported.
+    scroll = m_motionEstimator.estimate(pixels, rowPitch, width, height);
+
+    if (!scroll.IsNone())
+    {
+        m_dirtyRegionDetector.shift(scroll);
+    }
+
+    return m_dirtyRegionDetector.detect(pixels, rowPitch, width, height);
 }
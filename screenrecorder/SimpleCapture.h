@@ -2,6 +2,15 @@
 
 #include "pch.h"
 #include "CircularFrameBuffer.h"
+#include "RecordingOptions.h"
+#include "ExportOptions.h"
+#include "DirtyRegions.h"
+#include "MotionEstimator.h"
+#include "ReadbackQueue.h"
+#include "FrameBus.h"
+#include "FrameSource.h"
+#include "Redactor.h"
+#include "ActivityDetector.h"
 
 using namespace winrt;
 using namespace Windows::Foundation;
@@ -29,31 +38,70 @@ namespace util
     using namespace robmikh::common::uwp;
 }
 
-// This purpose of this class is to take screenshots and save them to disk.
+// This purpose of this class is to take screenshots from a frame source and save them to disk.
 class SimpleCapture
 {
 public:
     SimpleCapture(
         winrt::Windows::Graphics::DirectX::Direct3D11::IDirect3DDevice const& device,
-        winrt::Windows::Graphics::Capture::GraphicsCaptureItem const& item,
-        int framerate, CircularFrameBuffer frameBuffer);
+        std::unique_ptr<FrameSource> source,
+        POINT itemOrigin, const RecordingOptions& options, CircularFrameBuffer frameBuffer,
+        std::unique_ptr<ActivityDetector> activityDetector = nullptr);
     ~SimpleCapture() { Close(); }
 
     void StartCapture();
 
-    bool IsCursorEnabled() { CheckClosed(); return m_session.IsCursorCaptureEnabled(); }
-    void IsCursorEnabled(bool value) { CheckClosed(); m_session.IsCursorCaptureEnabled(value); }
-    bool IsBorderRequired() { CheckClosed(); return m_session.IsBorderRequired(); }
-    void IsBorderRequired(bool value) { CheckClosed(); m_session.IsBorderRequired(value); }
-    winrt::Windows::Graphics::Capture::GraphicsCaptureItem CaptureItem() { return m_item; }
-
     void Close();
     void CloseAndSave(StorageFolder storageFolder);
+    bool IsClosed() const { return m_closed.load(); }
+
+    /**
+     * Saves a copy of the selected frames while the capture keeps running.
+     * @throws std::invalid_argument if no frame was selected
+     */
+    void Export(StorageFolder storageFolder, const ExportOptions& options);
+
+    // The frame bus live frames are published to, or null if publishing was not requested.
+    const FrameBus* GetFrameBus() const { return m_frameBus.get(); }
+
+    /**
+     * Asks the activity detector whether the machine is in use, and pauses or resumes the capture when that changed.
+     * Called every activityPollInterval while the capture runs, and may be called to act on a change at once.
+     */
+    void CheckActivity();
 
 private:
-    void OnFrameArrived(
-        winrt::Windows::Graphics::Capture::Direct3D11CaptureFramePool const& sender,
-        winrt::Windows::Foundation::IInspectable const& args);
+    // A frame being read back to the CPU, to be stored or published once its copy is read.
+    struct PendingFrame
+    {
+        FrameMetadata metadata;
+        std::vector<DirtyRect> redactRegions;  // Regions still to be hidden in the pixels read back.
+        winrt::com_ptr<ID3D11Texture2D> texture;  // Copy of a frame to be stored as dirty regions, kept on the GPU.
+    };
+
+    void OnFrameArrived(winrt::com_ptr<ID3D11Texture2D> const& surfaceTexture, int64_t systemRelativeTime);
+    void StopActivityThread();
+
+    // Starts copying the frame to the CPU, and completes the oldest copy once readbackDepth of them are in flight.
+    void QueueReadback(winrt::com_ptr<ID3D11Texture2D> const& frameTexture, const FrameMetadata& metadata, std::vector<DirtyRect> redactRegions, winrt::com_ptr<ID3D11Texture2D> frameCopy = nullptr);
+    // Stores or publishes the oldest frame being read back, waiting for its copy if the GPU has not finished it.
+    void CompleteReadback();
+    // Completes every copy in flight, so the buffer holds every frame that arrived before it is saved or copied.
+    void FlushReadbacks();
+
+    // Copies the captured surface, which the source reuses, into a texture the buffer can keep.
+    winrt::com_ptr<ID3D11Texture2D> CopyFrame(winrt::com_ptr<ID3D11Texture2D> const& surfaceTexture);
+
+    void StoreKeyFrame(winrt::com_ptr<ID3D11Texture2D> const& frameCopy, FrameMetadata& metadata);
+    void StoreEncodedFrame(PendingFrame& frame);
+    void StoreCompressedFrame(PendingFrame& frame);
+    void StoreHdrFrame(PendingFrame& frame);
+    void StoreDirtyRegions(PendingFrame& frame);
+    void PublishFrame(const PendingFrame& frame);
+
+    // Hides the redacted regions of the frame in pixels read back from the GPU, and adds the time taken to the frame.
+    void RedactPixels(uint8_t* pixels, uint32_t rowPitch, PendingFrame& frame);
+    std::vector<DirtyRect> DetectDirtyRegions(const uint8_t* pixels, uint32_t rowPitch, uint32_t width, uint32_t height, ScrollMotion& scroll);
 
     inline void CheckClosed()
     {
@@ -64,10 +112,7 @@ private:
     }
 
 private:
-    winrt::Windows::Graphics::Capture::GraphicsCaptureItem m_item{ nullptr };
-    winrt::Windows::Graphics::Capture::Direct3D11CaptureFramePool m_framePool{ nullptr };
-    winrt::Windows::Graphics::Capture::GraphicsCaptureSession m_session{ nullptr };
-    winrt::Windows::Graphics::SizeInt32 m_lastSize;
+    std::unique_ptr<FrameSource> m_source;
 
     winrt::Windows::Graphics::DirectX::Direct3D11::IDirect3DDevice m_device{ nullptr };
     winrt::com_ptr<ID3D11Device> m_d3dDevice{ nullptr };
@@ -78,8 +123,56 @@ private:
     std::atomic<bool> m_closed = false;
     std::atomic<bool> m_captureNextImage = false;
 
+    // Guards the frame buffer, which frames are added to on the capture thread while exports copy from it.
+    std::mutex m_frameBufferMutex;
     CircularFrameBuffer m_frameBuffer;
     std::chrono::steady_clock::time_point m_lastFrameTime;
     int m_frameInterval;
     int m_framesBufferSize;
+    uint64_t m_frameSequence = 0;
+    uint32_t m_dedupeCount = 0;
+
+    // A delta frame is only stored when it is smaller than this share of a whole frame, and a key frame is stored at
+    // least every keyFrameInterval frames so that evicting a key frame never has to apply a long run of deltas.
+    static constexpr double maxDirtyShare = 0.5;
+    static const uint32_t keyFrameInterval = 60;
+
+    // Rows of pixels in each band a frame is split into to be compressed or packed, a multiple of the block size.
+    static constexpr uint32_t compressBandHeight = 64;
+
+    // How often the activity detector is asked, which bounds how long a paused capture takes to resume.
+    static constexpr std::chrono::milliseconds activityPollInterval{ 100 };
+
+    // Frames read back to the CPU are stored this many frames minus one after they arrive, so the GPU has had a frame
+    // interval to finish each copy before it is read.
+    static const size_t readbackDepth = 2;
+
+    bool m_storeDirtyRegions;
+    bool m_storeCursor;
+    POINT m_itemOrigin;
+    std::unique_ptr<ReadbackQueue> m_readback;
+    std::deque<PendingFrame> m_pendingFrames;  // In the order of their copies in m_readback.
+    std::vector<uint8_t> m_compressedFrame;  // Compressed or packed HDR frame on its way into the arena.
+    std::vector<uint8_t> m_publishedFrame;   // Tone mapped HDR frame on its way to the frame bus.
+    DirtyRegionDetector m_dirtyRegionDetector;
+    MotionEstimator m_motionEstimator;
+    winrt::com_ptr<ID3D11Texture2D> m_spareFrameCopy;  // Copy of a frame stored as dirty regions, reused for the next one.
+    uint32_t m_framesSinceKeyFrame = 0;
+    std::unique_ptr<FrameBus> m_frameBus;
+
+    // Null when nothing is redacted. The regions are those of the frame being stored.
+    std::unique_ptr<Redactor> m_redactor;
+
+    // Null when the recording never idles. While idle, the source is paused, or frames are stored every
+    // m_idleFrameInterval milliseconds if that is not 0. The first frame stored after the machine is used again is
+    // stored at once, and carries the length of the idle span in place of the frames that were not taken.
+    std::unique_ptr<ActivityDetector> m_activityDetector;
+    int m_idleFrameInterval;
+    std::thread m_activityThread;
+    std::mutex m_activityMutex;
+    std::condition_variable m_activityWake;
+    std::chrono::steady_clock::time_point m_idleSince;
+    std::atomic<bool> m_idle = false;
+    std::atomic<bool> m_resumed = false;
+    std::atomic<uint32_t> m_idleTime = 0;
 };
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "pch.h"
+#include "SyntheticFrameSource.h"
+
+SyntheticFrameSource::SyntheticFrameSource(std::vector<winrt::com_ptr<ID3D11Texture2D>> frames) : m_frames(std::move(frames))
+{
+    if (m_frames.empty())
+    {
+        throw std::invalid_argument("\b\tA synthetic frame source needs at least one frame.\n");
+    }
+
+    D3D11_TEXTURE2D_DESC desc{};
+    m_frames.front()->GetDesc(&desc);
+
+    m_size = { static_cast<int32_t>(desc.Width), static_cast<int32_t>(desc.Height) };
+}
+
+void SyntheticFrameSource::start(const FrameHandler& handler)
+{
+    m_handler = handler;
+    m_running = true;
+}
+
+void SyntheticFrameSource::close()
+{
+    m_running = false;
+}
+
+bool SyntheticFrameSource::push_frame()
+{
+    if (!m_running || m_paused)
+    {
+        return false;
+    }
+
+    // Times are in the 100 nanosecond units the capture API uses.
+    int64_t systemRelativeTime = std::chrono::duration_cast<std::chrono::duration<int64_t, std::ratio<1, 10000000>>>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    m_handler(m_frames[m_next], systemRelativeTime);
+    m_next = (m_next + 1) % m_frames.size();
+
+    return true;
+}
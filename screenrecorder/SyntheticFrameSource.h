@@ -0,0 +1,35 @@
+#pragma once
+
+#include "pch.h"
+#include "FrameSource.h"
+
+// The purpose of this class is to feed prepared frames through the recorder without a display or capture session,
+// so the whole store path can be benchmarked on build agents. Frames are delivered on the caller's thread, one per
+// push_frame, cycling through the prepared textures.
+class SyntheticFrameSource : public FrameSource {
+public:
+    /**
+     * @throws std::invalid_argument if no frames are given
+     */
+    SyntheticFrameSource(std::vector<winrt::com_ptr<ID3D11Texture2D>> frames);
+
+    void start(const FrameHandler& handler) override;
+    void close() override;
+    void pause() override { m_paused = true; }
+    void resume() override { m_paused = false; }
+    winrt::Windows::Graphics::SizeInt32 size() const override { return m_size; }
+
+    /**
+     * Hands the next frame to the handler.
+     * @returns false if the source was not started, is paused or has been closed
+     */
+    bool push_frame();
+
+private:
+    std::vector<winrt::com_ptr<ID3D11Texture2D>> m_frames;
+    winrt::Windows::Graphics::SizeInt32 m_size;
+    FrameHandler m_handler;
+    size_t m_next = 0;
+    std::atomic<bool> m_running = false;
+    std::atomic<bool> m_paused = false;
+};
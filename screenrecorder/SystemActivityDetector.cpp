@@ -0,0 +1,45 @@
+#include "pch.h"
+#include "SystemActivityDetector.h"
+
+#include <wtsapi32.h>
+
+ActivityState SystemActivityDetector::state()
+{
+    if (session_locked())
+    {
+        return ActivityState::Locked;
+    }
+
+    BOOL screenSaverRunning = FALSE;
+
+    if (SystemParametersInfoW(SPI_GETSCREENSAVERRUNNING, 0, &screenSaverRunning, 0) && screenSaverRunning)
+    {
+        return ActivityState::ScreenSaver;
+    }
+
+    LASTINPUTINFO lastInput = { sizeof(lastInput) };
+
+    // Tick counts wrap every 49.7 days, which the unsigned difference handles.
+    if (GetLastInputInfo(&lastInput) && GetTickCount() - lastInput.dwTime >= static_cast<DWORD>(m_idleThreshold.count()))
+    {
+        return ActivityState::Idle;
+    }
+
+    return ActivityState::Active;
+}
+
+bool SystemActivityDetector::session_locked()
+{
+    WTSINFOEXW* info = nullptr;
+    DWORD bytes = 0;
+
+    if (!WTSQuerySessionInformationW(WTS_CURRENT_SERVER_HANDLE, WTS_CURRENT_SESSION, WTSSessionInfoEx, reinterpret_cast<LPWSTR*>(&info), &bytes))
+    {
+        return false;
+    }
+
+    bool locked = info->Level == 1 && info->Data.WTSInfoExLevel1.SessionFlags == WTS_SESSIONSTATE_LOCK;
+    WTSFreeMemory(info);
+
+    return locked;
+}
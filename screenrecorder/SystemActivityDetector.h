@@ -0,0 +1,20 @@
+#pragma once
+
+#include "pch.h"
+#include "ActivityDetector.h"
+
+// The purpose of this class is to find out from Windows whether the session is in use. The session is locked or
+// showing the screensaver, which hide the desktop, or idle when no keyboard or mouse input has reached it for longer
+// than the threshold.
+class SystemActivityDetector : public ActivityDetector {
+public:
+    SystemActivityDetector(std::chrono::milliseconds idleThreshold) : m_idleThreshold(idleThreshold) {}
+
+    ActivityState state() override;
+
+private:
+    // Whether the session is showing the lock screen.
+    static bool session_locked();
+
+    std::chrono::milliseconds m_idleThreshold;
+};
@@ -0,0 +1,348 @@
+#include "pch.h"
+#include "TaskScheduler.h"
+
+static thread_local TaskLane currentLane = TaskLane::BulkSave;
+static thread_local int32_t currentWorker = -1;
+
+static int64_t steady_nanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TaskScheduler::TaskScheduler(uint32_t workerCount, size_t laneCapacity) : m_laneCapacity(std::max<size_t>(1, laneCapacity)), m_statsStart(steady_nanoseconds())
+{
+    if (workerCount == 0)
+    {
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+
+    // Workers only start once all of them exist, since they steal from each other.
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        m_workers[i]->thread = std::thread([this, i]() { run_worker(i); });
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_stopping = true;
+    }
+
+    m_wake.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        worker->thread.join();
+    }
+}
+
+TaskScheduler& TaskScheduler::shared()
+{
+    static TaskScheduler scheduler;
+
+    return scheduler;
+}
+
+TaskLane TaskScheduler::current_lane()
+{
+    return currentLane;
+}
+
+TaskScheduler::LaneScope::LaneScope(TaskLane lane) : m_previous(currentLane)
+{
+    currentLane = lane;
+}
+
+TaskScheduler::LaneScope::~LaneScope()
+{
+    currentLane = m_previous;
+}
+
+uint32_t TaskScheduler::lane_limit(TaskLane lane) const
+{
+    uint32_t workers = worker_count();
+
+    // One worker is always kept out of saving, so capture and live encoding never wait for a save to finish.
+    return lane == TaskLane::BulkSave && workers > 1 ? workers - 1 : workers;
+}
+
+bool TaskScheduler::congested(TaskLane lane) const
+{
+    return m_lanes[static_cast<size_t>(lane)].queued.load(std::memory_order_relaxed) * 4 >= m_laneCapacity * 3;
+}
+
+bool TaskScheduler::try_submit(TaskLane lane, std::function<void()> task)
+{
+    Lane& state = m_lanes[static_cast<size_t>(lane)];
+
+    // The slot is claimed before the task is queued, so the lane never holds more than its capacity.
+    if (state.queued.fetch_add(1, std::memory_order_acq_rel) >= m_laneCapacity)
+    {
+        state.queued.fetch_sub(1, std::memory_order_acq_rel);
+        state.rejected.fetch_add(1, std::memory_order_relaxed);
+
+        return false;
+    }
+
+    state.submitted.fetch_add(1, std::memory_order_relaxed);
+
+    // Workers queue their own tasks, where they are likely to run them next with warm caches. Other threads spread
+    // theirs over the workers.
+    uint32_t index = currentWorker >= 0 ? static_cast<uint32_t>(currentWorker) : m_nextWorker.fetch_add(1, std::memory_order_relaxed) % worker_count();
+    Worker& worker = *m_workers[index];
+
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queues[static_cast<size_t>(lane)].push_back({ std::move(task), std::chrono::steady_clock::now() });
+    }
+
+    // Taking the lock orders the wake up after a sleeping worker's last look at the queues.
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+    }
+
+    m_wake.notify_one();
+
+    return true;
+}
+
+bool TaskScheduler::has_runnable_task() const
+{
+    for (size_t lane = 0; lane < laneCount; lane++)
+    {
+        if (m_lanes[lane].queued.load(std::memory_order_acquire) > 0 &&
+            m_lanes[lane].running.load(std::memory_order_acquire) < lane_limit(static_cast<TaskLane>(lane)))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool TaskScheduler::take_task(uint32_t index, Task& task, TaskLane& lane)
+{
+    uint32_t workers = worker_count();
+
+    for (size_t laneIndex = 0; laneIndex < laneCount; laneIndex++)
+    {
+        Lane& state = m_lanes[laneIndex];
+
+        if (state.queued.load(std::memory_order_acquire) == 0)
+        {
+            continue;
+        }
+
+        // The worker reserves its place in the lane before looking for a task, so the limit holds even when several
+        // workers look at once.
+        uint32_t limit = lane_limit(static_cast<TaskLane>(laneIndex));
+
+        if (state.running.fetch_add(1, std::memory_order_acq_rel) >= limit)
+        {
+            state.running.fetch_sub(1, std::memory_order_acq_rel);
+            continue;
+        }
+
+        // A worker runs its own newest task first, while thieves take the oldest task of another worker.
+        for (uint32_t offset = 0; offset < workers; offset++)
+        {
+            Worker& victim = *m_workers[(index + offset) % workers];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            std::deque<Task>& queue = victim.queues[laneIndex];
+
+            if (queue.empty())
+            {
+                continue;
+            }
+
+            if (offset == 0)
+            {
+                task = std::move(queue.back());
+                queue.pop_back();
+            }
+            else
+            {
+                task = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            state.queued.fetch_sub(1, std::memory_order_acq_rel);
+            lane = static_cast<TaskLane>(laneIndex);
+
+            return true;
+        }
+
+        state.running.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    return false;
+}
+
+void TaskScheduler::run_worker(uint32_t index)
+{
+    currentWorker = static_cast<int32_t>(index);
+
+    while (true)
+    {
+        Task task;
+        TaskLane lane;
+
+        if (!take_task(index, task, lane))
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+
+            if (m_stopping)
+            {
+                return;
+            }
+
+            m_wake.wait(lock, [this]() { return m_stopping || has_runnable_task(); });
+
+            continue;
+        }
+
+        Lane& state = m_lanes[static_cast<size_t>(lane)];
+        auto start = std::chrono::steady_clock::now();
+        uint64_t wait = std::chrono::duration_cast<std::chrono::nanoseconds>(start - task.queued).count();
+
+        state.waitNanoseconds.fetch_add(wait, std::memory_order_relaxed);
+
+        uint64_t maxWait = state.maxWaitNanoseconds.load(std::memory_order_relaxed);
+
+        while (wait > maxWait && !state.maxWaitNanoseconds.compare_exchange_weak(maxWait, wait, std::memory_order_relaxed))
+        {
+        }
+
+        {
+            LaneScope scope(lane);
+            task.work();
+        }
+
+        auto end = std::chrono::steady_clock::now();
+
+        state.busyNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+        state.completed.fetch_add(1, std::memory_order_relaxed);
+        state.running.fetch_sub(1, std::memory_order_acq_rel);
+
+        // A worker that went to sleep because the lane was at its limit can take the next task now.
+        if (lane_limit(lane) < worker_count() && state.queued.load(std::memory_order_acquire) > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_wakeMutex);
+            }
+
+            m_wake.notify_one();
+        }
+    }
+}
+
+void TaskScheduler::parallel_for(uint32_t count, const std::function<void(uint32_t index)>& function)
+{
+    // Helpers that start after every index has been taken only touch the shared state, which outlives the call.
+    struct Loop
+    {
+        std::atomic<uint32_t> next = 0;
+        std::atomic<uint32_t> done = 0;
+        uint32_t count = 0;
+        const std::function<void(uint32_t index)>* function = nullptr;
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    auto loop = std::make_shared<Loop>();
+    loop->count = count;
+    loop->function = &function;
+
+    auto work = [](Loop& loop)
+        {
+            for (uint32_t index = loop.next++; index < loop.count; index = loop.next++)
+            {
+                try
+                {
+                    (*loop.function)(index);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(loop.mutex);
+
+                    if (!loop.error)
+                    {
+                        loop.error = std::current_exception();
+                    }
+                }
+
+                if (++loop.done == loop.count)
+                {
+                    std::lock_guard<std::mutex> lock(loop.mutex);
+                    loop.finished.notify_all();
+                }
+            }
+        };
+
+    TaskLane lane = current_lane();
+    uint32_t helpers = std::min(count, worker_count()) - 1;
+
+    for (uint32_t i = 0; i < helpers && !congested(lane); i++)
+    {
+        if (!try_submit(lane, [loop, work]() { work(*loop); }))
+        {
+            break;
+        }
+    }
+
+    work(*loop);
+
+    // Every index has been taken by now, so this only waits for helpers that are running.
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    loop->finished.wait(lock, [&loop]() { return loop->done == loop->count; });
+
+    if (loop->error)
+    {
+        std::rethrow_exception(loop->error);
+    }
+}
+
+TaskScheduler::LaneStats TaskScheduler::stats(TaskLane lane) const
+{
+    const Lane& state = m_lanes[static_cast<size_t>(lane)];
+    double elapsed = static_cast<double>(steady_nanoseconds() - m_statsStart.load());
+
+    LaneStats stats = {};
+    stats.Submitted = state.submitted.load();
+    stats.Rejected = state.rejected.load();
+    stats.Completed = state.completed.load();
+    stats.Queued = state.queued.load();
+    stats.Utilization = elapsed > 0 ? state.busyNanoseconds.load() / (elapsed * worker_count()) : 0;
+    stats.AverageWaitMicroseconds = stats.Completed > 0 ? state.waitNanoseconds.load() / 1000.0 / stats.Completed : 0;
+    stats.MaxWaitMicroseconds = state.maxWaitNanoseconds.load() / 1000.0;
+
+    return stats;
+}
+
+void TaskScheduler::reset_stats()
+{
+    for (Lane& state : m_lanes)
+    {
+        state.submitted = 0;
+        state.rejected = 0;
+        state.completed = 0;
+        state.busyNanoseconds = 0;
+        state.waitNanoseconds = 0;
+        state.maxWaitNanoseconds = 0;
+    }
+
+    m_statsStart = steady_nanoseconds();
+}
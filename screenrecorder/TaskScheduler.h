@@ -0,0 +1,125 @@
+#pragma once
+
+#include "pch.h"
+
+// Lanes in priority order. Capture is work the capture callback waits on, LiveEncode is encoding frames as they are
+// captured, and BulkSave is saving and exporting recordings.
+enum class TaskLane { Capture, LiveEncode, BulkSave };
+
+// The purpose of this class is to share a fixed set of worker threads between capture, live encoding and saving,
+// without letting a large save starve the capture. Every worker keeps a queue per lane and steals from the other
+// workers when its own queues are empty, always taking work from the highest priority lane that has any. Saving never
+// occupies every worker, so capture work always finds one free once the task in hand is done. Queues are bounded:
+// work that does not fit is refused rather than queued, and callers can ask whether a lane is congested before
+// offering it more.
+class TaskScheduler {
+public:
+    static constexpr size_t laneCount = 3;
+    static constexpr size_t default_laneCapacity = 256;
+
+    struct LaneStats
+    {
+        uint64_t Submitted;
+        uint64_t Rejected;               // Tasks refused because the lane was full.
+        uint64_t Completed;
+        size_t Queued;                   // Tasks waiting to run right now.
+        double Utilization;              // Share of the workers' time spent on the lane since the stats were reset.
+        double AverageWaitMicroseconds;  // Time from submitting a task to a worker starting it.
+        double MaxWaitMicroseconds;
+    };
+
+    /**
+     * @param workerCount number of worker threads, or 0 for one per logical processor
+     * @param laneCapacity most tasks each lane holds before refusing more
+     */
+    TaskScheduler(uint32_t workerCount = 0, size_t laneCapacity = default_laneCapacity);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // The scheduler the capture, encoders and saving share, created on first use.
+    static TaskScheduler& shared();
+
+    /**
+     * Queues a task to run on a worker. Tasks must not throw.
+     * @returns false if the lane is full and the task was not queued
+     */
+    bool try_submit(TaskLane lane, std::function<void()> task);
+
+    /**
+     * Runs the function for every index from 0 to count - 1 in the lane of the calling thread, and returns once all of
+     * them have run. The calling thread runs indices too, and helpers are only queued while the lane has room, so
+     * this never waits on a congested lane and can be called from within a task.
+     * @throws the first exception thrown by the function, once every index has run
+     */
+    void parallel_for(uint32_t count, const std::function<void(uint32_t index)>& function);
+
+    // Whether the lane is close enough to full that callers should do their work themselves instead of queueing it.
+    bool congested(TaskLane lane) const;
+
+    LaneStats stats(TaskLane lane) const;
+    void reset_stats();
+
+    uint32_t worker_count() const { return static_cast<uint32_t>(m_workers.size()); }
+
+    // The lane of the task running on this thread, or of the innermost LaneScope. Defaults to BulkSave.
+    static TaskLane current_lane();
+
+    // Sets the lane work started by the calling thread goes to, until the scope ends.
+    class LaneScope {
+    public:
+        LaneScope(TaskLane lane);
+        ~LaneScope();
+
+        LaneScope(const LaneScope&) = delete;
+        LaneScope& operator=(const LaneScope&) = delete;
+
+    private:
+        TaskLane m_previous;
+    };
+
+private:
+    struct Task
+    {
+        std::function<void()> work;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> queues[laneCount];
+        std::thread thread;
+    };
+
+    struct Lane
+    {
+        std::atomic<size_t> queued = 0;
+        std::atomic<uint32_t> running = 0;
+        std::atomic<uint64_t> submitted = 0;
+        std::atomic<uint64_t> rejected = 0;
+        std::atomic<uint64_t> completed = 0;
+        std::atomic<uint64_t> busyNanoseconds = 0;
+        std::atomic<uint64_t> waitNanoseconds = 0;
+        std::atomic<uint64_t> maxWaitNanoseconds = 0;
+    };
+
+    void run_worker(uint32_t index);
+
+    // Takes the next task for the worker, from its own queues first and then from the other workers'.
+    bool take_task(uint32_t index, Task& task, TaskLane& lane);
+
+    bool has_runnable_task() const;
+    uint32_t lane_limit(TaskLane lane) const;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    Lane m_lanes[laneCount];
+    size_t m_laneCapacity;
+    std::atomic<uint32_t> m_nextWorker = 0;
+    std::atomic<int64_t> m_statsStart;
+
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+};
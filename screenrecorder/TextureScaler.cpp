@@ -0,0 +1,66 @@
+#include "pch.h"
+#include "TextureScaler.h"
+
+winrt::com_ptr<ID3D11Texture2D> TextureScaler::downscale(winrt::com_ptr<ID3D11Texture2D> const& texture, uint32_t scale)
+{
+    if (!is_valid_scale(scale))
+    {
+        throw std::invalid_argument("\b\tScale must be a power of two.\n");
+    }
+
+    uint32_t level = 0;
+
+    while ((1u << level) < scale)
+    {
+        level++;
+    }
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    texture->GetDesc(&desc);
+
+    winrt::com_ptr<ID3D11Device> device;
+    texture->GetDevice(device.put());
+
+    winrt::com_ptr<ID3D11DeviceContext> context;
+    device->GetImmediateContext(context.put());
+
+    if (!m_mipChain || m_mipChainDesc.Width != desc.Width || m_mipChainDesc.Height != desc.Height || m_mipChainDesc.Format != desc.Format || m_mipChainDesc.MipLevels != level + 1)
+    {
+        D3D11_TEXTURE2D_DESC mipChainDesc = {};
+        mipChainDesc.Width = desc.Width;
+        mipChainDesc.Height = desc.Height;
+        mipChainDesc.MipLevels = level + 1;
+        mipChainDesc.ArraySize = 1;
+        mipChainDesc.Format = desc.Format;
+        mipChainDesc.SampleDesc.Count = 1;
+        mipChainDesc.Usage = D3D11_USAGE_DEFAULT;
+        mipChainDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+        mipChainDesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+
+        m_mipChain = nullptr;
+        m_mipChainView = nullptr;
+        winrt::check_hresult(device->CreateTexture2D(&mipChainDesc, nullptr, m_mipChain.put()));
+        winrt::check_hresult(device->CreateShaderResourceView(m_mipChain.get(), nullptr, m_mipChainView.put()));
+        m_mipChainDesc = mipChainDesc;
+    }
+
+    context->CopySubresourceRegion(m_mipChain.get(), 0, 0, 0, 0, texture.get(), 0, nullptr);
+    context->GenerateMips(m_mipChainView.get());
+
+    D3D11_TEXTURE2D_DESC scaledDesc = {};
+    scaledDesc.Width = std::max(1u, desc.Width >> level);
+    scaledDesc.Height = std::max(1u, desc.Height >> level);
+    scaledDesc.MipLevels = 1;
+    scaledDesc.ArraySize = 1;
+    scaledDesc.Format = desc.Format;
+    scaledDesc.SampleDesc.Count = 1;
+    scaledDesc.Usage = D3D11_USAGE_DEFAULT;
+    scaledDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    winrt::com_ptr<ID3D11Texture2D> scaled;
+    winrt::check_hresult(device->CreateTexture2D(&scaledDesc, nullptr, scaled.put()));
+
+    context->CopySubresourceRegion(scaled.get(), 0, 0, 0, 0, m_mipChain.get(), level, nullptr);
+
+    return scaled;
+}
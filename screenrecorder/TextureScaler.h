@@ -0,0 +1,22 @@
+#pragma once
+
+#include "pch.h"
+
+// The purpose of this class is to shrink frames on the GPU by a power of two. The frame is copied into the top of a
+// mip chain that the GPU fills in with box filtered levels, and the level of the requested size is copied out.
+class TextureScaler {
+public:
+    /**
+     * @param scale power of two to divide the width and height by
+     * @throws std::invalid_argument if scale is not a power of two
+     */
+    winrt::com_ptr<ID3D11Texture2D> downscale(winrt::com_ptr<ID3D11Texture2D> const& texture, uint32_t scale);
+
+    static bool is_valid_scale(uint32_t scale) { return scale != 0 && (scale & (scale - 1)) == 0; }
+
+private:
+    // The mip chain is kept between calls and only recreated when the frame size, format or scale changes.
+    winrt::com_ptr<ID3D11Texture2D> m_mipChain;
+    winrt::com_ptr<ID3D11ShaderResourceView> m_mipChainView;
+    D3D11_TEXTURE2D_DESC m_mipChainDesc = {};
+};
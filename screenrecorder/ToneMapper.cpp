@@ -0,0 +1,292 @@
+#include "pch.h"
+#include "ToneMapper.h"
+
+#include "Simd.h"
+
+static float float_from_bits(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+static uint32_t bits_from_float(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    return bits;
+}
+
+bool ToneMapper::has_f16c()
+{
+#ifdef SIMD_X86
+    static const bool supported = []()
+        {
+            int info[4];
+            read_cpuid(info, 1);
+
+            // F16C needs the AVX registers, so the operating system must save them too.
+            bool osSavesAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (read_xcr0() & 6) == 6;
+
+            return osSavesAvx && (info[2] & (1 << 29)) != 0;
+        }();
+
+    return supported;
+#else
+    return false;
+#endif
+}
+
+bool ToneMapper::has_avx2()
+{
+#ifdef SIMD_X86
+    static const bool supported = []()
+        {
+            int info[4];
+            read_cpuid(info, 0);
+
+            if (info[0] < 7)
+            {
+                return false;
+            }
+
+            read_cpuid(info, 7);
+
+            return has_f16c() && (info[1] & (1 << 5)) != 0;
+        }();
+
+    return supported;
+#else
+    return false;
+#endif
+}
+
+float ToneMapper::half_to_float(uint16_t half)
+{
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+
+    if (exponent == 0x1F)
+    {
+        return float_from_bits(sign | 0x7F800000 | mantissa << 13);
+    }
+
+    if (exponent != 0)
+    {
+        return float_from_bits(sign | (exponent + 112) << 23 | mantissa << 13);
+    }
+
+    if (mantissa == 0)
+    {
+        return float_from_bits(sign);
+    }
+
+    // Subnormal halves are normal floats, once the mantissa is shifted up to its leading one.
+    exponent = 113;
+
+    while ((mantissa & 0x400) == 0)
+    {
+        mantissa <<= 1;
+        exponent--;
+    }
+
+    return float_from_bits(sign | exponent << 23 | (mantissa & 0x3FF) << 13);
+}
+
+uint32_t ToneMapper::pack_pixel(float r, float g, float b)
+{
+    // The largest value RGB9E5 holds, 511/512 times 2^16. NaN fails every comparison and becomes 0 as well.
+    const float maxValue = 65408.0f;
+
+    r = r > 0 ? std::min(r, maxValue) : 0;
+    g = g > 0 ? std::min(g, maxValue) : 0;
+    b = b > 0 ? std::min(b, maxValue) : 0;
+
+    // The shared exponent is chosen so the largest channel fills its 9 bits, following the D3D conversion rules.
+    float maxChannel = std::max(r, std::max(g, b));
+    int32_t log2 = static_cast<int32_t>((bits_from_float(maxChannel) >> 23) & 0xFF) - 127;
+    int32_t exponent = std::max(-16, log2) + 16;
+
+    // Dividing by a power of two is exact, so it is done as a multiplication.
+    float scale = float_from_bits(static_cast<uint32_t>(24 - exponent + 127) << 23);
+
+    if (static_cast<uint32_t>(maxChannel * scale + 0.5f) == 512)
+    {
+        exponent++;
+        scale *= 0.5f;
+    }
+
+    uint32_t rm = static_cast<uint32_t>(r * scale + 0.5f);
+    uint32_t gm = static_cast<uint32_t>(g * scale + 0.5f);
+    uint32_t bm = static_cast<uint32_t>(b * scale + 0.5f);
+
+    return rm | gm << 9 | bm << 18 | static_cast<uint32_t>(exponent) << 27;
+}
+
+void ToneMapper::pack(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, uint8_t* packed, bool allowSimd)
+{
+    bool simd = allowSimd && has_f16c();
+    uint32_t* target = reinterpret_cast<uint32_t*>(packed);
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        const uint16_t* source = reinterpret_cast<const uint16_t*>(pixels + static_cast<size_t>(y) * rowPitch);
+        uint32_t x = 0;
+
+        if (simd)
+        {
+            x = pack_row_f16c(source, width, target);
+        }
+
+        for (; x < width; x++)
+        {
+            target[x] = pack_pixel(half_to_float(source[x * 4]), half_to_float(source[x * 4 + 1]), half_to_float(source[x * 4 + 2]));
+        }
+
+        target += width;
+    }
+}
+
+SIMD_TARGET_AVX2 uint32_t ToneMapper::pack_row_f16c(const uint16_t* source, uint32_t width, uint32_t* target)
+{
+    uint32_t x = 0;
+
+#ifdef SIMD_X86
+    // Two pixels at a time: eight halves in, eight floats out.
+    alignas(32) float channels[8];
+
+    for (; x + 2 <= width; x += 2)
+    {
+        __m256 converted = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x * 4)));
+        _mm256_store_ps(channels, converted);
+
+        target[x] = pack_pixel(channels[0], channels[1], channels[2]);
+        target[x + 1] = pack_pixel(channels[4], channels[5], channels[6]);
+    }
+#endif
+
+    return x;
+}
+
+const uint8_t* ToneMapper::srgb_table()
+{
+    static const std::vector<uint8_t> table = []()
+        {
+            std::vector<uint8_t> table(tableSize + 3);
+
+            for (uint32_t i = 0; i < tableSize; i++)
+            {
+                double linear = static_cast<double>(i) / (tableSize - 1);
+                double encoded = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+
+                table[i] = static_cast<uint8_t>(std::clamp(encoded * 255.0 + 0.5, 0.0, 255.0));
+            }
+
+            return table;
+        }();
+
+    return table.data();
+}
+
+uint32_t ToneMapper::tone_map_pixel(uint32_t packed, float inverseWhiteLevel, const uint8_t* table)
+{
+    float scale = float_from_bits(((packed >> 27) + 103) << 23);
+    uint32_t color = 0xFF000000;
+
+    // Blue, green and red land in the low, middle and high bytes of the BGRA8 pixel.
+    for (int channel = 0; channel < 3; channel++)
+    {
+        float mantissa = static_cast<float>((packed >> (9 * (2 - channel))) & 0x1FF);
+        float x = mantissa * scale * inverseWhiteLevel;
+
+        // Past the knee, values are squeezed into what is left of the range with x / (1 + x), which meets the
+        // straight part with the same slope and never quite reaches 1.
+        float t = (x - knee) * (1.0f / (1.0f - knee));
+        float mapped = x <= knee ? x : knee + (1.0f - knee) * (t / (1.0f + t));
+
+        uint32_t index = static_cast<uint32_t>(mapped * (tableSize - 1) + 0.5f);
+        color |= static_cast<uint32_t>(table[index]) << (8 * channel);
+    }
+
+    return color;
+}
+
+SIMD_TARGET_AVX2 void ToneMapper::tone_map_row_avx2(const uint32_t* packed, uint32_t width, float inverseWhiteLevel, const uint8_t* table, uint32_t* pixels)
+{
+#ifdef SIMD_X86
+    const __m256i mantissaMask = _mm256_set1_epi32(0x1FF);
+    const __m256i exponentBias = _mm256_set1_epi32(103);
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+    const __m256 inverseWhite = _mm256_set1_ps(inverseWhiteLevel);
+    const __m256 kneeValue = _mm256_set1_ps(knee);
+    const __m256 inverseRange = _mm256_set1_ps(1.0f / (1.0f - knee));
+    const __m256 range = _mm256_set1_ps(1.0f - knee);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 tableScale = _mm256_set1_ps(static_cast<float>(tableSize - 1));
+    const __m256 half = _mm256_set1_ps(0.5f);
+
+    // The same operations as tone_map_pixel in the same order, eight pixels at a time, so the results match exactly.
+    auto map_channel = [&](__m256i mantissa, __m256 scale) SIMD_TARGET_AVX2
+        {
+            __m256 x = _mm256_mul_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(mantissa), scale), inverseWhite);
+            __m256 t = _mm256_mul_ps(_mm256_sub_ps(x, kneeValue), inverseRange);
+            __m256 compressed = _mm256_add_ps(kneeValue, _mm256_mul_ps(range, _mm256_div_ps(t, _mm256_add_ps(one, t))));
+            __m256 mapped = _mm256_blendv_ps(compressed, x, _mm256_cmp_ps(x, kneeValue, _CMP_LE_OQ));
+
+            __m256i index = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(mapped, tableScale), half));
+
+            return _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int*>(table), index, 1), byteMask);
+        };
+
+    uint32_t x = 0;
+
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256i source = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(packed + x));
+        __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_srli_epi32(source, 27), exponentBias), 23));
+
+        __m256i r = map_channel(_mm256_and_si256(source, mantissaMask), scale);
+        __m256i g = map_channel(_mm256_and_si256(_mm256_srli_epi32(source, 9), mantissaMask), scale);
+        __m256i b = map_channel(_mm256_and_si256(_mm256_srli_epi32(source, 18), mantissaMask), scale);
+
+        __m256i color = _mm256_or_si256(_mm256_or_si256(alpha, b), _mm256_or_si256(_mm256_slli_epi32(g, 8), _mm256_slli_epi32(r, 16)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + x), color);
+    }
+
+    for (; x < width; x++)
+    {
+        pixels[x] = tone_map_pixel(packed[x], inverseWhiteLevel, table);
+    }
+#endif
+}
+
+void ToneMapper::tone_map(const uint8_t* packed, uint32_t width, uint32_t height, float whiteLevel, uint8_t* pixels, uint32_t rowPitch, bool allowSimd)
+{
+    bool simd = allowSimd && has_avx2();
+    float inverseWhiteLevel = 1.0f / std::max(whiteLevel, 0.01f);
+    const uint8_t* table = srgb_table();
+    const uint32_t* source = reinterpret_cast<const uint32_t*>(packed);
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        uint32_t* target = reinterpret_cast<uint32_t*>(pixels + static_cast<size_t>(y) * rowPitch);
+
+        if (simd)
+        {
+            tone_map_row_avx2(source, width, inverseWhiteLevel, table, target);
+        }
+        else
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                target[x] = tone_map_pixel(source[x], inverseWhiteLevel, table);
+            }
+        }
+
+        source += width;
+    }
+}
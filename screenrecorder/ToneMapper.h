@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The purpose of this class is to keep HDR frames in half the memory they are captured in, and to turn them into
+// ordinary 8-bit sRGB images when they are saved. Frames are captured as linear scRGB in 16-bit floats and packed
+// into the RGB9E5 shared exponent layout, 4 bytes per pixel: three 9-bit mantissas sharing one 5-bit exponent, which
+// keeps the whole range of the capture with about three significant digits. Colors outside the sRGB gamut are clipped
+// to it, since they cannot be saved in an 8-bit image anyway.
+class ToneMapper {
+public:
+    // scRGB value of the SDR reference white of 80 nits.
+    static constexpr float referenceWhiteLevel = 1.0f;
+
+    // Linear values up to this share of white are kept as they are, and brighter ones are compressed above it.
+    static constexpr float knee = 0.8f;
+
+    // Bytes a frame of the given size takes once packed.
+    static size_t packed_size(uint32_t width, uint32_t height) { return static_cast<size_t>(width) * height * 4; }
+
+    /**
+     * Packs an R16G16B16A16_FLOAT frame into packed_size(width, height) bytes of RGB9E5 pixels, rows packed tightly.
+     * Alpha is dropped, and negative values become 0.
+     * @param rowPitch distance in bytes between the starts of consecutive rows
+     * @param allowSimd converts the floats with F16C where available. The result is the same either way.
+     */
+    static void pack(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, uint8_t* packed, bool allowSimd = true);
+
+    /**
+     * Tone maps packed pixels into opaque BGRA8 sRGB pixels. Content drawn at the white level keeps its look, and
+     * highlights brighter than it are rolled off smoothly instead of clipping.
+     * @param whiteLevel scRGB value shown as white, usually the SDR white level of the display the frame came from
+     * @param allowSimd uses AVX2 where available. The result is the same either way.
+     */
+    static void tone_map(const uint8_t* packed, uint32_t width, uint32_t height, float whiteLevel, uint8_t* pixels, uint32_t rowPitch, bool allowSimd = true);
+
+    static bool has_f16c();
+    static bool has_avx2();
+
+private:
+    // Entries of the table from linear light between 0 and 1 to 8-bit sRGB.
+    static constexpr uint32_t tableSize = 16384;
+
+    static uint32_t pack_pixel(float r, float g, float b);
+    static float half_to_float(uint16_t half);
+
+    // Packs the pixels of a row two at a time with F16C, returning how many it packed.
+    static uint32_t pack_row_f16c(const uint16_t* source, uint32_t width, uint32_t* target);
+
+    static uint32_t tone_map_pixel(uint32_t packed, float inverseWhiteLevel, const uint8_t* table);
+    static void tone_map_row_avx2(const uint32_t* packed, uint32_t width, float inverseWhiteLevel, const uint8_t* table, uint32_t* pixels);
+
+    // The table is padded by 3 bytes, so it can be read 4 bytes at a time at any entry.
+    static const uint8_t* srgb_table();
+};
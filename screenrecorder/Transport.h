@@ -0,0 +1,44 @@
+#pragma once
+
+#include "pch.h"
+
+// The purpose of these interfaces is to decouple the server from the transport its clients connect over. A Listener
+// hands out one Connection per client, and the server serves every Connection independently of the others.
+class Connection {
+public:
+    virtual ~Connection() = default;
+
+    /**
+     * @throws std::ios_base::failure if function fails
+     */
+    virtual void send(const std::string& message) const = 0;
+
+    /**
+     * @throws std::ios_base::failure if function fails
+     */
+    virtual std::string receive() const = 0;
+
+    /**
+     * Waits for the client to read everything sent so far, then drops it.
+     * @throws std::ios_base::failure if attempt to disconnect fails
+     */
+    virtual void disconnect() const = 0;
+
+    // Drops the client immediately, failing any send or receive pending on another thread.
+    virtual void close() const = 0;
+};
+
+class Listener {
+public:
+    virtual ~Listener() = default;
+
+    /**
+     * Blocks until a client connects.
+     * @returns nullptr once the listener has been closed
+     * @throws std::ios_base::failure if attempt to accept a client fails
+     */
+    virtual std::unique_ptr<Connection> accept() = 0;
+
+    // Makes pending and future calls to accept return nullptr. Safe to call from any thread.
+    virtual void close() = 0;
+};
@@ -0,0 +1,227 @@
+#include "pch.h"
+#include "XShmFrameSource.h"
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+struct XShmFrameSource::Segment
+{
+    XShmSegmentInfo info = {};
+    bool attached = false;
+};
+
+// Errors of X requests are reported later, to a handler, instead of by the calls that caused them. The source syncs
+// after the requests that can fail and checks this flag, set by the handler it installs around them.
+static std::atomic<bool> requestFailed = false;
+
+static int RecordRequestError(Display*, XErrorEvent*)
+{
+    requestFailed = true;
+
+    return 0;
+}
+
+XShmFrameSource::XShmFrameSource(const std::string& displayName, int32_t left, int32_t top, uint32_t width, uint32_t height, double framerate) :
+    m_segment(std::make_unique<Segment>()), m_left(left), m_top(top),
+    m_frameInterval(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(1.0 / framerate)))
+{
+    m_display = XOpenDisplay(displayName.empty() ? nullptr : displayName.c_str());
+
+    if (!m_display)
+    {
+        throw std::runtime_error("\b\tCould not open X display \"" + (displayName.empty() ? std::string(getenv("DISPLAY") ? getenv("DISPLAY") : "") : displayName) + "\".\n");
+    }
+
+    try
+    {
+        if (!XShmQueryExtension(m_display))
+        {
+            throw std::runtime_error("\b\tThe X server does not support the MIT-SHM extension.\n");
+        }
+
+        int screen = DefaultScreen(m_display);
+        Visual* visual = DefaultVisual(m_display, screen);
+        int depth = DefaultDepth(m_display, screen);
+        m_root = RootWindow(m_display, screen);
+
+        uint32_t screenWidth = static_cast<uint32_t>(DisplayWidth(m_display, screen));
+        uint32_t screenHeight = static_cast<uint32_t>(DisplayHeight(m_display, screen));
+
+        if (left < 0 || top < 0 || static_cast<uint32_t>(left) >= screenWidth || static_cast<uint32_t>(top) >= screenHeight)
+        {
+            throw std::invalid_argument("\b\tThe region does not start on the screen.\n");
+        }
+
+        m_width = width ? width : screenWidth - left;
+        m_height = height ? height : screenHeight - top;
+
+        if (m_width > screenWidth - left || m_height > screenHeight - top)
+        {
+            throw std::invalid_argument("\b\tThe region of " + std::to_string(m_width) + "x" + std::to_string(m_height) + " does not fit on the " +
+                std::to_string(screenWidth) + "x" + std::to_string(screenHeight) + " screen.\n");
+        }
+
+        // The pixels are handed over as they are, so only servers that already store them as BGRA8 are taken.
+        if ((depth != 24 && depth != 32) || visual->red_mask != 0xff0000 || visual->green_mask != 0xff00 || visual->blue_mask != 0xff)
+        {
+            throw std::runtime_error("\b\tThe X screen must be 24 or 32-bit TrueColor.\n");
+        }
+
+        m_image = XShmCreateImage(m_display, visual, depth, ZPixmap, nullptr, &m_segment->info, m_width, m_height);
+
+        if (!m_image || m_image->bits_per_pixel != 32 || m_image->byte_order != LSBFirst)
+        {
+            throw std::runtime_error("\b\tThe X server does not lay out shared images as BGRA8.\n");
+        }
+
+        m_segment->info.shmid = shmget(IPC_PRIVATE, static_cast<size_t>(m_image->bytes_per_line) * m_height, IPC_CREAT | 0600);
+
+        if (m_segment->info.shmid < 0)
+        {
+            throw std::runtime_error("\b\tCould not create a shared memory segment for the frames.\n");
+        }
+
+        m_segment->info.shmaddr = m_image->data = static_cast<char*>(shmat(m_segment->info.shmid, nullptr, 0));
+        m_segment->info.readOnly = False;
+
+        if (m_segment->info.shmaddr == reinterpret_cast<char*>(-1))
+        {
+            m_segment->info.shmaddr = m_image->data = nullptr;
+            throw std::runtime_error("\b\tCould not map the shared memory segment for the frames.\n");
+        }
+
+        // A server on another machine cannot attach the segment, which only shows up once the request has been handled.
+        requestFailed = false;
+        auto previousHandler = XSetErrorHandler(RecordRequestError);
+        m_segment->attached = XShmAttach(m_display, &m_segment->info) && (XSync(m_display, False), !requestFailed);
+        XSetErrorHandler(previousHandler);
+
+        // The segment is freed once both ends have detached, so it cannot outlive a crash of the process.
+        shmctl(m_segment->info.shmid, IPC_RMID, nullptr);
+
+        if (!m_segment->attached)
+        {
+            throw std::runtime_error("\b\tThe X server could not attach the shared memory segment. MIT-SHM only works with a local X server.\n");
+        }
+    }
+    catch (...)
+    {
+        release();
+        throw;
+    }
+}
+
+XShmFrameSource::~XShmFrameSource()
+{
+    close();
+    release();
+}
+
+void XShmFrameSource::release()
+{
+    if (m_segment->attached)
+    {
+        XShmDetach(m_display, &m_segment->info);
+        XSync(m_display, False);
+        m_segment->attached = false;
+    }
+
+    if (m_image)
+    {
+        // The pixels live in the segment, which is detached below rather than freed by XDestroyImage.
+        m_image->data = nullptr;
+        XDestroyImage(m_image);
+        m_image = nullptr;
+    }
+
+    if (m_segment->info.shmaddr)
+    {
+        shmdt(m_segment->info.shmaddr);
+        m_segment->info.shmaddr = nullptr;
+    }
+
+    if (m_display)
+    {
+        XCloseDisplay(m_display);
+        m_display = nullptr;
+    }
+}
+
+void XShmFrameSource::grab()
+{
+    if (!XShmGetImage(m_display, m_root, m_image, m_left, m_top, AllPlanes))
+    {
+        throw std::runtime_error("\b\tThe X server failed to copy the screen.\n");
+    }
+}
+
+const uint8_t* XShmFrameSource::pixels() const
+{
+    return reinterpret_cast<const uint8_t*>(m_image->data);
+}
+
+uint32_t XShmFrameSource::row_pitch() const
+{
+    return static_cast<uint32_t>(m_image->bytes_per_line);
+}
+
+void XShmFrameSource::start(const FrameHandler& handler)
+{
+    // Frames are grabbed on a schedule rather than back to back, so a slow handler delays the next frame instead of
+    // piling them up, and a grab that fails, as when the screen is resized, is tried again on the next one.
+    m_thread = std::thread([this, handler]()
+        {
+            auto next = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            while (!m_wake.wait_until(lock, next, [this]() { return m_closed; }))
+            {
+                lock.unlock();
+
+                int64_t qpc = std::chrono::steady_clock::now().time_since_epoch().count();
+
+                if (XShmGetImage(m_display, m_root, m_image, m_left, m_top, AllPlanes))
+                {
+                    handler(pixels(), row_pitch(), qpc);
+                }
+
+                next = std::max(next + m_frameInterval, std::chrono::steady_clock::now());
+
+                lock.lock();
+            }
+        });
+}
+
+void XShmFrameSource::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+    }
+
+    m_wake.notify_all();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+bool XShmFrameSource::try_get_screen_size(const std::string& displayName, uint32_t& width, uint32_t& height)
+{
+    Display* display = XOpenDisplay(displayName.empty() ? nullptr : displayName.c_str());
+
+    if (!display)
+    {
+        return false;
+    }
+
+    width = static_cast<uint32_t>(DisplayWidth(display, DefaultScreen(display)));
+    height = static_cast<uint32_t>(DisplayHeight(display, DefaultScreen(display)));
+    XCloseDisplay(display);
+
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "pch.h"
+#include "PixelFrameSource.h"
+
+// Xlib is only included by the source file, since its macros, such as None and Status, clash with other code.
+struct _XDisplay;
+struct _XImage;
+
+// The purpose of this class is to grab frames of an X11 screen on Linux with the MIT-SHM extension. The X server
+// copies the region of the root window straight into a shared memory segment, which the handler reads in place, so a
+// frame is never copied through the socket or again in the process. Frames are grabbed on a thread of the source at
+// the given rate, or one at a time with grab, and need a 24 or 32-bit TrueColor screen laid out as BGRA8, as Xvfb and
+// the usual X servers on little endian machines are.
+class XShmFrameSource : public PixelFrameSource {
+public:
+    /**
+     * Opens the display and attaches a shared memory image of the region.
+     * @param displayName X display such as ":99", or empty for the DISPLAY environment variable
+     * @param width width of the region, or 0 for the rest of the screen right of left
+     * @param height height of the region, or 0 for the rest of the screen below top
+     * @throws std::runtime_error if the display cannot be opened, lacks MIT-SHM or is not laid out as BGRA8
+     * @throws std::invalid_argument if the region is empty or does not fit on the screen
+     */
+    XShmFrameSource(const std::string& displayName, int32_t left, int32_t top, uint32_t width, uint32_t height, double framerate);
+    ~XShmFrameSource();
+
+    XShmFrameSource(const XShmFrameSource&) = delete;
+    XShmFrameSource& operator=(const XShmFrameSource&) = delete;
+
+    void start(const FrameHandler& handler) override;
+    void close() override;
+    uint32_t width() const override { return m_width; }
+    uint32_t height() const override { return m_height; }
+
+    /**
+     * Grabs a frame into the shared image, on the caller's thread. Only for a source that was not started.
+     * @throws std::runtime_error if the X server fails to copy the region
+     */
+    void grab();
+
+    // The last frame grabbed, valid until the next grab.
+    const uint8_t* pixels() const;
+    uint32_t row_pitch() const;
+
+    // Size of the screen of the display, for picking regions that fit on it.
+    static bool try_get_screen_size(const std::string& displayName, uint32_t& width, uint32_t& height);
+
+private:
+    // The shared memory segment the image lives in. The image keeps a pointer to it, so it stays where it is.
+    struct Segment;
+
+    void release();
+
+    _XDisplay* m_display = nullptr;
+    unsigned long m_root = 0;
+    _XImage* m_image = nullptr;
+    std::unique_ptr<Segment> m_segment;
+
+    int32_t m_left;
+    int32_t m_top;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    std::chrono::nanoseconds m_frameInterval;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_closed = false;
+};
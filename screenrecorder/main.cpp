@@ -4,6 +4,13 @@
 #include "CommandLine.h"
 #include "Request.h"
 #include "Response.h"
+#include "FrameIndex.h"
+#include "Benchmark.h"
+#include "ScreenCodec.h"
+#include "QualityTuner.h"
+#include "ChunkStore.h"
+#include "FrameBus.h"
+#include "RecordingProcess.h"
 
 TRACELOGGING_DEFINE_PROVIDER(
     g_hMyComponentProvider,
@@ -13,27 +20,119 @@ TRACELOGGING_DEFINE_PROVIDER(
 
 const std::string helpMessage = "\n\tUsage: screenrecorder.exe options ...\n\n"
 "\t-help start\t- for screen recording start command\n"
-"\t-help stop\t- for screen recording stop commands\n";
+"\t-help stop\t- for screen recording stop commands\n"
+"\t-help export\t- for exporting screenshots while recording\n"
+"\t-help framebus\t- for reading live screenshots from other processes\n"
+"\t-help exportindex\t- for frame index export command\n"
+"\t-help decode\t- for screen codec decode command\n"
+"\t-help qualitycurve\t- for JPEG quality curve command\n"
+"\t-help chunks\t- for chunk store commands\n"
+"\t-help benchmark\t- for benchmark command\n";
 
 const std::string startHelpMessage = "\n  screenrecorder.exe -start ...        Starts screen recording.\n"
-"\tUsage:\tscreenrecorder.exe -start [-framerate <framerate>] [-monitor <monitor # to record>] [-framebuffer -mb <# of frames>] \n"
+"\tUsage:\tscreenrecorder.exe -start [-session <name>] [-framerate <framerate>] [-monitor <monitor # to record>] [-framebuffer -mb <# of frames>] [-dirtyregions] [-cursormetadata] [-storage <texture|encoded|compressed|hdr>] [-format <jpeg|png|bmp|screen>] [-quality <0-100|auto>] [-largepages] [-directio] [-chunkstore <folder>] [-idle <seconds>] [-idleinterval <seconds>] [-publish <# of slots>] [-memorycap <megabytes>] [-tier <interval> <scale> -mb <# of frames>]... [-redact <left> <top> <right> <bottom>]... [-redactapp <executable name>]... [-redactstyle <fill|pixelate>] \n"
 "\tEx>\tscreenrecorder.exe -start -framerate 10\n"
-"\tEx>\tscreenrecorder.exe -start -framerate 1 -monitor 0 -framebuffer -mb 100\n\n"
+"\tEx>\tscreenrecorder.exe -start -framerate 1 -monitor 0 -framebuffer -mb 100\n"
+"\tEx>\tscreenrecorder.exe -start -framerate 10 -framebuffer 600 -tier 1 2 1800 -tier 60 8 1440\n"
+"\tEx>\tscreenrecorder.exe -start -session left -monitor 0 & screenrecorder.exe -start -session right -monitor 1\n"
+"\tEx>\tscreenrecorder.exe -start -redactapp keepass.exe -redact 0 0 400 60 -redactstyle pixelate\n"
+"\tEx>\tscreenrecorder.exe -start -storage encoded -quality auto\n\n"
+"\t-session\tNames the recording, so several recordings can run at the same time. The other commands take the same -session to pick the recording. Names are letters, digits, - and _.\n"
 "\t-framerate\tSpecifies the rate at which screenshots will be taken, in frames per second.\n"
 "\t-monitor\tSpecifies the monitor to record, as an index. The highest index will record all monitors.\n"
-"\t-framebuffer\tSpecifies the size of the circular memory buffer in which to store screenshots, in number of screenshots. Adding the -mb flag specifies the size of the buffer in megabytes.\n";
+"\t-framebuffer\tSpecifies the size of the circular memory buffer in which to store screenshots, in number of screenshots. Adding the -mb flag specifies the size of the buffer in megabytes.\n"
+"\t-dirtyregions\tStores only the regions of each screenshot that changed since the previous one, so more screenshots fit in a buffer sized in megabytes. Whole screenshots are rebuilt when they are saved.\n"
+"\t-cursormetadata\tCaptures screenshots without the cursor and records its position and shape instead, so cursor movement does not change the stored pixels. The cursor is drawn back when the screenshots are saved.\n"
+"\t-storage\tSpecifies how screenshots are kept in the buffer. texture (the default) keeps them on the GPU as captured. encoded encodes them as soon as they are captured and keeps the encoded files in one block of memory, so a buffer sized in megabytes holds many more screenshots and -stop only has to write them out. compressed keeps them in the same kind of block, compressed to an eighth of their size with some loss of color detail, so a buffer sized in megabytes holds an exact number of screenshots. hdr captures the full brightness range of an HDR desktop instead of clipping it, keeps the screenshots in the same kind of block at 4 bytes per pixel, and tone maps them to ordinary images when they are saved. -dirtyregions has no effect with encoded, compressed or hdr storage.\n"
+"\t-format\t\tSpecifies the format screenshots are saved in. jpeg is the default. screen is a fast lossless format made for text and user interfaces, written as .srsc files that -decode converts to PNG.\n"
+"\t-quality\tSpecifies the JPEG quality, from 0 to 100. auto picks the lowest quality that keeps screenshots looking as captured, searched for separately for text and for photos and video on the first screenshot of each, and kept for the rest of the recording. See -help qualitycurve.\n"
+"\t-largepages\tBacks encoded storage with large pages when the account is allowed to lock pages in memory.\n"
+"\t-directio\tWrites saved screenshots around the system file cache, so saving a large buffer does not push other programs' files out of memory.\n"
+"\t-chunkstore\tKeeps saved screenshots in a store folder shared by every save, each identical screenshot only once, and writes only a list of them into the save folder. Saving the same buffer again, or a buffer that barely changed, writes almost nothing. See -help chunks.\n"
+"\t-idle\t\tIdles the recording while the session is locked, the screensaver runs or nobody has used the keyboard or mouse for <seconds>. An idle recording takes no screenshots, and the first one after the machine is used again is taken at once and records how long it was idle.\n"
+"\t-idleinterval\tKeeps one screenshot every <seconds> while idle, instead of none.\n"
+"\t-publish\tPublishes every screenshot, as it is captured, to a ring of <# of slots> slots in shared memory that other processes on the machine can read. See -help framebus.\n"
+"\t-memorycap\tRefuses to start the recording if the buffers and tiers of all running recordings could together take more than <megabytes>. Defaults to half of physical memory.\n"
+"\t-tier\t\tAdds a retention tier that keeps screenshots evicted from the buffer, or from the tier before it, instead of dropping them. A screenshot is kept if it is at least <interval> seconds newer than the last one kept, and is shrunk by <scale>, a power of two, relative to the captured size. The size of the tier is given like -framebuffer. Can be repeated, and needs texture storage.\n"
+"\t-redact\t\tHides a rectangle of every screenshot, given in pixels from the top left of the recorded monitor, before it is stored. Can be repeated.\n"
+"\t-redactapp\tHides the windows of the application with this executable name, such as keepass.exe, wherever they are on the recorded monitor. Can be repeated.\n"
+"\t-redactstyle\tSpecifies how redacted regions are hidden. fill (the default) paints them black. pixelate replaces them with 16x16 blocks of their average color.\n";
 
 const std::string stopHelpMessage = "\n  screenrecorder.exe -stop ...         Stops screen recording saves all screenshots in buffer to a folder.\n"
-"\tUsage:\tscreenrecorder.exe -stop <recording folder>\n"
+"\tUsage:\tscreenrecorder.exe -stop <recording folder> [-session <name>]\n"
 "\tEx>\tscreenrecorder.exe -stop \"D:\\screenrecorder\"\n"
 "\n  screenrecorder.exe -cancel ...       Cancels the screen recording.\n"
-"\tUsage:\tscreenrecorder.exe -cancel\n";
+"\tUsage:\tscreenrecorder.exe -cancel [-session <name>]\n";
+
+const std::string exportHelpMessage = "\n  screenrecorder.exe -export ...       Saves screenshots from the buffer to a folder without stopping the recording.\n"
+"\tUsage:\tscreenrecorder.exe -export <folder> [-from <qpc>] [-to <qpc>] [-stride <n>] [-session <name>]\n"
+"\tUsage:\tscreenrecorder.exe -export <folder> -at <qpc> [-session <name>]\n"
+"\tEx>\tscreenrecorder.exe -export \"D:\\screenrecorder\\hang\" -from 81234567890 -to 81264567890\n"
+"\tEx>\tscreenrecorder.exe -export \"D:\\screenrecorder\\hang\" -at 81250000000\n\n"
+"\t-from\t\tExports screenshots that arrived at or after this QueryPerformanceCounter value. Defaults to the oldest screenshot.\n"
+"\t-to\t\tExports screenshots that arrived at or before this QueryPerformanceCounter value. Defaults to the newest screenshot.\n"
+"\t-stride\t\tExports only every <n>th screenshot of the range.\n"
+"\t-at\t\tExports only the screenshot that arrived closest to this QueryPerformanceCounter value.\n\n"
+"\tTimes are QueryPerformanceCounter values, as in the Qpc column of the frame index and in ETW traces.\n";
+
+const std::string frameBusHelpMessage = "\n  screenrecorder.exe -framebus         Prints the name and layout of the shared memory live screenshots are published to.\n"
+"\tUsage:\tscreenrecorder.exe -framebus [-session <name>]\n"
+"\tEx>\tscreenrecorder.exe -start -framerate 10 -publish 8\n"
+"\tEx>\tscreenrecorder.exe -framebus\n\n"
+"\tThe recording must have been started with -publish. Consumers open the named file mapping read-only and read each\n"
+"\tslot the way FrameBusReader does: a slot whose version is odd is being written, and a slot whose version changed\n"
+"\twhile it was read was overwritten. Screenshots are BGRA8 with rows packed tightly.\n";
+
+const std::string exportIndexHelpMessage = "\n  screenrecorder.exe -exportindex ...   Exports the frame index saved with a recording to CSV or JSON.\n"
+"\tUsage:\tscreenrecorder.exe -exportindex <frame index file> <output file>\n"
+"\tEx>\tscreenrecorder.exe -exportindex \"D:\\screenrecorder\\frames.idx\" \"D:\\screenrecorder\\frames.csv\"\n"
+"\tEx>\tscreenrecorder.exe -exportindex \"D:\\screenrecorder\\frames.idx\" \"D:\\screenrecorder\\frames.json\"\n\n"
+"\tThe output format is chosen from the extension of the output file. Files ending in .json are written as JSON, all others as CSV.\n";
+
+const std::string decodeHelpMessage = "\n  screenrecorder.exe -decode ...       Converts a screenshot saved with -format screen to a standard image file.\n"
+"\tUsage:\tscreenrecorder.exe -decode <screenshot file> <output file>\n"
+"\tEx>\tscreenrecorder.exe -decode \"D:\\screenrecorder\\screenshot_2024-01-01_12-00-00-000000.srsc\" \"D:\\screenshot.png\"\n\n"
+"\tThe output format is chosen from the extension of the output file: .png, .bmp or .jpg.\n";
+
+const std::string qualityCurveHelpMessage = "\n  screenrecorder.exe -qualitycurve ... Reports the size and quality of a set of screenshots saved as JPEG at a range of qualities.\n"
+"\tUsage:\tscreenrecorder.exe -qualitycurve <folder> [<output file>]\n"
+"\tEx>\tscreenrecorder.exe -qualitycurve \"D:\\screenrecorder\" \"D:\\quality.csv\"\n\n"
+"\tEvery .png, .bmp, .jpg and .srsc file in the folder is encoded as JPEG at qualities from 5 to 100, decoded and\n"
+"\tcompared with the original with SSIM and PSNR. The averages are printed per content class, text or natural, with\n"
+"\tthe lowest quality -quality auto aims for in each. Lossless screenshots give the most accurate curve. If an output\n"
+"\tfile is given, the curve is also written to it as CSV.\n";
+
+const std::string chunksHelpMessage = "\n  screenrecorder.exe -chunkgc ...      Deletes the screenshots of a chunk store that no save uses anymore.\n"
+"\tUsage:\tscreenrecorder.exe -chunkgc <store folder> [<folder>]...\n"
+"\tEx>\tscreenrecorder.exe -chunkgc \"D:\\chunks\" \"E:\\incidents\"\n\n"
+"\tEvery save made with -chunkstore is registered with the store. Screenshots named by no registered save, nor by a\n"
+"\tsave found anywhere under the given folders, are deleted once they are an hour old. Saves deleted since are\n"
+"\tforgotten, so deleting a save and running -chunkgc frees the screenshots only it used. Saves moved elsewhere are\n"
+"\tfound by passing the folder they were moved to.\n"
+"\n  screenrecorder.exe -chunkrestore ... Copies the screenshots of a save made with -chunkstore into ordinary files.\n"
+"\tUsage:\tscreenrecorder.exe -chunkrestore <save folder> <output folder>\n"
+"\tEx>\tscreenrecorder.exe -chunkrestore \"D:\\screenrecorder\\hang\" \"D:\\hang\"\n";
+
+const std::string benchmarkHelpMessage = "\n  screenrecorder.exe -benchmark ...    Measures the capture, buffer and save pipeline on synthetic frames.\n"
+"\tUsage:\tscreenrecorder.exe -benchmark [-filter <benchmark name filter>] [<results file>]\n"
+"\tEx>\tscreenrecorder.exe -benchmark\n"
+"\tEx>\tscreenrecorder.exe -benchmark -filter encode/ \"D:\\benchmark.json\"\n\n"
+"\t-filter\t\tOnly runs the benchmarks whose name contains the filter.\n"
+"\tThe results are printed and, if a results file is given, also written to it as JSON.\n";
 
 const std::string invalidCommandSynatxMessage = "\b\tInvalid command syntax.\n";
 
-const std::string recordingAlreadyStarted = "\b\tThere is already a recording in process.\n";
 const std::string recordingNotStartedMessage = "\b\tThere is no recording in process.\n";
 
+const std::string failedToExportIndexMessage = "\b\tFailed to export the frame index.\n";
+
+const std::string failedToMeasureQualityCurveMessage = "\b\tFailed to measure the quality curve.\n";
+
+const std::string failedToCollectChunksMessage = "\b\tFailed to collect the chunk store.\n";
+const std::string failedToRestoreChunksMessage = "\b\tFailed to restore the screenshots.\n";
+
+const std::string failedToRunBenchmarkMessage = "\b\tFailed to run the benchmarks.\n";
+
 const std::string failedToCommunicateWithServerProcessMessage = "\b\tFailed to communicate with recording process.\n";
 const std::string failedToCreateServerProcessMessage = "\b\tFailed to create the recording process.\n";
 const std::string failedToConnectToServerProcessMessage = "\b\tFailed to connect to the recording process.\n";
@@ -43,44 +142,13 @@ const std::string defaultEnumCaseMessage = "\b\tReceived an unhandled response f
 
 const std::string defaultSeverExceptioinMessage = "\b\tReceived an unknown exception from the recording process.\n";
 
-bool TryCreateRecordingProcess()
-{
-    TCHAR szPath[MAX_PATH];
-
-    if (!GetModuleFileName(NULL, szPath, MAX_PATH))
-    {
-        return false;
-    }
-
-    std::wstring cmdLine = std::wstring(szPath) + L" -newserver";
-    STARTUPINFO info = { sizeof(info) };
-    info.dwFlags = STARTF_USESTDHANDLES;
-    info.hStdOutput = NULL;
-    info.hStdError = NULL;
-    PROCESS_INFORMATION processInfo;
-
-    if (!CreateProcess(szPath, &cmdLine[0], NULL, NULL, TRUE, 0, NULL, NULL, &info, &processInfo))
-    {
-        CloseHandle(processInfo.hProcess);
-        CloseHandle(processInfo.hThread);
-
-        return false;
-    }
-
-    CloseHandle(processInfo.hProcess);
-    CloseHandle(processInfo.hThread);
-
-    return true;
-}
-
 void start(CommandLine& commandLine)
 {
-    int framerate, monitorIndex, bufferCapacity;
-    bool isMegabytes;
+    RecordingOptions options;
 
     try
     {
-        commandLine.GetStartArgs(framerate, monitorIndex, bufferCapacity, isMegabytes);
+        commandLine.GetStartArgs(options);
     }
     catch (const std::invalid_argument& e)
     {
@@ -90,40 +158,32 @@ void start(CommandLine& commandLine)
         return;
     }
 
-    Request startRequest = Request::BuildStartRequest(framerate, monitorIndex, bufferCapacity, isMegabytes);
+    Request startRequest = Request::BuildStartRequest(options);
     Request disconnectRequest = Request::BuildDisconnectRequest();
     Request killRequest = Request::BuildKillRequest();
     Response response;
     Client client;
 
-    if (client.try_connect())
-    {
-        std::cout << recordingAlreadyStarted << std::endl;
+    RecordingProcess recordingProcess;
 
-        try
-        {
-            client.send(disconnectRequest);
-        }
-        catch (const std::ios_base::failure& e)
-        {
-            std::cout << failedToCommunicateWithServerProcessMessage << std::endl;
-        }
-
-        return;
-    }
-
-    if (!TryCreateRecordingProcess())
+    // Recordings with different session names share the recording process that is already running. The server
+    // refuses a second recording with the same name.
+    if (!client.try_connect())
     {
-        std::cout << failedToCreateServerProcessMessage << std::endl;
+        if (!recordingProcess.try_create())
+        {
+            std::cout << failedToCreateServerProcessMessage << std::endl;
 
-        return;
-    }
+            return;
+        }
 
-    if (!client.try_connect(3))
-    {
-        std::cout << failedToConnectToServerProcessMessage << std::endl;
+        // The recording process signals once its pipe is listening, usually within a few milliseconds.
+        if (!recordingProcess.wait_until_ready(5000) || !client.try_connect())
+        {
+            std::cout << failedToConnectToServerProcessMessage << std::endl;
 
-        return;
+            return;
+        }
     }
 
     try
@@ -205,11 +265,11 @@ void start(CommandLine& commandLine)
 
 void stop(CommandLine& commandLine)
 {
-    std::string folder;
+    std::string folder, session;
 
     try
     {
-        commandLine.GetStopArgs(folder);
+        commandLine.GetStopArgs(folder, session);
     }
     catch (const std::invalid_argument& e)
     {
@@ -219,7 +279,7 @@ void stop(CommandLine& commandLine)
         return;
     }
 
-    Request stopRequest = Request::BuildStopRequest(folder);
+    Request stopRequest = Request::BuildStopRequest(folder, session);
     Request disconnectRequest = Request::BuildDisconnectRequest();
     Request killRequest = Request::BuildKillRequest();
     Response response;
@@ -232,9 +292,23 @@ void stop(CommandLine& commandLine)
         return;
     }
 
+    ResponseType responseType;
+
     try
     {
         response = client.send(stopRequest);
+        responseType = response.ParseResponseType();
+
+        // The recording is saved by a job on the recording process, wait for it to finish.
+        if (responseType == ResponseType::Job)
+        {
+            int jobId;
+            response.ParseJobArgs(jobId);
+
+            Request jobWaitRequest = Request::BuildJobWaitRequest(jobId);
+            response = client.send(jobWaitRequest);
+            responseType = response.ParseResponseType();
+        }
     }
     catch (const std::ios_base::failure& e)
     {
@@ -245,7 +319,7 @@ void stop(CommandLine& commandLine)
 
     std::exception e;
 
-    switch (response.ParseResponseType())
+    switch (responseType)
     {
     case ResponseType::Success:
         break;
@@ -309,9 +383,116 @@ void stop(CommandLine& commandLine)
     }
 }
 
+void export_frames(CommandLine& commandLine)
+{
+    ExportOptions options;
+
+    try
+    {
+        commandLine.GetExportArgs(options);
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << invalidCommandSynatxMessage << std::endl;
+        std::cout << exportHelpMessage << std::endl;
+
+        return;
+    }
+
+    Request exportRequest = Request::BuildExportRequest(options);
+    Request disconnectRequest = Request::BuildDisconnectRequest();
+    Response response;
+    Client client;
+
+    if (!client.try_connect())
+    {
+        std::cout << recordingNotStartedMessage << std::endl;
+
+        return;
+    }
+
+    ResponseType responseType;
+
+    try
+    {
+        response = client.send(exportRequest);
+        responseType = response.ParseResponseType();
+
+        // The screenshots are saved by a job on the recording process, wait for it to finish.
+        if (responseType == ResponseType::Job)
+        {
+            int jobId;
+            response.ParseJobArgs(jobId);
+
+            Request jobWaitRequest = Request::BuildJobWaitRequest(jobId);
+            response = client.send(jobWaitRequest);
+            responseType = response.ParseResponseType();
+        }
+    }
+    catch (const std::ios_base::failure& e)
+    {
+        std::cout << failedToCommunicateWithServerProcessMessage << std::endl;
+
+        return;
+    }
+
+    std::exception e;
+
+    switch (responseType)
+    {
+    case ResponseType::Success:
+        break;
+    case ResponseType::Exception:
+        try
+        {
+            response.ParseExceptionArgs(e);
+
+            std::cout << e.what() << std::endl;
+        }
+        catch (const std::invalid_argument& e)
+        {
+            std::cout << defaultSeverExceptioinMessage << std::endl;
+        }
+
+        break;
+    case ResponseType::Unknown:
+        std::cout << unknownEnumCaseMessage << std::endl;
+
+        break;
+    default:
+        std::cout << defaultEnumCaseMessage << std::endl;
+
+        break;
+    }
+
+    // Unlike -stop, the recording keeps going, so the server is left running.
+    try
+    {
+        client.send(disconnectRequest);
+    }
+    catch (const std::ios_base::failure& e)
+    {
+        std::cout << failedToCommunicateWithServerProcessMessage << std::endl;
+    }
+}
+
 void cancel(CommandLine& commandLine)
 {
-    Request request = Request::BuildCancelRequest();
+    std::string session;
+
+    try
+    {
+        commandLine.GetSessionArgs(session);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cout << invalidCommandSynatxMessage << std::endl;
+        std::cout << stopHelpMessage << std::endl;
+
+        return;
+    }
+
+    Request request = Request::BuildCancelRequest(session);
     Request disconnectRequest = Request::BuildDisconnectRequest();
     Request killRequest = Request::BuildKillRequest();
     Response response;
@@ -401,11 +582,23 @@ void cancel(CommandLine& commandLine)
     }
 }
 
-void new_server()
+void new_server(CommandLine& commandLine)
 {
+    uint64_t readyEvent;
+    std::wstring pipeName;
+
+    try
+    {
+        commandLine.GetNewServerArgs(readyEvent, pipeName);
+    }
+    catch (const std::exception& e)
+    {
+        return;
+    }
+
     Request disconnectRequest = Request::BuildDisconnectRequest();
     Response response;
-    Client client;
+    Client client(pipeName);
 
     if (client.try_connect())
     {
@@ -420,16 +613,376 @@ void new_server()
         return;
     }
 
-    std::unique_ptr<Server> server = std::make_unique<Server>();
+    std::unique_ptr<Server> server = std::make_unique<Server>(pipeName);
 
     if (!server->try_init())
     {
         return;
     }
 
+    if (readyEvent)
+    {
+        RecordingProcess::signal_ready(readyEvent);
+    }
+
     server->run();
 }
 
+void frame_bus(CommandLine& commandLine)
+{
+    std::string session;
+
+    try
+    {
+        commandLine.GetSessionArgs(session);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cout << invalidCommandSynatxMessage << std::endl;
+        std::cout << frameBusHelpMessage << std::endl;
+
+        return;
+    }
+
+    Request frameBusRequest = Request::BuildFrameBusRequest(session);
+    Request disconnectRequest = Request::BuildDisconnectRequest();
+    Response response;
+    Client client;
+
+    if (!client.try_connect())
+    {
+        std::cout << recordingNotStartedMessage << std::endl;
+
+        return;
+    }
+
+    try
+    {
+        response = client.send(frameBusRequest);
+    }
+    catch (const std::ios_base::failure& e)
+    {
+        std::cout << failedToCommunicateWithServerProcessMessage << std::endl;
+
+        return;
+    }
+
+    std::exception e;
+    std::string name;
+    uint32_t slotCount, slotCapacity;
+
+    switch (response.ParseResponseType())
+    {
+    case ResponseType::FrameBus:
+        response.ParseFrameBusArgs(name, slotCount, slotCapacity);
+
+        std::cout << "\tName:\t\t" << name << "\n"
+            << "\tSlots:\t\t" << slotCount << "\n"
+            << "\tSlot capacity:\t" << slotCapacity << " bytes\n"
+            << "\tSegment size:\t" << FrameBus::calculate_segment_size(slotCount, slotCapacity) << " bytes\n"
+            << "\tLayout version:\t" << FrameBusLayout::version << std::endl;
+
+        break;
+    case ResponseType::Exception:
+        try
+        {
+            response.ParseExceptionArgs(e);
+
+            std::cout << e.what() << std::endl;
+        }
+        catch (const std::invalid_argument& e)
+        {
+            std::cout << defaultSeverExceptioinMessage << std::endl;
+        }
+
+        break;
+    case ResponseType::Unknown:
+        std::cout << unknownEnumCaseMessage << std::endl;
+
+        break;
+    default:
+        std::cout << defaultEnumCaseMessage << std::endl;
+
+        break;
+    }
+
+    try
+    {
+        client.send(disconnectRequest);
+    }
+    catch (const std::ios_base::failure& e)
+    {
+        std::cout << failedToCommunicateWithServerProcessMessage << std::endl;
+    }
+}
+
+void export_index(CommandLine& commandLine)
+{
+    std::string indexFile, outputFile;
+
+    try
+    {
+        commandLine.GetExportIndexArgs(indexFile, outputFile);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cout << invalidCommandSynatxMessage << std::endl;
+        std::cout << exportIndexHelpMessage << std::endl;
+
+        return;
+    }
+
+    try
+    {
+        int64_t qpcFrequency;
+        std::vector<FrameMetadata> records = FrameIndex::Read(indexFile, qpcFrequency);
+
+        std::ofstream output(outputFile, std::ios::trunc);
+
+        if (!output)
+        {
+            throw std::ios_base::failure("Failed to create \"" + outputFile + "\".");
+        }
+
+        bool isJson = outputFile.size() >= 5 && outputFile.compare(outputFile.size() - 5, 5, ".json") == 0;
+
+        if (isJson)
+        {
+            FrameIndex::ExportJson(output, records, qpcFrequency);
+        }
+        else
+        {
+            FrameIndex::ExportCsv(output, records, qpcFrequency);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << failedToExportIndexMessage << std::endl;
+        std::cout << "\t" << e.what() << std::endl;
+    }
+}
+
+void decode(CommandLine& commandLine)
+{
+    std::string inputFile, outputFile;
+
+    try
+    {
+        commandLine.GetDecodeArgs(inputFile, outputFile);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cout << invalidCommandSynatxMessage << std::endl;
+        std::cout << decodeHelpMessage << std::endl;
+
+        return;
+    }
+
+    try
+    {
+        std::ifstream input(inputFile, std::ios::binary);
+
+        if (!input)
+        {
+            throw std::ios_base::failure("Failed to open \"" + inputFile + "\".");
+        }
+
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+        uint32_t width, height;
+        std::vector<uint8_t> pixels = ScreenCodec::decode(data.data(), data.size(), width, height);
+
+        FrameEncoder encoder(FrameEncoder::format_from_filename(outputFile));
+        winrt::Windows::Storage::Streams::InMemoryRandomAccessStream stream;
+        encoder.encode(pixels.data(), width, height, width * 4, stream);
+
+        winrt::Windows::Storage::Streams::Buffer buffer(static_cast<uint32_t>(stream.Size()));
+        stream.Seek(0);
+        stream.ReadAsync(buffer, buffer.Capacity(), winrt::Windows::Storage::Streams::InputStreamOptions::None).get();
+
+        std::ofstream output(outputFile, std::ios::binary | std::ios::trunc);
+        output.write(reinterpret_cast<const char*>(buffer.data()), buffer.Length());
+
+        if (!output)
+        {
+            throw std::ios_base::failure("Failed to write \"" + outputFile + "\".");
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << "\t" << e.what() << std::endl;
+    }
+}
+
+void quality_curve(CommandLine& commandLine)
+{
+    std::string folder, outputFile;
+
+    try
+    {
+        commandLine.GetQualityCurveArgs(folder, outputFile);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cout << invalidCommandSynatxMessage << std::endl;
+        std::cout << qualityCurveHelpMessage << std::endl;
+
+        return;
+    }
+
+    try
+    {
+        std::vector<QualityCurvePoint> curve = QualityTuner::measure_curve(folder);
+
+        QualityTuner::write_curve(std::cout, curve);
+
+        if (!outputFile.empty())
+        {
+            std::ofstream output(outputFile, std::ios::trunc);
+
+            if (!output)
+            {
+                throw std::ios_base::failure("Failed to create \"" + outputFile + "\".");
+            }
+
+            QualityTuner::write_curve_csv(output, curve);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << failedToMeasureQualityCurveMessage << std::endl;
+        std::cout << "\t" << e.what() << std::endl;
+    }
+    catch (const winrt::hresult_error& e)
+    {
+        std::cout << failedToMeasureQualityCurveMessage << std::endl;
+        std::cout << "\t" << winrt::to_string(e.message()) << std::endl;
+    }
+}
+
+void chunk_gc(CommandLine& commandLine)
+{
+    std::string store;
+    std::vector<std::string> folders;
+
+    try
+    {
+        commandLine.GetChunkGcArgs(store, folders);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cout << invalidCommandSynatxMessage << std::endl;
+        std::cout << chunksHelpMessage << std::endl;
+
+        return;
+    }
+
+    try
+    {
+        std::vector<std::filesystem::path> extraFolders;
+
+        for (const auto& folder : folders)
+        {
+            extraFolders.push_back(std::filesystem::u8path(folder));
+        }
+
+        ChunkStore::GarbageReport report = ChunkStore::collect_garbage(std::filesystem::u8path(store), extraFolders);
+
+        std::cout << "\tKept " << report.keptChunks << " screenshots, deleted " << report.deletedChunks << " ("
+            << report.deletedBytes / (1024 * 1024) << " MB) and forgot " << report.droppedRoots << " deleted saves." << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << failedToCollectChunksMessage << std::endl;
+        std::cout << "\t" << e.what() << std::endl;
+    }
+}
+
+void chunk_restore(CommandLine& commandLine)
+{
+    std::string folder, outputFolder;
+
+    try
+    {
+        commandLine.GetChunkRestoreArgs(folder, outputFolder);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cout << invalidCommandSynatxMessage << std::endl;
+        std::cout << chunksHelpMessage << std::endl;
+
+        return;
+    }
+
+    try
+    {
+        size_t count = ChunkStore::restore(std::filesystem::u8path(folder), std::filesystem::u8path(outputFolder));
+
+        std::cout << "\tRestored " << count << " screenshots." << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << failedToRestoreChunksMessage << std::endl;
+        std::cout << "\t" << e.what() << std::endl;
+    }
+}
+
+// Returns the exit code of the process, which is not 0 when a benchmark failed, so scripts running them notice.
+int benchmark(CommandLine& commandLine)
+{
+    std::string filter, outputFile;
+
+    try
+    {
+        commandLine.GetBenchmarkArgs(filter, outputFile);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cout << invalidCommandSynatxMessage << std::endl;
+        std::cout << benchmarkHelpMessage << std::endl;
+
+        return 1;
+    }
+
+    Benchmark benchmark(filter);
+    int exitCode = 0;
+
+    try
+    {
+        benchmark.run_all();
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << failedToRunBenchmarkMessage << std::endl;
+        std::cout << "\t" << e.what() << std::endl;
+        exitCode = 1;
+    }
+    catch (const winrt::hresult_error& e)
+    {
+        std::cout << failedToRunBenchmarkMessage << std::endl;
+        std::cout << "\t" << winrt::to_string(e.message()) << std::endl;
+        exitCode = 1;
+    }
+
+    benchmark.write_summary(std::cout);
+
+    if (!outputFile.empty())
+    {
+        std::ofstream output(outputFile, std::ios::trunc);
+
+        if (!output)
+        {
+            std::cout << failedToRunBenchmarkMessage << std::endl;
+
+            return 1;
+        }
+
+        benchmark.write_json(output);
+    }
+
+    return exitCode;
+}
+
 void help(CommandLine& commandLine)
 {
     std::string arg;
@@ -454,6 +1007,34 @@ void help(CommandLine& commandLine)
     {
         std::cout << stopHelpMessage << std::endl;
     }
+    else if (arg.compare("export") == 0)
+    {
+        std::cout << exportHelpMessage << std::endl;
+    }
+    else if (arg.compare("framebus") == 0)
+    {
+        std::cout << frameBusHelpMessage << std::endl;
+    }
+    else if (arg.compare("exportindex") == 0)
+    {
+        std::cout << exportIndexHelpMessage << std::endl;
+    }
+    else if (arg.compare("decode") == 0)
+    {
+        std::cout << decodeHelpMessage << std::endl;
+    }
+    else if (arg.compare("qualitycurve") == 0)
+    {
+        std::cout << qualityCurveHelpMessage << std::endl;
+    }
+    else if (arg.compare("chunks") == 0)
+    {
+        std::cout << chunksHelpMessage << std::endl;
+    }
+    else if (arg.compare("benchmark") == 0)
+    {
+        std::cout << benchmarkHelpMessage << std::endl;
+    }
     else 
     {
         std::cout << invalidCommandSynatxMessage << std::endl;
@@ -463,6 +1044,10 @@ void help(CommandLine& commandLine)
 
 int main(int argc, char* argv[])
 {
+    // Window, cursor and monitor positions are compared with the pixels of captured frames, so the process sees them
+    // in physical pixels instead of scaled to a DPI it is not aware of. This must happen before any window is created.
+    SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
+
     CommandLine commandLine(argc, argv);
 
     switch (commandLine.GetCommandType())
@@ -480,9 +1065,39 @@ int main(int argc, char* argv[])
 
             break;
         case CommandType::NewServer:
-            new_server();
+            new_server(commandLine);
+
+            break;
+        case CommandType::Export:
+            export_frames(commandLine);
+
+            break;
+        case CommandType::FrameBus:
+            frame_bus(commandLine);
+
+            break;
+        case CommandType::ExportIndex:
+            export_index(commandLine);
+
+            break;
+        case CommandType::Decode:
+            decode(commandLine);
+
+            break;
+        case CommandType::QualityCurve:
+            quality_curve(commandLine);
+
+            break;
+        case CommandType::ChunkGc:
+            chunk_gc(commandLine);
+
+            break;
+        case CommandType::ChunkRestore:
+            chunk_restore(commandLine);
 
             break;
+        case CommandType::Benchmark:
+            return benchmark(commandLine);
         case CommandType::Help:
             help(commandLine);
 
@@ -0,0 +1,348 @@
+#include "pch.h"
+#include "PixelFrameBuffer.h"
+#include "TaskScheduler.h"
+#include "XShmFrameSource.h"
+
+#include <signal.h>
+
+// The Linux build records an X11 screen into a PixelFrameBuffer and saves it when told to stop. It runs in the
+// foreground rather than as a server taking commands over a pipe, so it is stopped with a signal, such as Ctrl+C.
+
+const std::string helpMessage = "\n\tUsage: screenrecorder options ...\n\n"
+"  screenrecorder -record ...           Records the screen until stopped, then saves all screenshots in the buffer to a folder.\n"
+"\tUsage:\tscreenrecorder -record <recording folder> [-display <name>] [-region <left> <top> <width> <height>] [-framerate <framerate>] [-framebuffer -mb <# of frames>] [-seconds <seconds>] [-largepages]\n"
+"\tEx>\tscreenrecorder -record ~/screenrecorder -framerate 10\n"
+"\tEx>\tscreenrecorder -record ~/screenrecorder -display :99 -framebuffer -mb 100 -seconds 30\n\n"
+"\t-display\tSpecifies the X display to record, such as :99. Defaults to the DISPLAY environment variable.\n"
+"\t-region\t\tRecords only a rectangle of the screen, in pixels from its top left. Defaults to the whole screen.\n"
+"\t-framerate\tSpecifies the rate at which screenshots will be taken, in frames per second.\n"
+"\t-framebuffer\tSpecifies the size of the circular memory buffer in which to store screenshots, in number of screenshots. Adding the -mb flag specifies the size of the buffer in megabytes.\n"
+"\t-seconds\tStops recording after <seconds>. Recording otherwise stops on Ctrl+C or SIGTERM.\n"
+"\t-largepages\tBacks the buffer with huge pages when some are reserved.\n\n"
+"\tScreenshots are kept compressed to an eighth of their size, like -storage compressed on Windows, and saved as BMP files with a frame index.\n"
+"\n  screenrecorder -benchmark ...        Measures grabbing and storing 1920x1080 and 3840x2160 frames.\n"
+"\tUsage:\tscreenrecorder -benchmark [-display <name>]\n"
+"\tEx>\tXvfb :99 -screen 0 3840x2160x24 & screenrecorder -benchmark -display :99\n\n"
+"\tGrabbing is only measured at the sizes that fit on the screen, and is skipped without a display.\n";
+
+const std::string invalidCommandSynatxMessage = "\b\tInvalid command syntax.\n";
+const std::string recordingSavedMessage = "\tSaved screenshots to ";
+
+struct RecordOptions
+{
+    std::string folder;
+    std::string display;
+    int32_t left = 0;
+    int32_t top = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    double framerate = 1.0;
+    size_t capacity = 60;
+    bool asMegabytes = false;
+    double seconds = 0;
+    bool largePages = false;
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    double nanosecondsPerOperation = 0;
+    double bytesPerSecond = 0;
+};
+
+static double parse_number(const std::vector<std::string>& args, size_t& i)
+{
+    if (++i >= args.size())
+    {
+        throw std::invalid_argument(args[i - 1] + " needs a value.");
+    }
+
+    size_t length = 0;
+    double value = std::stod(args[i], &length);
+
+    if (length != args[i].size() || value < 0)
+    {
+        throw std::invalid_argument(args[i] + " is not a valid value for " + args[i - 1] + ".");
+    }
+
+    return value;
+}
+
+static RecordOptions parse_record_options(const std::vector<std::string>& args)
+{
+    if (args.size() < 2 || args[1].empty() || args[1][0] == '-')
+    {
+        throw std::invalid_argument("-record needs a folder.");
+    }
+
+    RecordOptions options;
+    options.folder = args[1];
+
+    for (size_t i = 2; i < args.size(); i++)
+    {
+        if (args[i] == "-display" && i + 1 < args.size())
+        {
+            options.display = args[++i];
+        }
+        else if (args[i] == "-region")
+        {
+            options.left = static_cast<int32_t>(parse_number(args, i));
+            options.top = static_cast<int32_t>(parse_number(args, i));
+            options.width = static_cast<uint32_t>(parse_number(args, i));
+            options.height = static_cast<uint32_t>(parse_number(args, i));
+
+            if (options.width == 0 || options.height == 0)
+            {
+                throw std::invalid_argument("-region needs a width and height.");
+            }
+        }
+        else if (args[i] == "-framerate")
+        {
+            options.framerate = parse_number(args, i);
+
+            if (options.framerate <= 0)
+            {
+                throw std::invalid_argument("-framerate must be positive.");
+            }
+        }
+        else if (args[i] == "-framebuffer")
+        {
+            if (i + 1 < args.size() && args[i + 1] == "-mb")
+            {
+                options.asMegabytes = true;
+                i++;
+            }
+
+            options.capacity = static_cast<size_t>(parse_number(args, i));
+        }
+        else if (args[i] == "-seconds")
+        {
+            options.seconds = parse_number(args, i);
+        }
+        else if (args[i] == "-largepages")
+        {
+            options.largePages = true;
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown option " + args[i] + ".");
+        }
+    }
+
+    return options;
+}
+
+// Wall clock time as a UTC FILETIME, the timestamp frames are named by on Windows.
+static int64_t filetime_now()
+{
+    const int64_t unixEpochTicks = 116444736000000000;
+
+    return unixEpochTicks + std::chrono::duration_cast<std::chrono::duration<int64_t, std::ratio<1, 10000000>>>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static int record(const RecordOptions& options)
+{
+    // The signals that stop the recording are taken by sigtimedwait below rather than by a handler, so they are
+    // blocked before any thread is started and inherit the mask.
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+
+    XShmFrameSource source(options.display, options.left, options.top, options.width, options.height, options.framerate);
+    PixelFrameBuffer buffer(options.capacity, options.asMegabytes, source.width(), source.height(), options.largePages);
+
+    uint64_t sequence = 0;
+
+    source.start([&](const uint8_t* pixels, uint32_t rowPitch, int64_t qpc)
+        {
+            TaskScheduler::LaneScope lane(TaskLane::Capture);
+
+            FrameMetadata metadata = {};
+            metadata.Sequence = sequence++;
+            metadata.Timestamp = filetime_now();
+            metadata.Qpc = qpc;
+
+            buffer.add_frame(pixels, rowPitch, metadata);
+        });
+
+    std::cout << "\tRecording " << source.width() << "x" << source.height() << " at " << options.framerate << " frames per second into a buffer of "
+        << buffer.capacity() << " frames. Press Ctrl+C to stop and save.\n" << std::endl;
+
+    if (options.seconds > 0)
+    {
+        auto seconds = std::chrono::duration<double>(options.seconds);
+        timespec timeout = {};
+        timeout.tv_sec = static_cast<time_t>(options.seconds);
+        timeout.tv_nsec = static_cast<long>(std::chrono::duration_cast<std::chrono::nanoseconds>(seconds - std::chrono::seconds(timeout.tv_sec)).count());
+
+        while (sigtimedwait(&stopSignals, nullptr, &timeout) < 0 && errno == EINTR)
+        {
+        }
+    }
+    else
+    {
+        int signal = 0;
+        sigwait(&stopSignals, &signal);
+    }
+
+    source.close();
+
+    std::filesystem::create_directories(std::filesystem::u8path(options.folder));
+    buffer.save_frames(options.folder);
+
+    std::cout << recordingSavedMessage << options.folder << " (" << buffer.frame_count() << " frames)." << std::endl;
+
+    return 0;
+}
+
+/**
+ * Runs the function in batches until a second has passed, after calling it once to warm up.
+ * @param bytes bytes the function processes per call, for throughput, or 0
+ */
+static BenchmarkResult measure(const std::string& name, size_t bytes, const std::function<void()>& function)
+{
+    function();
+
+    uint64_t iterations = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::duration::zero();
+
+    while (elapsed < std::chrono::seconds(1) || iterations < 10)
+    {
+        function();
+        iterations++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+
+    double seconds = std::chrono::duration<double>(elapsed).count();
+
+    return { name, seconds * 1e9 / iterations, bytes ? bytes * iterations / seconds : 0 };
+}
+
+static int benchmark(const std::vector<std::string>& args)
+{
+    std::string display;
+
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        if (args[i] == "-display" && i + 1 < args.size())
+        {
+            display = args[++i];
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown option " + args[i] + ".");
+        }
+    }
+
+    const std::pair<uint32_t, uint32_t> sizes[] = { { 1920, 1080 }, { 3840, 2160 } };
+
+    uint32_t screenWidth = 0;
+    uint32_t screenHeight = 0;
+    bool hasDisplay = XShmFrameSource::try_get_screen_size(display, screenWidth, screenHeight);
+
+    // A display that was asked for has to be there, so a broken Xvfb setup fails the run instead of skipping it.
+    if (!hasDisplay && !display.empty())
+    {
+        throw std::runtime_error("xshm: could not open X display \"" + display + "\".");
+    }
+
+    std::vector<BenchmarkResult> results;
+
+    for (const auto& [width, height] : sizes)
+    {
+        std::string size = std::to_string(width) + "x" + std::to_string(height);
+        size_t frameBytes = static_cast<size_t>(width) * height * 4;
+
+        // Storing is measured on a synthetic frame, so it runs without a display as well.
+        std::vector<uint8_t> pixels(frameBytes);
+
+        for (size_t i = 0; i < frameBytes; i++)
+        {
+            pixels[i] = static_cast<uint8_t>((i * 2654435761u) >> 24);
+        }
+
+        PixelFrameBuffer buffer(8, false, width, height);
+        FrameMetadata metadata = {};
+
+        results.push_back(measure("store/" + size, frameBytes, [&]()
+            {
+                metadata.Sequence++;
+                buffer.add_frame(pixels.data(), width * 4, metadata);
+            }));
+
+        if (buffer.frame_count() != buffer.capacity())
+        {
+            throw std::runtime_error("store/" + size + ": the buffer holds " + std::to_string(buffer.frame_count()) + " frames, which differs from its capacity of " +
+                std::to_string(buffer.capacity()) + ".");
+        }
+
+        if (!hasDisplay || width > screenWidth || height > screenHeight)
+        {
+            std::cout << "\tSkipping xshm/" << size << ", which needs a display of at least that size." << std::endl;
+            continue;
+        }
+
+        XShmFrameSource source(display, 0, 0, width, height, 1.0);
+
+        results.push_back(measure("xshm/grab/" + size, frameBytes, [&]()
+            {
+                source.grab();
+            }));
+
+        results.push_back(measure("xshm/grab_and_store/" + size, frameBytes, [&]()
+            {
+                source.grab();
+                metadata.Sequence++;
+                buffer.add_frame(source.pixels(), source.row_pitch(), metadata);
+            }));
+    }
+
+    for (const auto& result : results)
+    {
+        std::cout << std::left << std::setw(32) << result.name
+            << std::right << std::setw(14) << std::fixed << std::setprecision(1) << result.nanosecondsPerOperation << " ns/op"
+            << std::setw(10) << std::setprecision(1) << result.bytesPerSecond / 1000000 << " MB/s" << std::endl;
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+
+    if (args.empty() || args[0] == "-help")
+    {
+        std::cout << helpMessage << std::endl;
+        return args.empty() ? 1 : 0;
+    }
+
+    try
+    {
+        if (args[0] == "-record")
+        {
+            return record(parse_record_options(args));
+        }
+        else if (args[0] == "-benchmark")
+        {
+            return benchmark(args);
+        }
+
+        throw std::invalid_argument("Unknown command " + args[0] + ".");
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cout << invalidCommandSynatxMessage << "\t" << e.what() << std::endl;
+        std::cout << helpMessage << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << e.what() << std::endl;
+    }
+
+    return 1;
+}
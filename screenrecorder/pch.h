@@ -1,5 +1,8 @@
 ﻿#pragma once
 
+// The Linux build shares the sources that only need the standard library, so everything else is left out there. See
+// CMakeLists.txt.
+#ifdef _WIN32
 // Windows SDK support
 #include <Unknwn.h>
 #include <inspectable.h>
@@ -24,6 +27,7 @@
 #include <winrt/Windows.UI.Composition.h>
 #include <winrt/Windows.UI.Composition.Desktop.h>
 #include <winrt/Windows.UI.Popups.h>
+#endif
 
 // STL
 #include <atomic>
@@ -34,12 +38,21 @@
 #include <optional>
 #include <future>
 #include <mutex>
+#include <fstream>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <filesystem>
+#include <cstring>
 
+#ifdef _WIN32
 // D3D
 #include <d3d11_4.h>
 #include <dxgi1_6.h>
 #include <d2d1_3.h>
 #include <wincodec.h>
+#include <compressapi.h>
 
 // DWM
 #include <dwmapi.h>
@@ -61,7 +74,10 @@
 
 // Other
 #include <windows.h>
+#include <crtdbg.h>
 #include <TraceLoggingProvider.h>
+#endif
+
 #include <iostream>
 #include <sstream>
 #include <exception>